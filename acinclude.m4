@@ -268,6 +268,43 @@ AC_DEFUN([OFP_CHECK_IF_PACKET],
                 [Define to 1 if net/if_packet.h is available.])
    fi])
 
+dnl Checks whether the kernel headers support AF_XDP sockets and attaching
+dnl XDP programs through BPF links.
+AC_DEFUN([OFP_CHECK_AF_XDP],
+  [AC_CACHE_CHECK([for AF_XDP support], [ofp_cv_af_xdp],
+     [AC_COMPILE_IFELSE(
+        [AC_LANG_PROGRAM([[#include <linux/bpf.h>
+                           #include <linux/if_link.h>
+                           #include <linux/if_xdp.h>]],
+                         [[struct sockaddr_xdp sxdp;
+                           union bpf_attr attr;
+                           sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP;
+                           attr.link_create.attach_type = BPF_XDP;
+                           return BPF_LINK_CREATE + XDP_FLAGS_SKB_MODE;]])],
+        [ofp_cv_af_xdp=yes],
+        [ofp_cv_af_xdp=no])])
+   AM_CONDITIONAL([HAVE_AF_XDP], [test "$ofp_cv_af_xdp" = yes])
+   if test "$ofp_cv_af_xdp" = yes; then
+      AC_DEFINE([HAVE_AF_XDP], [1],
+                [Define to 1 if AF_XDP sockets are available.])
+   fi])
+
+dnl Checks for memfd_create() and eventfd(), which the "shm:" vconn needs.
+AC_DEFUN([OFP_CHECK_SHM_VCONN],
+  [AC_CACHE_CHECK([for memfd_create and eventfd], [ofp_cv_shm_vconn],
+     [AC_LINK_IFELSE(
+        [AC_LANG_PROGRAM([[#include <sys/eventfd.h>
+                           #include <sys/mman.h>]],
+                         [[return memfd_create("x", MFD_CLOEXEC)
+                                  + eventfd(0, EFD_NONBLOCK);]])],
+        [ofp_cv_shm_vconn=yes],
+        [ofp_cv_shm_vconn=no])])
+   AM_CONDITIONAL([HAVE_SHM_VCONN], [test "$ofp_cv_shm_vconn" = yes])
+   if test "$ofp_cv_shm_vconn" = yes; then
+      AC_DEFINE([HAVE_SHM_VCONN], [1],
+                [Define to 1 if the shared-memory vconn can be built.])
+   fi])
+
 dnl Checks for dpkg-buildpackage.  If this is available then we check
 dnl that the Debian packaging is functional at "make distcheck" time.
 AC_DEFUN([OFP_CHECK_DPKG_BUILDPACKAGE],
@@ -75,6 +75,10 @@ static bool setup_flows = true;
 /* --max-idle: Maximum idle time, in seconds, before flows expire. */
 static int max_idle = 60;
 
+/* --packet-in-batch: Maximum number of packet-ins per batch, 0 to receive
+ * plain packet-ins. */
+static int packet_in_batch = 0;
+
 static int do_switching(struct switch_ *);
 static void new_switch(struct switch_ *, struct vconn *, const char *name);
 static void parse_options(int argc, char *argv[]);
@@ -212,6 +216,9 @@ new_switch(struct switch_ *sw, struct vconn *vconn, const char *name)
     sw->rconn = rconn_new_from_vconn(name, vconn);
     sw->lswitch = lswitch_create(sw->rconn, learn_macs,
                                  setup_flows ? max_idle : -1);
+    if (packet_in_batch) {
+        lswitch_set_packet_in_batch(sw->lswitch, sw->rconn, packet_in_batch);
+    }
 }
 
 static int
@@ -240,12 +247,14 @@ parse_options(int argc, char *argv[])
     enum {
         OPT_MAX_IDLE = UCHAR_MAX + 1,
         OPT_PEER_CA_CERT,
+        OPT_PACKET_IN_BATCH,
         VLOG_OPTION_ENUMS
     };
     static struct option long_options[] = {
         {"hub",         no_argument, 0, 'H'},
         {"noflow",      no_argument, 0, 'n'},
         {"max-idle",    required_argument, 0, OPT_MAX_IDLE},
+        {"packet-in-batch", required_argument, 0, OPT_PACKET_IN_BATCH},
         {"help",        no_argument, 0, 'h'},
         {"version",     no_argument, 0, 'V'},
         DAEMON_LONG_OPTIONS,
@@ -288,6 +297,14 @@ parse_options(int argc, char *argv[])
             }
             break;
 
+        case OPT_PACKET_IN_BATCH:
+            packet_in_batch = atoi(optarg);
+            if (packet_in_batch < 0 || packet_in_batch > 65535) {
+                ofp_fatal(0, "--packet-in-batch argument must be between 0 "
+                          "and 65535");
+            }
+            break;
+
         case 'h':
             usage();
 
@@ -330,6 +347,8 @@ usage(void)
            "  -H, --hub               act as hub instead of learning switch\n"
            "  -n, --noflow            pass traffic, but don't add flows\n"
            "  --max-idle=SECS         max idle time for new flows\n"
+           "  --packet-in-batch=N     ask switches to batch up to N packet-ins\n"
+           "                          per message\n"
            "  -h, --help              display this help message\n"
            "  -V, --version           display version information\n");
     exit(EXIT_SUCCESS);
@@ -102,6 +102,74 @@ of_hw_rx(...)
 
 static int rx_registered = 0;
 
+#if defined(OF_HW_RX_TEST)
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Receive test source
+ *
+ * Built with OF_HW_RX_TEST, the driver starts a thread that calls the
+ * registered receive callback with synthetic 64-byte broadcast frames, the
+ * way the receive path of a real platform would, so that the datapath's
+ * handoff from the driver thread can be exercised without hardware.  The
+ * environment variables OF_HW_RX_TEST_PORT (default 1), OF_HW_RX_TEST_COUNT
+ * (default 1000000) and OF_HW_RX_TEST_GAP_US (pause after every 32 frames,
+ * default 0) control it.  Each frame has a different source MAC so that each
+ * one misses in the flow table.
+ */
+static int
+rx_test_param(const char *name, int dflt)
+{
+    const char *value = getenv(name);
+    return value ? atoi(value) : dflt;
+}
+
+static void *
+rx_test_thread(void *dp_int_)
+{
+    of_hw_driver_int_t *dp_int = dp_int_;
+    int of_port = rx_test_param("OF_HW_RX_TEST_PORT", 1);
+    int count = rx_test_param("OF_HW_RX_TEST_COUNT", 1000000);
+    int gap_us = rx_test_param("OF_HW_RX_TEST_GAP_US", 0);
+    unsigned char frame[64];
+    of_packet_t pkt;
+    int i;
+
+    memset(frame, 0, sizeof frame);
+    memset(frame, 0xff, 6);           /* Broadcast destination. */
+    frame[6] = 0x02;                  /* Locally administered source. */
+    frame[12] = 0x88;                 /* Local experimental ethertype. */
+    frame[13] = 0xb5;
+    pkt.data = frame;
+    pkt.length = sizeof frame;
+    pkt.os_pkt = NULL;
+
+    for (i = 0; i < count; i++) {
+        frame[8] = i >> 24;
+        frame[9] = i >> 16;
+        frame[10] = i >> 8;
+        frame[11] = i;
+        dp_int->rx_handler(of_port, &pkt, 0, dp_int->rx_cookie);
+        if (gap_us && i % 32 == 31) {
+            usleep(gap_us);
+        }
+    }
+    return NULL;
+}
+
+static void
+rx_test_start(of_hw_driver_int_t *dp_int)
+{
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, rx_test_thread, dp_int) == 0) {
+        pthread_detach(thread);
+    }
+}
+#endif
+
 /*
  * packet_receive_register
  *
@@ -124,6 +192,9 @@ of_hw_packet_receive_register(of_hw_driver_t *hw_drv,
     dp_int = (of_hw_driver_int_t *)hw_drv;
     dp_int->rx_handler = callback;
     dp_int->rx_cookie = cookie;
+#if defined(OF_HW_RX_TEST)
+    rx_test_start(dp_int);
+#endif
 
     return 0;
 }
@@ -23,6 +23,18 @@ enum ofp_extension_commands { /* Queue configuration commands */
     OFP_EXT_QUEUE_MODIFY,  /* Add and/or modify */
     OFP_EXT_QUEUE_DELETE,  /* Remove a queue */
     OFP_EXT_SET_DESC,      /* Set ofp_desc_stat->dp_desc */
+    OFP_EXT_QUEUE_SCHED_STATS, /* Userspace queue scheduler counters */
+
+    /* Packet-in batching */
+    OFP_EXT_PACKET_IN_BATCH_CONFIG, /* Ask for batched packet_in events */
+    OFP_EXT_PACKET_IN_BATCH,        /* Batch of packet_in events */
+
+    /* Flow removed batching */
+    OFP_EXT_FLOW_REMOVED_BATCH_CONFIG, /* Ask for batched flow_removed */
+    OFP_EXT_FLOW_REMOVED_BATCH,        /* Batch of flow_removed events */
+
+    /* Monitor connections */
+    OFP_EXT_MONITOR_CONFIG, /* Choose messages copied to a monitor */
 
     OFP_EXT_COUNT
 };
@@ -81,6 +93,21 @@ enum openflow_queue_error_code {
 
 extern char *openflow_queue_error_strings[];
 
+/* Counters for one queue scheduled in userspace.  An OFP_EXT_QUEUE_SCHED_STATS
+ * request is an openflow_queue_command_header with an empty body; the reply
+ * is the same header followed by one of these for the default queue (with
+ * queue_id 0) and for each configured queue of the port. */
+struct openflow_queue_sched_stats {
+    uint32_t queue_id;
+    uint32_t backlog_packets;   /* Packets currently queued. */
+    uint64_t backlog_bytes;     /* Bytes currently queued. */
+    uint64_t tx_packets;        /* Packets transmitted. */
+    uint64_t dropped;           /* Packets dropped. */
+    uint64_t delay_total;       /* Sum of queuing delays, in microseconds. */
+    uint64_t delay_max;         /* Largest queuing delay, in microseconds. */
+};
+OFP_ASSERT(sizeof(struct openflow_queue_sched_stats) == 48);
+
 struct openflow_ext_set_dp_desc {
     struct ofp_extension_header header;
     char dp_desc[DESC_STR_LEN];
@@ -90,6 +117,122 @@ OFP_ASSERT(sizeof(struct openflow_ext_set_dp_desc) == 272);
 #define ofq_error_string(rv) (((rv) < OFQ_ERR_COUNT) && ((rv) >= 0) ? \
     openflow_queue_error_strings[rv] : "Unknown error code")
 
+/****************************************************************
+ *
+ * Packet-in batching
+ *
+ ****************************************************************/
+
+/* A controller that understands OFP_EXT_PACKET_IN_BATCH messages may ask the
+ * switch, with an OFP_EXT_PACKET_IN_BATCH_CONFIG message, to send it packet_in
+ * events in batches.  The switch then collects the packet_in events for the
+ * connection on which it received the request into a batch, which it sends
+ * once it holds 'max_packets' records or would exceed 'max_bytes' bytes, or
+ * 'max_delay' milliseconds after its first record was added, whichever comes
+ * first.  Setting 'max_packets' to 0 restores plain OFPT_PACKET_IN
+ * messages, which are also the default for a new connection. */
+struct openflow_packet_in_batch_config {
+    struct ofp_extension_header header;
+    uint16_t max_packets;       /* Records per batch, 0 to disable. */
+    uint16_t max_delay;         /* Milliseconds to hold a batch. */
+    uint32_t max_bytes;         /* Maximum message length, 0 for no limit. */
+};
+OFP_ASSERT(sizeof(struct openflow_packet_in_batch_config) == 24);
+
+/* An OFP_EXT_PACKET_IN_BATCH message is an ofp_extension_header followed by
+ * any number of these records, each of which describes one packet_in event
+ * with the same meaning as the corresponding ofp_packet_in members. */
+struct openflow_packet_in_record {
+    uint16_t len;               /* Length of record, including this header
+                                 * and padding to a multiple of 8 bytes. */
+    uint16_t data_len;          /* Length of 'data'. */
+    uint32_t buffer_id;         /* ID assigned by datapath. */
+    uint16_t total_len;         /* Full length of frame. */
+    uint16_t in_port;           /* Port on which frame was received. */
+    uint8_t reason;             /* Reason packet is being sent (OFPR_*). */
+    uint8_t pad[3];
+    uint8_t data[0];            /* Ethernet frame, 'data_len' bytes. */
+};
+OFP_ASSERT(sizeof(struct openflow_packet_in_record) == 16);
+
+/****************************************************************
+ *
+ * Flow removed batching
+ *
+ ****************************************************************/
+
+/* A controller that understands OFP_EXT_FLOW_REMOVED_BATCH messages may ask
+ * the switch, with an OFP_EXT_FLOW_REMOVED_BATCH_CONFIG message, to report
+ * removed flows in batches of up to 'max_flows' records (or as many as fit in
+ * one message, if fewer) on the connection that sent the request.  A batch
+ * that is not full is sent once the switch has finished the work that removed
+ * its flows, so batching adds no delay.  Setting 'max_flows' to 0 restores
+ * plain OFPT_FLOW_REMOVED messages, which are also the default for a new
+ * connection. */
+struct openflow_flow_removed_batch_config {
+    struct ofp_extension_header header;
+    uint16_t max_flows;         /* Records per batch, 0 to disable. */
+    uint8_t pad[6];             /* Align to 64 bits. */
+};
+OFP_ASSERT(sizeof(struct openflow_flow_removed_batch_config) == 24);
+
+/* An OFP_EXT_FLOW_REMOVED_BATCH message is an ofp_extension_header followed
+ * by any number of these records, each of which is the body of an
+ * ofp_flow_removed message without its ofp_header. */
+struct openflow_flow_removed_record {
+    struct ofp_match match;     /* Description of fields. */
+    uint64_t cookie;            /* Opaque controller-issued identifier. */
+
+    uint16_t priority;          /* Priority level of flow entry. */
+    uint8_t reason;             /* One of OFPRR_*. */
+    uint8_t pad[1];             /* Align to 32-bits. */
+
+    uint32_t duration_sec;      /* Time flow was alive in seconds. */
+    uint32_t duration_nsec;     /* Time flow was alive in nanoseconds beyond
+                                   duration_sec. */
+    uint16_t idle_timeout;      /* Idle timeout from original flow mod. */
+    uint8_t pad2[2];            /* Align to 64-bits. */
+    uint64_t packet_count;
+    uint64_t byte_count;
+};
+OFP_ASSERT(sizeof(struct openflow_flow_removed_record) == 80);
+
+/****************************************************************
+ *
+ * Monitor connections
+ *
+ ****************************************************************/
+
+/* A monitor connection (see the --monitor option of ofprotocol(8)) receives
+ * a copy of every message relayed to or from the datapath.  By sending an
+ * OFP_EXT_MONITOR_CONFIG message, the monitor may ask for only some of them:
+ *
+ *   - A message is copied only if its type's bit (1 << OFPT_*) is set in
+ *     'types'.  Types 32 and above are always copied.
+ *
+ *   - If the message is followed by any port numbers, then a packet_in,
+ *     packet_out, port_status, port_mod, flow_mod or flow_removed message for
+ *     a single port is copied only if that port is listed.
+ *
+ *   - Of the messages that pass these tests, only 1 in 'sample' is copied.
+ *     0 or 1 copies them all.
+ *
+ *   - Copies longer than 'max_bytes' are cut short, and their ofp_header
+ *     'length' is changed to match.  0 means no limit.
+ *
+ * Each config message replaces any earlier one.  A new monitor connection
+ * gets every message, as if 'types' had all bits set and nothing else was
+ * given. */
+struct openflow_monitor_config {
+    struct ofp_extension_header header;
+    uint32_t types;             /* Bitmap of OFPT_* types to copy. */
+    uint32_t sample;            /* Copy 1 in this many messages. */
+    uint16_t max_bytes;         /* Maximum length of a copy, 0 for no limit. */
+    uint8_t pad[6];             /* Align to 64 bits. */
+    uint16_t ports[0];          /* Ports to copy messages for. */
+};
+OFP_ASSERT(sizeof(struct openflow_monitor_config) == 32);
+
 /****************************************************************
  *
  * Unsupported, but potential extended queue properties
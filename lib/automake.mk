@@ -41,6 +41,7 @@ lib_libopenflow_a_SOURCES = \
 	lib/mac-learning.h \
 	lib/netdev.c \
 	lib/netdev.h \
+	lib/netdev-xdp.h \
 	lib/ofp-print.c \
 	lib/ofp-print.h \
 	lib/ofpbuf.c \
@@ -80,6 +81,7 @@ lib_libopenflow_a_SOURCES = \
 	lib/type-props.h \
 	lib/util.c \
 	lib/util.h \
+	lib/vconn-mem.c \
 	lib/vconn-provider.h \
 	lib/vconn-ssl.h \
 	lib/vconn-stream.c \
@@ -105,6 +107,14 @@ lib_libopenflow_a_SOURCES += \
 	lib/vconn-netlink.c
 endif
 
+if HAVE_AF_XDP
+lib_libopenflow_a_SOURCES += lib/netdev-xdp.c
+endif
+
+if HAVE_SHM_VCONN
+lib_libopenflow_a_SOURCES += lib/vconn-shm.c
+endif
+
 if HAVE_OPENSSL
 lib_libopenflow_a_SOURCES += \
 	lib/vconn-ssl.c 
@@ -33,6 +33,261 @@
 
 #include <config.h>
 #include "csum.h"
+#include <string.h>
+#include "compiler.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CSUM_X86 1
+#include <immintrin.h>
+#endif
+
+static uint64_t csum_sum_scalar(const uint8_t *, size_t);
+static uint64_t csum_sum_u64(const uint8_t *, size_t);
+#ifdef CSUM_X86
+static uint64_t csum_sum_sse2(const uint8_t *, size_t);
+static uint64_t csum_sum_avx2(const uint8_t *, size_t);
+#endif
+
+struct csum_impl {
+    const char *name;
+    uint64_t (*sum)(const uint8_t *, size_t);
+    const char *cpu_feature;    /* Required CPU feature, or NULL. */
+};
+
+/* Available implementations, fastest last. */
+static const struct csum_impl csum_impls[] = {
+    { "scalar", csum_sum_scalar, NULL },
+    { "u64", csum_sum_u64, NULL },
+#ifdef CSUM_X86
+    { "sse2", csum_sum_sse2, "sse2" },
+    { "avx2", csum_sum_avx2, "avx2" },
+#endif
+};
+#define N_CSUM_IMPLS (sizeof csum_impls / sizeof *csum_impls)
+
+static const struct csum_impl *csum_impl;
+
+static bool
+csum_impl_supported(const struct csum_impl *impl)
+{
+    if (!impl->cpu_feature) {
+        return true;
+    }
+#ifdef CSUM_X86
+    __builtin_cpu_init();
+    if (!strcmp(impl->cpu_feature, "sse2")) {
+        return __builtin_cpu_supports("sse2");
+    } else if (!strcmp(impl->cpu_feature, "avx2")) {
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return false;
+}
+
+static const struct csum_impl *
+csum_select_impl(void)
+{
+    size_t i;
+
+    for (i = N_CSUM_IMPLS; i-- > 0; ) {
+        if (csum_impl_supported(&csum_impls[i])) {
+            return &csum_impls[i];
+        }
+    }
+    return &csum_impls[0];
+}
+
+/* Makes csum() and csum_continue() use the implementation named 'name', which
+ * is one of "scalar", "u64", "sse2" or "avx2".  Returns false, without
+ * changing anything, if there is no such implementation or the CPU does not
+ * support it. */
+bool
+csum_set_impl(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < N_CSUM_IMPLS; i++) {
+        if (!strcmp(csum_impls[i].name, name)) {
+            if (!csum_impl_supported(&csum_impls[i])) {
+                return false;
+            }
+            csum_impl = &csum_impls[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Returns the name of the implementation that csum() and csum_continue()
+ * use. */
+const char *
+csum_get_impl(void)
+{
+    if (!csum_impl) {
+        csum_impl = csum_select_impl();
+    }
+    return csum_impl->name;
+}
+
+/* Adds 'x' to 'sum' in 64-bit ones-complement arithmetic.  Because 2**64 - 1
+ * is a multiple of 0xffff, the result folds down to the same 16-bit
+ * ones-complement sum as adding up the 16-bit words of both operands. */
+static inline uint64_t
+csum_add64(uint64_t sum, uint64_t x)
+{
+    sum += x;
+    return sum + (sum < x);
+}
+
+/* Folds 'sum' from csum_add64() down to 32 bits, never turning a nonzero sum
+ * into zero. */
+static inline uint32_t
+csum_fold64(uint64_t sum)
+{
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    return sum;
+}
+
+/* Adds the 'n' bytes at 'p', fewer than 8, to 'sum'.  A trailing odd byte is
+ * added as a value by itself, as the original 16-bit loop always did, so that
+ * every implementation gives the same result on any host. */
+static inline uint64_t
+csum_sum_tail(uint64_t sum, const uint8_t *p, size_t n)
+{
+    for (; n > 1; n -= 2, p += 2) {
+        uint16_t x;
+
+        memcpy(&x, p, sizeof x);
+        sum = csum_add64(sum, x);
+    }
+    if (n) {
+        sum = csum_add64(sum, *p);
+    }
+    return sum;
+}
+
+/* The original implementation: one 16-bit word at a time. */
+static uint64_t
+csum_sum_scalar(const uint8_t *p, size_t n)
+{
+    uint32_t partial = 0;
+
+    for (; n > 1; n -= 2, p += 2) {
+        uint16_t x;
+
+        memcpy(&x, p, sizeof x);
+        partial = csum_add16(partial, x);
+    }
+    if (n) {
+        partial += *p;
+    }
+    return partial;
+}
+
+/* Portable implementation that sums 64 bits at a time. */
+static uint64_t
+csum_sum_u64(const uint8_t *p, size_t n)
+{
+    uint64_t sum0 = 0, sum1 = 0;
+
+    for (; n >= 32; n -= 32, p += 32) {
+        uint64_t x[4];
+
+        memcpy(x, p, sizeof x);
+        sum0 = csum_add64(sum0, x[0]);
+        sum1 = csum_add64(sum1, x[1]);
+        sum0 = csum_add64(sum0, x[2]);
+        sum1 = csum_add64(sum1, x[3]);
+    }
+    for (; n >= 8; n -= 8, p += 8) {
+        uint64_t x;
+
+        memcpy(&x, p, sizeof x);
+        sum0 = csum_add64(sum0, x);
+    }
+    return csum_sum_tail(csum_add64(sum0, sum1), p, n);
+}
+
+#ifdef CSUM_X86
+/* Adds the two 64-bit lanes of 'acc' to 'sum'. */
+static inline uint64_t __attribute__((target("sse2")))
+csum_add_m128(uint64_t sum, __m128i acc)
+{
+    uint64_t lanes[2];
+
+    _mm_storeu_si128((__m128i *) lanes, acc);
+    return csum_add64(csum_add64(sum, lanes[0]), lanes[1]);
+}
+
+/* SSE2 implementation.  Zero-extends each 32-bit word of the data into a
+ * 64-bit lane, so the lanes cannot overflow for any buffer that fits in
+ * memory, and folds the lanes together at the end. */
+static uint64_t __attribute__((target("sse2")))
+csum_sum_sse2(const uint8_t *p, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc0 = zero, acc1 = zero;
+    uint64_t sum;
+
+    for (; n >= 32; n -= 32, p += 32) {
+        __m128i a = _mm_loadu_si128((const __m128i *) p);
+        __m128i b = _mm_loadu_si128((const __m128i *) (p + 16));
+
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(a, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(a, zero));
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(b, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(b, zero));
+    }
+    for (; n >= 16; n -= 16, p += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) p);
+
+        acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(a, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(a, zero));
+    }
+    sum = csum_add_m128(csum_add_m128(0, acc0), acc1);
+    for (; n >= 8; n -= 8, p += 8) {
+        uint64_t x;
+
+        memcpy(&x, p, sizeof x);
+        sum = csum_add64(sum, x);
+    }
+    return csum_sum_tail(sum, p, n);
+}
+
+/* AVX2 implementation, the same as the SSE2 one with twice as wide vectors,
+ * which handles the last 63 bytes or fewer. */
+static uint64_t __attribute__((target("avx2")))
+csum_sum_avx2(const uint8_t *p, size_t n)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = zero, acc1 = zero;
+    __m128i acc;
+
+    if (n < 64) {
+        return csum_sum_sse2(p, n);
+    }
+    for (; n >= 64; n -= 64, p += 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) p);
+        __m256i b = _mm256_loadu_si256((const __m256i *) (p + 32));
+
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(a, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(a, zero));
+        acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(b, zero));
+        acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(b, zero));
+    }
+
+    /* Each lane holds a sum of zero-extended 32-bit words, far below 2**64,
+     * so the lanes can be added without carries to the next lane. */
+    acc0 = _mm256_add_epi64(acc0, acc1);
+    acc = _mm_add_epi64(_mm256_castsi256_si128(acc0),
+                        _mm256_extracti128_si256(acc0, 1));
+
+    /* Avoid the penalty for mixing AVX with the SSE code that follows. */
+    _mm256_zeroupper();
+    return csum_add_m128(csum_sum_sse2(p, n), acc);
+}
+#endif /* CSUM_X86 */
 
 /* Returns the IP checksum of the 'n' bytes in 'data'. */
 uint16_t
@@ -65,17 +320,12 @@ csum_add32(uint32_t partial, uint32_t new)
  * 'partial'.  To obtain the finished checksum, pass the return value to
  * csum_finish().) */
 uint32_t
-csum_continue(uint32_t partial, const void *data_, size_t n)
+csum_continue(uint32_t partial, const void *data, size_t n)
 {
-    const uint16_t *data = data_;
-
-    for (; n > 1; n -= 2) {
-        partial = csum_add16(partial, *data++);
-    }
-    if (n) {
-        partial += *(uint8_t *) data;
+    if (unlikely(!csum_impl)) {
+        csum_impl = csum_select_impl();
     }
-    return partial;
+    return csum_fold64(csum_add64(partial, csum_impl->sum(data, n)));
 }
 
 /* Returns the IP checksum corresponding to 'partial', which is a value updated
@@ -83,7 +333,43 @@ csum_continue(uint32_t partial, const void *data_, size_t n)
 uint16_t
 csum_finish(uint32_t partial)
 {
-    return ~((partial & 0xffff) + (partial >> 16));
+    /* Summing more than a few hundred bytes can carry past bit 16 even after
+     * one fold, so keep folding until nothing is left over. */
+    while (partial >> 16) {
+        partial = (partial & 0xffff) + (partial >> 16);
+    }
+    return ~partial;
+}
+
+/* Adds to 'delta' the change of a 16-bit field from 'old_u16' to 'new_u16'
+ * and returns the updated delta, for passing to recalc_csum().  (To start a
+ * new delta, pass 0 for 'delta'.) */
+uint32_t
+csum_update16(uint32_t delta, uint16_t old_u16, uint16_t new_u16)
+{
+    /* Ones-complement arithmetic is endian-independent, so this code does not
+     * use htons() or ntohs().
+     *
+     * See RFC 1624 for formula and explanation. */
+    return delta + (uint16_t) ~old_u16 + new_u16;
+}
+
+/* Adds to 'delta' the change of a 32-bit field from 'old_u32' to 'new_u32'
+ * and returns the updated delta, for passing to recalc_csum(). */
+uint32_t
+csum_update32(uint32_t delta, uint32_t old_u32, uint32_t new_u32)
+{
+    return csum_update16(csum_update16(delta, old_u32, new_u32),
+                         old_u32 >> 16, new_u32 >> 16);
+}
+
+/* Returns the new checksum for a packet in which the checksum field previously
+ * contained 'old_csum' and whose other changed fields were summed into
+ * 'delta' by csum_update16() and csum_update32(). */
+uint16_t
+recalc_csum(uint16_t old_csum, uint32_t delta)
+{
+    return csum_finish(csum_add16(delta, ~old_csum));
 }
 
 /* Returns the new checksum for a packet in which the checksum field previously
@@ -92,16 +378,7 @@ csum_finish(uint32_t partial)
 uint16_t
 recalc_csum16(uint16_t old_csum, uint16_t old_u16, uint16_t new_u16)
 {
-    /* Ones-complement arithmetic is endian-independent, so this code does not
-     * use htons() or ntohs().
-     *
-     * See RFC 1624 for formula and explanation. */
-    uint16_t hc_complement = ~old_csum;
-    uint16_t m_complement = ~old_u16;
-    uint16_t m_prime = new_u16;
-    uint32_t sum = hc_complement + m_complement + m_prime;
-    uint16_t hc_prime_complement = sum + (sum >> 16);
-    return ~hc_prime_complement;
+    return recalc_csum(old_csum, csum_update16(0, old_u16, new_u16));
 }
 
 /* Returns the new checksum for a packet in which the checksum field previously
@@ -110,6 +387,5 @@ recalc_csum16(uint16_t old_csum, uint16_t old_u16, uint16_t new_u16)
 uint16_t
 recalc_csum32(uint16_t old_csum, uint32_t old_u32, uint32_t new_u32)
 {
-    return recalc_csum16(recalc_csum16(old_csum, old_u32, new_u32),
-                         old_u32 >> 16, new_u32 >> 16);
+    return recalc_csum(old_csum, csum_update32(0, old_u32, new_u32));
 }
@@ -34,6 +34,7 @@
 #ifndef CSUM_H
 #define CSUM_H 1
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -45,4 +46,17 @@ uint16_t csum_finish(uint32_t partial);
 uint16_t recalc_csum16(uint16_t old_csum, uint16_t old_u16, uint16_t new_u16);
 uint16_t recalc_csum32(uint16_t old_csum, uint32_t old_u32, uint32_t new_u32);
 
+/* Incremental update of a checksum over several changed fields at once: sum
+ * each field's change into a delta, starting from 0, then apply the delta
+ * with recalc_csum(). */
+uint32_t csum_update16(uint32_t delta, uint16_t old_u16, uint16_t new_u16);
+uint32_t csum_update32(uint32_t delta, uint32_t old_u32, uint32_t new_u32);
+uint16_t recalc_csum(uint16_t old_csum, uint32_t delta);
+
+/* Selection of the code that sums data for csum() and csum_continue(), for
+ * testing and benchmarking.  By default the fastest one that the CPU
+ * supports is used. */
+bool csum_set_impl(const char *name);
+const char *csum_get_impl(void);
+
 #endif /* csum.h */
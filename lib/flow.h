@@ -64,6 +64,8 @@ struct flow {
 BUILD_ASSERT_DECL(sizeof(struct flow) == 36);
 
 int flow_extract(struct ofpbuf *, uint16_t in_port, struct flow *);
+void flow_extract_batch(struct ofpbuf *packets[], size_t n, uint16_t in_port,
+                        struct flow flows[], int fragments[]);
 void flow_fill_match(struct ofp_match *, const struct flow *,
                      uint32_t wildcards);
 void flow_print(FILE *, const struct flow *);
@@ -45,6 +45,7 @@
 #include "ofpbuf.h"
 #include "ofp-print.h"
 #include "openflow/openflow.h"
+#include "openflow/openflow-ext.h"
 #include "poll-loop.h"
 #include "queue.h"
 #include "rconn.h"
@@ -78,6 +79,10 @@ struct lswitch {
     /* Number of outgoing queued packets on the rconn. */
     int n_queued;
 
+    /* Maximum number of packet-ins to ask the switch to batch into one
+     * OFP_EXT_PACKET_IN_BATCH message, or 0 for plain packet-ins. */
+    int batch_packets;
+
     /* Spanning tree protocol implementation.
      *
      * We implement STP states by, whenever a port's STP state changes,
@@ -97,6 +102,7 @@ static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(30, 300);
 
 static void queue_tx(struct lswitch *, struct rconn *, struct ofpbuf *);
 static void send_features_request(struct lswitch *, struct rconn *);
+static void send_packet_in_batch_config(struct lswitch *, struct rconn *);
 static void schedule_query(struct lswitch *, long long int delay);
 static bool may_learn(const struct lswitch *, uint16_t port_no);
 static bool may_recv(const struct lswitch *, uint16_t port_no,
@@ -110,6 +116,7 @@ static packet_handler_func process_echo_request;
 static packet_handler_func process_port_status;
 static packet_handler_func process_phy_port;
 static packet_handler_func process_stats_reply;
+static packet_handler_func process_vendor;
 
 /* Creates and returns a new learning switch.
  *
@@ -142,6 +149,18 @@ lswitch_create(struct rconn *rconn, bool learn_macs, int max_idle)
     return sw;
 }
 
+/* Asks the switch to which 'sw' is connected over 'rconn' to send up to
+ * 'max_packets' packet-ins at a time in OFP_EXT_PACKET_IN_BATCH messages, or
+ * plain OFPT_PACKET_IN messages if 'max_packets' is 0.  Either way, 'sw'
+ * handles both kinds of message. */
+void
+lswitch_set_packet_in_batch(struct lswitch *sw, struct rconn *rconn,
+                            int max_packets)
+{
+    sw->batch_packets = max_packets;
+    send_packet_in_batch_config(sw, rconn);
+}
+
 /* Destroys 'sw'. */
 void
 lswitch_destroy(struct lswitch *sw)
@@ -297,6 +316,11 @@ lswitch_process_packet(struct lswitch *sw, struct rconn *rconn,
             sizeof(struct ofp_flow_removed),
             NULL
         },
+        {
+            OFPT_VENDOR,
+            sizeof(struct ofp_vendor_header),
+            process_vendor
+        },
     };
     const size_t n_processors = ARRAY_SIZE(processors);
     const struct processor *p;
@@ -351,10 +375,32 @@ send_features_request(struct lswitch *sw, struct rconn *rconn)
         osc->miss_send_len = htons(OFP_DEFAULT_MISS_SEND_LEN);
         queue_tx(sw, rconn, b);
 
+        if (sw->batch_packets) {
+            send_packet_in_batch_config(sw, rconn);
+        }
+
         sw->last_features_request = now;
     }
 }
 
+static void
+send_packet_in_batch_config(struct lswitch *sw, struct rconn *rconn)
+{
+    struct openflow_packet_in_batch_config *config;
+    struct ofpbuf *b;
+
+    /* With a 'max_delay' of 0, the switch sends what it has collected as
+     * soon as it has finished its current round of packet processing, so
+     * batching adds no latency. */
+    config = make_openflow(sizeof *config, OFPT_VENDOR, &b);
+    config->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    config->header.subtype = htonl(OFP_EXT_PACKET_IN_BATCH_CONFIG);
+    config->max_packets = htons(sw->batch_packets);
+    config->max_delay = htons(0);
+    config->max_bytes = htonl(0);
+    queue_tx(sw, rconn, b);
+}
+
 static void
 queue_tx(struct lswitch *sw, struct rconn *rconn, struct ofpbuf *b)
 {
@@ -399,22 +445,20 @@ process_switch_features(struct lswitch *sw, struct rconn *rconn, void *osf_)
     }
 }
 
+/* Handles a packet-in event for the packet with the given 'buffer_id'
+ * (which may be UINT32_MAX), received on 'in_port', whose first 'data_len'
+ * bytes are 'data'. */
 static void
-process_packet_in(struct lswitch *sw, struct rconn *rconn, void *opi_)
+handle_packet_in(struct lswitch *sw, struct rconn *rconn, uint32_t buffer_id,
+                 uint16_t in_port, void *data, size_t data_len)
 {
-    struct ofp_packet_in *opi = opi_;
-    uint16_t in_port = ntohs(opi->in_port);
     uint16_t out_port = OFPP_FLOOD;
-
-    size_t pkt_ofs, pkt_len;
     struct ofpbuf pkt;
     struct flow flow;
 
-    /* Extract flow data from 'opi' into 'flow'. */
-    pkt_ofs = offsetof(struct ofp_packet_in, data);
-    pkt_len = ntohs(opi->header.length) - pkt_ofs;
-    pkt.data = opi->data;
-    pkt.size = pkt_len;
+    /* Extract flow data from the packet into 'flow'. */
+    pkt.data = data;
+    pkt.size = data_len;
     flow_extract(&pkt, in_port, &flow);
 
     if (may_learn(sw, in_port) && sw->ml) {
@@ -447,11 +491,11 @@ process_packet_in(struct lswitch *sw, struct rconn *rconn, void *opi_)
     } else if (sw->max_idle >= 0 && (!sw->ml || out_port != OFPP_FLOOD)) {
         /* The output port is known, or we always flood everything, so add a
          * new flow. */
-        queue_tx(sw, rconn, make_add_simple_flow(&flow, ntohl(opi->buffer_id),
+        queue_tx(sw, rconn, make_add_simple_flow(&flow, buffer_id,
                                                  out_port, sw->max_idle));
 
         /* If the switch didn't buffer the packet, we need to send a copy. */
-        if (ntohl(opi->buffer_id) == UINT32_MAX) {
+        if (buffer_id == UINT32_MAX) {
             queue_tx(sw, rconn,
                      make_unbuffered_packet_out(&pkt, in_port, out_port));
         }
@@ -459,10 +503,10 @@ process_packet_in(struct lswitch *sw, struct rconn *rconn, void *opi_)
         /* We don't know that MAC, or we don't set up flows.  Send along the
          * packet without setting up a flow. */
         struct ofpbuf *b;
-        if (ntohl(opi->buffer_id) == UINT32_MAX) {
+        if (buffer_id == UINT32_MAX) {
             b = make_unbuffered_packet_out(&pkt, in_port, out_port);
         } else {
-            b = make_buffered_packet_out(ntohl(opi->buffer_id),
+            b = make_buffered_packet_out(buffer_id,
                                          in_port, out_port);
         }
         queue_tx(sw, rconn, b);
@@ -472,7 +516,7 @@ process_packet_in(struct lswitch *sw, struct rconn *rconn, void *opi_)
 drop_it:
     if (sw->max_idle >= 0) {
         /* Set up a flow to drop packets. */
-        queue_tx(sw, rconn, make_add_flow(&flow, ntohl(opi->buffer_id),
+        queue_tx(sw, rconn, make_add_flow(&flow, buffer_id,
                                           sw->max_idle, 0));
     } else {
         /* Just drop the packet, since we don't set up flows at all.
@@ -482,6 +526,55 @@ drop_it:
     return;
 }
 
+static void
+process_packet_in(struct lswitch *sw, struct rconn *rconn, void *opi_)
+{
+    struct ofp_packet_in *opi = opi_;
+    size_t pkt_ofs = offsetof(struct ofp_packet_in, data);
+
+    handle_packet_in(sw, rconn, ntohl(opi->buffer_id), ntohs(opi->in_port),
+                     opi->data, ntohs(opi->header.length) - pkt_ofs);
+}
+
+/* Handles each record in an OFP_EXT_PACKET_IN_BATCH message as a separate
+ * packet-in. */
+static void
+process_packet_in_batch(struct lswitch *sw, struct rconn *rconn,
+                        struct ofp_extension_header *oeh)
+{
+    uint8_t *p = (uint8_t *) (oeh + 1);
+    size_t left = ntohs(oeh->header.length) - sizeof *oeh;
+
+    while (left >= sizeof(struct openflow_packet_in_record)) {
+        struct openflow_packet_in_record *rec = (void *) p;
+        size_t len = ntohs(rec->len);
+        size_t data_len = ntohs(rec->data_len);
+
+        if (len < sizeof *rec + data_len || len > left || len % 8) {
+            VLOG_WARN_RL(&rl, "%012llx: %s: bad packet-in record in batch",
+                         sw->datapath_id, rconn_get_name(rconn));
+            return;
+        }
+        handle_packet_in(sw, rconn, ntohl(rec->buffer_id),
+                         ntohs(rec->in_port), rec->data, data_len);
+        p += len;
+        left -= len;
+    }
+}
+
+static void
+process_vendor(struct lswitch *sw, struct rconn *rconn, void *ovh_)
+{
+    struct ofp_vendor_header *ovh = ovh_;
+    struct ofp_extension_header *oeh = ovh_;
+
+    if (ovh->vendor == htonl(OPENFLOW_VENDOR_ID)
+        && ntohs(ovh->header.length) >= sizeof *oeh
+        && oeh->subtype == htonl(OFP_EXT_PACKET_IN_BATCH)) {
+        process_packet_in_batch(sw, rconn, oeh);
+    }
+}
+
 static void
 process_echo_request(struct lswitch *sw, struct rconn *rconn, void *rq_)
 {
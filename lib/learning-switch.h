@@ -40,6 +40,8 @@ struct ofpbuf;
 struct rconn;
 
 struct lswitch *lswitch_create(struct rconn *, bool learn_macs, int max_idle);
+void lswitch_set_packet_in_batch(struct lswitch *, struct rconn *,
+                                 int max_packets);
 void lswitch_run(struct lswitch *, struct rconn *);
 void lswitch_wait(struct lswitch *);
 void lswitch_destroy(struct lswitch *);
@@ -0,0 +1,650 @@
+/* Copyright (c) 2010 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "netdev-xdp.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <poll.h>
+
+#include "ofpbuf.h"
+#include "poll-loop.h"
+#include "util.h"
+
+#define THIS_MODULE VLM_netdev
+#include "vlog.h"
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+/* UMEM geometry.  The UMEM is shared between the receive and transmit paths:
+ * half of its frames start out on the fill ring for the kernel to receive
+ * into, and the other half start out on our free list for transmission. */
+#define XDP_FRAME_SIZE 2048
+#define XDP_N_FRAMES 4096
+#define XDP_RING_SIZE (XDP_N_FRAMES / 2)
+
+/* One of the four single-producer, single-consumer rings shared with the
+ * kernel.  'cached_prod' and 'cached_cons' are our private copies of the
+ * shared indexes, so that the shared ones need only be read when the cached
+ * values run out.  For rings that we produce into (fill and TX),
+ * 'cached_cons' is kept 'size' ahead of the real consumer index so that the
+ * free space is simply 'cached_cons - cached_prod'. */
+struct xdp_ring {
+    uint32_t *producer;
+    uint32_t *consumer;
+    uint32_t *flags;
+    void *descs;
+    uint32_t size;
+    uint32_t mask;
+    uint32_t cached_prod;
+    uint32_t cached_cons;
+
+    void *map;
+    size_t map_size;
+};
+
+struct xdp_sock {
+    int fd;                     /* AF_XDP socket. */
+    int ifindex;
+    uint32_t queue_id;
+
+    /* XDP program that redirects 'queue_id' into 'fd', and its attachment. */
+    int map_fd;                 /* XSKMAP indexed by receive queue. */
+    int prog_fd;
+    int link_fd;                /* Closing this detaches the program. */
+    bool native;                /* Attached in driver mode (else generic)? */
+    bool zero_copy;             /* Bound with XDP_ZEROCOPY? */
+
+    /* UMEM and its rings. */
+    uint8_t *umem;
+    struct xdp_ring fill, comp, rx, tx;
+
+    /* Frames that are neither owned by the kernel nor in flight. */
+    uint64_t *free_frames;
+    size_t n_free;
+};
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 20);
+
+static int
+sys_bpf(int cmd, union bpf_attr *attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof *attr);
+}
+
+static uint32_t
+ring_prod_free(struct xdp_ring *r, uint32_t n)
+{
+    uint32_t n_free = r->cached_cons - r->cached_prod;
+    if (n_free < n) {
+        r->cached_cons = __atomic_load_n(r->consumer, __ATOMIC_ACQUIRE);
+        r->cached_cons += r->size;
+        n_free = r->cached_cons - r->cached_prod;
+    }
+    return n_free;
+}
+
+static void
+ring_prod_submit(struct xdp_ring *r)
+{
+    __atomic_store_n(r->producer, r->cached_prod, __ATOMIC_RELEASE);
+}
+
+static uint32_t
+ring_cons_avail(struct xdp_ring *r)
+{
+    uint32_t n = r->cached_prod - r->cached_cons;
+    if (!n) {
+        r->cached_prod = __atomic_load_n(r->producer, __ATOMIC_ACQUIRE);
+        n = r->cached_prod - r->cached_cons;
+    }
+    return n;
+}
+
+static void
+ring_cons_release(struct xdp_ring *r)
+{
+    __atomic_store_n(r->consumer, r->cached_cons, __ATOMIC_RELEASE);
+}
+
+static bool
+ring_needs_wakeup(const struct xdp_ring *r)
+{
+    return *r->flags & XDP_RING_NEED_WAKEUP;
+}
+
+/* Maps the ring at 'pgoff' on 'fd', whose layout is described by 'off' and
+ * which has 'size' entries of 'desc_size' bytes each.  Returns 0 if
+ * successful, otherwise a positive errno value. */
+static int
+ring_map(struct xdp_ring *r, int fd, off_t pgoff,
+         const struct xdp_ring_offset *off, uint32_t size, size_t desc_size,
+         bool producer)
+{
+    uint8_t *map;
+
+    r->map_size = off->desc + size * desc_size;
+    map = mmap(NULL, r->map_size, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, fd, pgoff);
+    if (map == MAP_FAILED) {
+        r->map = NULL;
+        return errno;
+    }
+    r->map = map;
+    r->producer = (uint32_t *) (map + off->producer);
+    r->consumer = (uint32_t *) (map + off->consumer);
+    r->flags = (uint32_t *) (map + off->flags);
+    r->descs = map + off->desc;
+    r->size = size;
+    r->mask = size - 1;
+    r->cached_prod = *r->producer;
+    r->cached_cons = *r->consumer + (producer ? size : 0);
+    return 0;
+}
+
+static void
+ring_unmap(struct xdp_ring *r)
+{
+    if (r->map) {
+        munmap(r->map, r->map_size);
+    }
+}
+
+/* Creates the XSKMAP and loads the XDP program that redirects each frame
+ * received on a queue with a bound socket to that socket, passing everything
+ * else up the regular stack.  The program is the equivalent of:
+ *
+ *     return bpf_redirect_map(&xsks_map, ctx->rx_queue_index, XDP_PASS);
+ */
+static int
+load_program(struct xdp_sock *xsk)
+{
+    static const char license[] = "BSD";
+    struct bpf_insn insns[] = {
+        { .code = BPF_LDX | BPF_MEM | BPF_W, .dst_reg = BPF_REG_2,
+          .src_reg = BPF_REG_1,
+          .off = offsetof(struct xdp_md, rx_queue_index) },
+        { .code = BPF_LD | BPF_DW | BPF_IMM, .dst_reg = BPF_REG_1,
+          .src_reg = BPF_PSEUDO_MAP_FD },
+        { .code = 0 },
+        { .code = BPF_ALU64 | BPF_MOV | BPF_K, .dst_reg = BPF_REG_3,
+          .imm = XDP_PASS },
+        { .code = BPF_JMP | BPF_CALL, .imm = BPF_FUNC_redirect_map },
+        { .code = BPF_JMP | BPF_EXIT },
+    };
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof attr);
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(int);
+    attr.max_entries = xsk->queue_id + 1;
+    xsk->map_fd = sys_bpf(BPF_MAP_CREATE, &attr);
+    if (xsk->map_fd < 0) {
+        return errno;
+    }
+
+    insns[1].imm = xsk->map_fd;
+    memset(&attr, 0, sizeof attr);
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = (uintptr_t) insns;
+    attr.insn_cnt = ARRAY_SIZE(insns);
+    attr.license = (uintptr_t) license;
+    xsk->prog_fd = sys_bpf(BPF_PROG_LOAD, &attr);
+    return xsk->prog_fd < 0 ? errno : 0;
+}
+
+/* Attaches the XDP program to the device, in driver mode if 'mode' allows and
+ * the driver supports it, otherwise in generic (SKB) mode.  The attachment is
+ * a BPF link, so the kernel detaches the program by itself when we exit, even
+ * if we crash. */
+static int
+attach_program(struct xdp_sock *xsk, enum netdev_xdp_mode mode)
+{
+    union bpf_attr attr;
+    int error = 0;
+
+    if (mode != NETDEV_XDP_GENERIC) {
+        memset(&attr, 0, sizeof attr);
+        attr.link_create.prog_fd = xsk->prog_fd;
+        attr.link_create.target_ifindex = xsk->ifindex;
+        attr.link_create.attach_type = BPF_XDP;
+        attr.link_create.flags = XDP_FLAGS_DRV_MODE;
+        xsk->link_fd = sys_bpf(BPF_LINK_CREATE, &attr);
+        if (xsk->link_fd >= 0) {
+            xsk->native = true;
+            return 0;
+        }
+        error = errno;
+        if (mode == NETDEV_XDP_NATIVE) {
+            return error;
+        }
+    }
+
+    memset(&attr, 0, sizeof attr);
+    attr.link_create.prog_fd = xsk->prog_fd;
+    attr.link_create.target_ifindex = xsk->ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+    xsk->link_fd = sys_bpf(BPF_LINK_CREATE, &attr);
+    return xsk->link_fd < 0 ? errno : 0;
+}
+
+/* Binds the socket to its queue, trying zero-copy first when the program is
+ * attached in driver mode, since only drivers with native XDP support can
+ * possibly provide it. */
+static int
+bind_socket(struct xdp_sock *xsk)
+{
+    struct sockaddr_xdp sxdp;
+
+    memset(&sxdp, 0, sizeof sxdp);
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = xsk->ifindex;
+    sxdp.sxdp_queue_id = xsk->queue_id;
+    if (xsk->native) {
+        sxdp.sxdp_flags = XDP_ZEROCOPY | XDP_USE_NEED_WAKEUP;
+        if (!bind(xsk->fd, (struct sockaddr *) &sxdp, sizeof sxdp)) {
+            xsk->zero_copy = true;
+            return 0;
+        }
+    }
+    sxdp.sxdp_flags = XDP_COPY | XDP_USE_NEED_WAKEUP;
+    return bind(xsk->fd, (struct sockaddr *) &sxdp, sizeof sxdp) ? errno : 0;
+}
+
+static int
+register_umem(struct xdp_sock *xsk)
+{
+    struct xdp_umem_reg mr;
+    struct xdp_mmap_offsets off;
+    socklen_t optlen;
+    uint32_t ring_size = XDP_RING_SIZE;
+    int error;
+
+    xsk->umem = mmap(NULL, XDP_N_FRAMES * XDP_FRAME_SIZE,
+                     PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                     -1, 0);
+    if (xsk->umem == MAP_FAILED) {
+        xsk->umem = NULL;
+        return errno;
+    }
+
+    memset(&mr, 0, sizeof mr);
+    mr.addr = (uintptr_t) xsk->umem;
+    mr.len = XDP_N_FRAMES * XDP_FRAME_SIZE;
+    mr.chunk_size = XDP_FRAME_SIZE;
+    mr.headroom = 0;
+    if (setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_REG, &mr, sizeof mr)
+        || setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_FILL_RING,
+                      &ring_size, sizeof ring_size)
+        || setsockopt(xsk->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING,
+                      &ring_size, sizeof ring_size)
+        || setsockopt(xsk->fd, SOL_XDP, XDP_RX_RING,
+                      &ring_size, sizeof ring_size)
+        || setsockopt(xsk->fd, SOL_XDP, XDP_TX_RING,
+                      &ring_size, sizeof ring_size)) {
+        return errno;
+    }
+
+    optlen = sizeof off;
+    if (getsockopt(xsk->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen)) {
+        return errno;
+    }
+
+    error = ring_map(&xsk->fill, xsk->fd, XDP_UMEM_PGOFF_FILL_RING, &off.fr,
+                     XDP_RING_SIZE, sizeof(uint64_t), true);
+    if (!error) {
+        error = ring_map(&xsk->comp, xsk->fd, XDP_UMEM_PGOFF_COMPLETION_RING,
+                         &off.cr, XDP_RING_SIZE, sizeof(uint64_t), false);
+    }
+    if (!error) {
+        error = ring_map(&xsk->rx, xsk->fd, XDP_PGOFF_RX_RING, &off.rx,
+                         XDP_RING_SIZE, sizeof(struct xdp_desc), false);
+    }
+    if (!error) {
+        error = ring_map(&xsk->tx, xsk->fd, XDP_PGOFF_TX_RING, &off.tx,
+                         XDP_RING_SIZE, sizeof(struct xdp_desc), true);
+    }
+    return error;
+}
+
+/* Hands the first half of the UMEM to the kernel for reception and keeps the
+ * rest for transmission. */
+static void
+populate_frames(struct xdp_sock *xsk)
+{
+    uint64_t *fill = xsk->fill.descs;
+    size_t i;
+
+    for (i = 0; i < XDP_RING_SIZE; i++) {
+        fill[xsk->fill.cached_prod++ & xsk->fill.mask] = i * XDP_FRAME_SIZE;
+    }
+    ring_prod_submit(&xsk->fill);
+
+    xsk->free_frames = xmalloc(XDP_N_FRAMES * sizeof *xsk->free_frames);
+    xsk->n_free = 0;
+    for (; i < XDP_N_FRAMES; i++) {
+        xsk->free_frames[xsk->n_free++] = i * XDP_FRAME_SIZE;
+    }
+}
+
+/* Opens an AF_XDP socket on receive queue 'queue_id' of the network device
+ * named 'name', whose index is 'ifindex', and attaches an XDP program that
+ * steers that queue's frames to it.  'mode' selects between driver and
+ * generic XDP; with NETDEV_XDP_AUTO, driver mode is preferred.  Zero-copy is
+ * used whenever the driver supports it.
+ *
+ * Returns 0 and sets '*xskp' to the new socket if successful, otherwise
+ * returns a positive errno value and sets '*xskp' to null. */
+int
+xdp_sock_open(const char *name, int ifindex, uint32_t queue_id,
+              enum netdev_xdp_mode mode, struct xdp_sock **xskp)
+{
+    struct xdp_sock *xsk;
+    uint32_t key = queue_id;
+    union bpf_attr attr;
+    int error;
+
+    *xskp = NULL;
+
+    xsk = xcalloc(1, sizeof *xsk);
+    xsk->ifindex = ifindex;
+    xsk->queue_id = queue_id;
+    xsk->map_fd = xsk->prog_fd = xsk->link_fd = -1;
+
+    xsk->fd = socket(AF_XDP, SOCK_RAW, 0);
+    if (xsk->fd < 0) {
+        error = errno;
+        VLOG_DBG("%s: AF_XDP socket creation failed: %s",
+                 name, strerror(error));
+        goto error;
+    }
+
+    error = register_umem(xsk);
+    if (error) {
+        VLOG_DBG("%s: AF_XDP UMEM setup failed: %s", name, strerror(error));
+        goto error;
+    }
+    populate_frames(xsk);
+
+    error = load_program(xsk);
+    if (error) {
+        VLOG_DBG("%s: loading XDP program failed: %s", name, strerror(error));
+        goto error;
+    }
+
+    error = attach_program(xsk, mode);
+    if (error) {
+        VLOG_DBG("%s: attaching XDP program failed: %s",
+                 name, strerror(error));
+        goto error;
+    }
+
+    error = bind_socket(xsk);
+    if (error) {
+        VLOG_DBG("%s: binding AF_XDP socket to queue %"PRIu32" failed: %s",
+                 name, queue_id, strerror(error));
+        goto error;
+    }
+
+    memset(&attr, 0, sizeof attr);
+    attr.map_fd = xsk->map_fd;
+    attr.key = (uintptr_t) &key;
+    attr.value = (uintptr_t) &xsk->fd;
+    attr.flags = BPF_ANY;
+    if (sys_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+        error = errno;
+        VLOG_DBG("%s: adding AF_XDP socket to XSKMAP failed: %s",
+                 name, strerror(error));
+        goto error;
+    }
+
+    VLOG_INFO("%s: opened AF_XDP socket on queue %"PRIu32" "
+              "(%s mode, %s)", name, queue_id,
+              xsk->native ? "native" : "generic",
+              xsk->zero_copy ? "zero-copy" : "copy");
+    *xskp = xsk;
+    return 0;
+
+error:
+    xdp_sock_close(xsk);
+    return error;
+}
+
+/* Closes 'xsk', detaching its XDP program from the network device. */
+void
+xdp_sock_close(struct xdp_sock *xsk)
+{
+    if (xsk) {
+        if (xsk->link_fd >= 0) {
+            close(xsk->link_fd);
+        }
+        if (xsk->prog_fd >= 0) {
+            close(xsk->prog_fd);
+        }
+        if (xsk->map_fd >= 0) {
+            close(xsk->map_fd);
+        }
+        ring_unmap(&xsk->fill);
+        ring_unmap(&xsk->comp);
+        ring_unmap(&xsk->rx);
+        ring_unmap(&xsk->tx);
+        if (xsk->fd >= 0) {
+            close(xsk->fd);
+        }
+        if (xsk->umem) {
+            munmap(xsk->umem, XDP_N_FRAMES * XDP_FRAME_SIZE);
+        }
+        free(xsk->free_frames);
+        free(xsk);
+    }
+}
+
+/* Kicks the kernel into refilling our RX ring, if it asked to be told. */
+static void
+kick_rx(struct xdp_sock *xsk)
+{
+    if (ring_needs_wakeup(&xsk->fill)) {
+        recvfrom(xsk->fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+    }
+}
+
+/* Kicks the kernel into transmitting what we queued on our TX ring, if it
+ * asked to be told. */
+static void
+kick_tx(struct xdp_sock *xsk)
+{
+    if (ring_needs_wakeup(&xsk->tx)
+        && sendto(xsk->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0
+        && errno != EAGAIN && errno != EBUSY && errno != ENOBUFS
+        && errno != ENETDOWN) {
+        VLOG_WARN_RL(&rl, "AF_XDP transmit kick failed: %s", strerror(errno));
+    }
+}
+
+/* Moves frames whose transmission has completed back to the free list. */
+static void
+reclaim_tx_frames(struct xdp_sock *xsk)
+{
+    uint32_t n = ring_cons_avail(&xsk->comp);
+    if (n) {
+        const uint64_t *addrs = xsk->comp.descs;
+        uint32_t i;
+
+        for (i = 0; i < n; i++) {
+            uint64_t addr = addrs[xsk->comp.cached_cons++ & xsk->comp.mask];
+            xsk->free_frames[xsk->n_free++] = addr;
+        }
+        ring_cons_release(&xsk->comp);
+    }
+}
+
+/* Attempts to receive a frame from 'xsk' into 'buffer', with the same
+ * semantics as netdev_recv().  The frame is copied out of the UMEM, and its
+ * UMEM frame is returned to the kernel at once, so 'buffer' is not tied to
+ * 'xsk' afterward. */
+int
+xdp_sock_recv(struct xdp_sock *xsk, struct ofpbuf *buffer)
+{
+    const struct xdp_desc *desc;
+    uint64_t *fill;
+    uint64_t addr;
+    uint32_t len;
+    int error;
+
+    if (!ring_cons_avail(&xsk->rx)) {
+        kick_rx(xsk);
+        return EAGAIN;
+    }
+
+    desc = xsk->rx.descs;
+    desc += xsk->rx.cached_cons++ & xsk->rx.mask;
+    addr = desc->addr;
+    len = desc->len;
+    ring_cons_release(&xsk->rx);
+
+    if (len <= ofpbuf_tailroom(buffer)) {
+        memcpy(ofpbuf_put_uninit(buffer, len), xsk->umem + addr, len);
+        error = 0;
+    } else {
+        VLOG_WARN_RL(&rl, "dropped %"PRIu32"-byte AF_XDP frame that does "
+                     "not fit in %zu-byte buffer",
+                     len, ofpbuf_tailroom(buffer));
+        error = EMSGSIZE;
+    }
+
+    /* The fill ring has room for every frame that the kernel can hand us, so
+     * the frame can always be recycled immediately. */
+    ring_prod_free(&xsk->fill, 1);
+    fill = xsk->fill.descs;
+    fill[xsk->fill.cached_prod++ & xsk->fill.mask]
+        = addr & ~(uint64_t) (XDP_FRAME_SIZE - 1);
+    ring_prod_submit(&xsk->fill);
+
+    return error;
+}
+
+void
+xdp_sock_recv_wait(struct xdp_sock *xsk)
+{
+    poll_fd_wait(xsk->fd, POLLIN);
+}
+
+/* Queues the 'size' bytes in 'data' for transmission on 'xsk'.  Returns 0 if
+ * successful, EAGAIN if no UMEM frame or TX ring slot is available right now,
+ * or EMSGSIZE if the frame is too big for a UMEM frame. */
+int
+xdp_sock_send(struct xdp_sock *xsk, const void *data, size_t size)
+{
+    struct xdp_desc *desc;
+    uint64_t addr;
+
+    if (size > XDP_FRAME_SIZE) {
+        return EMSGSIZE;
+    }
+
+    if (!xsk->n_free) {
+        reclaim_tx_frames(xsk);
+    }
+    if (!xsk->n_free || !ring_prod_free(&xsk->tx, 1)) {
+        kick_tx(xsk);
+        return EAGAIN;
+    }
+
+    addr = xsk->free_frames[--xsk->n_free];
+    memcpy(xsk->umem + addr, data, size);
+
+    desc = xsk->tx.descs;
+    desc += xsk->tx.cached_prod++ & xsk->tx.mask;
+    desc->addr = addr;
+    desc->len = size;
+    desc->options = 0;
+    ring_prod_submit(&xsk->tx);
+
+    kick_tx(xsk);
+    return 0;
+}
+
+/* Arranges for the poll loop to wake up when xdp_sock_send() can queue a
+ * frame, which takes both a UMEM frame, free or about to be reclaimed from
+ * the completion ring, and a free TX ring slot. */
+void
+xdp_sock_send_wait(struct xdp_sock *xsk)
+{
+    bool have_frame = xsk->n_free || ring_cons_avail(&xsk->comp);
+    bool have_slot = ring_prod_free(&xsk->tx, 1) > 0;
+
+    if (have_frame && have_slot) {
+        poll_immediate_wake();
+    } else if (!have_slot) {
+        /* The kernel reports POLLOUT once it has drained the TX ring. */
+        poll_fd_wait(xsk->fd, POLLOUT);
+    } else {
+        /* Every frame is in flight.  Nothing on the socket signals the
+         * completion ring, so check it again shortly. */
+        poll_timer_wait(1);
+    }
+}
+
+/* Returns true if 'xsk''s XDP program runs in the driver, false if it runs in
+ * generic (SKB) mode. */
+bool
+xdp_sock_is_native(const struct xdp_sock *xsk)
+{
+    return xsk->native;
+}
+
+/* Returns true if 'xsk' shares its UMEM with the NIC, false if the kernel
+ * copies frames in and out of it. */
+bool
+xdp_sock_is_zero_copy(const struct xdp_sock *xsk)
+{
+    return xsk->zero_copy;
+}
@@ -0,0 +1,110 @@
+/* Copyright (c) 2010 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#ifndef NETDEV_XDP_H
+#define NETDEV_XDP_H 1
+
+/* AF_XDP sockets for network devices.
+ *
+ * An xdp_sock is an AF_XDP socket bound to one receive queue of a network
+ * device, together with the UMEM that backs its rings and the small XDP
+ * program that steers that queue's frames into the socket.  It is an
+ * implementation detail of netdev.c, which uses it for ports opened with the
+ * "xdp:" prefix and falls back to its ordinary raw socket when AF_XDP is not
+ * available. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+#include "compiler.h"
+#include "netdev.h"
+
+struct ofpbuf;
+struct xdp_sock;
+
+#ifdef HAVE_AF_XDP
+int xdp_sock_open(const char *name, int ifindex, uint32_t queue_id,
+                  enum netdev_xdp_mode, struct xdp_sock **);
+void xdp_sock_close(struct xdp_sock *);
+
+int xdp_sock_recv(struct xdp_sock *, struct ofpbuf *);
+void xdp_sock_recv_wait(struct xdp_sock *);
+int xdp_sock_send(struct xdp_sock *, const void *, size_t);
+void xdp_sock_send_wait(struct xdp_sock *);
+
+bool xdp_sock_is_native(const struct xdp_sock *);
+bool xdp_sock_is_zero_copy(const struct xdp_sock *);
+#else  /* !HAVE_AF_XDP */
+static inline int
+xdp_sock_open(const char *name UNUSED, int ifindex UNUSED,
+              uint32_t queue_id UNUSED, enum netdev_xdp_mode mode UNUSED,
+              struct xdp_sock **xskp)
+{
+    *xskp = NULL;
+    return EOPNOTSUPP;
+}
+
+static inline void xdp_sock_close(struct xdp_sock *xsk UNUSED) { }
+
+static inline int
+xdp_sock_recv(struct xdp_sock *xsk UNUSED, struct ofpbuf *b UNUSED)
+{
+    return EAGAIN;
+}
+
+static inline void xdp_sock_recv_wait(struct xdp_sock *xsk UNUSED) { }
+
+static inline int
+xdp_sock_send(struct xdp_sock *xsk UNUSED, const void *data UNUSED,
+              size_t size UNUSED)
+{
+    return EOPNOTSUPP;
+}
+
+static inline void xdp_sock_send_wait(struct xdp_sock *xsk UNUSED) { }
+
+static inline bool
+xdp_sock_is_native(const struct xdp_sock *xsk UNUSED)
+{
+    return false;
+}
+
+static inline bool
+xdp_sock_is_zero_copy(const struct xdp_sock *xsk UNUSED)
+{
+    return false;
+}
+#endif /* !HAVE_AF_XDP */
+
+#endif /* netdev-xdp.h */
@@ -58,12 +58,15 @@
 #endif
 
 #include <linux/ethtool.h>
+#include <linux/pkt_sched.h>
 #include <linux/rtnetlink.h>
 #include <linux/sockios.h>
 #include <linux/version.h>
+#include <linux/virtio_net.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netpacket/packet.h>
 #include <net/ethernet.h>
 #include <net/if.h>
@@ -75,8 +78,11 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "csum.h"
 #include "fatal-signal.h"
+#include "hash.h"
 #include "list.h"
+#include "netdev-xdp.h"
 #include "netlink.h"
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
@@ -92,6 +98,14 @@
 #define IFF_LOWER_UP 0x10000
 #endif
 
+#ifndef PACKET_VNET_HDR
+#define PACKET_VNET_HDR 15
+#endif
+
+#define ETH_TYPE_IPV6 0x86dd
+#define IPV6_HEADER_LEN 40
+#define TCP_CWR 0x80
+
 #define THIS_MODULE VLM_netdev
 #include "vlog.h"
 
@@ -105,10 +119,31 @@ struct netdev {
     int tap_fd;                 /* TAP character device, if any, otherwise the
                                  * network device. */
 
+    /* Receive queues.  A multiqueue TAP device has one character device fd
+     * per queue, of which 'tap_fd' is the first; any other device has a
+     * single queue whose fd is 'tap_fd'. */
+    int rxq_fd[NETDEV_MAX_TAP_QUEUES];
+    int n_rxq;
+    int next_rxq;               /* Queue that netdev_recv() tries first. */
+
     /* one socket per queue.These are valid only for ordinary network devices*/
     int queue_fd[NETDEV_MAX_QUEUES + 1];
     uint16_t num_queues;
 
+    /* AF_XDP socket on receive queue 0, for "xdp:" devices whose XDP setup
+     * succeeded, otherwise null.  Frames on other receive queues, and frames
+     * transmitted on queues other than the default, still use the raw
+     * sockets above. */
+    struct xdp_sock *xsk;
+
+    /* True if the raw sockets above are in GSO mode, that is, if every frame
+     * read from or written to them is preceded by a struct virtio_net_hdr. */
+    bool vnet_hdr;
+
+    /* In GSO mode, NETDEV_GSO_MAX_SIZE bytes that take in the part of a
+     * super-packet that does not fit in the caller's buffer. */
+    uint8_t *rx_overflow;
+
     /* Cached network device information. */
     int ifindex;
     uint8_t etheraddr[ETH_ADDR_LEN];
@@ -132,6 +167,12 @@ struct netdev {
 /* All open network devices. */
 static struct list netdev_list = LIST_INITIALIZER(&netdev_list);
 
+/* How "xdp:" devices attach their XDP programs. */
+static enum netdev_xdp_mode xdp_mode = NETDEV_XDP_AUTO;
+
+/* Whether to open ordinary network devices in GSO mode. */
+static bool gso_enabled;
+
 /* An AF_INET socket (used for ioctl operations). */
 static int af_inet_sock = -1;
 
@@ -142,6 +183,9 @@ static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 20);
 static void init_netdev(void);
 static int do_open_netdev(const char *name, int ethertype, int tap_fd,
                           struct netdev **netdev_);
+static int netdev_open_xdp(const char *name, int ethertype,
+                           struct netdev **netdevp);
+static int set_vnet_hdr(int fd);
 static int restore_flags(struct netdev *netdev);
 static int get_flags(const char *netdev_name, int *flagsp);
 static int set_flags(const char *netdev_name, int flags);
@@ -194,37 +238,197 @@ get_ipv6_address(const char *name, struct in6_addr *in6)
  * without any bandwidth guarantees */
 #define TC_DEFAULT_CLASS 0xfffe
 #define TC_MIN_RATE 1
-/* This configures an HTB qdisc under the defined device. */
-#define COMMAND_ADD_DEV_QDISC "/sbin/tc qdisc add dev %s " \
-                              "root handle %x: htb default %x"
-#define COMMAND_DEL_DEV_QDISC "/sbin/tc qdisc del dev %s root"
-#define COMMAND_ADD_CLASS "/sbin/tc class add dev %s parent %x:%x " \
-                          "classid %x:%x htb rate %dkbit ceil %dkbit"
-#define COMMAND_CHANGE_CLASS "/sbin/tc class change dev %s parent %x:%x " \
-                             "classid %x:%x htb rate %dkbit ceil %dkbit"
-#define COMMAND_DEL_CLASS "/sbin/tc class del dev %s parent %x:%x classid %x:%x"
+
+/* Queue disciplines and classes are configured over rtnetlink, the same way
+ * that /sbin/tc does it, on this socket. */
+static struct nl_sock *rtnl_sock;
+
+/* Packet scheduler clock, from /proc/net/psched. */
+static unsigned int ticks_per_s;
+static unsigned int buffer_hz;
+
+static void
+read_psched(void)
+{
+    unsigned int a, b, c, d;
+    FILE *stream;
+
+    if (ticks_per_s) {
+        return;
+    }
+
+    /* Fall back to the values of kernels without high-resolution timers. */
+    ticks_per_s = 1000000;
+    buffer_hz = 100;
+
+    stream = fopen("/proc/net/psched", "r");
+    if (!stream) {
+        VLOG_WARN("/proc/net/psched: open failed: %s", strerror(errno));
+        return;
+    }
+    if (fscanf(stream, "%x %x %x %x", &a, &b, &c, &d) != 4 || !b || !c) {
+        VLOG_WARN("/proc/net/psched: could not parse contents");
+    } else {
+        ticks_per_s = (double) a * c / b;
+        buffer_hz = c == 1000000 ? d : c;
+    }
+    fclose(stream);
+}
+
+/* Returns the number of scheduler ticks needed to transmit 'size' bytes at
+ * 'rate' bytes per second. */
+static unsigned int
+tc_bytes_to_ticks(unsigned int rate, unsigned int size)
+{
+    return rate ? (unsigned long long int) ticks_per_s * size / rate : 0;
+}
 
 static int
-netdev_setup_root_class(const struct netdev *netdev, uint16_t class_id,
-                        uint16_t rate)
+tc_calc_cell_log(int mtu)
 {
-    char command[1024];
-    int actual_rate;
+    int cell_log;
+
+    mtu += VLAN_ETH_HEADER_LEN;
+    for (cell_log = 0; mtu >= 256; cell_log++) {
+        mtu >>= 1;
+    }
+    return cell_log;
+}
+
+static void
+tc_fill_rate(struct tc_ratespec *rate, uint64_t bytes_per_s, int mtu)
+{
+    memset(rate, 0, sizeof *rate);
+    rate->cell_log = tc_calc_cell_log(mtu);
+    rate->mpu = ETH_TOTAL_MIN;
+    rate->rate = MIN(bytes_per_s, UINT32_MAX);
+}
 
-    /* we need to translate from .1% to kbps */
-    actual_rate = rate*netdev->speed;
+/* Appends a rate table for 'rate' to 'msg' as attribute 'type'.  Kernels that
+ * predate precise rate computation require one. */
+static void
+tc_put_rtab(struct ofpbuf *msg, uint16_t type, const struct tc_ratespec *rate)
+{
+    uint32_t *rtab;
+    unsigned int i;
 
-    snprintf(command, sizeof(command), COMMAND_ADD_CLASS, netdev->name,
-             TC_QDISC,0,TC_QDISC, class_id, actual_rate, netdev->speed*1000);
-    if (system(command) != 0) {
-        VLOG_ERR("Problem configuring root class %d for device %s",
-                 class_id, netdev->name);
-        return -1;
+    rtab = nl_msg_put_unspec_uninit(msg, type, TC_RTAB_SIZE);
+    for (i = 0; i < TC_RTAB_SIZE / sizeof *rtab; i++) {
+        unsigned int packet_size = (i + 1) << rate->cell_log;
+        rtab[i] = tc_bytes_to_ticks(rate->rate, MAX(packet_size, rate->mpu));
     }
+}
+
+/* Returns the token bucket depth, in ticks, that tc would use by default for
+ * 'rate' bytes per second. */
+static unsigned int
+tc_calc_buffer(unsigned int rate, int mtu)
+{
+    return tc_bytes_to_ticks(rate, rate / buffer_hz + mtu);
+}
 
+/* Returns a new rtnetlink request of the given 'type' and 'flags' for the tc
+ * object with the given 'handle' and 'parent' on 'netdev'. */
+static struct ofpbuf *
+tc_make_request(const struct netdev *netdev, int type, unsigned int flags,
+                uint32_t handle, uint32_t parent)
+{
+    struct ofpbuf *request;
+    struct tcmsg *tcmsg;
+
+    request = ofpbuf_new(0);
+    nl_msg_put_nlmsghdr(request, rtnl_sock, sizeof *tcmsg, type,
+                        NLM_F_REQUEST | flags);
+    tcmsg = nl_msg_put_uninit(request, sizeof *tcmsg);
+    memset(tcmsg, 0, sizeof *tcmsg);
+    tcmsg->tcm_family = AF_UNSPEC;
+    tcmsg->tcm_ifindex = netdev->ifindex;
+    tcmsg->tcm_handle = handle;
+    tcmsg->tcm_parent = parent;
+    return request;
+}
+
+/* Returns a new request to create (with 'type' RTM_NEWTCLASS and 'flags'
+ * NLM_F_CREATE | NLM_F_EXCL) or change (with flags 0) HTB class 'class_id'
+ * under 'parent_id' on 'netdev'.  'rate' is the minimum rate of the class in
+ * 1/10 of a percent of the link speed; every class may use the whole link. */
+static struct ofpbuf *
+tc_make_class_request(const struct netdev *netdev, unsigned int flags,
+                      uint16_t parent_id, uint16_t class_id, uint16_t rate)
+{
+    uint64_t link_rate = (uint64_t) netdev->speed * 1000 * 1000 / 8;
+    struct tc_htb_opt opt;
+    struct ofpbuf *request;
+    size_t opt_offset;
+
+    memset(&opt, 0, sizeof opt);
+    tc_fill_rate(&opt.rate, link_rate * rate / 1000, netdev->mtu);
+    tc_fill_rate(&opt.ceil, link_rate, netdev->mtu);
+    opt.buffer = tc_calc_buffer(opt.rate.rate, netdev->mtu);
+    opt.cbuffer = tc_calc_buffer(opt.ceil.rate, netdev->mtu);
+
+    request = tc_make_request(netdev, RTM_NEWTCLASS, flags,
+                              TC_H_MAKE(TC_QDISC << 16, class_id),
+                              TC_H_MAKE(TC_QDISC << 16, parent_id));
+    nl_msg_put_string(request, TCA_KIND, "htb");
+    opt_offset = nl_msg_start_nested(request, TCA_OPTIONS);
+    nl_msg_put_unspec(request, TCA_HTB_PARMS, &opt, sizeof opt);
+    tc_put_rtab(request, TCA_HTB_RTAB, &opt.rate);
+    tc_put_rtab(request, TCA_HTB_CTAB, &opt.ceil);
+    nl_msg_end_nested(request, opt_offset);
+    return request;
+}
+
+/* Sends the 'n' tc requests in 'requests' to the kernel as a batch, waits for
+ * the kernel to process them, and destroys them.  Stores the result of each
+ * request in the corresponding element of 'errors'.  Returns 0 if successful,
+ * otherwise a positive errno value if the batch could not be completed. */
+static int
+tc_transact(const struct netdev *netdev, struct ofpbuf **requests, size_t n,
+            int errors[])
+{
+    size_t i;
+    int error;
+
+    error = nl_sock_transact_multiple(rtnl_sock, requests, n, errors);
+    if (error) {
+        VLOG_ERR("%s: rtnetlink transaction failed: %s",
+                 netdev->name, strerror(error));
+    }
+    for (i = 0; i < n; i++) {
+        ofpbuf_delete(requests[i]);
+    }
+    return error;
+}
+
+/* Opens the rtnetlink socket used for tc configuration, if it is not open
+ * already.  Returns 0 if successful, otherwise a positive errno value. */
+static int
+tc_init(void)
+{
+    if (!rtnl_sock) {
+        int error = nl_sock_create(NETLINK_ROUTE, 0, 0, 0, &rtnl_sock);
+        if (error) {
+            VLOG_ERR("failed to create rtnetlink socket: %s",
+                     strerror(error));
+            return error;
+        }
+        read_psched();
+    }
     return 0;
 }
 
+/* Sends the single tc request 'request' and returns its result. */
+static int
+tc_transact_one(const struct netdev *netdev, struct ofpbuf *request)
+{
+    int retval;
+    int error;
+
+    retval = tc_transact(netdev, &request, 1, &error);
+    return retval ? retval : error;
+}
+
 /** Defines a class for the specific queue discipline. A class
  * represents an OpenFlow queue.
  *
@@ -232,30 +436,27 @@ netdev_setup_root_class(const struct netdev *netdev, uint16_t class_id,
  * @param class_id unique identifier for this queue. TC limits this to 16-bits,
  * so we need to keep an internal mapping between class_id and OpenFlow
  * queue_id
- * @param rate the minimum rate for this queue in kbps
- * @return 0 on success, non-zero value when the configuration was not
- * successful.
+ * @param rate the minimum rate for this queue in 1/10 of a percent of the
+ * link speed
+ * @return 0 on success, otherwise a positive errno value.
  */
 int
 netdev_setup_class(const struct netdev *netdev, uint16_t class_id,
                    uint16_t rate)
 {
-    char command[1024];
-    int actual_rate;
-
-    /* we need to translate from .1% to kbps */
-    actual_rate = rate*netdev->speed;
+    int error;
 
-    snprintf(command, sizeof(command), COMMAND_ADD_CLASS, netdev->name,
-             TC_QDISC, TC_ROOT_CLASS, TC_QDISC, class_id, actual_rate,
-             netdev->speed*1000);
-    if (system(command) != 0) {
-        VLOG_ERR("Problem configuring class %d for device %s",class_id,
-                 netdev->name);
-        return -1;
+    error = tc_init();
+    if (!error) {
+        error = tc_transact_one(netdev, tc_make_class_request(
+                                    netdev, NLM_F_CREATE | NLM_F_EXCL,
+                                    TC_ROOT_CLASS, class_id, rate));
     }
-
-    return 0;
+    if (error) {
+        VLOG_ERR("Problem configuring class %d for device %s: %s",
+                 class_id, netdev->name, strerror(error));
+    }
+    return error;
 }
 
 /** Changes a class already defined.
@@ -264,53 +465,52 @@ netdev_setup_class(const struct netdev *netdev, uint16_t class_id,
  * @param class_id unique identifier for this queue. TC limits this to 16-bits,
  * so we need to keep an internal mapping between class_id and OpenFlow
  * queue_id
- * @param rate the minimum rate for this queue in kbps
- * @return 0 on success, non-zero value when the configuration was not
- * successful.
+ * @param rate the minimum rate for this queue in 1/10 of a percent of the
+ * link speed
+ * @return 0 on success, otherwise a positive errno value.
  */
 int
 netdev_change_class(const struct netdev *netdev, uint16_t class_id, uint16_t rate)
 {
-    char command[1024];
-    int actual_rate;
-
-    /* we need to translate from .1% to kbps */
-    actual_rate = rate*netdev->speed;
+    int error;
 
-    snprintf(command, sizeof(command), COMMAND_CHANGE_CLASS, netdev->name,
-             TC_QDISC, TC_ROOT_CLASS, TC_QDISC, class_id, actual_rate,
-             netdev->speed*1000 );
-    if (system(command) != 0) {
-        VLOG_ERR("Problem configuring class %d for device %s",
-                 class_id, netdev->name);
-        return -1;
+    error = tc_init();
+    if (!error) {
+        error = tc_transact_one(netdev, tc_make_class_request(
+                                    netdev, 0, TC_ROOT_CLASS, class_id,
+                                    rate));
     }
-
-    return 0;
+    if (error) {
+        VLOG_ERR("Problem configuring class %d for device %s: %s",
+                 class_id, netdev->name, strerror(error));
+    }
+    return error;
 }
 
 /** Deletes a class already defined to represent an OpenFlow queue.
  *
  * @param netdev the device under configuration
  * @param class_id unique identifier for this queue.
- * @param rate the minimum rate for this queue in kbps
- * @return 0 on success, non-zero value when the configuration was not
- * successful.
+ * @return 0 on success, otherwise a positive errno value.
  */
 int
 netdev_delete_class(const struct netdev *netdev, uint16_t class_id)
 {
-    char command[1024];
+    int error;
 
-    snprintf(command, sizeof(command), COMMAND_DEL_CLASS, netdev->name,
-             TC_QDISC, TC_ROOT_CLASS, TC_QDISC, class_id);
-    if (system(command) != 0) {
-        VLOG_ERR("Problem deleting class %d for device %s",class_id,
-                 netdev->name);
-        return -1;
+    error = tc_init();
+    if (!error) {
+        error = tc_transact_one(netdev, tc_make_request(
+                                    netdev, RTM_DELTCLASS, 0,
+                                    TC_H_MAKE(TC_QDISC << 16, class_id),
+                                    TC_H_MAKE(TC_QDISC << 16,
+                                              TC_ROOT_CLASS)));
     }
-
-    return 0;
+    if (error) {
+        VLOG_ERR("Problem deleting class %d for device %s: %s",
+                 class_id, netdev->name, strerror(error));
+    }
+    return error;
 }
 
 static int
@@ -385,44 +585,40 @@ open_queue_socket(const char * name, uint16_t class_id, int * fd)
  * http://luxik.cdi.cz/~devik/qos/htb/
  * http://luxik.cdi.cz/~devik/qos/htb/manual/userg.htm
  *
- * @param netdev_name the device to be configured
- * @return 0 on success, non-zero value when the configuration was not
- * successful.
+ * Returns a new request to create the HTB qdisc on 'netdev'.
  */
-static int
-do_setup_qdisc(const char *netdev_name)
+static struct ofpbuf *
+tc_make_qdisc_request(const struct netdev *netdev)
 {
-    char command[1024];
-    int error;
-
-    snprintf(command, sizeof(command), COMMAND_ADD_DEV_QDISC, netdev_name,
-             TC_QDISC, TC_DEFAULT_CLASS);
-    error = system(command);
-    if (error) {
-        VLOG_WARN("Problem configuring qdisc for device %s",netdev_name);
-        return error;
-    }
-    return 0;
+    struct tc_htb_glob opt;
+    struct ofpbuf *request;
+    size_t opt_offset;
+
+    memset(&opt, 0, sizeof opt);
+    opt.version = TC_HTB_PROTOVER;
+    opt.rate2quantum = 10;
+    opt.defcls = TC_DEFAULT_CLASS;
+
+    request = tc_make_request(netdev, RTM_NEWQDISC,
+                              NLM_F_CREATE | NLM_F_EXCL,
+                              TC_H_MAKE(TC_QDISC << 16, 0), TC_H_ROOT);
+    nl_msg_put_string(request, TCA_KIND, "htb");
+    opt_offset = nl_msg_start_nested(request, TCA_OPTIONS);
+    nl_msg_put_unspec(request, TCA_HTB_INIT, &opt, sizeof opt);
+    nl_msg_end_nested(request, opt_offset);
+    return request;
 }
 
-/** Remove current queue disciplines from a net device
- * @param netdev_name the device under configuration
+/** Returns a new request to remove the current root queue discipline from a
+ * net device
+ * @param netdev the device under configuration
  */
-static int
-do_remove_qdisc(const char *netdev_name)
+static struct ofpbuf *
+tc_make_remove_qdisc_request(const struct netdev *netdev)
 {
-    char command[1024];
-
-    snprintf(command, sizeof(command), COMMAND_DEL_DEV_QDISC, netdev_name);
-    system(command);
-
-    /* There is no need for a device to already be configured. Therefore no
-     * need to indicate any error */
-    return 0;
+    return tc_make_request(netdev, RTM_DELQDISC, 0, 0, TC_H_ROOT);
 }
 
-
-
 /** Configures a port to support slicing
  * @param netdev_name the device under configuration
  * @return 0 on success
@@ -430,38 +626,52 @@ do_remove_qdisc(const char *netdev_name)
 int
 netdev_setup_slicing(struct netdev *netdev, uint16_t num_queues)
 {
+    struct ofpbuf *requests[4];
+    int errors[4];
     int i;
     int * fd;
     int error;
 
     netdev->num_queues = num_queues;
 
-    /* remove any previous queue configuration for this device */
-    error = do_remove_qdisc(netdev->name);
+    error = tc_init();
     if (error) {
         return error;
     }
 
-    /* Configure tc queue discipline to allow slicing queues */
-    error = do_setup_qdisc(netdev->name);
+    /* Configure the whole tc hierarchy in one rtnetlink transaction:
+     *
+     *   - Remove any previous queue configuration for this device.  There is
+     *     no need for a device to already be configured, so the result of
+     *     this request is ignored.
+     *
+     *   - Configure an HTB queue discipline to allow slicing queues.
+     *
+     *   - Define a root class for the queue disc. In order to allow spare
+     *     bandwidth to be used efficiently, we need all the classes under a
+     *     root class. For details, refer to :
+     *     http://luxik.cdi.cz/~devik/qos/htb/
+     *
+     *   - Configure a default class. This would be the best-effort, getting
+     *     everything that remains from the other queues.  tc requires a
+     *     min-rate to configure a class, we put a min_rate here. */
+    requests[0] = tc_make_remove_qdisc_request(netdev);
+    requests[1] = tc_make_qdisc_request(netdev);
+    requests[2] = tc_make_class_request(netdev, NLM_F_CREATE | NLM_F_EXCL,
+                                        0, TC_ROOT_CLASS, 1000);
+    requests[3] = tc_make_class_request(netdev, NLM_F_CREATE | NLM_F_EXCL,
+                                        TC_ROOT_CLASS, TC_DEFAULT_CLASS,
+                                        TC_MIN_RATE);
+    error = tc_transact(netdev, requests, ARRAY_SIZE(requests), errors);
     if (error) {
         return error;
     }
-
-    /* This define a root class for the queue disc. In order to allow spare
-     * bandwidth to be used efficiently, we need all the classes under a root
-     * class. For details, refer to :
-     * http://luxik.cdi.cz/~devik/qos/htb/ */
-    error = netdev_setup_root_class(netdev, TC_ROOT_CLASS,1000);
-    if (error) {
-        return error;
-    }
-    /* we configure a default class. This would be the best-effort, getting
-     * everything that remains from the other queues.tc requires a min-rate
-     * to configure a class, we put a min_rate here */
-    error = netdev_setup_class(netdev,TC_DEFAULT_CLASS,1);
-    if (error) {
-        return error;
+    for (i = 1; i < ARRAY_SIZE(requests); i++) {
+        if (errors[i]) {
+            VLOG_WARN("Problem configuring qdisc for device %s: %s",
+                      netdev->name, strerror(errors[i]));
+            return errors[i];
+        }
     }
 
     /* the tc backend has been configured. Now, we need to create sockets that
@@ -481,6 +691,14 @@ netdev_setup_slicing(struct netdev *netdev, uint16_t num_queues)
         if (error) {
             return error;
         }
+        if (netdev->vnet_hdr) {
+            error = set_vnet_hdr(*fd);
+            if (error) {
+                VLOG_ERR("%s: enabling GSO on queue %d failed: %s",
+                         netdev->name, i, strerror(error));
+                return error;
+            }
+        }
     }
 
     return 0;
@@ -623,12 +841,28 @@ do_ethtool(struct netdev *netdev)
  * 'ethertype' may be a 16-bit Ethernet protocol value in host byte order to
  * capture frames of that type received on the device.  It may also be one of
  * the 'enum netdev_pseudo_ethertype' values to receive frames in one of those
- * categories. */
+ * categories.
+ *
+ * A name of the form "tap:NAME" opens a TAP device (see netdev_open_tap()),
+ * and "tap:NAME:N" a TAP device with N queues (see netdev_open_tap_mq()).
+ * A name of the form "xdp:NAME" opens device NAME and receives from and
+ * transmits on it through an AF_XDP socket where possible (see
+ * netdev_set_xdp_mode()). */
 int
 netdev_open(const char *name, int ethertype, struct netdev **netdevp)
 {
     if (!strncmp(name, "tap:", 4)) {
+        const char *n_queues = strchr(name + 4, ':');
+        if (n_queues) {
+            char *tap_name = xmemdup0(name + 4, n_queues - (name + 4));
+            int error = netdev_open_tap_mq(tap_name, atoi(n_queues + 1),
+                                           netdevp);
+            free(tap_name);
+            return error;
+        }
         return netdev_open_tap(name + 4, netdevp);
+    } else if (!strncmp(name, "xdp:", 4)) {
+        return netdev_open_xdp(name + 4, ethertype, netdevp);
     } else {
         return do_open_netdev(name, ethertype, -1, netdevp);
     }
@@ -641,43 +875,138 @@ netdev_open(const char *name, int ethertype, struct netdev **netdevp)
  * '*netdevp' to the new network device, otherwise to null.  */
 int
 netdev_open_tap(const char *name, struct netdev **netdevp)
+{
+    return netdev_open_tap_mq(name, 1, netdevp);
+}
+
+/* Opens a TAP virtual network device with 'n_queues' queues, which must be
+ * between 1 and NETDEV_MAX_TAP_QUEUES.  Each queue has its own file
+ * descriptor: the kernel spreads the frames that it sends to the device
+ * across the queues by flow, and netdev_rxq_recv() receives from any one of
+ * them independently of the others.  Otherwise the same as
+ * netdev_open_tap(). */
+int
+netdev_open_tap_mq(const char *name, int n_queues, struct netdev **netdevp)
 {
     static const char tap_dev[] = "/dev/net/tun";
+    int fds[NETDEV_MAX_TAP_QUEUES];
     struct ifreq ifr;
     int error;
-    int tap_fd;
+    int i;
 
-    tap_fd = open(tap_dev, O_RDWR);
-    if (tap_fd < 0) {
-        ofp_error(errno, "opening \"%s\" failed", tap_dev);
-        return errno;
+    *netdevp = NULL;
+    if (n_queues < 1 || n_queues > NETDEV_MAX_TAP_QUEUES) {
+        VLOG_ERR("cannot open TAP device with %d queues (must be 1 to %d)",
+                 n_queues, NETDEV_MAX_TAP_QUEUES);
+        return EINVAL;
     }
 
     memset(&ifr, 0, sizeof ifr);
-    ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
     if (name) {
         strncpy(ifr.ifr_name, name, sizeof ifr.ifr_name);
     }
-    if (ioctl(tap_fd, TUNSETIFF, &ifr) < 0) {
-        int error = errno;
-        ofp_error(error, "ioctl(TUNSETIFF) on \"%s\" failed", tap_dev);
-        close(tap_fd);
+    for (i = 0; i < n_queues; i++) {
+        fds[i] = open(tap_dev, O_RDWR);
+        if (fds[i] < 0) {
+            error = errno;
+            ofp_error(error, "opening \"%s\" failed", tap_dev);
+            goto error;
+        }
+
+        /* The first TUNSETIFF fills in the device name, if it was not given,
+         * so that the later ones attach their queues to the same device. */
+        ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+        if (n_queues > 1) {
+            ifr.ifr_flags |= IFF_MULTI_QUEUE;
+        }
+        if (ioctl(fds[i], TUNSETIFF, &ifr) < 0) {
+            error = errno;
+            ofp_error(error, "ioctl(TUNSETIFF) on \"%s\" failed", tap_dev);
+            close(fds[i]);
+            goto error;
+        }
+
+        error = set_nonblocking(fds[i]);
+        if (error) {
+            ofp_error(error, "set_nonblocking on \"%s\" failed", tap_dev);
+            close(fds[i]);
+            goto error;
+        }
+    }
+
+    /* do_open_netdev() closes fds[0] itself on failure. */
+    error = do_open_netdev(ifr.ifr_name, NETDEV_ETH_TYPE_NONE, fds[0],
+                           netdevp);
+    if (error) {
+        for (i = 1; i < n_queues; i++) {
+            close(fds[i]);
+        }
         return error;
     }
+    for (i = 1; i < n_queues; i++) {
+        (*netdevp)->rxq_fd[i] = fds[i];
+    }
+    (*netdevp)->n_rxq = n_queues;
+    return 0;
+
+error:
+    while (i-- > 0) {
+        close(fds[i]);
+    }
+    return error;
+}
+
+/* Opens the network device named 'name' like netdev_open(), then tries to
+ * attach an AF_XDP socket to its first receive queue.  If AF_XDP is
+ * unavailable, for whatever reason, the device falls back to using only its
+ * raw socket, so this fails only if netdev_open() would. */
+static int
+netdev_open_xdp(const char *name, int ethertype, struct netdev **netdevp)
+{
+    struct netdev *netdev;
+    int error;
 
-    error = set_nonblocking(tap_fd);
+    error = do_open_netdev(name, ethertype, -1, netdevp);
     if (error) {
-        ofp_error(error, "set_nonblocking on \"%s\" failed", tap_dev);
-        close(tap_fd);
         return error;
     }
+    netdev = *netdevp;
 
-    error = do_open_netdev(ifr.ifr_name, NETDEV_ETH_TYPE_NONE, tap_fd,
-                           netdevp);
+    error = xdp_sock_open(name, netdev->ifindex, 0, xdp_mode, &netdev->xsk);
     if (error) {
-        close(tap_fd);
+        VLOG_WARN("%s: AF_XDP unavailable (%s), falling back to raw socket",
+                  name, strerror(error));
     }
-    return error;
+    return 0;
+}
+
+/* Enables or disables GSO mode for ordinary network devices opened from now
+ * on.  In GSO mode, netdev_recv() may return super-packets of up to
+ * NETDEV_GSO_MAX_SIZE bytes that the kernel aggregated (GRO) or that the
+ * local stack has not yet segmented (TSO), with their segmentation and
+ * checksum offload state in the ofpbuf, growing the caller's buffer to fit
+ * them, and netdev_send() hands such packets to the kernel as-is for it (or
+ * the NIC) to segment.  Packets sent to
+ * devices that are not in GSO mode are segmented in software. */
+void
+netdev_set_gso(bool enable)
+{
+    gso_enabled = enable;
+}
+
+/* Returns true if 'netdev' is in GSO mode (see netdev_set_gso()). */
+bool
+netdev_get_gso(const struct netdev *netdev)
+{
+    return netdev->vnet_hdr;
+}
+
+/* Selects how "xdp:" network devices opened from now on attach their XDP
+ * programs. */
+void
+netdev_set_xdp_mode(enum netdev_xdp_mode mode)
+{
+    xdp_mode = mode;
 }
 
 static int
@@ -784,10 +1113,26 @@ do_open_netdev(const char *name, int ethertype, int tap_fd,
     netdev->netdev_fd = netdev_fd;
     netdev->tap_fd = tap_fd < 0 ? netdev_fd : tap_fd;
     netdev->queue_fd[0] = netdev->tap_fd;
+    netdev->rxq_fd[0] = netdev->tap_fd;
+    netdev->n_rxq = 1;
+    netdev->next_rxq = 0;
     memcpy(netdev->etheraddr, etheraddr, sizeof etheraddr);
     netdev->mtu = mtu;
     netdev->in6 = in6;
     netdev->num_queues = 0;
+    netdev->xsk = NULL;
+    netdev->vnet_hdr = false;
+    netdev->rx_overflow = NULL;
+    if (gso_enabled && tap_fd < 0) {
+        error = set_vnet_hdr(netdev_fd);
+        if (!error) {
+            netdev->vnet_hdr = true;
+            netdev->rx_overflow = xmalloc(NETDEV_GSO_MAX_SIZE);
+        } else {
+            VLOG_WARN("%s: GSO mode unavailable, receiving individual "
+                      "segments (%s)", name, strerror(error));
+        }
+    }
 
     /* Get speed, features. */
     do_ethtool(netdev);
@@ -836,6 +1181,8 @@ netdev_close(struct netdev *netdev)
         }
 
         /* Free. */
+        xdp_sock_close(netdev->xsk);
+        free(netdev->rx_overflow);
         free(netdev->name);
         close(netdev->netdev_fd);
         if (netdev->netdev_fd != netdev->tap_fd) {
@@ -845,6 +1192,9 @@ netdev_close(struct netdev *netdev)
         for (i =1; i <= netdev->num_queues; i++) {
             close(netdev->queue_fd[i]);
         }
+        for (i = 1; i < netdev->n_rxq; i++) {
+            close(netdev->rxq_fd[i]);
+        }
         free(netdev);
     }
 }
@@ -859,42 +1209,228 @@ pad_to_minimum_length(struct ofpbuf *buffer)
     }
 }
 
+/* Puts raw socket 'fd' into GSO mode.  Returns 0 if successful, otherwise a
+ * positive errno value. */
+static int
+set_vnet_hdr(int fd)
+{
+    int on = 1;
+    return (setsockopt(fd, SOL_PACKET, PACKET_VNET_HDR, &on, sizeof on) < 0
+            ? errno : 0);
+}
+
+/* Locates the TCP or UDP header in Ethernet frame 'packet', which may have one
+ * VLAN tag and an IPv4 or IPv6 (without extension headers) network header.
+ * If successful, returns the offset of the transport header from the start
+ * of the frame and stores its IP protocol in '*protop' and the offset of the
+ * network header in '*l3_ofsp'.  Otherwise returns 0. */
+static size_t
+find_l4(const struct ofpbuf *packet, uint8_t *protop, size_t *l3_ofsp)
+{
+    const uint8_t *data = packet->data;
+    size_t l3_ofs = ETH_HEADER_LEN;
+    size_t l4_ofs;
+    uint16_t eth_type;
+    uint8_t proto;
+
+    if (packet->size < ETH_HEADER_LEN) {
+        return 0;
+    }
+    eth_type = ((const struct eth_header *) data)->eth_type;
+    if (eth_type == htons(ETH_TYPE_VLAN)) {
+        if (packet->size < VLAN_ETH_HEADER_LEN) {
+            return 0;
+        }
+        eth_type = ((const struct vlan_eth_header *) data)->veth_next_type;
+        l3_ofs = VLAN_ETH_HEADER_LEN;
+    }
+
+    if (eth_type == htons(ETH_TYPE_IP)) {
+        const struct ip_header *nh = (const void *) (data + l3_ofs);
+        if (packet->size < l3_ofs + IP_HEADER_LEN) {
+            return 0;
+        }
+        proto = nh->ip_proto;
+        l4_ofs = l3_ofs + IP_IHL(nh->ip_ihl_ver) * 4;
+    } else if (eth_type == htons(ETH_TYPE_IPV6)) {
+        if (packet->size < l3_ofs + IPV6_HEADER_LEN) {
+            return 0;
+        }
+        proto = data[l3_ofs + 6];
+        l4_ofs = l3_ofs + IPV6_HEADER_LEN;
+    } else {
+        return 0;
+    }
+
+    if (proto == IP_TYPE_TCP) {
+        if (packet->size < l4_ofs + TCP_HEADER_LEN) {
+            return 0;
+        }
+    } else if (proto == IP_TYPE_UDP) {
+        if (packet->size < l4_ofs + UDP_HEADER_LEN) {
+            return 0;
+        }
+    } else {
+        return 0;
+    }
+
+    *protop = proto;
+    *l3_ofsp = l3_ofs;
+    return l4_ofs;
+}
+
+/* Returns the number of bytes of headers that each segment of TCP
+ * super-packet 'packet' carries, or 0 if 'packet' is not a well-formed TCP
+ * super-packet. */
+static size_t
+gso_hdr_len(const struct ofpbuf *packet)
+{
+    const struct tcp_header *th;
+    size_t l3_ofs, l4_ofs, hdr_len;
+    uint8_t proto;
+
+    l4_ofs = find_l4(packet, &proto, &l3_ofs);
+    if (!l4_ofs || proto != IP_TYPE_TCP) {
+        return 0;
+    }
+    th = (const struct tcp_header *) ((const char *) packet->data + l4_ofs);
+    hdr_len = l4_ofs + TCP_OFFSET(th->tcp_ctl) * 4;
+    return hdr_len <= packet->size ? hdr_len : 0;
+}
+
+/* Returns the number of packets that 'packet' represents on the wire, which
+ * is more than 1 if it is a super-packet received in GSO mode, and stores in
+ * '*n_bytes' the total number of bytes in those packets. */
+unsigned int
+netdev_packet_segs(const struct ofpbuf *packet, uint64_t *n_bytes)
+{
+    if (packet->gso_size) {
+        size_t hdr_len = gso_hdr_len(packet);
+        if (hdr_len && packet->size > hdr_len) {
+            size_t payload = packet->size - hdr_len;
+            unsigned int segs = DIV_ROUND_UP(payload, packet->gso_size);
+            *n_bytes = packet->size + (uint64_t) (segs - 1) * hdr_len;
+            return segs;
+        }
+    }
+    *n_bytes = packet->size;
+    return 1;
+}
+
 /* Attempts to receive a packet from 'netdev' into 'buffer', which the caller
  * must have initialized with sufficient room for the packet.  The space
  * required to receive any packet is ETH_HEADER_LEN bytes, plus VLAN_HEADER_LEN
  * bytes, plus the device's MTU (which may be retrieved via netdev_get_mtu()).
  * (Some devices do not allow for a VLAN header, in which case VLAN_HEADER_LEN
- * need not be included.)
+ * need not be included.)  A device in GSO mode reallocates 'buffer' to hold
+ * a super-packet that does not fit, keeping its headroom.
  *
  * If a packet is successfully retrieved, returns 0.  In this case 'buffer' is
  * guaranteed to contain at least ETH_TOTAL_MIN bytes.  Otherwise, returns a
  * positive errno value.  Returns EAGAIN immediately if no packet is ready to
  * be returned.
+ *
+ * On a device with more than one receive queue, each call starts with the
+ * queue after the one that the previous packet came from, so that no queue
+ * can starve the others.
  */
 int
 netdev_recv(struct netdev *netdev, struct ofpbuf *buffer)
 {
+    int i;
+
+    for (i = 0; i < netdev->n_rxq; i++) {
+        int rxq = (netdev->next_rxq + i) % netdev->n_rxq;
+        int error = netdev_rxq_recv(netdev, rxq, buffer);
+        if (error != EAGAIN) {
+            netdev->next_rxq = (rxq + 1) % netdev->n_rxq;
+            return error;
+        }
+    }
+    return EAGAIN;
+}
+
+/* Returns the number of receive queues that 'netdev' has, which is more than
+ * 1 only for multiqueue TAP devices (see netdev_open_tap_mq()). */
+int
+netdev_get_n_rxq(const struct netdev *netdev)
+{
+    return netdev->n_rxq;
+}
+
+/* Attempts to receive a packet from receive queue 'rxq' of 'netdev', which
+ * must be between 0 and netdev_get_n_rxq(netdev) - 1, into 'buffer'.
+ * Otherwise the same as netdev_recv(). */
+int
+netdev_rxq_recv(struct netdev *netdev, int rxq, struct ofpbuf *buffer)
+{
+    int fd = netdev->rxq_fd[rxq];
     ssize_t n_bytes;
     struct sockaddr_ll sll;
     socklen_t sll_len;
+    struct virtio_net_hdr vnet;
 
+    assert(rxq >= 0 && rxq < netdev->n_rxq);
     assert(buffer->size == 0);
     assert(ofpbuf_tailroom(buffer) >= ETH_TOTAL_MIN);
 
+    /* Frames steered to the AF_XDP socket never reach the raw socket, and
+     * vice versa, so it does not matter which one we check first. */
+    if (netdev->xsk && !rxq) {
+        int error = xdp_sock_recv(netdev->xsk, buffer);
+        if (!error) {
+            pad_to_minimum_length(buffer);
+            return 0;
+        } else if (error != EAGAIN) {
+            return error;
+        }
+    }
+
     /* prepare to call recvfrom */
     memset(&sll,0,sizeof sll);
     sll_len = sizeof sll;
 
     /* cannot execute recvfrom over a tap device */
-    if (!strncmp(netdev->name, "tap", 3)) {
+    if (netdev->tap_fd != netdev->netdev_fd) {
         do {
-            n_bytes = read(netdev->tap_fd, ofpbuf_tail(buffer),
+            n_bytes = read(fd, ofpbuf_tail(buffer),
                            (ssize_t)ofpbuf_tailroom(buffer));
         } while (n_bytes < 0 && errno == EINTR);
     }
+    else if (netdev->vnet_hdr) {
+        size_t room = ofpbuf_tailroom(buffer);
+        struct iovec iov[3];
+        struct msghdr msg;
+
+        /* The caller's buffer need only fit an ordinary frame.  The rest of a
+         * super-packet lands in 'rx_overflow' and is copied over once the
+         * buffer has grown to fit it. */
+        iov[0].iov_base = &vnet;
+        iov[0].iov_len = sizeof vnet;
+        iov[1].iov_base = ofpbuf_tail(buffer);
+        iov[1].iov_len = room;
+        iov[2].iov_base = netdev->rx_overflow;
+        iov[2].iov_len = NETDEV_GSO_MAX_SIZE;
+        memset(&msg, 0, sizeof msg);
+        msg.msg_name = &sll;
+        msg.msg_namelen = sll_len;
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 3;
+        do {
+            n_bytes = recvmsg(fd, &msg, 0);
+        } while (n_bytes < 0 && errno == EINTR);
+        if (n_bytes >= 0) {
+            n_bytes = MAX(n_bytes - (ssize_t) sizeof vnet, 0);
+            if (n_bytes > room) {
+                ofpbuf_prealloc_tailroom(buffer, n_bytes);
+                memcpy((char *) ofpbuf_tail(buffer) + room,
+                       netdev->rx_overflow, n_bytes - room);
+            }
+        }
+    }
     else {
         do {
-            n_bytes = recvfrom(netdev->tap_fd, ofpbuf_tail(buffer),
+            n_bytes = recvfrom(fd, ofpbuf_tail(buffer),
                                (ssize_t)ofpbuf_tailroom(buffer), 0,
                                (struct sockaddr *)&sll, &sll_len);
         } while (n_bytes < 0 && errno == EINTR);
@@ -915,6 +1451,14 @@ netdev_recv(struct netdev *netdev, struct ofpbuf *buffer)
 
 
         buffer->size += n_bytes;
+        if (netdev->vnet_hdr) {
+            if (vnet.gso_type != VIRTIO_NET_HDR_GSO_NONE) {
+                buffer->gso_type = vnet.gso_type;
+                buffer->gso_size = vnet.gso_size;
+            }
+            buffer->csum_partial
+                = (vnet.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) != 0;
+        }
 
         /* When the kernel internally sends out an Ethernet frame on an
          * interface, it gives us a copy *before* padding the frame to the
@@ -931,7 +1475,23 @@ netdev_recv(struct netdev *netdev, struct ofpbuf *buffer)
 void
 netdev_recv_wait(struct netdev *netdev)
 {
-    poll_fd_wait(netdev->tap_fd, POLLIN);
+    int i;
+
+    for (i = 0; i < netdev->n_rxq; i++) {
+        netdev_rxq_wait(netdev, i);
+    }
+}
+
+/* Registers with the poll loop to wake up from the next call to poll_block()
+ * when a packet is ready to be received with netdev_rxq_recv() on receive
+ * queue 'rxq' of 'netdev'. */
+void
+netdev_rxq_wait(struct netdev *netdev, int rxq)
+{
+    if (netdev->xsk && !rxq) {
+        xdp_sock_recv_wait(netdev->xsk);
+    }
+    poll_fd_wait(netdev->rxq_fd[rxq], POLLIN);
 }
 
 /* Discards all packets waiting to be received from 'netdev'. */
@@ -939,37 +1499,121 @@ int
 netdev_drain(struct netdev *netdev)
 {
     if (netdev->tap_fd != netdev->netdev_fd) {
-        drain_fd(netdev->tap_fd, netdev->txqlen);
+        int i;
+
+        for (i = 0; i < netdev->n_rxq; i++) {
+            drain_fd(netdev->rxq_fd[i], netdev->txqlen);
+        }
         return 0;
     } else {
         return drain_rcvbuf(netdev->netdev_fd);
     }
 }
 
-/* Sends 'buffer' on 'netdev'.  Returns 0 if successful, otherwise a positive
- * errno value.  Returns EAGAIN without blocking if the packet cannot be queued
- * immediately.  Returns EMSGSIZE if a partial packet was transmitted or if
- * the packet is too big or too small to transmit on the device.
- *
- * class_id denotes the queue to send the packet. If 0, it goes to the
- * default,best-effort queue.
- *
- * The caller retains ownership of 'buffer' in all cases.
- *
- * The kernel maintains a packet transmission queue, so the caller is not
- * expected to do additional queuing of packets.
- */
-int
-netdev_send(struct netdev *netdev, const struct ofpbuf *buffer,
-            uint16_t class_id)
+/* Fills in 'vnet' with the offload state of 'packet', for transmission on a
+ * device in GSO mode.  Returns 0 if successful, otherwise EINVAL. */
+static int
+make_vnet_hdr(const struct ofpbuf *packet, struct virtio_net_hdr *vnet)
 {
+    memset(vnet, 0, sizeof *vnet);
+    if (packet->csum_partial) {
+        size_t l3_ofs, l4_ofs;
+        uint8_t proto;
+
+        l4_ofs = find_l4(packet, &proto, &l3_ofs);
+        if (!l4_ofs) {
+            return EINVAL;
+        }
+        vnet->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+        vnet->csum_start = l4_ofs;
+        vnet->csum_offset = (proto == IP_TYPE_TCP
+                             ? offsetof(struct tcp_header, tcp_csum)
+                             : offsetof(struct udp_header, udp_csum));
+    }
+    if (packet->gso_size) {
+        size_t hdr_len = gso_hdr_len(packet);
+        if (!hdr_len) {
+            return EINVAL;
+        }
+        vnet->gso_type = packet->gso_type;
+        vnet->gso_size = packet->gso_size;
+        vnet->hdr_len = hdr_len;
+    }
+    return 0;
+}
+
+/* Chooses the queue of multiqueue TAP device 'netdev' on which to transmit
+ * 'packet', by hashing its addresses and ports so that each flow always uses
+ * the same queue. */
+static int
+select_txq(const struct netdev *netdev, const struct ofpbuf *packet)
+{
+    const char *data = packet->data;
+    size_t l3_ofs, l4_ofs;
+    uint32_t hash;
+    uint8_t proto;
+
+    l4_ofs = find_l4(packet, &proto, &l3_ofs);
+    if (!l4_ofs) {
+        hash = hash_bytes(data, MIN(packet->size, 2 * ETH_ADDR_LEN), 0);
+    } else if (IP_VER(data[l3_ofs]) == IP_VERSION) {
+        hash = hash_bytes(data + l3_ofs + offsetof(struct ip_header, ip_src),
+                          2 * IP_ADDR_LEN, proto);
+    } else {
+        hash = hash_bytes(data + l3_ofs + 8, 32, proto);
+    }
+    if (l4_ofs) {
+        hash = hash_bytes(data + l4_ofs, 4, hash);
+    }
+    return hash % netdev->n_rxq;
+}
+
+/* Sends 'buffer' on queue 'class_id' of 'netdev', passing along its offload
+ * state if 'netdev' is in GSO mode.  See netdev_send() for the return value
+ * convention. */
+static int
+do_send(struct netdev *netdev, const struct ofpbuf *buffer, uint16_t class_id)
+{
+    int fd = netdev->queue_fd[class_id];
     ssize_t n_bytes;
 
-    assert(class_id <= NETDEV_MAX_QUEUES);
+    if (netdev->xsk && !class_id) {
+        int error = xdp_sock_send(netdev->xsk, buffer->data, buffer->size);
+        if (error && error != EAGAIN) {
+            VLOG_WARN_RL(&rl, "error sending Ethernet packet on %s: %s",
+                         netdev->name, strerror(error));
+        }
+        return error;
+    }
 
-    do {
-        n_bytes = write(netdev->queue_fd[class_id], buffer->data, buffer->size);
-    } while (n_bytes < 0 && errno == EINTR);
+    if (netdev->vnet_hdr) {
+        struct virtio_net_hdr vnet;
+        struct iovec iov[2];
+
+        if (make_vnet_hdr(buffer, &vnet)) {
+            VLOG_WARN_RL(&rl, "dropping %zu-byte offloaded packet with "
+                         "unparseable headers on %s",
+                         buffer->size, netdev->name);
+            return EINVAL;
+        }
+        iov[0].iov_base = &vnet;
+        iov[0].iov_len = sizeof vnet;
+        iov[1].iov_base = buffer->data;
+        iov[1].iov_len = buffer->size;
+        do {
+            n_bytes = writev(fd, iov, 2);
+        } while (n_bytes < 0 && errno == EINTR);
+        if (n_bytes >= 0) {
+            n_bytes = MAX(n_bytes - (ssize_t) sizeof vnet, 0);
+        }
+    } else {
+        if (!class_id && netdev->n_rxq > 1) {
+            fd = netdev->rxq_fd[select_txq(netdev, buffer)];
+        }
+        do {
+            n_bytes = write(fd, buffer->data, buffer->size);
+        } while (n_bytes < 0 && errno == EINTR);
+    }
 
     if (n_bytes < 0) {
         /* The Linux AF_PACKET implementation never blocks waiting for room
@@ -992,6 +1636,170 @@ netdev_send(struct netdev *netdev, const struct ofpbuf *buffer,
     }
 }
 
+/* Turns 'seg', which consists of a copy of the headers of a TCP super-packet
+ * followed by the payload starting 'seq_ofs' bytes into the super-packet's
+ * payload, into a self-contained TCP segment.  The network and transport
+ * headers are at offsets 'l3_ofs' and 'l4_ofs'.  'index' is the number of
+ * segments preceding this one, and 'last' is true for the final segment. */
+static void
+fix_segment(struct ofpbuf *seg, size_t l3_ofs, size_t l4_ofs,
+            uint32_t seq_ofs, uint16_t index, bool last)
+{
+    char *data = seg->data;
+    struct tcp_header *th = (struct tcp_header *) (data + l4_ofs);
+    size_t l4_len = seg->size - l4_ofs;
+    uint32_t partial;
+
+    if (IP_VER(data[l3_ofs]) == IP_VERSION) {
+        struct ip_header *nh = (struct ip_header *) (data + l3_ofs);
+
+        nh->ip_tot_len = htons(seg->size - l3_ofs);
+        nh->ip_id = htons(ntohs(nh->ip_id) + index);
+        nh->ip_csum = 0;
+        nh->ip_csum = csum(nh, IP_IHL(nh->ip_ihl_ver) * 4);
+        partial = csum_add32(csum_add32(0, nh->ip_src), nh->ip_dst);
+    } else {
+        uint16_t payload_len = htons(seg->size - l3_ofs - IPV6_HEADER_LEN);
+
+        memcpy(data + l3_ofs + 4, &payload_len, sizeof payload_len);
+        partial = csum_continue(0, data + l3_ofs + 8, 32);
+    }
+
+    th->tcp_seq = htonl(ntohl(th->tcp_seq) + seq_ofs);
+    if (index) {
+        th->tcp_ctl &= ~htons(TCP_CWR);
+    }
+    if (!last) {
+        th->tcp_ctl &= ~htons(TCP_FIN | TCP_PSH);
+    }
+
+    partial = csum_add16(partial, htons(IP_TYPE_TCP));
+    partial = csum_add16(partial, htons(l4_len));
+    th->tcp_csum = 0;
+    th->tcp_csum = csum_finish(csum_continue(partial, th, l4_len));
+}
+
+/* Passes each of the packets that 'packet', which carries offload state
+ * (see netdev_set_gso()), represents on the wire to 'cb' along with 'aux',
+ * after completing its checksum and, for a TCP super-packet, segmenting it in
+ * software.  The buffer passed to 'cb' is reused for the next segment, so 'cb'
+ * must copy anything that it wants to keep.  'cb' returns true to be called
+ * with the next segment, false to stop.
+ *
+ * Returns 0 if successful, or EINVAL if 'packet' cannot be segmented in
+ * software, in which case 'cb' is not called. */
+int
+netdev_segment(const struct ofpbuf *packet,
+               netdev_segment_cb *cb, void *aux)
+{
+    size_t l3_ofs, l4_ofs, hdr_len, payload, ofs;
+    struct ofpbuf seg;
+    uint16_t index;
+    uint8_t proto;
+    int gso_type;
+    bool more;
+
+    l4_ofs = find_l4(packet, &proto, &l3_ofs);
+    hdr_len = packet->gso_size ? gso_hdr_len(packet) : l4_ofs;
+    gso_type = packet->gso_type & ~VIRTIO_NET_HDR_GSO_ECN;
+    if (!l4_ofs || !hdr_len
+        || (packet->gso_size && gso_type != VIRTIO_NET_HDR_GSO_TCPV4
+            && gso_type != VIRTIO_NET_HDR_GSO_TCPV6)) {
+        VLOG_WARN_RL(&rl, "dropping %zu-byte offloaded packet that cannot "
+                     "be segmented in software", packet->size);
+        return EINVAL;
+    }
+
+    if (!packet->gso_size) {
+        /* Only the checksum, whose field holds the pseudo-header checksum,
+         * needs to be completed. */
+        uint16_t *field;
+
+        ofpbuf_init(&seg, packet->size);
+        ofpbuf_put(&seg, packet->data, packet->size);
+        field = (uint16_t *) ((char *) seg.data + l4_ofs
+                              + (proto == IP_TYPE_TCP
+                                 ? offsetof(struct tcp_header, tcp_csum)
+                                 : offsetof(struct udp_header, udp_csum)));
+        *field = csum((char *) seg.data + l4_ofs, seg.size - l4_ofs);
+        if (proto == IP_TYPE_UDP && !*field) {
+            *field = 0xffff;
+        }
+        cb(&seg, aux);
+        ofpbuf_uninit(&seg);
+        return 0;
+    }
+
+    ofpbuf_init(&seg, hdr_len + packet->gso_size);
+    payload = packet->size - hdr_len;
+    ofs = index = 0;
+    do {
+        size_t len = MIN(packet->gso_size, payload - ofs);
+
+        seg.size = 0;
+        ofpbuf_put(&seg, packet->data, hdr_len);
+        ofpbuf_put(&seg, (char *) packet->data + hdr_len + ofs, len);
+        fix_segment(&seg, l3_ofs, l4_ofs, ofs, index, ofs + len >= payload);
+        more = cb(&seg, aux);
+
+        ofs += len;
+        index++;
+    } while (more && ofs < payload);
+    ofpbuf_uninit(&seg);
+
+    return 0;
+}
+
+/* The netdev and queue on which send_segment() transmits, and the result. */
+struct send_segment_aux {
+    struct netdev *netdev;
+    uint16_t class_id;
+    int error;
+};
+
+/* netdev_segment() callback for netdev_send(), which stops at the first
+ * error. */
+static bool
+send_segment(struct ofpbuf *seg, void *aux_)
+{
+    struct send_segment_aux *aux = aux_;
+
+    aux->error = do_send(aux->netdev, seg, aux->class_id);
+    return !aux->error;
+}
+
+/* Sends 'buffer' on 'netdev'.  Returns 0 if successful, otherwise a positive
+ * errno value.  Returns EAGAIN without blocking if the packet cannot be queued
+ * immediately.  Returns EMSGSIZE if a partial packet was transmitted or if
+ * the packet is too big or too small to transmit on the device.
+ *
+ * class_id denotes the queue to send the packet. If 0, it goes to the
+ * default,best-effort queue.
+ *
+ * A super-packet received in GSO mode is handed to the kernel whole if
+ * 'netdev' is also in GSO mode, otherwise segmented here first.
+ *
+ * The caller retains ownership of 'buffer' in all cases.
+ *
+ * The kernel maintains a packet transmission queue, so the caller is not
+ * expected to do additional queuing of packets.
+ */
+int
+netdev_send(struct netdev *netdev, const struct ofpbuf *buffer,
+            uint16_t class_id)
+{
+    assert(class_id <= NETDEV_MAX_QUEUES);
+
+    if ((buffer->gso_size || buffer->csum_partial)
+        && (!netdev->vnet_hdr || (netdev->xsk && !class_id))) {
+        struct send_segment_aux aux = { netdev, class_id, 0 };
+        int error = netdev_segment(buffer, send_segment, &aux);
+
+        return error ? error : aux.error;
+    }
+    return do_send(netdev, buffer, class_id);
+}
+
 /* Registers with the poll loop to wake up from the next call to poll_block()
  * when the packet transmission queue has sufficient room to transmit a packet
  * with netdev_send().
@@ -1002,7 +1810,9 @@ netdev_send(struct netdev *netdev, const struct ofpbuf *buffer,
 void
 netdev_send_wait(struct netdev *netdev)
 {
-    if (netdev->tap_fd == netdev->netdev_fd) {
+    if (netdev->xsk) {
+        xdp_sock_send_wait(netdev->xsk);
+    } else if (netdev->tap_fd == netdev->netdev_fd) {
         poll_fd_wait(netdev->tap_fd, POLLOUT);
     } else {
         /* TAP device always accepts packets.*/
@@ -1055,6 +1865,14 @@ netdev_get_mtu(const struct netdev *netdev)
     return netdev->mtu;
 }
 
+/* Returns the link speed of 'netdev' in Mbps, or 1000 if the device does not
+ * report one. */
+int
+netdev_get_speed(const struct netdev *netdev)
+{
+    return netdev->speed;
+}
+
 /* Returns the features supported by 'netdev' of type 'type', as a bitmap
  * of bits from enum ofp_phy_features, in host byte order. */
 uint32_t
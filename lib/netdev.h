@@ -68,16 +68,44 @@ enum netdev_pseudo_ethertype {
     NETDEV_ETH_TYPE_802_2        /* Receive all IEEE 802.2 frames. */
 };
 
+/* How "xdp:" network devices attach their XDP program. */
+enum netdev_xdp_mode {
+    NETDEV_XDP_AUTO,            /* Driver mode if supported, else generic. */
+    NETDEV_XDP_NATIVE,          /* Driver mode only. */
+    NETDEV_XDP_GENERIC          /* Generic (SKB) mode only. */
+};
+
 #define NETDEV_MAX_QUEUES 8
 
+/* Maximum number of queues of a multiqueue TAP device. */
+#define NETDEV_MAX_TAP_QUEUES 16
+
+/* Largest frame that netdev_recv() can return on a device in GSO mode: a
+ * maximum-size IP packet plus an 18-byte VLAN-tagged Ethernet header. */
+#define NETDEV_GSO_MAX_SIZE (65535 + 18)
+
 struct netdev;
 
 int netdev_open(const char *name, int ethertype, struct netdev **);
 int netdev_open_tap(const char *name, struct netdev **);
+int netdev_open_tap_mq(const char *name, int n_queues, struct netdev **);
 void netdev_close(struct netdev *);
+void netdev_set_xdp_mode(enum netdev_xdp_mode);
+void netdev_set_gso(bool enable);
+bool netdev_get_gso(const struct netdev *);
+unsigned int netdev_packet_segs(const struct ofpbuf *, uint64_t *n_bytes);
+
+/* Callback for netdev_segment(), which passes it each segment of a packet
+ * along with the caller's 'aux'.  Returns true to go on to the next segment,
+ * false to stop. */
+typedef bool netdev_segment_cb(struct ofpbuf *seg, void *aux);
+int netdev_segment(const struct ofpbuf *, netdev_segment_cb *, void *aux);
 
 int netdev_recv(struct netdev *, struct ofpbuf *);
 void netdev_recv_wait(struct netdev *);
+int netdev_get_n_rxq(const struct netdev *);
+int netdev_rxq_recv(struct netdev *, int rxq, struct ofpbuf *);
+void netdev_rxq_wait(struct netdev *, int rxq);
 int netdev_drain(struct netdev *);
 int netdev_send(struct netdev *, const struct ofpbuf *, uint16_t class_id);
 void netdev_send_wait(struct netdev *);
@@ -85,6 +113,7 @@ int netdev_set_etheraddr(struct netdev *, const uint8_t mac[6]);
 const uint8_t *netdev_get_etheraddr(const struct netdev *);
 const char *netdev_get_name(const struct netdev *);
 int netdev_get_mtu(const struct netdev *);
+int netdev_get_speed(const struct netdev *);
 uint32_t netdev_get_features(struct netdev *, int);
 bool netdev_get_in4(const struct netdev *, struct in_addr *);
 int netdev_set_in4(struct netdev *, struct in_addr addr, struct in_addr mask);
@@ -426,6 +426,72 @@ recv:
     return 0;
 }
 
+/* Sends the 'n' Netlink messages in 'requests' to the kernel on 'sock' in a
+ * single datagram and waits for the kernel to acknowledge each of them.  The
+ * kernel executes the requests in order, continuing past any that fail.
+ *
+ * Returns 0 if the requests were sent and all of their acknowledgements were
+ * received, in which case errors[i] is set to 0 if requests[i] succeeded or a
+ * positive errno value if it failed.  Otherwise, returns a positive errno
+ * value and the contents of 'errors' are indeterminate.
+ *
+ * Unlike nl_sock_transact(), this does not resend requests if the receive
+ * buffer overflows, because the requests need not be idempotent.  Any reply
+ * other than an acknowledgement is discarded. */
+int
+nl_sock_transact_multiple(struct nl_sock *sock, struct ofpbuf **requests,
+                          size_t n, int errors[])
+{
+    struct iovec *iov;
+    size_t n_pending;
+    size_t i;
+    int retval;
+
+    iov = xmalloc(n * sizeof *iov);
+    for (i = 0; i < n; i++) {
+        struct nlmsghdr *nlmsghdr = nl_msg_nlmsghdr(requests[i]);
+        nlmsghdr->nlmsg_len = requests[i]->size;
+        nlmsghdr->nlmsg_flags |= NLM_F_ACK;
+        iov[i].iov_base = requests[i]->data;
+        iov[i].iov_len = requests[i]->size;
+        errors[i] = -1;
+    }
+    retval = nl_sock_sendv(sock, iov, n, true);
+    free(iov);
+    if (retval) {
+        return retval;
+    }
+
+    n_pending = n;
+    while (n_pending > 0) {
+        struct ofpbuf *reply;
+        uint32_t seq;
+        int error;
+
+        retval = nl_sock_recv(sock, &reply, true);
+        if (retval) {
+            return retval;
+        }
+        seq = nl_msg_nlmsghdr(reply)->nlmsg_seq;
+        if (nl_msg_nlmsgerr(reply, &error)) {
+            for (i = 0; i < n; i++) {
+                if (nl_msg_nlmsghdr(requests[i])->nlmsg_seq == seq
+                    && errors[i] < 0) {
+                    if (error) {
+                        VLOG_DBG_RL(&rl, "received NAK error=%d (%s)",
+                                    error, strerror(error));
+                    }
+                    errors[i] = error;
+                    n_pending--;
+                    break;
+                }
+            }
+        }
+        ofpbuf_delete(reply);
+    }
+    return 0;
+}
+
 /* Causes poll_block() to wake up when any of the specified 'events' (which is
  * a OR'd combination of POLLIN, POLLOUT, etc.) occur on 'sock'. */
 void
@@ -655,6 +721,27 @@ nl_msg_put_string(struct ofpbuf *msg, uint16_t type, const char *value)
     nl_msg_put_unspec(msg, type, value, strlen(value) + 1);
 }
 
+/* Starts a nested Netlink attribute of the given 'type' in 'msg', to which
+ * the caller may then append further attributes.  Returns the offset of the
+ * nested attribute within 'msg', which the caller must later pass to
+ * nl_msg_end_nested(). */
+size_t
+nl_msg_start_nested(struct ofpbuf *msg, uint16_t type)
+{
+    size_t offset = msg->size;
+    nl_msg_put_unspec(msg, type, NULL, 0);
+    return offset;
+}
+
+/* Finishes the nested Netlink attribute begun at 'offset' in 'msg' by
+ * nl_msg_start_nested(), so that it covers every attribute appended since. */
+void
+nl_msg_end_nested(struct ofpbuf *msg, size_t offset)
+{
+    struct nlattr *attr = ofpbuf_at_assert(msg, offset, sizeof *attr);
+    attr->nla_len = msg->size - offset;
+}
+
 /* Appends a Netlink attribute of the given 'type' and the given buffered
  * netlink message in 'nested_msg' to 'msg'.  The nlmsg_len field in
  * 'nested_msg' is finalized to match 'nested_msg->size'. */
@@ -54,6 +54,10 @@ ofpbuf_use(struct ofpbuf *b, void *base, size_t allocated)
     b->l2 = b->l3 = b->l4 = b->l7 = NULL;
     b->next = NULL;
     b->private = NULL;
+    b->shared = NULL;
+    b->gso_size = 0;
+    b->gso_type = 0;
+    b->csum_partial = false;
 }
 
 /* Initializes 'b' as an empty ofpbuf with an initial capacity of 'size'
@@ -69,7 +73,11 @@ void
 ofpbuf_uninit(struct ofpbuf *b) 
 {
     if (b) {
-        free(b->base);
+        if (b->shared) {
+            ofpbuf_shared_unref(b->shared);
+        } else {
+            free(b->base);
+        }
     }
 }
 
@@ -91,10 +99,16 @@ ofpbuf_new(size_t size)
     return b;
 }
 
+/* Creates and returns a copy of 'buffer''s data, along with its offload
+ * state. */
 struct ofpbuf *
 ofpbuf_clone(const struct ofpbuf *buffer)
 {
-    return ofpbuf_clone_data(buffer->data, buffer->size);
+    struct ofpbuf *b = ofpbuf_clone_data(buffer->data, buffer->size);
+    b->gso_size = buffer->gso_size;
+    b->gso_type = buffer->gso_type;
+    b->csum_partial = buffer->csum_partial;
+    return b;
 }
 
 struct ofpbuf *
@@ -115,6 +129,66 @@ ofpbuf_delete(struct ofpbuf *b)
     }
 }
 
+/* A block of memory that several ofpbufs can point into, so that, e.g., the
+ * messages in a chunk of data received in one system call can be handed out
+ * without copying each of them.  The block is freed along with the last
+ * ofpbuf that points into it. */
+struct ofpbuf_shared {
+    unsigned int n_refs;        /* Creator's reference plus one per ofpbuf. */
+    void *data;                 /* malloc()'d memory. */
+};
+
+/* Creates and returns a new shared block of 'size' bytes.  The caller holds
+ * a reference to it, which it must release with ofpbuf_shared_unref(). */
+struct ofpbuf_shared *
+ofpbuf_shared_new(size_t size)
+{
+    struct ofpbuf_shared *sh = xmalloc(sizeof *sh);
+    sh->n_refs = 1;
+    sh->data = xmalloc(size);
+    return sh;
+}
+
+/* Returns the first byte of 'sh''s memory. */
+void *
+ofpbuf_shared_data(const struct ofpbuf_shared *sh)
+{
+    return sh->data;
+}
+
+/* Returns true if ofpbufs other than the caller's reference to 'sh' still
+ * point into it, so that the caller must not overwrite its memory. */
+bool
+ofpbuf_shared_is_shared(const struct ofpbuf_shared *sh)
+{
+    return sh->n_refs > 1;
+}
+
+/* Releases a reference to 'sh', freeing it if it was the last one. */
+void
+ofpbuf_shared_unref(struct ofpbuf_shared *sh)
+{
+    if (sh && !--sh->n_refs) {
+        free(sh->data);
+        free(sh);
+    }
+}
+
+/* Creates and returns a new ofpbuf whose data is the 'size' bytes at 'data',
+ * which must lie within 'sh''s memory.  The new ofpbuf has no headroom or
+ * tailroom, so that adding to it copies it to memory of its own instead of
+ * overwriting its neighbors in 'sh'. */
+struct ofpbuf *
+ofpbuf_new_shared(struct ofpbuf_shared *sh, void *data, size_t size)
+{
+    struct ofpbuf *b = xmalloc(sizeof *b);
+    ofpbuf_use(b, data, size);
+    b->size = size;
+    b->shared = sh;
+    sh->n_refs++;
+    return b;
+}
+
 /* Returns the number of bytes of headroom in 'b', that is, the number of bytes
  * of unused space in ofpbuf 'b' before the data that is in use.  (Most
  * commonly, the data in a ofpbuf is at its beginning, and thus the ofpbuf's
@@ -143,7 +217,12 @@ ofpbuf_prealloc_tailroom(struct ofpbuf *b, size_t size)
         void *new_base = xmalloc(new_allocated);
         uintptr_t base_delta = (char*)new_base - (char*)b->base;
         memcpy(new_base, b->base, b->allocated);
-        free(b->base);
+        if (b->shared) {
+            ofpbuf_shared_unref(b->shared);
+            b->shared = NULL;
+        } else {
+            free(b->base);
+        }
         b->base = new_base;
         b->allocated = new_allocated;
         b->data = (char*)b->data + base_delta;
@@ -34,7 +34,11 @@
 #ifndef OFPBUF_H
 #define OFPBUF_H 1
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+struct ofpbuf_shared;
 
 /* Buffer for holding arbitrary data.  An ofpbuf is automatically reallocated
  * as necessary if it grows too large for the available memory. */
@@ -52,6 +56,14 @@ struct ofpbuf {
 
     struct ofpbuf *next;        /* Next in a list of ofpbufs. */
     void *private;              /* Private pointer for use by owner. */
+    struct ofpbuf_shared *shared; /* Memory that 'base' points into, if it is
+                                   * shared with other ofpbufs, else null. */
+
+    /* Offload state of a packet received from a network device in GSO mode
+     * (see netdev_set_gso()).  All-zero for other buffers. */
+    uint16_t gso_size;          /* Payload bytes per segment, 0 if not GSO. */
+    uint8_t gso_type;           /* VIRTIO_NET_HDR_GSO_* value. */
+    bool csum_partial;          /* L4 checksum covers only pseudo-header? */
 };
 
 void ofpbuf_use(struct ofpbuf *, void *, size_t);
@@ -65,6 +77,12 @@ struct ofpbuf *ofpbuf_clone(const struct ofpbuf *);
 struct ofpbuf *ofpbuf_clone_data(const void *, size_t);
 void ofpbuf_delete(struct ofpbuf *);
 
+struct ofpbuf_shared *ofpbuf_shared_new(size_t);
+void *ofpbuf_shared_data(const struct ofpbuf_shared *);
+bool ofpbuf_shared_is_shared(const struct ofpbuf_shared *);
+void ofpbuf_shared_unref(struct ofpbuf_shared *);
+struct ofpbuf *ofpbuf_new_shared(struct ofpbuf_shared *, void *, size_t);
+
 void *ofpbuf_at(const struct ofpbuf *, size_t offset, size_t size);
 void *ofpbuf_at_assert(const struct ofpbuf *, size_t offset, size_t size);
 void *ofpbuf_tail(const struct ofpbuf *);
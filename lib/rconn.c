@@ -33,6 +33,7 @@
 
 #include <config.h>
 #include "rconn.h"
+#include <arpa/inet.h>
 #include <assert.h>
 #include <errno.h>
 #include <limits.h>
@@ -40,6 +41,7 @@
 #include <string.h>
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
+#include "openflow/openflow-ext.h"
 #include "poll-loop.h"
 #include "sat-math.h"
 #include "timeval.h"
@@ -85,6 +87,12 @@ struct rconn {
     bool reliable;
 
     struct ofp_queue txq;
+    size_t n_txq_counted;       /* Head of 'txq' already in 'ofps_sent'. */
+
+    /* Messages of the types in 'keep_types' that were still in 'txq' when the
+     * last connection dropped, for rconn_pop_unsent() to hand back. */
+    uint32_t keep_types;        /* Bitmap of OFPT_* types. */
+    struct ofp_queue unsent;
 
     int backoff;
     int max_backoff;
@@ -130,7 +138,7 @@ struct rconn {
 
     /* Messages sent or received are copied to the monitor connections. */
 #define MAX_MONITORS 8
-    struct vconn *monitors[8];
+    struct rconn_monitor *monitors[MAX_MONITORS];
     size_t n_monitors;
 
     /* Protocol statistical informaition. */
@@ -140,6 +148,31 @@ struct rconn {
     uint32_t idle_echo_xid;
 };
 
+/* A connection to which messages sent and received on an rconn are copied.
+ *
+ * Copies wait in a queue of their own, so that a slow monitor only loses
+ * copies and never holds up the rconn.  The monitor may narrow down which
+ * messages it gets with an OFP_EXT_MONITOR_CONFIG message. */
+struct rconn_monitor {
+    struct vconn *vconn;
+    struct ofp_queue txq;       /* Copies not yet sent. */
+
+    /* Filter, from the monitor's latest OFP_EXT_MONITOR_CONFIG. */
+    uint32_t types;             /* Bitmap of OFPT_* types to copy. */
+    uint16_t *ports;            /* Ports to copy messages for, if any. */
+    size_t n_ports;
+    uint32_t sample;            /* Copy 1 in this many messages. */
+    uint32_t countdown;         /* Messages to skip before the next copy. */
+    size_t max_bytes;           /* Maximum length of a copy. */
+
+    /* Statistics. */
+    unsigned long long int n_copied;  /* Copies queued. */
+    unsigned long long int n_dropped; /* Copies dropped because txq was full. */
+};
+
+/* Maximum number of copies queued for a monitor. */
+#define MONITOR_MAX_TXQ 128
+
 static unsigned int elapsed_in_this_state(const struct rconn *);
 static unsigned int timeout(const struct rconn *);
 static bool timed_out(const struct rconn *);
@@ -150,6 +183,8 @@ static void disconnect(struct rconn *, int error);
 static void flush_queue(struct rconn *);
 static void question_connectivity(struct rconn *);
 static void copy_to_monitor(struct rconn *, const struct ofpbuf *);
+static void run_monitors(struct rconn *);
+static void close_monitor(struct rconn *, size_t idx, int error);
 static bool is_connected_state(enum state);
 static bool is_admitted_msg(const struct ofpbuf *);
 
@@ -196,6 +231,10 @@ rconn_create(int probe_interval, int max_backoff)
     rc->reliable = false;
 
     queue_init(&rc->txq);
+    rc->n_txq_counted = 0;
+
+    rc->keep_types = 0;
+    queue_init(&rc->unsent);
 
     rc->backoff = 0;
     rc->max_backoff = max_backoff ? max_backoff : 60;
@@ -278,14 +317,13 @@ void
 rconn_destroy(struct rconn *rc)
 {
     if (rc) {
-        size_t i;
-
         free(rc->name);
         vconn_close(rc->vconn);
         flush_queue(rc);
         queue_destroy(&rc->txq);
-        for (i = 0; i < rc->n_monitors; i++) {
-            vconn_close(rc->monitors[i]);
+        queue_destroy(&rc->unsent);
+        while (rc->n_monitors > 0) {
+            close_monitor(rc, rc->n_monitors - 1, 0);
         }
         free(rc);
     }
@@ -352,6 +390,7 @@ run_CONNECTING(struct rconn *rc)
     if (!retval) {
         VLOG_INFO("%s: connected", rc->name);
         rc->n_successful_connections++;
+        queue_clear(&rc->unsent);
         state_transition(rc, S_ACTIVE);
         rc->last_connected = rc->state_entered;
     } else if (retval != EAGAIN) {
@@ -448,6 +487,8 @@ rconn_run(struct rconn *rc)
             NOT_REACHED();
         }
     } while (rc->state != old_state);
+
+    run_monitors(rc);
 }
 
 /* Causes the next call to poll_block() to wake up when rconn_run() should be
@@ -456,6 +497,8 @@ void
 rconn_run_wait(struct rconn *rc)
 {
     unsigned int timeo = timeout(rc);
+    size_t i;
+
     if (timeo != UINT_MAX) {
         unsigned int expires = sat_add(rc->state_entered, timeo);
         unsigned int remaining = sat_sub(expires, time_now());
@@ -465,6 +508,14 @@ rconn_run_wait(struct rconn *rc)
     if ((rc->state & (S_ACTIVE | S_IDLE)) && rc->txq.n) {
         vconn_wait(rc->vconn, WAIT_SEND);
     }
+
+    for (i = 0; i < rc->n_monitors; i++) {
+        struct rconn_monitor *m = rc->monitors[i];
+        vconn_wait(m->vconn, WAIT_RECV);
+        if (m->txq.n) {
+            vconn_wait(m->vconn, WAIT_SEND);
+        }
+    }
 }
 
 /* Attempts to receive a packet from 'rc'.  If successful, returns the packet;
@@ -525,9 +576,11 @@ rconn_recv_wait(struct rconn *rc)
  *
  * If 'n_queued' is non-null, then '*n_queued' will be incremented while the
  * packet is in flight, then decremented when it has been sent (or discarded
- * due to disconnection).  Because 'b' may be sent (or discarded) before this
- * function returns, the caller may not be able to observe any change in
- * '*n_queued'.
+ * due to disconnection).
+ *
+ * 'b' is only queued here.  The next call to rconn_run() transmits it along
+ * with everything else queued by then, so that a burst of messages goes out
+ * in a few system calls instead of one apiece.
  *
  * There is no rconn_send_wait() function: an rconn has a send queue that it
  * takes care of sending if you call rconn_run(), which will have the side
@@ -542,14 +595,6 @@ rconn_send(struct rconn *rc, struct ofpbuf *b, int *n_queued)
             ++*n_queued;
         }
         queue_push_tail(&rc->txq, b);
-
-        /* If the queue was empty before we added 'b', try to send some
-         * packets.  (But if the queue had packets in it, it's because the
-         * vconn is backlogged and there's no point in stuffing more into it
-         * now.  We'll get back to that in rconn_run().) */
-        if (rc->txq.n == 1) {
-            try_send(rc);
-        }
         return 0;
     } else {
         return ENOTCONN;
@@ -562,8 +607,9 @@ rconn_send(struct rconn *rc, struct ofpbuf *b, int *n_queued)
  * at least as large as 'queue_limit', or ENOTCONN if 'rc' is not currently
  * connected.  Regardless of return value, 'b' is destroyed.
  *
- * Because 'b' may be sent (or discarded) before this function returns, the
- * caller may not be able to observe any change in '*n_queued'.
+ * If '*n_queued' has reached 'queue_limit', this function first tries to
+ * transmit what is queued, so that a caller producing a burst of messages
+ * only sees EAGAIN if the vconn is really backlogged.
  *
  * There is no rconn_send_wait() function: an rconn has a send queue that it
  * takes care of sending if you call rconn_run(), which will have the side
@@ -573,6 +619,9 @@ rconn_send_with_limit(struct rconn *rc, struct ofpbuf *b,
                       int *n_queued, int queue_limit)
 {
     int retval;
+    if (*n_queued >= queue_limit && rconn_is_connected(rc)) {
+        do_tx_work(rc);
+    }
     retval = *n_queued >= queue_limit ? EAGAIN : rconn_send(rc, b, n_queued);
     if (retval) {
         ofpbuf_delete(b);
@@ -580,6 +629,65 @@ rconn_send_with_limit(struct rconn *rc, struct ofpbuf *b,
     return retval;
 }
 
+/* Asks 'rc' to keep the messages whose OFPT_* types are in the bitmap 'types'
+ * that it still has queued when its connection drops, instead of discarding
+ * them, so that they can be passed along to another peer.  Such messages may
+ * be retrieved with rconn_pop_unsent() until 'rc' connects again or its
+ * next connection drops. */
+void
+rconn_keep_unsent(struct rconn *rc, uint32_t types)
+{
+    rc->keep_types = types;
+}
+
+/* Removes and returns the oldest of the messages that 'rc' kept, according
+ * to rconn_keep_unsent(), when its last connection dropped, or a null pointer
+ * if there are none left.  The caller is responsible for freeing the
+ * message. */
+struct ofpbuf *
+rconn_pop_unsent(struct rconn *rc)
+{
+    return rc->unsent.n ? queue_pop_head(&rc->unsent) : NULL;
+}
+
+/* Exchanges the connections of 'a' and 'b': afterward each of them is
+ * connected, connecting or backing off, with the same name and send queue,
+ * as the other one was before.  Everything else, such as statistics,
+ * monitors and the inactivity probe interval, stays with the rconn.
+ *
+ * This allows a connection to a peer that was set up in advance to take the
+ * place of one that has failed, without the users of the latter rconn having
+ * to know. */
+void
+rconn_swap_connection(struct rconn *a, struct rconn *b)
+{
+    struct rconn tmp = *a;
+
+#define SWAP_FIELD(FIELD) (a->FIELD = b->FIELD, b->FIELD = tmp.FIELD)
+    SWAP_FIELD(state);
+    SWAP_FIELD(state_entered);
+    SWAP_FIELD(vconn);
+    SWAP_FIELD(name);
+    SWAP_FIELD(reliable);
+    SWAP_FIELD(txq);
+    SWAP_FIELD(n_txq_counted);
+    SWAP_FIELD(backoff);
+    SWAP_FIELD(backoff_deadline);
+    SWAP_FIELD(last_received);
+    SWAP_FIELD(last_connected);
+    SWAP_FIELD(probably_admitted);
+    SWAP_FIELD(last_admitted);
+    SWAP_FIELD(questionable_connectivity);
+    SWAP_FIELD(last_questioned);
+    SWAP_FIELD(idle_echo_xid);
+#undef SWAP_FIELD
+
+    /* Each rconn now has a different connection. */
+    a->seqno++;
+    b->seqno++;
+    poll_immediate_wake();
+}
+
 /* Returns the total number of packets successfully sent on the underlying
  * vconn.  A packet is not counted as sent while it is still queued in the
  * rconn, only when it has been successfuly passed to the vconn.  */
@@ -590,13 +698,22 @@ rconn_packets_sent(const struct rconn *rc)
 }
 
 /* Adds 'vconn' to 'rc' as a monitoring connection, to which all messages sent
- * and received on 'rconn' will be copied.  'rc' takes ownership of 'vconn'. */
+ * and received on 'rconn' will be copied (unless the monitor asks for fewer
+ * with an OFP_EXT_MONITOR_CONFIG message).  'rc' takes ownership of
+ * 'vconn'. */
 void
 rconn_add_monitor(struct rconn *rc, struct vconn *vconn)
 {
     if (rc->n_monitors < ARRAY_SIZE(rc->monitors)) {
+        struct rconn_monitor *m = xcalloc(1, sizeof *m);
+
         VLOG_INFO("new monitor connection from %s", vconn_get_name(vconn));
-        rc->monitors[rc->n_monitors++] = vconn;
+        m->vconn = vconn;
+        queue_init(&m->txq);
+        m->types = UINT32_MAX;
+        m->sample = m->countdown = 1;
+        m->max_bytes = SIZE_MAX;
+        rc->monitors[rc->n_monitors++] = m;
     } else {
         VLOG_DBG("too many monitor connections, discarding %s",
                  vconn_get_name(vconn));
@@ -604,6 +721,38 @@ rconn_add_monitor(struct rconn *rc, struct vconn *vconn)
     }
 }
 
+/* Returns the number of monitoring connections attached to 'rc'.  They are
+ * numbered 0 through one less than the return value, but the numbering of
+ * the remaining monitors changes when one is closed. */
+size_t
+rconn_count_monitors(const struct rconn *rc)
+{
+    return rc->n_monitors;
+}
+
+/* Returns the name of monitoring connection 'idx' on 'rc'. */
+const char *
+rconn_monitor_name(const struct rconn *rc, size_t idx)
+{
+    return vconn_get_name(rc->monitors[idx]->vconn);
+}
+
+/* Returns the number of messages copied to monitoring connection 'idx' on
+ * 'rc'. */
+unsigned long long int
+rconn_monitor_copied(const struct rconn *rc, size_t idx)
+{
+    return rc->monitors[idx]->n_copied;
+}
+
+/* Returns the number of messages that monitoring connection 'idx' on 'rc'
+ * asked for but lost because it was not keeping up. */
+unsigned long long int
+rconn_monitor_dropped(const struct rconn *rc, size_t idx)
+{
+    return rc->monitors[idx]->n_dropped;
+}
+
 /* Returns 'rc''s name (the 'name' argument passed to rconn_new()). */
 const char *
 rconn_get_name(const struct rconn *rc)
@@ -771,31 +920,60 @@ rconn_update_protocol_stat(struct rconn *rconn,
     *ofps_sent = rconn->ofps_sent;
 }
 
-/* Tries to send a packet from 'rc''s send buffer.  Returns 0 if successful,
- * otherwise a positive errno value. */
+/* Maximum number of bytes, and of messages, that try_send() passes to the
+ * vconn at once. */
+#define RCONN_TX_BUDGET (256 * 1024)
+#define RCONN_TX_BATCH 512
+
+/* Tries to send the packets at the head of 'rc''s send queue, handing as many
+ * of them to the vconn at once as fit within RCONN_TX_BUDGET.  Returns 0 if
+ * all of those were accepted, otherwise a positive errno value. */
 static int
 try_send(struct rconn *rc)
 {
-    int retval = 0;
-    struct ofpbuf *next = rc->txq.head->next;
-    struct ofp_header *h = rc->txq.head->data;
-    int *n_queued = rc->txq.head->private;
-    ofpstat_inc_protocol_stat(&rc->ofps_sent, h);
-    rc->idle_echo_xid = h->xid;
-    retval = vconn_send(rc->vconn, rc->txq.head);
-    if (retval) {
-        rc->idle_echo_xid = 0;
-        if (retval != EAGAIN) {
-            disconnect(rc, retval);
+    struct ofpbuf *batch[RCONN_TX_BATCH];
+    int *n_queued[RCONN_TX_BATCH];
+    uint32_t xids[RCONN_TX_BATCH];
+    struct ofpbuf *next;
+    size_t n_bytes = 0;
+    size_t n_sent;
+    size_t n = 0;
+    size_t i;
+    int retval;
+
+    for (next = rc->txq.head; next && n < RCONN_TX_BATCH; next = next->next) {
+        struct ofp_header *h = next->data;
+        if (n && n_bytes + next->size > RCONN_TX_BUDGET) {
+            break;
+        }
+        n_bytes += next->size;
+        if (n >= rc->n_txq_counted) {
+            /* Count each packet once, however many tries it takes to send. */
+            ofpstat_inc_protocol_stat(&rc->ofps_sent, h);
         }
-        return retval;
+        n_queued[n] = next->private;
+        xids[n] = h->xid;
+        batch[n++] = next;
     }
-    rc->packets_sent++;
-    if (n_queued) {
-        --*n_queued;
+    rc->n_txq_counted = MAX(rc->n_txq_counted, n);
+
+    /* The vconn may destroy the packets it accepts, so everything needed from
+     * them has to be gathered first. */
+    retval = vconn_send_batch(rc->vconn, batch, n, &n_sent);
+    for (i = 0; i < n_sent; i++) {
+        if (n_queued[i]) {
+            --*n_queued[i];
+        }
+        queue_advance_head(&rc->txq, i + 1 < n ? batch[i + 1] : next);
     }
-    queue_advance_head(&rc->txq, next);
-    return 0;
+    rc->n_txq_counted -= n_sent;
+    rc->packets_sent += n_sent;
+    rc->idle_echo_xid = n_sent ? xids[n_sent - 1] : 0;
+
+    if (retval && retval != EAGAIN) {
+        disconnect(rc, retval);
+    }
+    return retval;
 }
 
 /* Disconnects 'rc'.  'error' is used only for logging purposes.  If it is
@@ -820,6 +998,7 @@ disconnect(struct rconn *rc, int error)
             }
             vconn_close(rc->vconn);
             rc->vconn = NULL;
+            queue_clear(&rc->unsent);
             flush_queue(rc);
         }
 
@@ -841,20 +1020,28 @@ disconnect(struct rconn *rc, int error)
 }
 
 /* Drops all the packets from 'rc''s send queue and decrements their queue
- * counts. */
+ * counts.  Packets of the types that rconn_keep_unsent() asked for are moved
+ * to 'rc->unsent' instead of being destroyed. */
 static void
 flush_queue(struct rconn *rc)
 {
     if (!rc->txq.n) {
         return;
     }
+    rc->n_txq_counted = 0;
     while (rc->txq.n > 0) {
         struct ofpbuf *b = queue_pop_head(&rc->txq);
+        struct ofp_header *oh = b->data;
         int *n_queued = b->private;
         if (n_queued) {
             --*n_queued;
         }
-        ofpbuf_delete(b);
+        if (oh->type < 32 && rc->keep_types & (UINT32_C(1) << oh->type)) {
+            b->private = NULL;
+            queue_push_tail(&rc->unsent, b);
+        } else {
+            ofpbuf_delete(b);
+        }
     }
     poll_immediate_wake();
 }
@@ -908,32 +1095,245 @@ question_connectivity(struct rconn *rc)
     }
 }
 
+/* If 'b' is a message that concerns a single port, stores the port's number
+ * in '*port' and returns true.  Otherwise returns false. */
+static bool
+get_msg_port(const struct ofpbuf *b, uint16_t *port)
+{
+    const struct ofp_header *oh = b->data;
+    const struct ofp_match *match;
+
+    switch (oh->type) {
+    case OFPT_PACKET_IN:
+        if (b->size >= offsetof(struct ofp_packet_in, data)) {
+            *port = ntohs(((const struct ofp_packet_in *) oh)->in_port);
+            return true;
+        }
+        return false;
+
+    case OFPT_PACKET_OUT:
+        if (b->size >= sizeof(struct ofp_packet_out)) {
+            *port = ntohs(((const struct ofp_packet_out *) oh)->in_port);
+            return true;
+        }
+        return false;
+
+    case OFPT_PORT_STATUS:
+        if (b->size >= sizeof(struct ofp_port_status)) {
+            *port = ntohs(((const struct ofp_port_status *) oh)->desc.port_no);
+            return true;
+        }
+        return false;
+
+    case OFPT_PORT_MOD:
+        if (b->size >= sizeof(struct ofp_port_mod)) {
+            *port = ntohs(((const struct ofp_port_mod *) oh)->port_no);
+            return true;
+        }
+        return false;
+
+    case OFPT_FLOW_MOD:
+        if (b->size < sizeof(struct ofp_flow_mod)) {
+            return false;
+        }
+        match = &((const struct ofp_flow_mod *) oh)->match;
+        break;
+
+    case OFPT_FLOW_REMOVED:
+        if (b->size < sizeof(struct ofp_flow_removed)) {
+            return false;
+        }
+        match = &((const struct ofp_flow_removed *) oh)->match;
+        break;
+
+    default:
+        return false;
+    }
+
+    if (match->wildcards & htonl(OFPFW_IN_PORT)) {
+        return false;
+    }
+    *port = ntohs(match->in_port);
+    return true;
+}
+
+/* Returns true if 'm' should get a copy of 'b'. */
+static bool
+monitor_wants(struct rconn_monitor *m, const struct ofpbuf *b)
+{
+    const struct ofp_header *oh = b->data;
+    uint16_t port;
+
+    if (oh->type < 32 && !(m->types & (UINT32_C(1) << oh->type))) {
+        return false;
+    }
+    if (m->n_ports && get_msg_port(b, &port)) {
+        size_t i;
+
+        for (i = 0; i < m->n_ports; i++) {
+            if (m->ports[i] == port) {
+                break;
+            }
+        }
+        if (i >= m->n_ports) {
+            return false;
+        }
+    }
+    if (--m->countdown) {
+        return false;
+    }
+    m->countdown = m->sample;
+    return true;
+}
+
+/* Queues a copy of 'b' for each of 'rc''s monitors that wants one.  The
+ * copies are sent by rconn_run(). */
 static void
 copy_to_monitor(struct rconn *rc, const struct ofpbuf *b)
 {
-    struct ofpbuf *clone = NULL;
+    size_t i;
+
+    for (i = 0; i < rc->n_monitors; i++) {
+        struct rconn_monitor *m = rc->monitors[i];
+        struct ofpbuf *copy;
+
+        if (!monitor_wants(m, b)) {
+            continue;
+        } else if (m->txq.n >= MONITOR_MAX_TXQ) {
+            m->n_dropped++;
+            continue;
+        }
+
+        copy = ofpbuf_clone_data(b->data, MIN(b->size, m->max_bytes));
+        if (copy->size < b->size) {
+            struct ofp_header *oh = copy->data;
+            oh->length = htons(copy->size);
+        }
+        queue_push_tail(&m->txq, copy);
+        m->n_copied++;
+    }
+}
+
+/* Applies 'config', received from 'm', to 'm'. */
+static void
+configure_monitor(struct rconn_monitor *m, const struct ofpbuf *config)
+{
+    const struct openflow_monitor_config *omc = config->data;
+    size_t i;
+
+    m->types = ntohl(omc->types);
+    m->sample = MAX(ntohl(omc->sample), 1);
+    m->countdown = 1;
+    m->max_bytes = (omc->max_bytes
+                    ? MAX(ntohs(omc->max_bytes), sizeof(struct ofp_header))
+                    : SIZE_MAX);
+
+    free(m->ports);
+    m->n_ports = (config->size - sizeof *omc) / sizeof *omc->ports;
+    m->ports = xmalloc(m->n_ports * sizeof *m->ports);
+    for (i = 0; i < m->n_ports; i++) {
+        m->ports[i] = ntohs(omc->ports[i]);
+    }
+}
+
+/* Handles the messages that 'm' has sent us, which may change what it wants
+ * to receive.  Returns 0 if successful, otherwise a positive errno value that
+ * means that 'm' should be closed. */
+static int
+recv_from_monitor(struct rconn_monitor *m)
+{
+    int i;
+
+    for (i = 0; i < 50; i++) {
+        const struct openflow_monitor_config *omc;
+        struct ofpbuf *b;
+        int retval;
+
+        retval = vconn_recv(m->vconn, &b);
+        if (retval) {
+            return retval == EAGAIN ? 0 : retval;
+        }
+
+        omc = b->data;
+        if (b->size >= sizeof *omc
+            && omc->header.header.type == OFPT_VENDOR
+            && omc->header.vendor == htonl(OPENFLOW_VENDOR_ID)
+            && omc->header.subtype == htonl(OFP_EXT_MONITOR_CONFIG)) {
+            VLOG_DBG("%s: new monitor configuration",
+                     vconn_get_name(m->vconn));
+            configure_monitor(m, b);
+        }
+        ofpbuf_delete(b);
+    }
+    return 0;
+}
+
+/* Sends as many of the copies queued for 'm' as it will take without
+ * blocking.  Returns 0 if successful, otherwise a positive errno value that
+ * means that 'm' should be closed. */
+static int
+send_to_monitor(struct rconn_monitor *m)
+{
+    struct ofpbuf *batch[MONITOR_MAX_TXQ];
+    struct ofpbuf *next;
+    size_t n_sent;
+    size_t n = 0;
+    size_t i;
     int retval;
+
+    if (!m->txq.n) {
+        return 0;
+    }
+    for (next = m->txq.head; next; next = next->next) {
+        batch[n++] = next;
+    }
+    retval = vconn_send_batch(m->vconn, batch, n, &n_sent);
+    for (i = 0; i < n_sent; i++) {
+        queue_advance_head(&m->txq, i + 1 < n ? batch[i + 1] : NULL);
+    }
+    return retval == EAGAIN ? 0 : retval;
+}
+
+/* Receives configuration from and sends queued copies to 'rc''s monitors,
+ * closing those that have failed. */
+static void
+run_monitors(struct rconn *rc)
+{
     size_t i;
 
     for (i = 0; i < rc->n_monitors; ) {
-        struct vconn *vconn = rc->monitors[i];
-
-        if (!clone) {
-            clone = ofpbuf_clone(b);
+        struct rconn_monitor *m = rc->monitors[i];
+        int error = recv_from_monitor(m);
+        if (!error) {
+            error = send_to_monitor(m);
         }
-        retval = vconn_send(vconn, clone);
-        if (!retval) {
-            clone = NULL;
-        } else if (retval != EAGAIN) {
-            VLOG_DBG("%s: closing monitor connection to %s: %s",
-                     rconn_get_name(rc), vconn_get_name(vconn),
-                     strerror(retval));
-            rc->monitors[i] = rc->monitors[--rc->n_monitors];
-            continue;
+        if (error) {
+            close_monitor(rc, i, error);
+        } else {
+            i++;
         }
-        i++;
     }
-    ofpbuf_delete(clone);
+}
+
+/* Closes and removes monitor 'idx' from 'rc' because of 'error' (0 if 'rc'
+ * is being destroyed). */
+static void
+close_monitor(struct rconn *rc, size_t idx, int error)
+{
+    struct rconn_monitor *m = rc->monitors[idx];
+
+    if (error) {
+        VLOG_INFO("%s: closing monitor connection to %s: %s "
+                  "(%llu messages copied, %llu dropped)",
+                  rconn_get_name(rc), vconn_get_name(m->vconn),
+                  error == EOF ? "connection closed" : strerror(error),
+                  m->n_copied, m->n_dropped);
+    }
+    vconn_close(m->vconn);
+    queue_destroy(&m->txq);
+    free(m->ports);
+    free(m);
+    rc->monitors[idx] = rc->monitors[--rc->n_monitors];
 }
 
 static bool
@@ -36,6 +36,7 @@
 
 #include "queue.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <time.h>
 
@@ -71,10 +72,17 @@ void rconn_recv_wait(struct rconn *);
 int rconn_send(struct rconn *, struct ofpbuf *, int *n_queued);
 int rconn_send_with_limit(struct rconn *, struct ofpbuf *,
                           int *n_queued, int queue_limit);
+void rconn_keep_unsent(struct rconn *, uint32_t types);
+struct ofpbuf *rconn_pop_unsent(struct rconn *);
+void rconn_swap_connection(struct rconn *, struct rconn *);
 unsigned int rconn_packets_sent(const struct rconn *);
 unsigned int rconn_packets_received(const struct rconn *);
 
 void rconn_add_monitor(struct rconn *, struct vconn *);
+size_t rconn_count_monitors(const struct rconn *);
+const char *rconn_monitor_name(const struct rconn *, size_t idx);
+unsigned long long int rconn_monitor_copied(const struct rconn *, size_t idx);
+unsigned long long int rconn_monitor_dropped(const struct rconn *, size_t idx);
 
 const char *rconn_get_name(const struct rconn *);
 bool rconn_is_alive(const struct rconn *);
@@ -0,0 +1,314 @@
+/* Copyright (c) 2008, 2009 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "vconn.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "list.h"
+#include "ofpbuf.h"
+#include "poll-loop.h"
+#include "queue.h"
+#include "util.h"
+#include "vconn-provider.h"
+
+#include "vlog.h"
+#define THIS_MODULE VLM_vconn_mem
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 5);
+
+/* In-process vconns.
+ *
+ * A "mem:NAME" vconn connects to a "pmem:NAME" pvconn opened earlier in the
+ * same process.  Each message is handed to the peer by passing the ofpbuf
+ * itself, so nothing is copied, serialized, or sent through the kernel.
+ *
+ * Both ends must be run from the same thread and the same poll loop.  The
+ * peer of a vconn only ever changes state while its owner is running, that
+ * is, before the wait functions are called, so a wait function can tell
+ * whether the vconn is ready just by looking at it and never needs to wait
+ * for anything else. */
+
+/* Maximum number of messages queued in either direction, so that a sender
+ * that outpaces its receiver sees EAGAIN and applies its own queue limits,
+ * just as it would with a socket. */
+#define MEM_MAX_QUEUE 1024
+
+struct mem_vconn {
+    struct vconn vconn;
+    struct mem_vconn *peer;     /* Null once the peer has closed. */
+    struct ofp_queue rxq;       /* Messages sent by 'peer'. */
+};
+
+struct pmem_pvconn {
+    struct pvconn pvconn;
+    struct list node;           /* In 'pmem_pvconns'. */
+    char *suffix;               /* NAME from "pmem:NAME". */
+
+    /* Connections not yet accepted. */
+    struct mem_vconn **pending;
+    size_t n_pending, allocated_pending;
+};
+
+/* All the open pmem pvconns. */
+static struct list pmem_pvconns = LIST_INITIALIZER(&pmem_pvconns);
+
+static struct mem_vconn *
+mem_vconn_cast(struct vconn *vconn)
+{
+    vconn_assert_class(vconn, &mem_vconn_class);
+    return CONTAINER_OF(vconn, struct mem_vconn, vconn);
+}
+
+static struct mem_vconn *
+new_mem_vconn(const char *name)
+{
+    struct mem_vconn *m = xmalloc(sizeof *m);
+    vconn_init(&m->vconn, &mem_vconn_class, 0, 0, name, true);
+    m->peer = NULL;
+    queue_init(&m->rxq);
+    return m;
+}
+
+static void
+mem_close(struct vconn *vconn)
+{
+    struct mem_vconn *m = mem_vconn_cast(vconn);
+    if (m->peer) {
+        m->peer->peer = NULL;
+    }
+    queue_destroy(&m->rxq);
+    free(m);
+}
+
+static int
+mem_connect(struct vconn *vconn UNUSED)
+{
+    return 0;
+}
+
+static int
+mem_recv(struct vconn *vconn, struct ofpbuf **bufferp)
+{
+    struct mem_vconn *m = mem_vconn_cast(vconn);
+
+    if (m->rxq.n) {
+        *bufferp = queue_pop_head(&m->rxq);
+        return 0;
+    }
+    return m->peer ? EAGAIN : EOF;
+}
+
+static int
+mem_send_batch(struct vconn *vconn, struct ofpbuf *msgs[], size_t n,
+               size_t *n_sentp)
+{
+    struct mem_vconn *m = mem_vconn_cast(vconn);
+    struct mem_vconn *peer = m->peer;
+    size_t i;
+
+    *n_sentp = 0;
+    if (!peer) {
+        return EPIPE;
+    }
+    for (i = 0; i < n && peer->rxq.n < MEM_MAX_QUEUE; i++) {
+        msgs[i]->private = NULL;
+        queue_push_tail(&peer->rxq, msgs[i]);
+    }
+    *n_sentp = i;
+    return i < n ? EAGAIN : 0;
+}
+
+static int
+mem_send(struct vconn *vconn, struct ofpbuf *buffer)
+{
+    size_t n_sent;
+    return mem_send_batch(vconn, &buffer, 1, &n_sent);
+}
+
+static void
+mem_wait(struct vconn *vconn, enum vconn_wait_type wait)
+{
+    struct mem_vconn *m = mem_vconn_cast(vconn);
+    bool ready;
+
+    switch (wait) {
+    case WAIT_CONNECT:
+        ready = true;
+        break;
+
+    case WAIT_RECV:
+        ready = m->rxq.n || !m->peer;
+        break;
+
+    case WAIT_SEND:
+        ready = !m->peer || m->peer->rxq.n < MEM_MAX_QUEUE;
+        break;
+
+    default:
+        NOT_REACHED();
+    }
+
+    /* Otherwise there is nothing to wait for here: the peer can only send
+     * on 'vconn', or make room for it to send, while it runs. */
+    if (ready) {
+        poll_immediate_wake();
+    }
+}
+
+static struct pmem_pvconn *
+pmem_find(const char *suffix)
+{
+    struct pmem_pvconn *pm;
+
+    LIST_FOR_EACH (pm, struct pmem_pvconn, node, &pmem_pvconns) {
+        if (!strcmp(pm->suffix, suffix)) {
+            return pm;
+        }
+    }
+    return NULL;
+}
+
+static int
+mem_open(const char *name, char *suffix, struct vconn **vconnp)
+{
+    struct pmem_pvconn *pm = pmem_find(suffix);
+    struct mem_vconn *active, *passive;
+
+    if (!pm) {
+        VLOG_ERR_RL(&rl, "%s: no such in-process listener", name);
+        return ECONNREFUSED;
+    }
+
+    active = new_mem_vconn(name);
+    passive = new_mem_vconn(name);
+    active->peer = passive;
+    passive->peer = active;
+
+    if (pm->n_pending >= pm->allocated_pending) {
+        pm->pending = x2nrealloc(pm->pending, &pm->allocated_pending,
+                                 sizeof *pm->pending);
+    }
+    pm->pending[pm->n_pending++] = passive;
+
+    *vconnp = &active->vconn;
+    return 0;
+}
+
+struct vconn_class mem_vconn_class = {
+    "mem",                      /* name */
+    mem_open,                   /* open */
+    mem_close,                  /* close */
+    mem_connect,                /* connect */
+    mem_recv,                   /* recv */
+    mem_send,                   /* send */
+    mem_wait,                   /* wait */
+    mem_send_batch,             /* send_batch */
+};
+
+/* Passive in-process vconn. */
+
+static struct pmem_pvconn *
+pmem_pvconn_cast(struct pvconn *pvconn)
+{
+    pvconn_assert_class(pvconn, &pmem_pvconn_class);
+    return CONTAINER_OF(pvconn, struct pmem_pvconn, pvconn);
+}
+
+static int
+pmem_open(const char *name, char *suffix, struct pvconn **pvconnp)
+{
+    struct pmem_pvconn *pm;
+
+    if (pmem_find(suffix)) {
+        VLOG_ERR("%s: already listening", name);
+        return EADDRINUSE;
+    }
+
+    pm = xmalloc(sizeof *pm);
+    pvconn_init(&pm->pvconn, &pmem_pvconn_class, name);
+    list_push_back(&pmem_pvconns, &pm->node);
+    pm->suffix = xstrdup(suffix);
+    pm->pending = NULL;
+    pm->n_pending = pm->allocated_pending = 0;
+
+    *pvconnp = &pm->pvconn;
+    return 0;
+}
+
+static void
+pmem_close(struct pvconn *pvconn)
+{
+    struct pmem_pvconn *pm = pmem_pvconn_cast(pvconn);
+    size_t i;
+
+    for (i = 0; i < pm->n_pending; i++) {
+        mem_close(&pm->pending[i]->vconn);
+    }
+    list_remove(&pm->node);
+    free(pm->pending);
+    free(pm->suffix);
+    free(pm);
+}
+
+static int
+pmem_accept(struct pvconn *pvconn, struct vconn **new_vconnp)
+{
+    struct pmem_pvconn *pm = pmem_pvconn_cast(pvconn);
+
+    if (!pm->n_pending) {
+        return EAGAIN;
+    }
+    *new_vconnp = &pm->pending[0]->vconn;
+    memmove(pm->pending, pm->pending + 1,
+            --pm->n_pending * sizeof *pm->pending);
+    return 0;
+}
+
+static void
+pmem_wait(struct pvconn *pvconn)
+{
+    struct pmem_pvconn *pm = pmem_pvconn_cast(pvconn);
+    if (pm->n_pending) {
+        poll_immediate_wake();
+    }
+}
+
+struct pvconn_class pmem_pvconn_class = {
+    "pmem",
+    pmem_open,
+    pmem_close,
+    pmem_accept,
+    pmem_wait
+};
@@ -154,4 +154,5 @@ struct vconn_class netlink_vconn_class = {
     netlink_recv,               /* recv */
     netlink_send,               /* send */
     netlink_wait,               /* wait */
+    NULL,                       /* send_batch */
 };
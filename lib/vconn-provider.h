@@ -126,6 +126,22 @@ struct vconn_class {
     /* Arranges for the poll loop to wake up when 'vconn' is ready to take an
      * action of the given 'type'. */
     void (*wait)(struct vconn *vconn, enum vconn_wait_type type);
+
+    /* Tries to queue the 'n' messages in 'msgs' for transmission on 'vconn',
+     * in order, stopping at the first one that cannot be accepted.  Stores the
+     * number of messages accepted into '*n_sentp'; ownership of each of those
+     * is transferred to the vconn, as with the send function, and the caller
+     * retains the rest.  Returns 0 if all 'n' messages were accepted,
+     * otherwise a positive errno value (EAGAIN if the vconn cannot take any
+     * more for now).
+     *
+     * The send_batch function must not block.  It should transmit as many of
+     * the messages as it can with as few system calls as it can.
+     *
+     * May be null if the vconn has no better way to transmit several messages
+     * than calling the send function once for each of them. */
+    int (*send_batch)(struct vconn *vconn, struct ofpbuf *msgs[], size_t n,
+                      size_t *n_sentp);
 };
 
 /* Passive virtual connection to an OpenFlow device.
@@ -183,6 +199,8 @@ extern struct vconn_class tcp_vconn_class;
 extern struct pvconn_class ptcp_pvconn_class;
 extern struct vconn_class unix_vconn_class;
 extern struct pvconn_class punix_pvconn_class;
+extern struct vconn_class mem_vconn_class;
+extern struct pvconn_class pmem_pvconn_class;
 #ifdef HAVE_OPENSSL
 extern struct vconn_class ssl_vconn_class;
 extern struct pvconn_class pssl_pvconn_class;
@@ -190,5 +208,9 @@ extern struct pvconn_class pssl_pvconn_class;
 #ifdef HAVE_NETLINK
 extern struct vconn_class netlink_vconn_class;
 #endif
+#ifdef HAVE_SHM_VCONN
+extern struct vconn_class shm_vconn_class;
+extern struct pvconn_class pshm_pvconn_class;
+#endif
 
 #endif /* vconn-provider.h */
@@ -0,0 +1,607 @@
+/* Copyright (c) 2008, 2009 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "vconn.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "poll-loop.h"
+#include "socket-util.h"
+#include "util.h"
+#include "vconn-provider.h"
+#include "vconn-stream.h"
+
+#include "vlog.h"
+#define THIS_MODULE VLM_vconn_shm
+
+/* Shared-memory vconn.
+ *
+ * An "shm:" connection carries OpenFlow messages between two processes on
+ * the same host through a pair of single-producer, single-consumer byte rings
+ * in a memfd that both of them map.  Messages are copied into the ring by the
+ * sender and out of it by the receiver, with no system calls at all while
+ * both sides are busy.
+ *
+ * Each side has an eventfd on which it sleeps when it has nothing to do.  A
+ * consumer that finds its ring empty, or a producer that finds its ring full,
+ * sets a flag in the ring before it sleeps, and the other side writes to the
+ * eventfd only when it finds that flag set.
+ *
+ * The connection is set up over a Unix domain socket: the active side creates
+ * the memfd and both eventfds and passes them to the passive side with
+ * SCM_RIGHTS.  After that the socket carries no data; it only serves to tell
+ * each side when the other one has gone away. */
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(5, 25);
+
+#define SHM_MAGIC 0x4f46534d    /* "OFSM". */
+
+/* Bytes of message data in each direction.  Must be a power of 2 and large
+ * enough for several of the longest possible OpenFlow messages. */
+#define SHM_RING_SIZE (1024 * 1024)
+
+/* Keeps the fields written by the producer and by the consumer on separate
+ * cache lines. */
+#define SHM_CACHE_LINE 64
+
+struct shm_ring {
+    /* Written by the producer (but 'waiting' is cleared by the consumer when
+     * it wakes the producer). */
+    struct {
+        uint32_t head;          /* Bytes ever written, mod 2**32. */
+        int waiting;            /* Producer may sleep until there is room. */
+    } prod __attribute__((aligned(SHM_CACHE_LINE)));
+
+    /* Written by the consumer (but 'waiting' is cleared by the producer when
+     * it wakes the consumer). */
+    struct {
+        uint32_t tail;          /* Bytes ever read, mod 2**32. */
+        int waiting;            /* Consumer may sleep until there is data. */
+    } cons __attribute__((aligned(SHM_CACHE_LINE)));
+
+    uint8_t data[SHM_RING_SIZE] __attribute__((aligned(SHM_CACHE_LINE)));
+};
+
+struct shm_region {
+    uint32_t magic;             /* SHM_MAGIC. */
+    uint32_t ring_size;         /* SHM_RING_SIZE. */
+    uint32_t kicks[2];          /* Writes to side i's eventfd, by the peer. */
+    struct shm_ring rings[2];   /* rings[i] carries messages sent by side i. */
+};
+
+/* Index of each side in 'kicks' and 'rings'. */
+enum { SHM_ACTIVE, SHM_PASSIVE };
+
+struct shm_vconn
+{
+    struct vconn vconn;
+    int side;                   /* SHM_ACTIVE or SHM_PASSIVE. */
+    int sock;                   /* Unix socket to the peer. */
+    int memfd;                  /* Until handed over (active side only). */
+    int efds[2];                /* Each side's eventfd. */
+    struct shm_region *region;  /* Null until set up (passive side only). */
+    struct shm_ring *tx, *rx;
+    uint32_t kicks_drained;     /* Sum of counts read from own eventfd. */
+    struct poll_waiter *sock_waiter;
+    bool peer_gone;             /* Peer closed its end of 'sock'? */
+};
+
+static struct shm_vconn *
+shm_vconn_cast(struct vconn *vconn)
+{
+    vconn_assert_class(vconn, &shm_vconn_class);
+    return CONTAINER_OF(vconn, struct shm_vconn, vconn);
+}
+
+static struct shm_vconn *
+new_shm_vconn(const char *name, int side, int sock)
+{
+    struct shm_vconn *s = xcalloc(1, sizeof *s);
+    vconn_init(&s->vconn, &shm_vconn_class, EAGAIN, 0, name, true);
+    s->side = side;
+    s->sock = sock;
+    s->memfd = -1;
+    s->efds[0] = s->efds[1] = -1;
+    return s;
+}
+
+/* Maps the region in 'fd', which must already be the right size. */
+static int
+shm_map(struct shm_vconn *s, int fd)
+{
+    void *p = mmap(NULL, sizeof *s->region, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        VLOG_ERR("%s: mmap: %s", s->vconn.name, strerror(errno));
+        return errno;
+    }
+    s->region = p;
+    s->tx = &s->region->rings[s->side];
+    s->rx = &s->region->rings[!s->side];
+    return 0;
+}
+
+static void
+shm_sock_cb(int fd UNUSED, short int revents UNUSED, void *s_)
+{
+    struct shm_vconn *s = s_;
+
+    /* Nothing is ever sent on the socket after setup, so it can only have
+     * become readable because the peer closed it. */
+    s->sock_waiter = NULL;
+    s->peer_gone = true;
+}
+
+/* Finishes setting up 's' once the region is mapped on both sides. */
+static void
+shm_start(struct shm_vconn *s)
+{
+    s->sock_waiter = poll_fd_callback(s->sock, POLLIN, shm_sock_cb, s);
+}
+
+static void
+shm_close(struct vconn *vconn)
+{
+    struct shm_vconn *s = shm_vconn_cast(vconn);
+    int i;
+
+    poll_cancel(s->sock_waiter);
+    if (s->region) {
+        munmap(s->region, sizeof *s->region);
+    }
+    if (s->memfd >= 0) {
+        close(s->memfd);
+    }
+    for (i = 0; i < 2; i++) {
+        if (s->efds[i] >= 0) {
+            close(s->efds[i]);
+        }
+    }
+    close(s->sock);
+    free(s);
+}
+
+/* Active side: sends the memfd and eventfds to the passive side. */
+static int
+shm_send_fds(struct shm_vconn *s)
+{
+    int fds[3] = { s->memfd, s->efds[0], s->efds[1] };
+    char cbuf[CMSG_SPACE(sizeof fds)];
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    char byte = 0;
+    int error;
+
+    error = check_connection_completion(s->sock);
+    if (error) {
+        return error;
+    }
+
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof cbuf;
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof fds);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof fds);
+
+    if (sendmsg(s->sock, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) != 1) {
+        return errno == EAGAIN ? EAGAIN : errno;
+    }
+    close(s->memfd);
+    s->memfd = -1;
+    return 0;
+}
+
+/* Passive side: receives the memfd and eventfds from the active side and maps
+ * the region. */
+static int
+shm_recv_fds(struct shm_vconn *s)
+{
+    int fds[3];
+    char cbuf[CMSG_SPACE(sizeof fds)];
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    struct stat st;
+    ssize_t retval;
+    char byte;
+    int error;
+    int i;
+
+    iov.iov_base = &byte;
+    iov.iov_len = 1;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof cbuf;
+    retval = recvmsg(s->sock, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    if (retval < 0) {
+        return errno;
+    } else if (!retval) {
+        return EOF;
+    }
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET
+        || cmsg->cmsg_type != SCM_RIGHTS
+        || cmsg->cmsg_len != CMSG_LEN(sizeof fds)) {
+        VLOG_ERR("%s: peer did not pass shared memory descriptors",
+                 s->vconn.name);
+        return EPROTO;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof fds);
+    s->efds[0] = fds[1];
+    s->efds[1] = fds[2];
+
+    if (fstat(fds[0], &st) || st.st_size != sizeof *s->region) {
+        VLOG_ERR("%s: shared memory region has wrong size", s->vconn.name);
+        error = EPROTO;
+    } else {
+        error = shm_map(s, fds[0]);
+        if (!error && (s->region->magic != SHM_MAGIC
+                       || s->region->ring_size != SHM_RING_SIZE)) {
+            VLOG_ERR("%s: shared memory region has bad header",
+                     s->vconn.name);
+            error = EPROTO;
+        }
+    }
+    close(fds[0]);
+    for (i = 0; error && i < 2; i++) {
+        close(s->efds[i]);
+        s->efds[i] = -1;
+    }
+    return error;
+}
+
+static int
+shm_connect(struct vconn *vconn)
+{
+    struct shm_vconn *s = shm_vconn_cast(vconn);
+    int error;
+
+    error = s->side == SHM_ACTIVE ? shm_send_fds(s) : shm_recv_fds(s);
+    if (!error) {
+        shm_start(s);
+    }
+    return error;
+}
+
+/* Writes to side 'side''s eventfd, to wake it up. */
+static void
+shm_kick(struct shm_vconn *s, int side)
+{
+    uint64_t one = 1;
+
+    /* Count the kick before making it, so that the count never falls behind
+     * what is in the eventfd.  (See shm_wait().) */
+    __atomic_store_n(&s->region->kicks[side], s->region->kicks[side] + 1,
+                     __ATOMIC_RELEASE);
+    if (write(s->efds[side], &one, sizeof one) < 0 && errno != EAGAIN) {
+        VLOG_WARN_RL(&rl, "%s: eventfd write failed: %s",
+                     s->vconn.name, strerror(errno));
+    }
+}
+
+/* Wakes up the side that may be sleeping on 'waiting', if it is. */
+static void
+shm_wake(struct shm_vconn *s, int *waiting, int side)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_RELAXED)
+        && __atomic_exchange_n(waiting, 0, __ATOMIC_RELAXED)) {
+        shm_kick(s, side);
+    }
+}
+
+/* Copies 'n' bytes from 'data' into 'r' at byte position 'pos'. */
+static void
+shm_ring_put(struct shm_ring *r, uint32_t pos, const void *data, size_t n)
+{
+    size_t ofs = pos & (SHM_RING_SIZE - 1);
+    size_t n1 = MIN(n, SHM_RING_SIZE - ofs);
+
+    memcpy(&r->data[ofs], data, n1);
+    memcpy(r->data, (const uint8_t *) data + n1, n - n1);
+}
+
+/* Copies 'n' bytes out of 'r' at byte position 'pos' into 'data'. */
+static void
+shm_ring_get(const struct shm_ring *r, uint32_t pos, void *data, size_t n)
+{
+    size_t ofs = pos & (SHM_RING_SIZE - 1);
+    size_t n1 = MIN(n, SHM_RING_SIZE - ofs);
+
+    memcpy(data, &r->data[ofs], n1);
+    memcpy((uint8_t *) data + n1, r->data, n - n1);
+}
+
+static int
+shm_recv(struct vconn *vconn, struct ofpbuf **bufferp)
+{
+    struct shm_vconn *s = shm_vconn_cast(vconn);
+    struct shm_ring *rx = s->rx;
+    uint32_t tail = rx->cons.tail;
+    struct ofp_header oh;
+    struct ofpbuf *buffer;
+    uint32_t avail;
+    size_t length;
+
+    /* This side is awake, so the peer need not wake it. */
+    if (rx->cons.waiting) {
+        __atomic_store_n(&rx->cons.waiting, 0, __ATOMIC_RELAXED);
+    }
+
+    avail = __atomic_load_n(&rx->prod.head, __ATOMIC_ACQUIRE) - tail;
+    if (avail < sizeof oh) {
+        /* The sender writes whole messages, so any leftover bytes would be
+         * corruption. */
+        return !s->peer_gone ? EAGAIN : !avail ? EOF : EPROTO;
+    }
+    shm_ring_get(rx, tail, &oh, sizeof oh);
+    length = ntohs(oh.length);
+    if (length < sizeof oh || length > avail) {
+        VLOG_ERR_RL(&rl, "%s: bad message length %zu in shared memory ring",
+                    vconn->name, length);
+        return EPROTO;
+    }
+
+    buffer = ofpbuf_new(length);
+    shm_ring_get(rx, tail, ofpbuf_put_uninit(buffer, length), length);
+    __atomic_store_n(&rx->cons.tail, tail + length, __ATOMIC_RELEASE);
+    shm_wake(s, &rx->prod.waiting, !s->side);
+
+    *bufferp = buffer;
+    return 0;
+}
+
+static int
+shm_send_batch(struct vconn *vconn, struct ofpbuf *msgs[], size_t n,
+               size_t *n_sentp)
+{
+    struct shm_vconn *s = shm_vconn_cast(vconn);
+    struct shm_ring *tx = s->tx;
+    uint32_t head = tx->prod.head;
+    uint32_t room;
+    size_t i;
+
+    *n_sentp = 0;
+    if (s->peer_gone) {
+        return EPIPE;
+    }
+    if (tx->prod.waiting) {
+        __atomic_store_n(&tx->prod.waiting, 0, __ATOMIC_RELAXED);
+    }
+
+    room = SHM_RING_SIZE - (head - __atomic_load_n(&tx->cons.tail,
+                                                   __ATOMIC_ACQUIRE));
+    for (i = 0; i < n && msgs[i]->size <= room; i++) {
+        shm_ring_put(tx, head, msgs[i]->data, msgs[i]->size);
+        head += msgs[i]->size;
+        room -= msgs[i]->size;
+        ofpbuf_delete(msgs[i]);
+    }
+    if (i) {
+        __atomic_store_n(&tx->prod.head, head, __ATOMIC_RELEASE);
+        shm_wake(s, &tx->cons.waiting, !s->side);
+    }
+
+    *n_sentp = i;
+    return i < n ? EAGAIN : 0;
+}
+
+static int
+shm_send(struct vconn *vconn, struct ofpbuf *buffer)
+{
+    size_t n_sent;
+    return shm_send_batch(vconn, &buffer, 1, &n_sent);
+}
+
+/* Returns true if 'r' has room for a message of the greatest possible
+ * length. */
+static bool
+shm_ring_has_room(const struct shm_ring *r)
+{
+    uint32_t used = r->prod.head - __atomic_load_n(&r->cons.tail,
+                                                   __ATOMIC_ACQUIRE);
+    return SHM_RING_SIZE - used >= UINT16_MAX;
+}
+
+/* Returns true if 'r' has a message ready to receive. */
+static bool
+shm_ring_has_data(const struct shm_ring *r)
+{
+    return __atomic_load_n(&r->prod.head, __ATOMIC_ACQUIRE) != r->cons.tail;
+}
+
+static void
+shm_wait(struct vconn *vconn, enum vconn_wait_type wait)
+{
+    struct shm_vconn *s = shm_vconn_cast(vconn);
+    uint32_t kicks;
+    bool ready;
+
+    if (wait == WAIT_CONNECT) {
+        poll_fd_wait(s->sock, s->side == SHM_ACTIVE ? POLLOUT : POLLIN);
+        return;
+    } else if (s->peer_gone) {
+        poll_immediate_wake();
+        return;
+    }
+
+    /* Clear the eventfd if the peer has kicked it since we last did.  The
+     * peer counts each kick before writing it, so if the count is ahead of
+     * what we have read, either the eventfd is readable or a write is about
+     * to make it so; either way, we read again next time around. */
+    kicks = __atomic_load_n(&s->region->kicks[s->side], __ATOMIC_ACQUIRE);
+    if (kicks != s->kicks_drained) {
+        uint64_t count;
+
+        if (read(s->efds[s->side], &count, sizeof count) == sizeof count) {
+            s->kicks_drained += count;
+        } else if (errno != EAGAIN) {
+            VLOG_WARN_RL(&rl, "%s: eventfd read failed: %s",
+                         vconn->name, strerror(errno));
+        }
+    }
+
+    /* Announce that this side is about to sleep, then check again, in case
+     * the peer made progress before it could see the announcement. */
+    if (wait == WAIT_RECV) {
+        __atomic_store_n(&s->rx->cons.waiting, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        ready = shm_ring_has_data(s->rx);
+    } else if (wait == WAIT_SEND) {
+        __atomic_store_n(&s->tx->prod.waiting, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        ready = shm_ring_has_room(s->tx);
+    } else {
+        NOT_REACHED();
+    }
+
+    if (ready) {
+        poll_immediate_wake();
+    } else {
+        poll_fd_wait(s->efds[s->side], POLLIN);
+    }
+}
+
+static int
+shm_vconn_open(const char *name, char *suffix, struct vconn **vconnp)
+{
+    struct shm_vconn *s;
+    int error;
+    int sock;
+    int i;
+
+    sock = make_unix_socket(SOCK_STREAM, true, false, NULL, suffix);
+    if (sock < 0) {
+        VLOG_ERR("%s: connection failed: %s", name, strerror(-sock));
+        return -sock;
+    }
+    s = new_shm_vconn(name, SHM_ACTIVE, sock);
+
+    s->memfd = memfd_create("openflow-shm", MFD_CLOEXEC);
+    if (s->memfd < 0 || ftruncate(s->memfd, sizeof *s->region)) {
+        error = errno;
+        VLOG_ERR("%s: creating shared memory: %s", name, strerror(error));
+        goto error;
+    }
+    for (i = 0; i < 2; i++) {
+        s->efds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (s->efds[i] < 0) {
+            error = errno;
+            VLOG_ERR("%s: eventfd: %s", name, strerror(error));
+            goto error;
+        }
+    }
+    error = shm_map(s, s->memfd);
+    if (error) {
+        goto error;
+    }
+    s->region->magic = SHM_MAGIC;
+    s->region->ring_size = SHM_RING_SIZE;
+
+    *vconnp = &s->vconn;
+    return 0;
+
+error:
+    shm_close(&s->vconn);
+    return error;
+}
+
+struct vconn_class shm_vconn_class = {
+    "shm",                      /* name */
+    shm_vconn_open,             /* open */
+    shm_close,                  /* close */
+    shm_connect,                /* connect */
+    shm_recv,                   /* recv */
+    shm_send,                   /* send */
+    shm_wait,                   /* wait */
+    shm_send_batch,             /* send_batch */
+};
+
+/* Passive shared-memory vconn. */
+
+static int pshm_accept(int fd, const struct sockaddr *sa, size_t sa_len,
+                       void *name, struct vconn **vconnp);
+
+static int
+pshm_open(const char *name UNUSED, char *suffix, struct pvconn **pvconnp)
+{
+    char *vconn_name;
+    int fd;
+
+    fd = make_unix_socket(SOCK_STREAM, true, false, suffix, NULL);
+    if (fd < 0) {
+        VLOG_ERR("%s: binding failed: %s", suffix, strerror(-fd));
+        return -fd;
+    }
+
+    vconn_name = xasprintf("shm:%s", suffix);
+    return new_pstream_pvconn("pshm", fd, pshm_accept, vconn_name, pvconnp);
+}
+
+static int
+pshm_accept(int fd, const struct sockaddr *sa UNUSED, size_t sa_len UNUSED,
+            void *name, struct vconn **vconnp)
+{
+    *vconnp = &new_shm_vconn(name, SHM_PASSIVE, fd)->vconn;
+    return 0;
+}
+
+struct pvconn_class pshm_pvconn_class = {
+    "pshm",
+    pshm_open,
+    NULL,
+    NULL,
+    NULL
+};
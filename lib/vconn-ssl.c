@@ -53,6 +53,7 @@
 #include "openflow/openflow.h"
 #include "packets.h"
 #include "poll-loop.h"
+#include "shash.h"
 #include "socket-util.h"
 #include "socket-util.h"
 #include "util.h"
@@ -145,9 +146,20 @@ struct ssl_vconn
     int rx_want, tx_want;
 };
 
+/* Largest amount of data that ssl_send_batch() gathers into a single
+ * SSL_write() call.  This is the largest plaintext that fits in one TLS
+ * record, so that a burst of small messages costs one record (one MAC and one
+ * encryption) instead of one per message. */
+#define SSL_TX_RECORD 16384
+
 /* SSL context created by ssl_init(). */
 static SSL_CTX *ctx;
 
+/* The session most recently established by an active SSL connection to each
+ * peer, indexed by vconn name, for offering to the peer the next time we
+ * connect to it so that it can skip the full handshake. */
+static struct shash client_sessions = SHASH_INITIALIZER(&client_sessions);
+
 /* Required configuration. */
 static bool has_private_key, has_certificate, has_ca_cert;
 
@@ -172,6 +184,8 @@ static int do_ssl_init(void);
 static bool ssl_wants_io(int ssl_error);
 static void ssl_close(struct vconn *);
 static void ssl_clear_txbuf(struct ssl_vconn *);
+static void ssl_forget_session(const char *name);
+static void ssl_remember_session(struct ssl_vconn *);
 static int interpret_ssl_error(const char *function, int ret, int error,
                                int *want);
 static void ssl_tx_poll_callback(int fd, short int revents, void *vconn_);
@@ -246,6 +260,11 @@ new_ssl_vconn(const char *name, int fd, enum session_type type,
     }
     if (bootstrap_ca_cert && type == CLIENT) {
         SSL_set_verify(ssl, SSL_VERIFY_NONE, NULL);
+    } else if (type == CLIENT) {
+        SSL_SESSION *session = shash_find_data(&client_sessions, name);
+        if (session) {
+            SSL_set_session(ssl, session);
+        }
     }
 
     /* Create and return the ssl_vconn. */
@@ -453,6 +472,9 @@ ssl_connect(struct vconn *vconn)
                 int unused;
                 interpret_ssl_error((sslv->type == CLIENT ? "SSL_connect"
                                      : "SSL_accept"), retval, error, &unused);
+                if (sslv->type == CLIENT) {
+                    ssl_forget_session(vconn_get_name(vconn));
+                }
                 shutdown(sslv->fd, SHUT_RDWR);
                 return EPROTO;
             }
@@ -472,6 +494,12 @@ ssl_connect(struct vconn *vconn)
             VLOG_ERR("rejecting SSL connection during bootstrap race window");
             return EPROTO;
         } else {
+            if (SSL_session_reused(sslv->ssl)) {
+                VLOG_DBG("%s: resumed SSL session", vconn_get_name(vconn));
+            }
+            if (sslv->type == CLIENT) {
+                ssl_remember_session(sslv);
+            }
             return 0;
         }
     }
@@ -479,6 +507,32 @@ ssl_connect(struct vconn *vconn)
     NOT_REACHED();
 }
 
+/* Discards the session saved for the peer of the active SSL connection named
+ * 'name', if any. */
+static void
+ssl_forget_session(const char *name)
+{
+    struct shash_node *node = shash_find(&client_sessions, name);
+    if (node) {
+        SSL_SESSION_free(node->data);
+        shash_delete(&client_sessions, node);
+    }
+}
+
+/* Saves the session negotiated by active SSL connection 'sslv' so that the
+ * next connection to the same peer can resume it. */
+static void
+ssl_remember_session(struct ssl_vconn *sslv)
+{
+    const char *name = vconn_get_name(&sslv->vconn);
+    SSL_SESSION *session = SSL_get1_session(sslv->ssl);
+
+    ssl_forget_session(name);
+    if (session) {
+        shash_add(&client_sessions, name, session);
+    }
+}
+
 static void
 ssl_close(struct vconn *vconn)
 {
@@ -486,6 +540,15 @@ ssl_close(struct vconn *vconn)
     poll_cancel(sslv->tx_waiter);
     ssl_clear_txbuf(sslv);
     ofpbuf_delete(sslv->rxbuf);
+
+    /* Try to send a close_notify alert.  Whether or not it gets out, this
+     * keeps OpenSSL from discarding the session as it otherwise would for a
+     * connection that was not shut down, so that the session can still be
+     * resumed when we or our peer reconnects. */
+    if (SSL_is_init_finished(sslv->ssl)) {
+        SSL_shutdown(sslv->ssl);
+        ERR_clear_error();
+    }
     SSL_free(sslv->ssl);
     close(sslv->fd);
     free(sslv);
@@ -703,30 +766,71 @@ ssl_tx_poll_callback(int fd UNUSED, short int revents UNUSED, void *vconn_)
 }
 
 static int
-ssl_send(struct vconn *vconn, struct ofpbuf *buffer)
+ssl_send_batch(struct vconn *vconn, struct ofpbuf *msgs[], size_t n,
+               size_t *n_sentp)
 {
     struct ssl_vconn *sslv = ssl_vconn_cast(vconn);
+    size_t n_sent = 0;
+    int error = 0;
 
-    if (sslv->txbuf) {
-        return EAGAIN;
-    } else {
-        int error;
+    while (n_sent < n && !sslv->txbuf) {
+        struct ofpbuf *buffer;
+        size_t n_msgs, size;
+        size_t i;
+
+        /* Gather as many messages as fit into a single record.  A lone
+         * message is sent as is, however long it is. */
+        size = msgs[n_sent]->size;
+        for (n_msgs = 1; n_sent + n_msgs < n; n_msgs++) {
+            size_t next = msgs[n_sent + n_msgs]->size;
+            if (size + next > SSL_TX_RECORD) {
+                break;
+            }
+            size += next;
+        }
+        if (n_msgs == 1) {
+            buffer = msgs[n_sent];
+        } else {
+            buffer = ofpbuf_new(size);
+            for (i = 0; i < n_msgs; i++) {
+                const struct ofpbuf *msg = msgs[n_sent + i];
+                ofpbuf_put(buffer, msg->data, msg->size);
+            }
+        }
 
         sslv->txbuf = buffer;
         error = ssl_do_tx(vconn);
-        switch (error) {
-        case 0:
+        if (error && error != EAGAIN) {
+            sslv->txbuf = NULL;
+            if (buffer != msgs[n_sent]) {
+                ofpbuf_delete(buffer);
+            }
+            break;
+        }
+
+        if (buffer != msgs[n_sent]) {
+            for (i = 0; i < n_msgs; i++) {
+                ofpbuf_delete(msgs[n_sent + i]);
+            }
+        }
+        n_sent += n_msgs;
+        if (!error) {
             ssl_clear_txbuf(sslv);
-            return 0;
-        case EAGAIN:
+        } else {
             leak_checker_claim(buffer);
             ssl_register_tx_waiter(vconn);
-            return 0;
-        default:
-            sslv->txbuf = NULL;
-            return error;
         }
     }
+
+    *n_sentp = n_sent;
+    return n_sent < n ? (error ? error : EAGAIN) : 0;
+}
+
+static int
+ssl_send(struct vconn *vconn, struct ofpbuf *buffer)
+{
+    size_t n_sent;
+    return ssl_send_batch(vconn, &buffer, 1, &n_sent);
 }
 
 static void
@@ -787,6 +891,7 @@ struct vconn_class ssl_vconn_class = {
     ssl_recv,                   /* recv */
     ssl_send,                   /* send */
     ssl_wait,                   /* wait */
+    ssl_send_batch,             /* send_batch */
 };
 
 /* Passive SSL. */
@@ -949,6 +1054,7 @@ ssl_init(void)
 static int
 do_ssl_init(void)
 {
+    static const unsigned char session_id_context[] = "openflow";
     SSL_METHOD *method;
 
     SSL_library_init();
@@ -972,6 +1078,13 @@ do_ssl_init(void)
     SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT,
                        NULL);
 
+    /* Let clients that reconnect resume their sessions, by session ID or by
+     * session ticket.  OpenSSL refuses to resume a session whose peer was
+     * verified unless the session ID context is set. */
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_set_session_id_context(ctx, session_id_context,
+                                   sizeof session_id_context - 1);
+
     return 0;
 }
 
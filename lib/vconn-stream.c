@@ -35,10 +35,15 @@
 #include "vconn-stream.h"
 #include <assert.h>
 #include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <poll.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include "leak-checker.h"
 #include "ofpbuf.h"
@@ -58,15 +63,26 @@ struct stream_vconn
 {
     struct vconn vconn;
     int fd;
-    struct ofpbuf *rxbuf;
+    struct ofpbuf_shared *rx_block; /* Memory that 'rxbuf' uses, or null. */
+    struct ofpbuf rxbuf;        /* Received data not yet handed out. */
     struct ofpbuf *txbuf;
     struct poll_waiter *tx_waiter;
+    bool cork;                  /* Set TCP_CORK around multi-writev bursts? */
 };
 
 static struct vconn_class stream_vconn_class;
 
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(10, 25);
 
+/* Size of the buffer that stream_recv() reads into.  It holds the longest
+ * possible OpenFlow message, so one read() can take in a whole burst of
+ * short ones, which stream_recv() then returns one at a time. */
+#define STREAM_RX_SIZE 65536
+
+/* Maximum number of messages that stream_send_batch() passes to one writev()
+ * call (well under any system's IOV_MAX). */
+#define STREAM_TX_IOV 256
+
 static void stream_clear_txbuf(struct stream_vconn *);
 
 int
@@ -81,7 +97,8 @@ new_stream_vconn(const char *name, int fd, int connect_status,
     s->fd = fd;
     s->txbuf = NULL;
     s->tx_waiter = NULL;
-    s->rxbuf = NULL;
+    s->rx_block = NULL;
+    s->cork = false;
     *vconnp = &s->vconn;
     return 0;
 }
@@ -93,13 +110,29 @@ stream_vconn_cast(struct vconn *vconn)
     return CONTAINER_OF(vconn, struct stream_vconn, vconn);
 }
 
+/* Makes 'vconn', which must have been created by new_stream_vconn() on a TCP
+ * socket, cork its socket with TCP_CORK while it sends a batch of messages
+ * that takes more than one writev() call, so that the seams between the calls
+ * do not turn into short segments.  Does nothing on systems without TCP_CORK.
+ */
+void
+stream_vconn_set_cork(struct vconn *vconn, bool cork)
+{
+    struct stream_vconn *s = stream_vconn_cast(vconn);
+#ifdef TCP_CORK
+    s->cork = cork;
+#else
+    s->cork = false;
+#endif
+}
+
 static void
 stream_close(struct vconn *vconn)
 {
     struct stream_vconn *s = stream_vconn_cast(vconn);
     poll_cancel(s->tx_waiter);
     stream_clear_txbuf(s);
-    ofpbuf_delete(s->rxbuf);
+    ofpbuf_shared_unref(s->rx_block);
     close(s->fd);
     free(s);
 }
@@ -111,62 +144,106 @@ stream_connect(struct vconn *vconn)
     return check_connection_completion(s->fd);
 }
 
+/* If 'rx' begins with a complete OpenFlow message, stores its length in
+ * '*lengthp' and returns 0.  Returns EAGAIN if more data is needed, or
+ * EPROTO if the message at the start of 'rx' has an impossible length. */
+static int
+stream_rx_parse(const struct ofpbuf *rx, size_t *lengthp)
+{
+    const struct ofp_header *oh;
+    size_t length;
+
+    if (rx->size < sizeof *oh) {
+        return EAGAIN;
+    }
+    oh = rx->data;
+    length = ntohs(oh->length);
+    if (length < sizeof *oh) {
+        return EPROTO;
+    } else if (rx->size < length) {
+        return EAGAIN;
+    }
+    *lengthp = length;
+    return 0;
+}
+
+/* Points 's''s receive buffer at a new block, carrying over the 'size' bytes
+ * of a partial message at 'data', if any. */
+static void
+stream_rx_new_block(struct stream_vconn *s, const void *data, size_t size)
+{
+    struct ofpbuf_shared *block = ofpbuf_shared_new(STREAM_RX_SIZE);
+
+    ofpbuf_use(&s->rxbuf, ofpbuf_shared_data(block), STREAM_RX_SIZE);
+    if (size) {
+        ofpbuf_put(&s->rxbuf, data, size);
+    }
+    ofpbuf_shared_unref(s->rx_block);
+    s->rx_block = block;
+}
+
+/* Messages are handed out as ofpbufs that point into the receive buffer's
+ * block, without copying them, unless one would be misaligned for its 64-bit
+ * fields.  The block lives on until the last of them is freed. */
 static int
 stream_recv(struct vconn *vconn, struct ofpbuf **bufferp)
 {
     struct stream_vconn *s = stream_vconn_cast(vconn);
     struct ofpbuf *rx;
-    size_t want_bytes;
-    ssize_t retval;
+    size_t length;
+    int error;
 
-    if (s->rxbuf == NULL) {
-        s->rxbuf = ofpbuf_new(1564);
+    if (s->rx_block == NULL) {
+        stream_rx_new_block(s, NULL, 0);
     }
-    rx = s->rxbuf;
-
-again:
-    if (sizeof(struct ofp_header) > rx->size) {
-        want_bytes = sizeof(struct ofp_header) - rx->size;
-    } else {
-        struct ofp_header *oh = rx->data;
-        size_t length = ntohs(oh->length);
-        if (length < sizeof(struct ofp_header)) {
-            VLOG_ERR_RL(&rl, "received too-short ofp_header (%zu bytes)",
-                        length);
-            return EPROTO;
-        }
-        want_bytes = length - rx->size;
-        if (!want_bytes) {
-            *bufferp = rx;
-            s->rxbuf = NULL;
-            return 0;
+    rx = &s->rxbuf;
+
+    error = stream_rx_parse(rx, &length);
+    if (error == EAGAIN) {
+        ssize_t retval;
+
+        /* Move the start of a partial message, if any, to the front of the
+         * buffer and fill up the rest.  If messages already handed out
+         * still point into the block, move to a new one instead. */
+        if (ofpbuf_shared_is_shared(s->rx_block)) {
+            if (rx->data != rx->base || !ofpbuf_tailroom(rx)) {
+                stream_rx_new_block(s, rx->data, rx->size);
+            }
+        } else if (rx->data != rx->base) {
+            memmove(rx->base, rx->data, rx->size);
+            rx->data = rx->base;
         }
-    }
-    ofpbuf_prealloc_tailroom(rx, want_bytes);
-
-    retval = read(s->fd, ofpbuf_tail(rx), want_bytes);
-    if (retval > 0) {
-        rx->size += retval;
-        if (retval == want_bytes) {
-            if (rx->size > sizeof(struct ofp_header)) {
-                *bufferp = rx;
-                s->rxbuf = NULL;
-                return 0;
+        retval = read(s->fd, ofpbuf_tail(rx), ofpbuf_tailroom(rx));
+        if (retval > 0) {
+            rx->size += retval;
+            error = stream_rx_parse(rx, &length);
+        } else if (retval == 0) {
+            if (rx->size) {
+                VLOG_ERR_RL(&rl, "connection dropped mid-packet");
+                return EPROTO;
             } else {
-                goto again;
+                return EOF;
             }
-        }
-        return EAGAIN;
-    } else if (retval == 0) {
-        if (rx->size) {
-            VLOG_ERR_RL(&rl, "connection dropped mid-packet");
-            return EPROTO;
         } else {
-            return EOF;
+            return errno;
+        }
+    }
+    if (error) {
+        if (error == EPROTO) {
+            const struct ofp_header *oh = rx->data;
+            VLOG_ERR_RL(&rl, "received too-short ofp_header (%zu bytes)",
+                        (size_t) ntohs(oh->length));
         }
+        return error;
+    }
+
+    if ((uintptr_t) rx->data % 8) {
+        *bufferp = ofpbuf_clone_data(rx->data, length);
     } else {
-        return errno;
+        *bufferp = ofpbuf_new_shared(s->rx_block, rx->data, length);
     }
+    ofpbuf_pull(rx, length);
+    return 0;
 }
 
 static void
@@ -199,37 +276,112 @@ stream_do_tx(int fd UNUSED, short int revents UNUSED, void *vconn_)
     s->tx_waiter = poll_fd_callback(s->fd, POLLOUT, stream_do_tx, vconn);
 }
 
+static void
+stream_set_cork(struct stream_vconn *s, int on)
+{
+#ifdef TCP_CORK
+    if (setsockopt(s->fd, IPPROTO_TCP, TCP_CORK, &on, sizeof on)) {
+        VLOG_WARN_RL(&rl, "%s: setsockopt(TCP_CORK): %s",
+                     s->vconn.name, strerror(errno));
+    }
+#endif
+}
+
+/* Writes as many of the 'n' messages in 'msgs' as the socket will take,
+ * preceded by whatever is left of 's->txbuf', with one writev() call for every
+ * STREAM_TX_IOV messages.  A message that is only partly written becomes the
+ * new 's->txbuf' and is finished by stream_do_tx() in the background. */
 static int
-stream_send(struct vconn *vconn, struct ofpbuf *buffer)
+stream_send_batch(struct vconn *vconn, struct ofpbuf *msgs[], size_t n,
+                  size_t *n_sentp)
 {
     struct stream_vconn *s = stream_vconn_cast(vconn);
-    ssize_t retval;
+    struct iovec iov[STREAM_TX_IOV + 1];
+    bool corked = false;
+    size_t n_sent = 0;
+    int error = 0;
+
+    while (n_sent < n) {
+        size_t n_iov = 0;
+        size_t n_msgs;
+        ssize_t retval;
+        size_t i;
+
+        if (s->txbuf) {
+            iov[n_iov].iov_base = s->txbuf->data;
+            iov[n_iov].iov_len = s->txbuf->size;
+            n_iov++;
+        }
+        n_msgs = MIN(n - n_sent, STREAM_TX_IOV);
+        for (i = 0; i < n_msgs; i++) {
+            iov[n_iov].iov_base = msgs[n_sent + i]->data;
+            iov[n_iov].iov_len = msgs[n_sent + i]->size;
+            n_iov++;
+        }
 
-    if (s->txbuf) {
-        return EAGAIN;
-    }
+        if (s->cork && !corked && n_sent + n_msgs < n) {
+            stream_set_cork(s, 1);
+            corked = true;
+        }
 
-    retval = write(s->fd, buffer->data, buffer->size);
-    if (retval == buffer->size) {
-        ofpbuf_delete(buffer);
-        return 0;
-    } else if (retval >= 0 || errno == EAGAIN) {
-        leak_checker_claim(buffer);
-        s->txbuf = buffer;
-        if (retval > 0) {
-            ofpbuf_pull(buffer, retval);
+        retval = writev(s->fd, iov, n_iov);
+        if (retval < 0) {
+            error = errno;
+            break;
         }
-        s->tx_waiter = poll_fd_callback(s->fd, POLLOUT, stream_do_tx, vconn);
-        return 0;
-    } else {
-        return errno;
+
+        /* Retire everything that went out completely.  The first message
+         * that did not becomes the new txbuf, unless none of it went out. */
+        if (s->txbuf) {
+            if (retval < s->txbuf->size) {
+                ofpbuf_pull(s->txbuf, retval);
+                error = EAGAIN;
+                break;
+            }
+            retval -= s->txbuf->size;
+            poll_cancel(s->tx_waiter);
+            stream_clear_txbuf(s);
+        }
+        for (i = 0; i < n_msgs && retval > 0; i++) {
+            struct ofpbuf *msg = msgs[n_sent++];
+            if (retval >= msg->size) {
+                retval -= msg->size;
+                ofpbuf_delete(msg);
+            } else {
+                leak_checker_claim(msg);
+                ofpbuf_pull(msg, retval);
+                s->txbuf = msg;
+                s->tx_waiter = poll_fd_callback(s->fd, POLLOUT,
+                                                stream_do_tx, vconn);
+                retval = 0;
+            }
+        }
+        if (i < n_msgs || s->txbuf) {
+            error = EAGAIN;
+            break;
+        }
+    }
+
+    if (corked) {
+        stream_set_cork(s, 0);
     }
+    *n_sentp = n_sent;
+    return n_sent < n ? error : 0;
+}
+
+static int
+stream_send(struct vconn *vconn, struct ofpbuf *buffer)
+{
+    size_t n_sent;
+    return stream_send_batch(vconn, &buffer, 1, &n_sent);
 }
 
 static void
 stream_wait(struct vconn *vconn, enum vconn_wait_type wait)
 {
     struct stream_vconn *s = stream_vconn_cast(vconn);
+    size_t length;
+
     switch (wait) {
     case WAIT_CONNECT:
         poll_fd_wait(s->fd, POLLOUT);
@@ -244,7 +396,12 @@ stream_wait(struct vconn *vconn, enum vconn_wait_type wait)
         break;
 
     case WAIT_RECV:
-        poll_fd_wait(s->fd, POLLIN);
+        if (s->rx_block && stream_rx_parse(&s->rxbuf, &length) != EAGAIN) {
+            /* A message (or an error) is already buffered. */
+            poll_immediate_wake();
+        } else {
+            poll_fd_wait(s->fd, POLLIN);
+        }
         break;
 
     default:
@@ -260,6 +417,7 @@ static struct vconn_class stream_vconn_class = {
     stream_recv,                /* recv */
     stream_send,                /* send */
     stream_wait,                /* wait */
+    stream_send_batch,          /* send_batch */
 };
 
 /* Passive stream socket vconn. */
@@ -269,7 +427,8 @@ struct pstream_pvconn
     struct pvconn pvconn;
     int fd;
     int (*accept_cb)(int fd, const struct sockaddr *, size_t sa_len,
-                     struct vconn **);
+                     void *aux, struct vconn **);
+    void *aux;
 };
 
 static struct pvconn_class pstream_pvconn_class;
@@ -281,11 +440,15 @@ pstream_pvconn_cast(struct pvconn *pvconn)
     return CONTAINER_OF(pvconn, struct pstream_pvconn, pvconn);
 }
 
+/* Creates a new passive stream vconn listening on 'fd'.  Each accepted
+ * connection is passed to 'accept_cb' along with 'aux'.  Takes ownership of
+ * 'aux', which is freed with free() when the pvconn is closed (or at once, if
+ * this function fails). */
 int
 new_pstream_pvconn(const char *name, int fd,
                   int (*accept_cb)(int fd, const struct sockaddr *,
-                                   size_t sa_len, struct vconn **),
-                  struct pvconn **pvconnp)
+                                   size_t sa_len, void *aux, struct vconn **),
+                  void *aux, struct pvconn **pvconnp)
 {
     struct pstream_pvconn *ps;
     int retval;
@@ -293,6 +456,7 @@ new_pstream_pvconn(const char *name, int fd,
     retval = set_nonblocking(fd);
     if (retval) {
         close(fd);
+        free(aux);
         return retval;
     }
 
@@ -300,6 +464,7 @@ new_pstream_pvconn(const char *name, int fd,
         int error = errno;
         VLOG_ERR("%s: listen: %s", name, strerror(error));
         close(fd);
+        free(aux);
         return error;
     }
 
@@ -307,6 +472,7 @@ new_pstream_pvconn(const char *name, int fd,
     pvconn_init(&ps->pvconn, &pstream_pvconn_class, name);
     ps->fd = fd;
     ps->accept_cb = accept_cb;
+    ps->aux = aux;
     *pvconnp = &ps->pvconn;
     return 0;
 }
@@ -316,6 +482,7 @@ pstream_close(struct pvconn *pvconn)
 {
     struct pstream_pvconn *ps = pstream_pvconn_cast(pvconn);
     close(ps->fd);
+    free(ps->aux);
     free(ps);
 }
 
@@ -344,7 +511,7 @@ pstream_accept(struct pvconn *pvconn, struct vconn **new_vconnp)
     }
 
     return ps->accept_cb(new_fd, (const struct sockaddr *) &ss, ss_len,
-                         new_vconnp);
+                         ps->aux, new_vconnp);
 }
 
 static void
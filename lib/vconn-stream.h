@@ -44,9 +44,11 @@ struct sockaddr;
 
 int new_stream_vconn(const char *name, int fd, int connect_status,
                      uint32_t ip, bool reconnectable, struct vconn **vconnp);
+void stream_vconn_set_cork(struct vconn *, bool cork);
 int new_pstream_pvconn(const char *name, int fd,
                       int (*accept_cb)(int fd, const struct sockaddr *,
-                                       size_t sa_len, struct vconn **),
-                      struct pvconn **pvconnp);
+                                       size_t sa_len, void *aux,
+                                       struct vconn **),
+                      void *aux, struct pvconn **pvconnp);
 
 #endif /* vconn-stream.h */
@@ -51,24 +51,90 @@
 #include "vlog.h"
 #define THIS_MODULE VLM_vconn_tcp
 
+/* Socket options for a TCP connection, given as ",OPTION" suffixes on a
+ * "tcp:" or "ptcp:" connection name. */
+struct tcp_options {
+    bool nodelay;               /* Set TCP_NODELAY?  ("nodelay=yes|no") */
+    bool cork;                  /* Cork around bursts?  ("cork") */
+    int sndbuf;                 /* SO_SNDBUF, 0 for default ("sndbuf=N"). */
+};
+
+/* Parses the comma-separated 'options', if any, from the connection named
+ * 'name' into 'opts'.  Returns 0 if successful, otherwise EINVAL. */
+static int
+parse_tcp_options(const char *name, char *options, struct tcp_options *opts)
+{
+    char *save_ptr = NULL;
+    char *option;
+
+    opts->nodelay = true;
+    opts->cork = false;
+    opts->sndbuf = 0;
+    if (!options) {
+        return 0;
+    }
+
+    for (option = strtok_r(options, ",", &save_ptr); option;
+         option = strtok_r(NULL, ",", &save_ptr)) {
+        if (!strcmp(option, "nodelay") || !strcmp(option, "nodelay=yes")) {
+            opts->nodelay = true;
+        } else if (!strcmp(option, "nodelay=no")) {
+            opts->nodelay = false;
+        } else if (!strcmp(option, "cork")) {
+            opts->cork = true;
+        } else if (!strncmp(option, "sndbuf=", 7) && atoi(option + 7) > 0) {
+            opts->sndbuf = atoi(option + 7);
+        } else {
+            ofp_error(0, "%s: unknown TCP option \"%s\"", name, option);
+            return EINVAL;
+        }
+    }
+    return 0;
+}
+
+/* Splits the ",OPTION..." suffix off 'suffix' and returns it, or returns a
+ * null pointer if there is none. */
+static char *
+split_tcp_options(char *suffix)
+{
+    char *comma = strchr(suffix, ',');
+    if (comma) {
+        *comma++ = '\0';
+    }
+    return comma;
+}
+
 /* Active TCP. */
 
 static int
 new_tcp_vconn(const char *name, int fd, int connect_status,
-              const struct sockaddr_in *sin, struct vconn **vconnp)
+              const struct sockaddr_in *sin, const struct tcp_options *opts,
+              struct vconn **vconnp)
 {
-    int on = 1;
     int retval;
 
-    retval = setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
-    if (retval) {
-        VLOG_ERR("%s: setsockopt(TCP_NODELAY): %s", name, strerror(errno));
-        close(fd);
-        return errno;
+    if (opts->nodelay) {
+        int on = 1;
+        retval = setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof on);
+        if (retval) {
+            VLOG_ERR("%s: setsockopt(TCP_NODELAY): %s",
+                     name, strerror(errno));
+            close(fd);
+            return errno;
+        }
+    }
+    if (opts->sndbuf
+        && setsockopt(fd, SOL_SOCKET, SO_SNDBUF,
+                      &opts->sndbuf, sizeof opts->sndbuf)) {
+        VLOG_WARN("%s: setsockopt(SO_SNDBUF): %s", name, strerror(errno));
     }
 
-    return new_stream_vconn(name, fd, connect_status, sin->sin_addr.s_addr,
-                            true, vconnp);
+    retval = new_stream_vconn(name, fd, connect_status, sin->sin_addr.s_addr,
+                              true, vconnp);
+    if (!retval && opts->cork) {
+        stream_vconn_set_cork(*vconnp, true);
+    }
+    return retval;
 }
 
 static int
@@ -77,10 +143,16 @@ tcp_open(const char *name, char *suffix, struct vconn **vconnp)
     char *save_ptr;
     const char *host_name;
     const char *port_string;
+    struct tcp_options opts;
     struct sockaddr_in sin;
     int retval;
     int fd;
 
+    retval = parse_tcp_options(name, split_tcp_options(suffix), &opts);
+    if (retval) {
+        return retval;
+    }
+
     /* Glibc 2.7 has a bug in strtok_r when compiling with optimization that
      * can cause segfaults here:
      * http://sources.redhat.com/bugzilla/show_bug.cgi?id=5614.
@@ -114,7 +186,7 @@ tcp_open(const char *name, char *suffix, struct vconn **vconnp)
     retval = connect(fd, (struct sockaddr *) &sin, sizeof sin);
     if (retval < 0) {
         if (errno == EINPROGRESS) {
-            return new_tcp_vconn(name, fd, EAGAIN, &sin, vconnp);
+            return new_tcp_vconn(name, fd, EAGAIN, &sin, &opts, vconnp);
         } else {
             int error = errno;
             VLOG_ERR("%s: connect: %s", name, strerror(error));
@@ -122,7 +194,7 @@ tcp_open(const char *name, char *suffix, struct vconn **vconnp)
             return error;
         }
     } else {
-        return new_tcp_vconn(name, fd, 0, &sin, vconnp);
+        return new_tcp_vconn(name, fd, 0, &sin, &opts, vconnp);
     }
 }
 
@@ -134,21 +206,28 @@ struct vconn_class tcp_vconn_class = {
     NULL,                       /* recv */
     NULL,                       /* send */
     NULL,                       /* wait */
+    NULL,                       /* send_batch */
 };
 
 /* Passive TCP. */
 
 static int ptcp_accept(int fd, const struct sockaddr *sa, size_t sa_len,
-                       struct vconn **vconnp);
+                       void *opts, struct vconn **vconnp);
 
 static int
 ptcp_open(const char *name, char *suffix, struct pvconn **pvconnp)
 {
+    struct tcp_options opts;
     struct sockaddr_in sin;
     int retval;
     int fd;
     unsigned int yes  = 1;
 
+    retval = parse_tcp_options(name, split_tcp_options(suffix), &opts);
+    if (retval) {
+        return retval;
+    }
+
     fd = socket(AF_INET, SOCK_STREAM, 0);
     if (fd < 0) {
         VLOG_ERR("%s: socket: %s", name, strerror(errno));
@@ -172,12 +251,13 @@ ptcp_open(const char *name, char *suffix, struct pvconn **pvconnp)
         return error;
     }
 
-    return new_pstream_pvconn("ptcp", fd, ptcp_accept, pvconnp);
+    return new_pstream_pvconn("ptcp", fd, ptcp_accept,
+                              xmemdup(&opts, sizeof opts), pvconnp);
 }
 
 static int
 ptcp_accept(int fd, const struct sockaddr *sa, size_t sa_len,
-            struct vconn **vconnp)
+            void *opts, struct vconn **vconnp)
 {
     const struct sockaddr_in *sin = (const struct sockaddr_in *) sa;
     char name[128];
@@ -190,7 +270,7 @@ ptcp_accept(int fd, const struct sockaddr *sa, size_t sa_len,
     } else {
         strcpy(name, "tcp");
     }
-    return new_tcp_vconn(name, fd, 0, sin, vconnp);
+    return new_tcp_vconn(name, fd, 0, sin, opts, vconnp);
 }
 
 struct pvconn_class ptcp_pvconn_class = {
@@ -88,12 +88,13 @@ struct vconn_class unix_vconn_class = {
     NULL,                       /* recv */
     NULL,                       /* send */
     NULL,                       /* wait */
+    NULL,                       /* send_batch */
 };
 
 /* Passive UNIX socket. */
 
 static int punix_accept(int fd, const struct sockaddr *sa, size_t sa_len,
-                        struct vconn **vconnp);
+                        void *aux, struct vconn **vconnp);
 
 static int
 punix_open(const char *name UNUSED, char *suffix, struct pvconn **pvconnp)
@@ -106,12 +107,12 @@ punix_open(const char *name UNUSED, char *suffix, struct pvconn **pvconnp)
         return errno;
     }
 
-    return new_pstream_pvconn("punix", fd, punix_accept, pvconnp);
+    return new_pstream_pvconn("punix", fd, punix_accept, NULL, pvconnp);
 }
 
 static int
 punix_accept(int fd, const struct sockaddr *sa, size_t sa_len,
-             struct vconn **vconnp)
+             void *aux UNUSED, struct vconn **vconnp)
 {
     const struct sockaddr_un *sun = (const struct sockaddr_un *) sa;
     int name_len = get_unix_name_len(sa_len);
@@ -68,20 +68,28 @@ enum vconn_state {
 static struct vconn_class *vconn_classes[] = {
     &tcp_vconn_class,
     &unix_vconn_class,
+    &mem_vconn_class,
 #ifdef HAVE_NETLINK
     &netlink_vconn_class,
 #endif
 #ifdef HAVE_OPENSSL
     &ssl_vconn_class,
 #endif
+#ifdef HAVE_SHM_VCONN
+    &shm_vconn_class,
+#endif
 };
 
 static struct pvconn_class *pvconn_classes[] = {
     &ptcp_pvconn_class,
     &punix_pvconn_class,
+    &pmem_pvconn_class,
 #ifdef HAVE_OPENSSL
     &pssl_pvconn_class,
 #endif
+#ifdef HAVE_SHM_VCONN
+    &pshm_pvconn_class,
+#endif
 };
 
 /* High rate limit because most of the rate-limiting here is individual
@@ -145,19 +153,23 @@ vconn_usage(bool active, bool passive, bool bootstrap UNUSED)
         printf("  nl:DP_IDX               "
                "local datapath DP_IDX\n");
 #endif
-        printf("  tcp:HOST[:PORT]         "
+        printf("  tcp:HOST[:PORT][,OPT]   "
                "PORT (default: %d) on remote TCP HOST\n", OFP_TCP_PORT);
 #ifdef HAVE_OPENSSL
         printf("  ssl:HOST[:PORT]         "
                "SSL PORT (default: %d) on remote HOST\n", OFP_SSL_PORT);
 #endif
         printf("  unix:FILE               Unix domain socket named FILE\n");
+#ifdef HAVE_SHM_VCONN
+        printf("  shm:FILE                "
+               "shared memory, set up via Unix socket FILE\n");
+#endif
         printf("  fd:N                    File descriptor N\n");
     }
 
     if (passive) {
         printf("Passive OpenFlow connection methods:\n");
-        printf("  ptcp:[PORT]             "
+        printf("  ptcp:[PORT][,OPT]       "
                "listen to TCP PORT (default: %d)\n",
                OFP_TCP_PORT);
 #ifdef HAVE_OPENSSL
@@ -167,6 +179,14 @@ vconn_usage(bool active, bool passive, bool bootstrap UNUSED)
 #endif
         printf("  punix:FILE              "
                "listen on Unix domain socket FILE\n");
+#ifdef HAVE_SHM_VCONN
+        printf("  pshm:FILE               "
+               "listen for shared memory connections on FILE\n");
+#endif
+    }
+
+    if (active || passive) {
+        printf("TCP options (OPT): nodelay=yes|no, cork, sndbuf=BYTES\n");
     }
 
 #ifdef HAVE_OPENSSL
@@ -565,6 +585,52 @@ do_send(struct vconn *vconn, struct ofpbuf *msg)
     return retval;
 }
 
+/* Tries to queue the 'n' messages in 'msgs' for transmission on 'vconn', in
+ * order.  Stores into '*n_sentp' the number of messages, counting from the
+ * first, that were accepted; ownership of each of those passes to 'vconn'
+ * just as if it had been passed to vconn_send(), and the caller retains the
+ * rest.  Returns 0 if all 'n' messages were accepted, otherwise a positive
+ * errno value, which is EAGAIN if 'vconn' cannot take any more for now.
+ *
+ * Where the vconn supports it, the whole batch goes to the kernel in a single
+ * system call, so this is much cheaper than calling vconn_send() once per
+ * message when many messages are ready at once.
+ *
+ * vconn_send_batch will not block. */
+int
+vconn_send_batch(struct vconn *vconn, struct ofpbuf *msgs[], size_t n,
+                 size_t *n_sentp)
+{
+    int retval;
+
+    *n_sentp = 0;
+    retval = vconn_connect(vconn);
+    if (retval) {
+        return retval;
+    }
+
+    if (vconn->class->send_batch && !VLOG_IS_DBG_ENABLED()) {
+#ifndef NDEBUG
+        size_t i;
+
+        for (i = 0; i < n; i++) {
+            assert(msgs[i]->size >= sizeof(struct ofp_header));
+            assert(((struct ofp_header *) msgs[i]->data)->length
+                   == htons(msgs[i]->size));
+        }
+#endif
+        return (vconn->class->send_batch)(vconn, msgs, n, n_sentp);
+    }
+
+    for (; *n_sentp < n; ++*n_sentp) {
+        retval = do_send(vconn, msgs[*n_sentp]);
+        if (retval) {
+            return retval;
+        }
+    }
+    return 0;
+}
+
 /* Same as vconn_send, except that it waits until 'msg' can be transmitted. */
 int
 vconn_send_block(struct vconn *vconn, struct ofpbuf *msg)
@@ -1,7 +1,8 @@
 bin_PROGRAMS += secchan/ofprotocol
 man_MANS += secchan/ofprotocol.8
 
-secchan_ofprotocol_SOURCES = \
+noinst_LIBRARIES += secchan/libsecchan.a
+secchan_libsecchan_a_SOURCES = \
 	secchan/discovery.c \
 	secchan/discovery.h \
 	secchan/emerg-flow.c \
@@ -24,7 +25,10 @@ secchan_ofprotocol_SOURCES = \
 	secchan/status.h \
 	secchan/stp-secchan.c \
 	secchan/stp-secchan.h
-secchan_ofprotocol_LDADD = lib/libopenflow.a $(FAULT_LIBS) $(SSL_LIBS)
+
+secchan_ofprotocol_SOURCES = secchan/ofprotocol.c
+secchan_ofprotocol_LDADD = \
+	secchan/libsecchan.a lib/libopenflow.a $(FAULT_LIBS) $(SSL_LIBS)
 
 EXTRA_DIST += secchan/ofprotocol.8.in
 DISTCLEANFILES += secchan/ofprotocol.8
@@ -128,6 +128,9 @@ emerg_flow_start(struct secchan *secchan, const struct settings *settings,
 		emerg_flow_periodic_cb,	/* periodic_cb */
 		NULL,		/* wait_cb */
 		NULL,		/* closing_cb */
+		0,		/* local_types */
+		0,		/* remote_types */
+		"emerg-flow",	/* name */
 	};
 
 	context = xmalloc(sizeof(*context));
@@ -131,12 +131,18 @@ fail_open_status_cb(struct status_reply *sr, void *fail_open_)
     status_reply_put(sr, "max-idle=%d", s->max_idle);
 }
 
+/* The learning switch only takes over messages from the datapath while the
+ * controller is disconnected, and then the relay offers it every message
+ * regardless of type. */
 static struct hook_class fail_open_hook_class = {
     fail_open_local_packet_cb,  /* local_packet_cb */
     NULL,                       /* remote_packet_cb */
     fail_open_periodic_cb,      /* periodic_cb */
     fail_open_wait_cb,          /* wait_cb */
     NULL,                       /* closing_cb */
+    0,                          /* local_types */
+    0,                          /* remote_types */
+    "fail-open",                /* name */
 };
 
 void
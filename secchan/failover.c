@@ -31,35 +31,84 @@
  */
 
 #include <config.h>
+#include <arpa/inet.h>
 #include <stdlib.h>
 #include <stddef.h>
 #include <string.h>
 
+#include "openflow/openflow.h"
+
 #include "util.h"
+#include "ofpbuf.h"
 #include "rconn.h"
 #include "secchan.h"
 #include "status.h"
 #include "timeval.h"
-#include "sat-math.h"
+#include "vconn.h"
 #include "failover.h"
 #define THIS_MODULE VLM_failover
 #include "vlog.h"
 
-struct failover_peer {
-	time_t epoch;
+/* A connection to a backup controller, kept up while another controller is
+ * in charge so that it can take over at once when that one fails.  The
+ * secure channel answers the controller's echo and features requests itself,
+ * passes on port status changes so that its view of the ports stays current,
+ * and refuses any other request with an OFPBRC_EPERM error, so that the
+ * controller knows that it is not in charge.  It is sent nothing else until
+ * it is promoted. */
+struct failover_standby {
+	struct rconn *rconn;
+	int n_txq;		/* Replies queued on 'rconn'. */
+	bool features_pending;	/* Owes the controller a features reply? */
+	uint32_t features_xid;	/* xid of the request it owes a reply to. */
 };
 
 struct failover_context {
 	const struct settings *settings;
 	const struct secchan *secchan;
 	struct rconn *remote_rconn;
-	int index;
-	struct failover_peer *peers[MAX_CONTROLLERS];
+
+	/* One standby connection per controller other than the one that
+	 * 'remote_rconn' is connected to.  Promoting a standby swaps its
+	 * connection with 'remote_rconn''s, so that the standby then tries to
+	 * reconnect to the controller that failed. */
+	struct failover_standby standbys[MAX_CONTROLLERS - 1];
+	int n_standbys;
+
+	/* Latest features reply from the datapath, kept up to date with the
+	 * port status messages since then, to answer the standby controllers'
+	 * features requests with. */
+	struct ofpbuf *features;
+
+	/* Statistics. */
+	long long int down_since;	/* When 'remote_rconn' was seen down. */
+	unsigned int n_failovers;
+	long long int last_failover_msec; /* Time 'remote_rconn' was down. */
+	unsigned long long int n_replayed; /* Packet-ins passed on. */
 };
 
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
+
+/* Maximum number of messages read from a standby connection per call to
+ * failover_periodic_cb(). */
+#define STANDBY_MAX_RECV 50
+
+/* Maximum number of replies queued on a standby connection. */
+#define STANDBY_MAX_TXQ 10
+
 static void failover_status_cb(struct status_reply *, void *);
-static bool is_timed_out(const struct failover_peer *, int);
+static bool failover_local_packet_cb(struct relay *, void *);
 static void failover_periodic_cb(void *);
+static void failover_wait_cb(void *);
+static void send_features_reply(struct failover_standby *,
+				const struct ofpbuf *features, uint32_t xid);
+static void update_features(struct ofpbuf *features,
+			    const struct ofp_port_status *);
+static void send_eperm(struct failover_standby *, const struct ofpbuf *rq);
+static void standby_run(struct failover_context *,
+			struct failover_standby *);
+static bool is_ready(const struct failover_standby *);
+static bool promote_standby(struct failover_context *);
 
 static void
 failover_status_cb(struct status_reply *status_reply, void *context_)
@@ -76,39 +125,264 @@ failover_status_cb(struct status_reply *status_reply, void *context_)
 		status_reply_put(status_reply, "controller#%d=%s",
 				 i, context->settings->controller_names[i]);
 	}
+
+	status_reply_put(status_reply, "primary=%s",
+			 rconn_get_name(context->remote_rconn));
+	for (i = 0; i < context->n_standbys; ++i) {
+		const struct failover_standby *standby = &context->standbys[i];
+		status_reply_put(status_reply, "standby#%d=%s", i,
+				 rconn_get_name(standby->rconn));
+		status_reply_put(status_reply, "standby#%d-state=%s", i,
+				 is_ready(standby) ? "READY"
+				 : rconn_get_state(standby->rconn));
+	}
+	status_reply_put(status_reply, "failovers=%u",
+			 context->n_failovers);
+	if (context->n_failovers) {
+		status_reply_put(status_reply, "last-failover-msec=%lld",
+				 context->last_failover_msec);
+	}
+	status_reply_put(status_reply, "replayed-packet-ins=%llu",
+			 context->n_replayed);
 }
 
 static bool
-is_timed_out(const struct failover_peer *peer, int max_backoff)
+failover_local_packet_cb(struct relay *r, void *context_)
+{
+	struct failover_context *context = context_;
+	struct failover_standby *standby;
+	const struct ofpbuf *msg = r->msg.buf;
+
+	if (r->msg.type == OFPT_FEATURES_REPLY) {
+		ofpbuf_delete(context->features);
+		context->features = ofpbuf_clone(msg);
+		for (standby = context->standbys;
+		     standby < &context->standbys[context->n_standbys];
+		     standby++) {
+			if (standby->features_pending) {
+				send_features_reply(standby, msg,
+						    standby->features_xid);
+			}
+		}
+	} else if (r->msg.type == OFPT_PORT_STATUS) {
+		if (msg->size < sizeof(struct ofp_port_status))
+			return false;
+		if (context->features)
+			update_features(context->features, msg->data);
+		for (standby = context->standbys;
+		     standby < &context->standbys[context->n_standbys];
+		     standby++) {
+			if (is_ready(standby)) {
+				rconn_send_with_limit(standby->rconn,
+						      ofpbuf_clone(msg),
+						      &standby->n_txq,
+						      STANDBY_MAX_TXQ);
+			}
+		}
+	} else if (r->msg.type == OFPT_PACKET_IN
+		   && !rconn_is_connected(context->remote_rconn)) {
+		/* Promote a standby now rather than in the periodic callback,
+		 * so that this packet_in goes to it instead of being dropped. */
+		promote_standby(context);
+	}
+	return false;
+}
+
+/* Queues a copy of 'features', with transaction ID 'xid', for sending to
+ * 'standby'. */
+static void
+send_features_reply(struct failover_standby *standby,
+		    const struct ofpbuf *features, uint32_t xid)
+{
+	struct ofpbuf *b = ofpbuf_clone(features);
+	struct ofp_header *oh = b->data;
+
+	oh->xid = xid;
+	rconn_send_with_limit(standby->rconn, b, &standby->n_txq,
+			      STANDBY_MAX_TXQ);
+	standby->features_pending = false;
+}
+
+/* Applies the port change described by 'ops' to the port list in
+ * 'features', a features reply. */
+static void
+update_features(struct ofpbuf *features, const struct ofp_port_status *ops)
+{
+	struct ofp_switch_features *osf = features->data;
+	size_t n_ports = ((features->size - offsetof(struct ofp_switch_features,
+						     ports))
+			  / sizeof *osf->ports);
+	size_t i;
+
+	for (i = 0; i < n_ports; i++) {
+		if (osf->ports[i].port_no == ops->desc.port_no)
+			break;
+	}
+
+	if (ops->reason == OFPPR_DELETE) {
+		if (i < n_ports) {
+			memmove(&osf->ports[i], &osf->ports[i + 1],
+				(n_ports - i - 1) * sizeof *osf->ports);
+			features->size -= sizeof *osf->ports;
+		}
+	} else if (i < n_ports) {
+		osf->ports[i] = ops->desc;
+	} else if (features->size + sizeof ops->desc <= UINT16_MAX) {
+		ofpbuf_put(features, &ops->desc, sizeof ops->desc);
+		osf = features->data;
+	}
+	osf->header.length = htons(features->size);
+}
+
+/* Queues for sending to 'standby' an OFPBRC_EPERM error in reply to request
+ * 'rq', which a controller that is not in charge may not make. */
+static void
+send_eperm(struct failover_standby *standby, const struct ofpbuf *rq)
 {
-	unsigned int sat_value = sat_add(peer->epoch, max_backoff);
-	return time_now() >= sat_value;
+	const struct ofp_header *oh = rq->data;
+	size_t len = MIN(rq->size, 64);
+	struct ofp_error_msg *oem;
+	struct ofpbuf *b;
+
+	oem = make_openflow_xid(sizeof *oem + len, OFPT_ERROR, oh->xid, &b);
+	oem->type = htons(OFPET_BAD_REQUEST);
+	oem->code = htons(OFPBRC_EPERM);
+	memcpy(oem->data, rq->data, len);
+	rconn_send_with_limit(standby->rconn, b, &standby->n_txq,
+			      STANDBY_MAX_TXQ);
+}
+
+/* Keeps 'standby''s connection going and handles the requests that its
+ * controller sends while it is not in charge. */
+static void
+standby_run(struct failover_context *context,
+	    struct failover_standby *standby)
+{
+	unsigned int seqno = rconn_get_connection_seqno(standby->rconn);
+	int i;
+
+	rconn_run(standby->rconn);
+	if (rconn_get_connection_seqno(standby->rconn) != seqno) {
+		standby->features_pending = false;
+	}
+
+	for (i = 0; i < STANDBY_MAX_RECV; i++) {
+		struct ofpbuf *b = rconn_recv(standby->rconn);
+		struct ofp_header *oh;
+
+		if (!b)
+			break;
+		oh = b->data;
+		switch (oh->type) {
+		case OFPT_ECHO_REQUEST:
+			rconn_send_with_limit(standby->rconn,
+					      make_echo_reply(oh),
+					      &standby->n_txq,
+					      STANDBY_MAX_TXQ);
+			break;
+
+		case OFPT_FEATURES_REQUEST:
+			if (context->features) {
+				send_features_reply(standby, context->features,
+						    oh->xid);
+			} else {
+				standby->features_pending = true;
+				standby->features_xid = oh->xid;
+			}
+			break;
+
+		case OFPT_ECHO_REPLY:
+		case OFPT_ERROR:
+			break;
+
+		default:
+			VLOG_DBG_RL(&rl, "%s: refusing message of type %d "
+				    "from standby controller",
+				    rconn_get_name(standby->rconn), oh->type);
+			send_eperm(standby, b);
+			break;
+		}
+		ofpbuf_delete(b);
+	}
+}
+
+/* Returns true if 'standby' is connected and has been told the datapath's
+ * features, so that its controller is ready to take charge. */
+static bool
+is_ready(const struct failover_standby *standby)
+{
+	return (rconn_is_connected(standby->rconn)
+		&& !standby->features_pending);
+}
+
+/* If one of the standby controllers is ready, makes it the controller in
+ * charge in place of the one that 'context->remote_rconn' has lost, and
+ * passes it the packet_ins that the lost controller never got.  Returns true
+ * if successful, false if no standby was ready. */
+static bool
+promote_standby(struct failover_context *context)
+{
+	struct rconn *remote = context->remote_rconn;
+	struct ofpbuf *b;
+	char *prev_peer;
+	int i;
+
+	if (!context->down_since)
+		context->down_since = time_msec();
+	for (i = 0; i < context->n_standbys; ++i) {
+		if (is_ready(&context->standbys[i]))
+			break;
+	}
+	if (i >= context->n_standbys)
+		return false;
+
+	prev_peer = xstrdup(rconn_get_name(remote));
+	rconn_swap_connection(remote, context->standbys[i].rconn);
+	context->standbys[i].features_pending = false;
+
+	while ((b = rconn_pop_unsent(remote)) != NULL) {
+		if (!rconn_send(remote, b, NULL)) {
+			context->n_replayed++;
+		} else {
+			ofpbuf_delete(b);
+		}
+	}
+
+	context->n_failovers++;
+	context->last_failover_msec = time_msec() - context->down_since;
+	context->down_since = 0;
+	VLOG_INFO("Switching over to %s, from %s, after %lld ms",
+		  rconn_get_name(remote), prev_peer,
+		  context->last_failover_msec);
+	free(prev_peer);
+	return true;
 }
 
 static void
 failover_periodic_cb(void *context_)
 {
 	struct failover_context *context = context_;
-	char *curr_peer = NULL;
-	char *prev_peer = NULL;
+	int i;
+
+	for (i = 0; i < context->n_standbys; ++i)
+		standby_run(context, &context->standbys[i]);
 
 	if (rconn_is_connected(context->remote_rconn))
-		return;
+		context->down_since = 0;
+	else
+		promote_standby(context);
+}
 
-	if (!is_timed_out(context->peers[context->index],
-			  context->settings->max_backoff)) {
-		return;
-	}
+static void
+failover_wait_cb(void *context_)
+{
+	struct failover_context *context = context_;
+	int i;
 
-	rconn_disconnect(context->remote_rconn);
-	prev_peer = (char *)context->settings->controller_names[context->index];
-	context->index = (context->index + 1)
-		% context->settings->num_controllers;
-	curr_peer = (char *)context->settings->controller_names[context->index];
-	rconn_connect(context->remote_rconn,
-		      context->settings->controller_names[context->index]);
-	context->peers[context->index]->epoch = time_now();
-	VLOG_INFO("Switching over to %s, from %s", curr_peer, prev_peer);
+	for (i = 0; i < context->n_standbys; ++i) {
+		rconn_run_wait(context->standbys[i].rconn);
+		rconn_recv_wait(context->standbys[i].rconn);
+	}
 }
 
 void
@@ -118,26 +392,37 @@ failover_start(struct secchan *secchan, const struct settings *settings,
 	struct failover_context *context = NULL;
 	int i;
 	static struct hook_class failover_hook_class = {
-		NULL,		/* local_packet_cb */
+		failover_local_packet_cb,	/* local_packet_cb */
 		NULL,		/* remote_packet_cb */
 		failover_periodic_cb,	/* periodic_cb */
-		NULL,		/* wait_cb */
+		failover_wait_cb,	/* wait_cb */
 		NULL,		/* closing_cb */
+		(HOOK_TYPE_BIT(OFPT_FEATURES_REPLY)
+		 | HOOK_TYPE_BIT(OFPT_PORT_STATUS)
+		 | HOOK_TYPE_BIT(OFPT_PACKET_IN)),	/* local_types */
+		0,		/* remote_types */
+		"failover",	/* name */
 	};
 
-	context = xmalloc(sizeof(*context));
+	context = xcalloc(1, sizeof(*context));
 	context->settings = settings;
 	context->secchan = secchan;
 	context->remote_rconn = remote_rconn;
-	context->index = 0;
-	for (i = 0; i < MAX_CONTROLLERS; ++i) {
-		context->peers[i] = NULL;
+	for (i = 1; i < MAX_CONTROLLERS; ++i) {
+		struct failover_standby *standby;
+
 		if (settings->controller_names[i] == NULL)
 			continue;
-		context->peers[i] = xmalloc(sizeof(struct failover_peer));
-		context->peers[i]->epoch = time_now();
+		standby = &context->standbys[context->n_standbys++];
+		standby->rconn = rconn_create(settings->probe_interval,
+					      settings->max_backoff);
+		rconn_connect(standby->rconn, settings->controller_names[i]);
 	}
 
+	/* Packet-ins that the controller in charge never got are passed on to
+	 * the standby that takes over from it. */
+	rconn_keep_unsent(remote_rconn, HOOK_TYPE_BIT(OFPT_PACKET_IN));
+
 	switch_status_register_category(switch_status, "failover",
 					failover_status_cb, context);
 	add_hook(secchan, &failover_hook_class, context);
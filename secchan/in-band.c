@@ -136,24 +136,32 @@ in_band_learn_mac(struct in_band_data *in_band,
     }
 }
 
+/* Returns true if 'flow' is an OpenFlow connection over TCP or SSL. */
+static bool
+is_openflow_flow(const struct flow *flow)
+{
+    return (flow->dl_type == htons(ETH_TYPE_IP)
+            && flow->nw_proto == IP_TYPE_TCP
+            && (flow->tp_src == htons(OFP_TCP_PORT)
+                || flow->tp_src == htons(OFP_SSL_PORT)
+                || flow->tp_dst == htons(OFP_TCP_PORT)
+                || flow->tp_dst == htons(OFP_SSL_PORT)));
+}
+
 static bool
 in_band_local_packet_cb(struct relay *r, void *in_band_)
 {
     struct in_band_data *in_band = in_band_;
     struct rconn *rc = r->halves[HALF_LOCAL].rconn;
+    const struct ofpbuf *payload = &r->msg.payload;
+    uint16_t in_port = r->msg.in_port;
     struct ofp_packet_in *opi;
     struct eth_header *eth;
-    struct ofpbuf payload;
-    struct flow flow;
-    uint16_t in_port;
     int out_port;
 
     if (!get_ofp_packet_eth_header(r, &opi, &eth) || !in_band->of_device) {
         return false;
     }
-    in_port = ntohs(opi->in_port);
-    get_ofp_packet_payload(opi, &payload);
-    flow_extract(&payload, in_port, &flow);
 
     /* Deal with local stuff. */
     if (in_port == OFPP_LOCAL) {
@@ -171,12 +179,7 @@ in_band_local_packet_cb(struct relay *r, void *in_band_)
         out_port = OFPP_FLOOD;
     } else if ((is_controller_mac(eth->eth_dst, in_band)
                 || is_controller_mac(eth->eth_src, in_band))
-               && flow.dl_type == htons(ETH_TYPE_IP)
-               && flow.nw_proto == IP_TYPE_TCP
-               && (flow.tp_src == htons(OFP_TCP_PORT)
-                   || flow.tp_src == htons(OFP_SSL_PORT)
-                   || flow.tp_dst == htons(OFP_TCP_PORT)
-                   || flow.tp_dst == htons(OFP_SSL_PORT))) {
+               && is_openflow_flow(get_ofp_packet_flow(r))) {
         /* Traffic to or from controller.  Switch it by hand. */
         in_band_learn_mac(in_band, in_port, eth->eth_src);
         out_port = mac_learning_lookup(in_band->ml, eth->eth_dst, 0);
@@ -200,25 +203,27 @@ in_band_local_packet_cb(struct relay *r, void *in_band_)
 
     if (in_port == out_port) {
         /* The input and output port match.  Set up a flow to drop packets. */
-        queue_tx(rc, in_band, make_add_flow(&flow, ntohl(opi->buffer_id),
-                                          in_band->s->max_idle, 0));
+        queue_tx(rc, in_band, make_add_flow(get_ofp_packet_flow(r),
+                                            ntohl(opi->buffer_id),
+                                            in_band->s->max_idle, 0));
     } else if (out_port != OFPP_FLOOD) {
         /* The output port is known, so add a new flow. */
         queue_tx(rc, in_band,
-                 make_add_simple_flow(&flow, ntohl(opi->buffer_id),
+                 make_add_simple_flow(get_ofp_packet_flow(r),
+                                      ntohl(opi->buffer_id),
                                       out_port, in_band->s->max_idle));
 
         /* If the switch didn't buffer the packet, we need to send a copy. */
         if (ntohl(opi->buffer_id) == UINT32_MAX) {
             queue_tx(rc, in_band,
-                     make_unbuffered_packet_out(&payload, in_port, out_port));
+                     make_unbuffered_packet_out(payload, in_port, out_port));
         }
     } else {
         /* We don't know that MAC.  Send along the packet without setting up a
          * flow. */
         struct ofpbuf *b;
         if (ntohl(opi->buffer_id) == UINT32_MAX) {
-            b = make_unbuffered_packet_out(&payload, in_port, out_port);
+            b = make_unbuffered_packet_out(payload, in_port, out_port);
         } else {
             b = make_buffered_packet_out(ntohl(opi->buffer_id),
                                          in_port, out_port);
@@ -256,14 +261,6 @@ in_band_status_cb(struct status_reply *sr, void *in_band_)
     }
 }
 
-void
-get_ofp_packet_payload(struct ofp_packet_in *opi, struct ofpbuf *payload)
-{
-    payload->data = opi->data;
-    payload->size = ntohs(opi->header.length) - offsetof(struct ofp_packet_in,
-                                                         data);
-}
-
 static void
 in_band_local_port_cb(const struct ofp_phy_port *port, void *in_band_)
 {
@@ -310,6 +307,9 @@ static struct hook_class in_band_hook_class = {
     in_band_periodic_cb,        /* periodic_cb */
     in_band_wait_cb,            /* wait_cb */
     NULL,                       /* closing_cb */
+    HOOK_TYPE_BIT(OFPT_PACKET_IN), /* local_types */
+    0,                          /* remote_types */
+    "in-band",                  /* name */
 };
 
 void
@@ -594,6 +594,10 @@ static struct hook_class port_watcher_hook_class = {
     port_watcher_periodic_cb,                            /* periodic_cb */
     port_watcher_wait_cb,                                /* wait_cb */
     NULL,                                                /* closing_cb */
+    (HOOK_TYPE_BIT(OFPT_FEATURES_REPLY)                  /* local_types */
+     | HOOK_TYPE_BIT(OFPT_PORT_STATUS)),
+    HOOK_TYPE_BIT(OFPT_PORT_MOD),                        /* remote_types */
+    "port-watcher",                                      /* name */
 };
 
 void
@@ -190,6 +190,9 @@ protocol_stat_start(struct secchan *secchan, const struct settings *settings,
 		NULL,		/* periodic_cb */
 		NULL,		/* wait_cb */
 		NULL,		/* closing_cb */
+		0,		/* local_types */
+		HOOK_TYPE_BIT(OFPT_VENDOR),	/* remote_types */
+		"protocol-stat",	/* name */
 	};
 
 	context = xmalloc(sizeof(*context));
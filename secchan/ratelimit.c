@@ -35,9 +35,11 @@
 #include "ratelimit.h"
 #include <arpa/inet.h>
 #include <stdlib.h>
+#include "list.h"
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
 #include "poll-loop.h"
+#include "port-array.h"
 #include "queue.h"
 #include "rconn.h"
 #include "secchan.h"
@@ -45,14 +47,30 @@
 #include "timeval.h"
 #include "vconn.h"
 
+/* Packets queued for one ingress port. */
+struct rl_port {
+    struct ofp_queue queue;     /* Queued packet_in messages. */
+    struct list active_node;    /* In rate_limiter's 'active', if queued. */
+    struct list length_node;    /* In rate_limiter's 'lengths[queue.n]'. */
+    unsigned long long n_dropped; /* # dropped from this queue on overflow. */
+};
+
 struct rate_limiter {
     const struct settings *s;
     struct rconn *remote_rconn;
 
-    /* One queue per physical port. */
-    struct ofp_queue queues[OFPP_MAX];
-    int n_queued;               /* Sum over queues[*].n. */
-    int next_tx_port;           /* Next port to check in round-robin. */
+    /* One queue per physical port, created when the port first needs one. */
+    struct port_array ports;    /* Contains "struct rl_port *"s. */
+    struct list active;         /* Ports with packets queued, in tx order. */
+    int n_queued;               /* Sum over all ports' queue.n. */
+
+    /* Ports indexed by queue length, so that the longest queue can be found
+     * without looking at the others.  lengths[n] lists the ports with exactly
+     * 'n' packets queued (lengths[0] is unused), and no queue is longer than
+     * 'max_length'. */
+    struct list *lengths;
+    int n_lengths;              /* Number of elements in 'lengths'. */
+    int max_length;             /* Length of longest queue, 0 if none. */
 
     /* Token bucket.
      *
@@ -73,52 +91,106 @@ struct rate_limiter {
     unsigned long long n_tx_dropped;    /* # dropped due to tx overflow. */
 };
 
-/* Drop a packet from the longest queue in 'rl'. */
-static void
-drop_packet(struct rate_limiter *rl)
+/* Returns the queue for 'port_no' in 'rl', creating it if necessary. */
+static struct rl_port *
+get_port(struct rate_limiter *rl, uint16_t port_no)
 {
-    struct ofp_queue *longest;  /* Queue currently selected as longest. */
-    int n_longest;              /* # of queues of same length as 'longest'. */
-    struct ofp_queue *q;
+    struct rl_port *p = port_array_get(&rl->ports, port_no);
+    if (!p) {
+        p = xcalloc(1, sizeof *p);
+        queue_init(&p->queue);
+        port_array_set(&rl->ports, port_no, p);
+    }
+    return p;
+}
 
-    longest = &rl->queues[0];
-    n_longest = 1;
-    for (q = &rl->queues[0]; q < &rl->queues[OFPP_MAX]; q++) {
-        if (longest->n < q->n) {
-            longest = q;
-            n_longest = 1;
-        } else if (longest->n == q->n) {
-            n_longest++;
+/* Makes room in rl->lengths for a queue of length 'n'.  The list heads cannot
+ * simply be realloc()'d, because the lists' elements point to them. */
+static void
+grow_lengths(struct rate_limiter *rl, int n)
+{
+    int n_lengths = MAX(rl->n_lengths * 2, MAX(n + 1, 16));
+    struct list *lengths = xmalloc(n_lengths * sizeof *lengths);
+    int i;
 
-            /* Randomly select one of the longest queues, with a uniform
-             * distribution (Knuth algorithm 3.4.2R). */
-            if (!random_range(n_longest)) {
-                longest = q;
-            }
+    for (i = 0; i < n_lengths; i++) {
+        if (i < rl->n_lengths && !list_is_empty(&rl->lengths[i])) {
+            list_replace(&lengths[i], &rl->lengths[i]);
+        } else {
+            list_init(&lengths[i]);
         }
     }
+    free(rl->lengths);
+    rl->lengths = lengths;
+    rl->n_lengths = n_lengths;
+}
 
-    /* FIXME: do we want to pop the tail instead? */
-    ofpbuf_delete(queue_pop_head(longest));
+/* Appends 'msg' to the queue for 'p' in 'rl'. */
+static void
+enqueue_packet(struct rate_limiter *rl, struct rl_port *p, struct ofpbuf *msg)
+{
+    queue_push_tail(&p->queue, msg);
+    if (p->queue.n == 1) {
+        list_push_back(&rl->active, &p->active_node);
+    } else {
+        list_remove(&p->length_node);
+    }
+    if (p->queue.n >= rl->n_lengths) {
+        grow_lengths(rl, p->queue.n);
+    }
+    list_push_back(&rl->lengths[p->queue.n], &p->length_node);
+    rl->max_length = MAX(rl->max_length, p->queue.n);
+    rl->n_queued++;
+}
+
+/* Removes and returns the packet at the head of the queue for 'p' in 'rl'.
+ * The caller must take 'p' off rl->active if its queue becomes empty. */
+static struct ofpbuf *
+pop_packet(struct rate_limiter *rl, struct rl_port *p)
+{
+    struct ofpbuf *b = queue_pop_head(&p->queue);
+
+    list_remove(&p->length_node);
+    if (p->queue.n) {
+        list_push_back(&rl->lengths[p->queue.n], &p->length_node);
+    }
+    if (list_is_empty(&rl->lengths[rl->max_length])) {
+        /* 'p' was the only longest queue, so now it is one shorter, or, if it
+         * is empty, so is every other queue. */
+        rl->max_length--;
+    }
     rl->n_queued--;
+    return b;
+}
+
+/* Drop a packet from the longest queue in 'rl'.  Among queues of the same
+ * length, the one that has been that long for the longest time loses. */
+static void
+drop_packet(struct rate_limiter *rl)
+{
+    struct rl_port *p = CONTAINER_OF(list_front(&rl->lengths[rl->max_length]),
+                                     struct rl_port, length_node);
+
+    /* FIXME: do we want to pop the tail instead? */
+    ofpbuf_delete(pop_packet(rl, p));
+    if (!p->queue.n) {
+        list_remove(&p->active_node);
+    }
+    p->n_dropped++;
+    rl->n_queue_dropped++;
 }
 
 /* Remove and return the next packet to transmit (in round-robin order). */
 static struct ofpbuf *
 dequeue_packet(struct rate_limiter *rl)
 {
-    unsigned int i;
-
-    for (i = 0; i < OFPP_MAX; i++) {
-        unsigned int port = (rl->next_tx_port + i) % OFPP_MAX;
-        struct ofp_queue *q = &rl->queues[port];
-        if (q->n) {
-            rl->next_tx_port = (port + 1) % OFPP_MAX;
-            rl->n_queued--;
-            return queue_pop_head(q);
-        }
+    struct rl_port *p = CONTAINER_OF(list_pop_front(&rl->active),
+                                     struct rl_port, active_node);
+    struct ofpbuf *b = pop_packet(rl, p);
+    if (p->queue.n) {
+        list_push_back(&rl->active, &p->active_node);
     }
-    NOT_REACHED();
+    return b;
 }
 
 /* Add tokens to the bucket based on elapsed time. */
@@ -153,14 +225,12 @@ rate_limit_local_packet_cb(struct relay *r, void *rl_)
 {
     struct rate_limiter *rl = rl_;
     const struct settings *s = rl->s;
-    struct ofp_packet_in *opi;
 
-    opi = get_ofp_packet_in(r);
-    if (!opi) {
+    if (!get_ofp_packet_in(r)) {
         return false;
     }
 
-    if (opi->reason == OFPR_ACTION) {
+    if (r->msg.reason == OFPR_ACTION) {
         /* Don't rate-limit 'ofp-packet_in's generated by flows that the
          * controller set up.  XXX we should really just rate-limit them
          * *separately* so that no one can flood the controller this way. */
@@ -174,13 +244,12 @@ rate_limit_local_packet_cb(struct relay *r, void *rl_)
         return false;
     } else {
         /* Otherwise queue it up for the periodic callback to drain out. */
-        struct ofpbuf *msg = r->halves[HALF_LOCAL].rxbuf;
-        int port = ntohs(opi->in_port) % OFPP_MAX;
+        struct ofpbuf *msg = r->msg.buf;
+        struct rl_port *p = get_port(rl, r->msg.in_port);
         if (rl->n_queued >= s->burst_limit) {
             drop_packet(rl);
         }
-        queue_push_tail(&rl->queues[port], ofpbuf_clone(msg));
-        rl->n_queued++;
+        enqueue_packet(rl, p, ofpbuf_clone(msg));
         rl->n_limited++;
         return true;
     }
@@ -190,11 +259,20 @@ static void
 rate_limit_status_cb(struct status_reply *sr, void *rl_)
 {
     struct rate_limiter *rl = rl_;
+    unsigned int port_no;
+    struct rl_port *p;
 
     status_reply_put(sr, "normal=%llu", rl->n_normal);
     status_reply_put(sr, "limited=%llu", rl->n_limited);
     status_reply_put(sr, "queue-dropped=%llu", rl->n_queue_dropped);
     status_reply_put(sr, "tx-dropped=%llu", rl->n_tx_dropped);
+    for (p = port_array_first(&rl->ports, &port_no); p;
+         p = port_array_next(&rl->ports, &port_no)) {
+        if (p->n_dropped) {
+            status_reply_put(sr, "port%u-queue-dropped=%llu",
+                             port_no, p->n_dropped);
+        }
+    }
 }
 
 static void
@@ -240,6 +318,9 @@ static struct hook_class rate_limit_hook_class = {
     rate_limit_periodic_cb,     /* periodic_cb */
     rate_limit_wait_cb,         /* wait_cb */
     NULL,                       /* closing_cb */
+    HOOK_TYPE_BIT(OFPT_PACKET_IN), /* local_types */
+    0,                          /* remote_types */
+    "rate-limit",               /* name */
 };
 
 void
@@ -247,14 +328,12 @@ rate_limit_start(struct secchan *secchan, const struct settings *s,
                  struct switch_status *ss, struct rconn *remote)
 {
     struct rate_limiter *rl;
-    size_t i;
 
     rl = xcalloc(1, sizeof *rl);
     rl->s = s;
     rl->remote_rconn = remote;
-    for (i = 0; i < ARRAY_SIZE(rl->queues); i++) {
-        queue_init(&rl->queues[i]);
-    }
+    port_array_init(&rl->ports);
+    list_init(&rl->active);
     rl->last_fill = time_msec();
     rl->tokens = s->rate_limit * 100;
     switch_status_register_category(ss, "rate-limit",
@@ -38,8 +38,8 @@
 #include <getopt.h>
 #include <netinet/in.h>
 #include <stdlib.h>
-#include <signal.h>
 #include <string.h>
+#include <time.h>
 
 #include "command-line.h"
 #include "compiler.h"
@@ -49,12 +49,13 @@
 #include "emerg-flow.h"
 #include "fail-open.h"
 #include "failover.h"
-#include "fault.h"
+#include "flow.h"
 #include "in-band.h"
 #include "leak-checker.h"
 #include "list.h"
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
+#include "openflow/openflow-ext.h"
 #include "packets.h"
 #include "protocol-stat.h"
 #include "port-watcher.h"
@@ -67,24 +68,74 @@
 #include "util.h"
 #include "vconn-ssl.h"
 #include "vconn.h"
-#include "vlog-socket.h"
 
 #include "vlog.h"
 #define THIS_MODULE VLM_secchan
 
+/* Calls to one kind of hook callback, for the "hook" status.  Reading the
+ * clock costs about as much as a typical callback, so only one round of calls
+ * in HOOK_SAMPLE_INTERVAL is timed, and the total time is estimated from
+ * those. */
+struct hook_timer {
+    unsigned long long int n_calls;     /* Number of calls. */
+    unsigned long long int n_timed;     /* Number of calls timed. */
+    unsigned long long int nsec;        /* Time taken by the timed calls. */
+};
+
+#define HOOK_SAMPLE_INTERVAL 64
+
 struct hook {
     const struct hook_class *class;
     void *aux;
+    struct hook_timer packet;   /* local_packet_cb and remote_packet_cb. */
+    struct hook_timer periodic; /* periodic_cb. */
+};
+
+/* The hooks whose packet callback to call for one type of message. */
+struct hook_set {
+    struct hook **hooks;
+    size_t n;
 };
 
 struct secchan {
-    struct hook *hooks;
+    struct hook **hooks;
     size_t n_hooks, allocated_hooks;
+
+    /* Packet callbacks to call for messages received from the datapath and
+     * from the controller, indexed by message type.  Element HOOK_N_TYPES
+     * holds every hook with a callback, for messages whose type is too large
+     * for a hook to name and for relays whose peer is not connected. */
+    struct hook_set local_hooks[HOOK_N_TYPES + 1];
+    struct hook_set remote_hooks[HOOK_N_TYPES + 1];
+
+    /* Rounds of hook calls so far, for choosing which ones to time. */
+    unsigned int n_packet_rounds;
+    unsigned int n_periodic_rounds;
+
+    const struct settings *s;
+    struct list relays;
+
+    /* Listeners for management and monitoring connections. */
+    struct pvconn *listeners[MAX_MGMT];
+    size_t n_listeners;
+    struct pvconn *monitor;
+
+    /* Connections to the datapath and the controller. */
+    struct rconn *local_rconn, *remote_rconn;
+
+    struct discovery *discovery;
+    struct switch_status *switch_status;
+    struct port_watcher *pw;
 };
 
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
 
-static void parse_options(int argc, char *argv[], struct settings *);
+/* Maximum number of messages that a relay queues for transmission in one
+ * direction before it stops receiving in that direction.  More than one lets
+ * a run of messages, such as the replies to a flow table dump, go out in a
+ * single batch. */
+#define RELAY_MAX_TXQ 64
+
 static void usage(void) NO_RETURN;
 
 static char *vconn_name_without_subscription(const char *);
@@ -99,77 +150,71 @@ static void relay_run(struct relay *, struct secchan *);
 static void relay_wait(struct relay *);
 static void relay_destroy(struct relay *);
 
-int
-main(int argc, char *argv[])
+static bool hook_start_round(unsigned int *n_rounds, long long int *start);
+static void hook_timer_update(struct hook_timer *, bool timed,
+                              long long int *start);
+static void hook_status_cb(struct status_reply *, void *secchan_);
+
+/* Creates and returns a new secure channel configured by 's', which must
+ * remain valid for as long as the secure channel exists.  Starts listening
+ * for management and monitoring connections but does not connect to the
+ * datapath or the controller until secchan_start() is called, so that the
+ * caller can daemonize in between. */
+struct secchan *
+secchan_create(const struct settings *s)
 {
-    struct settings s;
+    struct secchan *secchan = xcalloc(1, sizeof *secchan);
+    size_t i;
 
-    struct list relays = LIST_INITIALIZER(&relays);
+    secchan->s = s;
+    list_init(&secchan->relays);
 
-    struct secchan secchan;
+    /* Start listening for management and monitoring connections. */
+    for (i = 0; i < s->n_listeners; i++) {
+        secchan->listeners[secchan->n_listeners++]
+            = open_passive_vconn(s->listener_names[i]);
+    }
+    secchan->monitor = (s->monitor_name
+                        ? open_passive_vconn(s->monitor_name)
+                        : NULL);
 
-    struct pvconn *monitor;
+    /* Initialize switch status hook. */
+    switch_status_start(secchan, s, &secchan->switch_status);
+    switch_status_register_category(secchan->switch_status, "hook",
+                                    hook_status_cb, secchan);
 
-    struct pvconn *listeners[MAX_MGMT];
-    size_t n_listeners;
+    return secchan;
+}
 
+/* Connects 'secchan' to its datapath and its controller and sets up the
+ * hooks that process the messages relayed between them. */
+void
+secchan_start(struct secchan *secchan)
+{
+    const struct settings *s = secchan->s;
+    struct switch_status *switch_status = secchan->switch_status;
     char *local_rconn_name;
     struct rconn *async_rconn, *local_rconn, *remote_rconn;
     struct relay *controller_relay;
-    struct discovery *discovery;
-    struct switch_status *switch_status;
-    struct port_watcher *pw;
-    int i;
     int retval;
 
-    set_program_name(argv[0]);
-    register_fault_handlers();
-    time_init();
-    vlog_init();
-    parse_options(argc, argv, &s);
-    signal(SIGPIPE, SIG_IGN);
-
-    secchan.hooks = NULL;
-    secchan.n_hooks = 0;
-    secchan.allocated_hooks = 0;
-
-    /* Start listening for management and monitoring connections. */
-    n_listeners = 0;
-    for (i = 0; i < s.n_listeners; i++) {
-        listeners[n_listeners++] = open_passive_vconn(s.listener_names[i]);
-    }
-    monitor = s.monitor_name ? open_passive_vconn(s.monitor_name) : NULL;
-
-    /* Initialize switch status hook. */
-    switch_status_start(&secchan, &s, &switch_status);
-
-    die_if_already_running();
-    daemonize();
-
-    /* Start listening for vlogconf requests. */
-    retval = vlog_server_listen(NULL, NULL);
-    if (retval) {
-        ofp_fatal(retval, "Could not listen for vlog connections");
-    }
-
-    VLOG_INFO("OpenFlow reference implementation version %s", VERSION BUILDNR);
-    VLOG_INFO("OpenFlow protocol version 0x%02x", OFP_VERSION);
-
     /* Check datapath name, to try to catch command-line invocation errors. */
-    if (strncmp(s.dp_name, "nl:", 3) && strncmp(s.dp_name, "unix:", 5)
-        && !s.controller_names[0]) {
-        VLOG_WARN("Controller not specified and datapath is not nl: or "
-                  "unix:.  (Did you forget to specify the datapath?)");
+    if (strncmp(s->dp_name, "nl:", 3) && strncmp(s->dp_name, "unix:", 5)
+        && strncmp(s->dp_name, "shm:", 4) && strncmp(s->dp_name, "mem:", 4)
+        && !s->controller_names[0]) {
+        VLOG_WARN("Controller not specified and datapath is not nl:, "
+                  "unix:, or shm:.  (Did you forget to specify the "
+                  "datapath?)");
     }
 
-    if (!strncmp(s.dp_name, "nl:", 3)) {
+    if (!strncmp(s->dp_name, "nl:", 3)) {
         /* Connect to datapath with a subscription for asynchronous events.  By
          * separating the connection for asynchronous events from that for
          * request and replies we prevent the socket receive buffer from being
          * filled up by received packet data, which in turn would prevent
          * getting replies to any Netlink messages we send to the kernel. */
-        async_rconn = rconn_create(0, s.max_backoff);
-        rconn_connect(async_rconn, s.dp_name);
+        async_rconn = rconn_create(0, s->max_backoff);
+        rconn_connect(async_rconn, s->dp_name);
         switch_status_register_category(switch_status, "async",
                                         rconn_status_cb, async_rconn);
     } else {
@@ -183,121 +228,146 @@ main(int argc, char *argv[])
     }
 
     /* Connect to datapath without a subscription, for requests and replies. */
-    local_rconn_name = vconn_name_without_subscription(s.dp_name);
-    local_rconn = rconn_create(0, s.max_backoff);
+    local_rconn_name = vconn_name_without_subscription(s->dp_name);
+    local_rconn = rconn_create(0, s->max_backoff);
     rconn_connect(local_rconn, local_rconn_name);
     free(local_rconn_name);
     switch_status_register_category(switch_status, "local",
                                     rconn_status_cb, local_rconn);
 
     /* Connect to controller. */
-    remote_rconn = rconn_create(s.probe_interval, s.max_backoff);
-    if (s.controller_names[0]) {
-        retval = rconn_connect(remote_rconn, s.controller_names[0]);
+    remote_rconn = rconn_create(s->probe_interval, s->max_backoff);
+    if (s->controller_names[0]) {
+        retval = rconn_connect(remote_rconn, s->controller_names[0]);
         if (retval == EAFNOSUPPORT) {
-            ofp_fatal(0, "No support for %s vconn", s.controller_names[0]);
+            ofp_fatal(0, "No support for %s vconn", s->controller_names[0]);
         }
     }
     switch_status_register_category(switch_status, "remote",
                                     rconn_status_cb, remote_rconn);
+    secchan->local_rconn = local_rconn;
+    secchan->remote_rconn = remote_rconn;
 
     /* Start relaying. */
     controller_relay = relay_create(async_rconn, local_rconn, remote_rconn,
                                     false);
-    list_push_back(&relays, &controller_relay->node);
+    list_push_back(&secchan->relays, &controller_relay->node);
 
     /* Set up hooks. */
-    port_watcher_start(&secchan, local_rconn, remote_rconn, &pw);
-    discovery = s.discovery ? discovery_init(&s, pw, switch_status) : NULL;
-    if (s.enable_stp) {
-        stp_start(&secchan, pw, local_rconn, remote_rconn);
+    port_watcher_start(secchan, local_rconn, remote_rconn, &secchan->pw);
+    secchan->discovery = (s->discovery
+                          ? discovery_init(s, secchan->pw, switch_status)
+                          : NULL);
+    if (s->enable_stp) {
+        stp_start(secchan, secchan->pw, local_rconn, remote_rconn);
     }
-    if (s.in_band) {
-        in_band_start(&secchan, &s, switch_status, pw, remote_rconn);
+    if (s->in_band) {
+        in_band_start(secchan, s, switch_status, secchan->pw, remote_rconn);
     }
-    if (s.fail_mode == FAIL_OPEN) {
-        fail_open_start(&secchan, &s, switch_status,
+    if (s->fail_mode == FAIL_OPEN) {
+        fail_open_start(secchan, s, switch_status,
                         local_rconn, remote_rconn);
     }
-    if (s.num_controllers > 1) {
-        failover_start(&secchan, &s, switch_status, remote_rconn);
+    if (s->num_controllers > 1) {
+        failover_start(secchan, s, switch_status, remote_rconn);
     }
-    if (s.n_listeners > 0) {
-        protocol_stat_start(&secchan, &s, local_rconn, remote_rconn);
+    if (s->n_listeners > 0) {
+        protocol_stat_start(secchan, s, local_rconn, remote_rconn);
     }
-    if (s.rate_limit) {
-        rate_limit_start(&secchan, &s, switch_status, remote_rconn);
+    if (s->rate_limit) {
+        rate_limit_start(secchan, s, switch_status, remote_rconn);
     }
-    if (s.emerg_flow) {
-        emerg_flow_start(&secchan, &s, switch_status, local_rconn, remote_rconn);
+    if (s->emerg_flow) {
+        emerg_flow_start(secchan, s, switch_status, local_rconn, remote_rconn);
     }
+}
 
-    while (s.discovery || rconn_is_alive(remote_rconn)) {
-        struct relay *r, *n;
-        size_t i;
+/* Relays messages and runs the hooks in 'secchan', which must have been
+ * started with secchan_start().  Returns false if the secure channel has
+ * nothing more to do because its controller connection has died, true
+ * otherwise. */
+bool
+secchan_run(struct secchan *secchan)
+{
+    const struct settings *s = secchan->s;
+    struct relay *r, *n;
+    long long int start;
+    bool timed;
+    size_t i;
+
+    if (!s->discovery && !rconn_is_alive(secchan->remote_rconn)) {
+        return false;
+    }
 
-        /* Do work. */
-        LIST_FOR_EACH_SAFE (r, n, struct relay, node, &relays) {
-            relay_run(r, &secchan);
-        }
-        for (i = 0; i < n_listeners; i++) {
-            for (;;) {
-                struct relay *r = relay_accept(&s, listeners[i]);
-                if (!r) {
-                    break;
-                }
-                list_push_back(&relays, &r->node);
-            }
-        }
-        if (monitor) {
-            struct vconn *new = accept_vconn(monitor);
-            if (new) {
-                /* XXX should monitor async_rconn too but rconn_add_monitor()
-                 * takes ownership of the vconn passed in. */
-                rconn_add_monitor(local_rconn, new);
-            }
-        }
-        for (i = 0; i < secchan.n_hooks; i++) {
-            if (secchan.hooks[i].class->periodic_cb) {
-                secchan.hooks[i].class->periodic_cb(secchan.hooks[i].aux);
-            }
-        }
-        if (s.discovery) {
-            char *controller_name;
-            if (rconn_is_connectivity_questionable(remote_rconn)) {
-                discovery_question_connectivity(discovery);
-            }
-            if (discovery_run(discovery, &controller_name)) {
-                if (controller_name) {
-                    rconn_connect(remote_rconn, controller_name);
-                } else {
-                    rconn_disconnect(remote_rconn);
-                }
+    LIST_FOR_EACH_SAFE (r, n, struct relay, node, &secchan->relays) {
+        relay_run(r, secchan);
+    }
+    for (i = 0; i < secchan->n_listeners; i++) {
+        for (;;) {
+            struct relay *r = relay_accept(s, secchan->listeners[i]);
+            if (!r) {
+                break;
             }
+            list_push_back(&secchan->relays, &r->node);
         }
-
-        /* Wait for something to happen. */
-        LIST_FOR_EACH (r, struct relay, node, &relays) {
-            relay_wait(r);
+    }
+    if (secchan->monitor) {
+        struct vconn *new = accept_vconn(secchan->monitor);
+        if (new) {
+            /* XXX should monitor async_rconn too but rconn_add_monitor()
+             * takes ownership of the vconn passed in. */
+            rconn_add_monitor(secchan->local_rconn, new);
         }
-        for (i = 0; i < n_listeners; i++) {
-            pvconn_wait(listeners[i]);
+    }
+    timed = hook_start_round(&secchan->n_periodic_rounds, &start);
+    for (i = 0; i < secchan->n_hooks; i++) {
+        struct hook *h = secchan->hooks[i];
+        if (h->class->periodic_cb) {
+            h->class->periodic_cb(h->aux);
+            hook_timer_update(&h->periodic, timed, &start);
         }
-        if (monitor) {
-            pvconn_wait(monitor);
+    }
+    if (s->discovery) {
+        char *controller_name;
+        if (rconn_is_connectivity_questionable(secchan->remote_rconn)) {
+            discovery_question_connectivity(secchan->discovery);
         }
-        for (i = 0; i < secchan.n_hooks; i++) {
-            if (secchan.hooks[i].class->wait_cb) {
-                secchan.hooks[i].class->wait_cb(secchan.hooks[i].aux);
+        if (discovery_run(secchan->discovery, &controller_name)) {
+            if (controller_name) {
+                rconn_connect(secchan->remote_rconn, controller_name);
+            } else {
+                rconn_disconnect(secchan->remote_rconn);
             }
         }
-        if (discovery) {
-            discovery_wait(discovery);
-        }
-        poll_block();
     }
+    return true;
+}
 
-    return 0;
+/* Arranges for the poll loop to wake up when 'secchan' has work to do. */
+void
+secchan_wait(struct secchan *secchan)
+{
+    struct relay *r;
+    size_t i;
+
+    LIST_FOR_EACH (r, struct relay, node, &secchan->relays) {
+        relay_wait(r);
+    }
+    for (i = 0; i < secchan->n_listeners; i++) {
+        pvconn_wait(secchan->listeners[i]);
+    }
+    if (secchan->monitor) {
+        pvconn_wait(secchan->monitor);
+    }
+    for (i = 0; i < secchan->n_hooks; i++) {
+        struct hook *h = secchan->hooks[i];
+        if (h->class->wait_cb) {
+            h->class->wait_cb(h->aux);
+        }
+    }
+    if (secchan->discovery) {
+        discovery_wait(secchan->discovery);
+    }
 }
 
 static struct pvconn *
@@ -326,49 +396,139 @@ accept_vconn(struct pvconn *pvconn)
     return new;
 }
 
+/* Adds 'hook' to 'set'. */
+static void
+hook_set_add(struct hook_set *set, struct hook *hook)
+{
+    set->hooks = xrealloc(set->hooks, (set->n + 1) * sizeof *set->hooks);
+    set->hooks[set->n++] = hook;
+}
+
 void
 add_hook(struct secchan *secchan, const struct hook_class *class, void *aux)
 {
     struct hook *hook;
+    int type;
 
     if (secchan->n_hooks >= secchan->allocated_hooks) {
         secchan->hooks = x2nrealloc(secchan->hooks, &secchan->allocated_hooks,
                                     sizeof *secchan->hooks);
     }
-    hook = &secchan->hooks[secchan->n_hooks++];
+    hook = secchan->hooks[secchan->n_hooks++] = xcalloc(1, sizeof *hook);
     hook->class = class;
     hook->aux = aux;
+
+    for (type = 0; type <= HOOK_N_TYPES; type++) {
+        if (class->local_packet_cb
+            && (type == HOOK_N_TYPES
+                || class->local_types & HOOK_TYPE_BIT(type))) {
+            hook_set_add(&secchan->local_hooks[type], hook);
+        }
+        if (class->remote_packet_cb
+            && (type == HOOK_N_TYPES
+                || class->remote_types & HOOK_TYPE_BIT(type))) {
+            hook_set_add(&secchan->remote_hooks[type], hook);
+        }
+    }
+}
+
+/* Returns a monotonic time in nanoseconds, for timing hooks. */
+static long long int
+hook_time_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long int) ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
+/* Starts a round of hook calls, counted in '*n_rounds'.  Returns true if the
+ * calls in this round should be timed, storing the current time in '*start',
+ * false otherwise. */
+static bool
+hook_start_round(unsigned int *n_rounds, long long int *start)
+{
+    bool timed = !((*n_rounds)++ % HOOK_SAMPLE_INTERVAL);
+    *start = timed ? hook_time_nsec() : 0;
+    return timed;
+}
+
+/* Counts a hook callback that has just returned.  If 'timed', charges it
+ * with the time since '*start' and then sets '*start' to the current time,
+ * ready for the next callback in the round. */
+static void
+hook_timer_update(struct hook_timer *t, bool timed, long long int *start)
+{
+    t->n_calls++;
+    if (timed) {
+        long long int now = hook_time_nsec();
+        t->n_timed++;
+        t->nsec += now - *start;
+        *start = now;
+    }
+}
+
+/* Returns the estimated total time, in microseconds, of the calls counted in
+ * 't'. */
+static unsigned long long int
+hook_timer_usec(const struct hook_timer *t)
+{
+    return t->n_timed ? (double) t->nsec / t->n_timed * t->n_calls / 1000 : 0;
+}
+
+static void
+hook_status_cb(struct status_reply *sr, void *secchan_)
+{
+    struct secchan *secchan = secchan_;
+    size_t i;
+
+    for (i = 0; i < secchan->n_hooks; i++) {
+        const struct hook *h = secchan->hooks[i];
+        const char *name = h->class->name;
+
+        status_reply_put(sr, "%s-packets=%llu", name, h->packet.n_calls);
+        status_reply_put(sr, "%s-packet-usec=%llu",
+                         name, hook_timer_usec(&h->packet));
+        status_reply_put(sr, "%s-periodic-usec=%llu",
+                         name, hook_timer_usec(&h->periodic));
+    }
+}
+
+/* Returns the packet_in message being passed to the hooks on 'r', or a null
+ * pointer if that message is not a valid packet_in. */
 struct ofp_packet_in *
 get_ofp_packet_in(struct relay *r)
 {
-    struct ofpbuf *msg = r->halves[HALF_LOCAL].rxbuf;
-    struct ofp_header *oh = msg->data;
-    if (oh->type == OFPT_PACKET_IN) {
-        if (msg->size >= offsetof (struct ofp_packet_in, data)) {
-            return msg->data;
-        } else {
-            VLOG_WARN("packet too short (%zu bytes) for packet_in",
-                      msg->size);
-        }
-    }
-    return NULL;
+    return r->msg.opi;
 }
 
 bool
 get_ofp_packet_eth_header(struct relay *r, struct ofp_packet_in **opip,
                           struct eth_header **ethp)
 {
-    const int min_len = offsetof(struct ofp_packet_in, data) + ETH_HEADER_LEN;
-    struct ofp_packet_in *opi = get_ofp_packet_in(r);
-    if (opi && ntohs(opi->header.length) >= min_len) {
-        *opip = opi;
-        *ethp = (void *) opi->data;
+    if (r->msg.eth) {
+        *opip = r->msg.opi;
+        *ethp = r->msg.eth;
         return true;
     }
     return false;
 }
+
+/* Returns the flow of the packet in the packet_in message being passed to
+ * the hooks on 'r', which must be a valid packet_in.  The flow is extracted
+ * the first time a hook asks for it. */
+const struct flow *
+get_ofp_packet_flow(struct relay *r)
+{
+    struct relay_msg *m = &r->msg;
+
+    assert(m->opi);
+    if (!m->have_flow) {
+        flow_extract(&m->payload, m->in_port, &m->flow);
+        m->have_flow = true;
+    }
+    return &m->flow;
+}
 
 /* OpenFlow message relaying. */
 
@@ -441,30 +601,187 @@ relay_create(struct rconn *async, struct rconn *local, struct rconn *remote,
     return r;
 }
 
+/* Returns the hooks to call for 'msg', received on half 'i' of 'r'.  If the
+ * set is empty, 'msg' can go straight to the other half. */
+static const struct hook_set *
+hooks_for_msg(const struct secchan *secchan, const struct relay *r, int i,
+              const struct ofpbuf *msg)
+{
+    const struct ofp_header *oh = msg->data;
+    const struct hook_set *sets = (i == HALF_LOCAL
+                                   ? secchan->local_hooks
+                                   : secchan->remote_hooks);
+
+    return (oh->type < HOOK_N_TYPES && rconn_is_connected(r->halves[!i].rconn)
+            ? &sets[oh->type]
+            : &sets[HOOK_N_TYPES]);
+}
+
+/* Fills in 'm' with what the hooks need to know about 'buf'. */
+static void
+parse_relay_msg(struct relay_msg *m, struct ofpbuf *buf)
+{
+    const struct ofp_header *oh = buf->data;
+
+    m->buf = buf;
+    m->type = oh->type;
+    m->xid = oh->xid;
+    m->opi = NULL;
+    m->eth = NULL;
+    m->have_flow = false;
+    if (m->type == OFPT_PACKET_IN) {
+        size_t hdr_len = offsetof(struct ofp_packet_in, data);
+        if (buf->size >= hdr_len) {
+            struct ofp_packet_in *opi = buf->data;
+
+            m->opi = opi;
+            m->in_port = ntohs(opi->in_port);
+            m->reason = opi->reason;
+            ofpbuf_use(&m->payload, opi->data, buf->size - hdr_len);
+            m->payload.size = buf->size - hdr_len;
+            if (m->payload.size >= ETH_HEADER_LEN) {
+                m->eth = m->payload.data;
+            }
+        } else {
+            VLOG_WARN("packet too short (%zu bytes) for packet_in",
+                      buf->size);
+        }
+    }
+}
+
+/* Passes the message received on half 'i' of 'r' to the hooks in 'set', in
+ * order, until one of them consumes it.  Returns true if one did. */
 static bool
-call_local_packet_cbs(struct secchan *secchan, struct relay *r)
+call_packet_cbs(struct secchan *secchan, const struct hook_set *set,
+                struct relay *r, int i)
 {
-    const struct hook *h;
-    for (h = secchan->hooks; h < &secchan->hooks[secchan->n_hooks]; h++) {
-        bool (*cb)(struct relay *, void *aux) = h->class->local_packet_cb;
-        if (cb && (cb)(r, h->aux)) {
+    long long int start;
+    bool timed;
+    size_t j;
+
+    parse_relay_msg(&r->msg, r->halves[i].rxbuf);
+    timed = hook_start_round(&secchan->n_packet_rounds, &start);
+    for (j = 0; j < set->n; j++) {
+        struct hook *h = set->hooks[j];
+        bool (*cb)(struct relay *, void *aux) = (i == HALF_LOCAL
+                                                 ? h->class->local_packet_cb
+                                                 : h->class->remote_packet_cb);
+        bool consumed = cb(r, h->aux);
+
+        hook_timer_update(&h->packet, timed, &start);
+        if (consumed) {
             return true;
         }
     }
     return false;
 }
 
+/* Answers 'msg', received from the controller on 'r', with an OFPBRC_EPERM
+ * error. */
+static void
+send_eperm(struct relay *r, const struct ofpbuf *msg)
+{
+    const struct ofp_header *oh = msg->data;
+    size_t len = MIN(msg->size, 64);
+    struct ofp_error_msg *oem;
+    struct ofpbuf *b;
+
+    oem = make_openflow_xid(sizeof *oem + len, OFPT_ERROR, oh->xid, &b);
+    oem->type = htons(OFPET_BAD_REQUEST);
+    oem->code = htons(OFPBRC_EPERM);
+    memcpy(oem->data, msg->data, len);
+    if (rconn_send(r->halves[HALF_REMOTE].rconn, b, NULL)) {
+        ofpbuf_delete(b);
+    }
+}
+
+/* Notes whether 'msg', received from the controller on 'r', turns packet-in
+ * or flow removed batching on or off in the datapath.  Returns false if
+ * 'msg' must not be passed on to the datapath.
+ *
+ * The hooks that act on packet-ins (rate limiting, in-band control, STP,
+ * failover) only understand plain OFPT_PACKET_IN messages, so a request to
+ * turn packet-in batching on is refused, with an error to the controller,
+ * if any of them is running. */
 static bool
-call_remote_packet_cbs(struct secchan *secchan, struct relay *r)
+note_batching(const struct secchan *secchan, struct relay *r,
+              const struct ofpbuf *msg)
 {
-    const struct hook *h;
-    for (h = secchan->hooks; h < &secchan->hooks[secchan->n_hooks]; h++) {
-        bool (*cb)(struct relay *, void *aux) = h->class->remote_packet_cb;
-        if (cb && (cb)(r, h->aux)) {
-            return true;
+    const struct ofp_extension_header *oeh = msg->data;
+
+    if (msg->size < sizeof *oeh
+        || oeh->header.type != OFPT_VENDOR
+        || oeh->vendor != htonl(OPENFLOW_VENDOR_ID)) {
+        return true;
+    }
+
+    if (oeh->subtype == htonl(OFP_EXT_PACKET_IN_BATCH_CONFIG)
+        && msg->size >= sizeof(struct openflow_packet_in_batch_config)) {
+        const struct openflow_packet_in_batch_config *opibc = msg->data;
+
+        if (opibc->max_packets
+            && secchan->local_hooks[OFPT_PACKET_IN].n) {
+            VLOG_INFO_RL(&rl, "refusing packet-in batching because "
+                         "packet-ins must pass through the %s hook",
+                         secchan->local_hooks[OFPT_PACKET_IN]
+                         .hooks[0]->class->name);
+            send_eperm(r, msg);
+            return false;
         }
+        r->packet_in_batching = opibc->max_packets != 0;
+    } else if (oeh->subtype == htonl(OFP_EXT_FLOW_REMOVED_BATCH_CONFIG)
+               && (msg->size
+                   >= sizeof(struct openflow_flow_removed_batch_config))) {
+        const struct openflow_flow_removed_batch_config *ofrbc = msg->data;
+        r->flow_removed_batching = ofrbc->max_flows != 0;
+    } else {
+        return true;
+    }
+    r->remote_seqno = rconn_get_connection_seqno(r->halves[HALF_REMOTE].rconn);
+    return true;
+}
+
+/* Sends 'b', a batching configuration message, to the datapath on 'r'. */
+static void
+send_batching_reset(struct relay *r, struct ofpbuf *b)
+{
+    if (rconn_send(r->halves[HALF_LOCAL].rconn, b, NULL)) {
+        ofpbuf_delete(b);
+    }
+}
+
+/* Turns off batching in the datapath if the controller that asked for it is
+ * no longer the one connected to 'r', so that a new controller starts out
+ * receiving plain packet-in and flow removed messages. */
+static void
+reset_batching(struct relay *r)
+{
+    if ((!r->packet_in_batching && !r->flow_removed_batching)
+        || (rconn_get_connection_seqno(r->halves[HALF_REMOTE].rconn)
+            == r->remote_seqno)) {
+        return;
+    }
+
+    if (r->packet_in_batching) {
+        struct openflow_packet_in_batch_config *opibc;
+        struct ofpbuf *b;
+
+        opibc = make_openflow(sizeof *opibc, OFPT_VENDOR, &b);
+        opibc->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+        opibc->header.subtype = htonl(OFP_EXT_PACKET_IN_BATCH_CONFIG);
+        send_batching_reset(r, b);
+        r->packet_in_batching = false;
+    }
+    if (r->flow_removed_batching) {
+        struct openflow_flow_removed_batch_config *ofrbc;
+        struct ofpbuf *b;
+
+        ofrbc = make_openflow(sizeof *ofrbc, OFPT_VENDOR, &b);
+        ofrbc->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+        ofrbc->header.subtype = htonl(OFP_EXT_FLOW_REMOVED_BATCH_CONFIG);
+        send_batching_reset(r, b);
+        r->flow_removed_batching = false;
     }
-    return false;
 }
 
 static void
@@ -479,6 +796,9 @@ relay_run(struct relay *r, struct secchan *secchan)
     for (i = 0; i < 2; i++) {
         rconn_run(r->halves[i].rconn);
     }
+    if (!r->is_mgmt_conn) {
+        reset_batching(r);
+    }
 
     /* Limit the number of iterations to prevent other tasks from starving. */
     for (iteration = 0; iteration < 50; iteration++) {
@@ -493,10 +813,17 @@ relay_run(struct relay *r, struct secchan *secchan)
                     this->rxbuf = rconn_recv(r->async_rconn);
                 }
                 if (this->rxbuf && (i == HALF_REMOTE || !r->is_mgmt_conn)) {
-                    if (i == HALF_LOCAL
-                        ? call_local_packet_cbs(secchan, r)
-                        : call_remote_packet_cbs(secchan, r))
-                    {
+                    const struct hook_set *set;
+
+                    if (i == HALF_REMOTE && !r->is_mgmt_conn
+                        && !note_batching(secchan, r, this->rxbuf)) {
+                        ofpbuf_delete(this->rxbuf);
+                        this->rxbuf = NULL;
+                        progress = true;
+                        break;
+                    }
+                    set = hooks_for_msg(secchan, r, i, this->rxbuf);
+                    if (set->n && call_packet_cbs(secchan, set, r, i)) {
                         ofpbuf_delete(this->rxbuf);
                         this->rxbuf = NULL;
                         progress = true;
@@ -505,7 +832,7 @@ relay_run(struct relay *r, struct secchan *secchan)
                 }
             }
 
-            if (this->rxbuf && !this->n_txq) {
+            if (this->rxbuf && this->n_txq < RELAY_MAX_TXQ) {
                 int retval = rconn_send(peer->rconn, this->rxbuf,
                                         &this->n_txq);
                 if (retval != EAGAIN) {
@@ -551,6 +878,9 @@ relay_wait(struct relay *r)
             if (i == HALF_LOCAL && r->async_rconn) {
                 rconn_recv_wait(r->async_rconn);
             }
+        } else if (this->n_txq < RELAY_MAX_TXQ) {
+            /* relay_run() stopped early to let other work run. */
+            poll_immediate_wake();
         }
     }
 }
@@ -572,8 +902,9 @@ relay_destroy(struct relay *r)
 
 /* User interface. */
 
-static void
-parse_options(int argc, char *argv[], struct settings *s)
+/* Parses the ofprotocol command line 'argc' and 'argv' into 's'. */
+void
+secchan_parse_options(int argc, char *argv[], struct settings *s)
 {
     enum {
         OPT_ACCEPT_VCONN = UCHAR_MAX + 1,
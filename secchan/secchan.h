@@ -37,7 +37,10 @@
 #include <regex.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include "flow.h"
 #include "list.h"
+#include "ofpbuf.h"
 #include "packets.h"
 
 struct secchan;
@@ -95,6 +98,24 @@ struct half {
     int n_txq;                  /* No. of packets queued for tx on 'rconn'. */
 };
 
+/* The message that a relay is passing to its hooks, parsed once beforehand
+ * so that each hook need not parse it again. */
+struct relay_msg {
+    struct ofpbuf *buf;         /* The message: its half's 'rxbuf'. */
+    uint8_t type;               /* OFPT_* message type. */
+    uint32_t xid;               /* Transaction ID, in network byte order. */
+
+    /* For OFPT_PACKET_IN only.  'opi' is null for other types of message and
+     * for a packet_in too short to be valid. */
+    struct ofp_packet_in *opi;
+    uint16_t in_port;           /* Ingress port, in host byte order. */
+    uint8_t reason;             /* OFPR_* reason for sending the packet. */
+    struct eth_header *eth;     /* Null if too short for an Ethernet header. */
+    struct ofpbuf payload;      /* The packet itself. */
+    bool have_flow;             /* Is 'flow' valid?  See get_ofp_packet_flow. */
+    struct flow flow;           /* Flow extracted from 'payload'. */
+};
+
 struct relay {
     struct list node;
 
@@ -114,6 +135,15 @@ struct relay {
      * events and thus have a null 'async_rconn'. */
     bool is_mgmt_conn;          /* Is this a management connection? */
     struct rconn *async_rconn;  /* For receiving asynchronous events. */
+
+    /* Packet-in and flow removed batching are negotiated by the controller
+     * but configured in the datapath, so they have to be switched off again
+     * whenever the controller connection changes. */
+    bool packet_in_batching;    /* Controller enabled packet-in batching? */
+    bool flow_removed_batching; /* Controller enabled flow removed batching? */
+    unsigned int remote_seqno;  /* Controller connection they apply to. */
+
+    struct relay_msg msg;       /* Message being passed to the hooks. */
 };
 
 struct hook_class {
@@ -122,14 +152,33 @@ struct hook_class {
     void (*periodic_cb)(void *aux);
     void (*wait_cb)(void *aux);
     void (*closing_cb)(struct relay *, void *aux);
+
+    /* Types of the messages that 'local_packet_cb' and 'remote_packet_cb',
+     * respectively, act on, each a bitmap of HOOK_TYPE_BIT(OFPT_*) values.
+     * While a relay's peer is connected, a packet callback is called only
+     * for messages of the types it asked for (and for messages of types
+     * HOOK_N_TYPES and above, which no bitmap can name). */
+    uint32_t local_types;
+    uint32_t remote_types;
+
+    const char *name;           /* Name for per-hook status counters. */
 };
 
+#define HOOK_N_TYPES 32
+#define HOOK_TYPE_BIT(TYPE) (UINT32_C(1) << (TYPE))
+
+void secchan_parse_options(int argc, char *argv[], struct settings *);
+struct secchan *secchan_create(const struct settings *);
+void secchan_start(struct secchan *);
+bool secchan_run(struct secchan *);
+void secchan_wait(struct secchan *);
+
 void add_hook(struct secchan *, const struct hook_class *, void *);
 
 struct ofp_packet_in *get_ofp_packet_in(struct relay *);
 bool get_ofp_packet_eth_header(struct relay *, struct ofp_packet_in **,
                                struct eth_header **);
-void get_ofp_packet_payload(struct ofp_packet_in *, struct ofpbuf *);
+const struct flow *get_ofp_packet_flow(struct relay *);
 
 
 #endif /* secchan.h */
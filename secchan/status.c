@@ -118,6 +118,7 @@ rconn_status_cb(struct status_reply *sr, void *rconn_)
 {
     struct rconn *rconn = rconn_;
     time_t now = time_now();
+    size_t i;
 
     status_reply_put(sr, "name=%s", rconn_get_name(rconn));
     status_reply_put(sr, "state=%s", rconn_get_state(rconn));
@@ -135,6 +136,14 @@ rconn_status_cb(struct status_reply *sr, void *rconn_)
     status_reply_put(sr, "time-connected=%lu",
                      rconn_get_total_time_connected(rconn));
     status_reply_put(sr, "state-elapsed=%u", rconn_get_state_elapsed(rconn));
+    for (i = 0; i < rconn_count_monitors(rconn); i++) {
+        status_reply_put(sr, "monitor%zu-name=%s",
+                         i, rconn_monitor_name(rconn, i));
+        status_reply_put(sr, "monitor%zu-copied=%llu",
+                         i, rconn_monitor_copied(rconn, i));
+        status_reply_put(sr, "monitor%zu-dropped=%llu",
+                         i, rconn_monitor_dropped(rconn, i));
+    }
 }
 
 static void
@@ -171,6 +180,9 @@ static struct hook_class switch_status_hook_class = {
     NULL,                           /* periodic_cb */
     NULL,                           /* wait_cb */
     NULL,                           /* closing_cb */
+    0,                              /* local_types */
+    HOOK_TYPE_BIT(OFPT_VENDOR),     /* remote_types */
+    "status",                       /* name */
 };
 
 void
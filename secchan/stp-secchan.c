@@ -63,18 +63,15 @@ static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
 static bool
 stp_local_packet_cb(struct relay *r, void *stp_)
 {
-    struct ofpbuf *msg = r->halves[HALF_LOCAL].rxbuf;
-    struct ofp_header *oh;
+    struct ofpbuf *msg = r->msg.buf;
     struct stp_data *stp = stp_;
     struct ofp_packet_in *opi;
     struct eth_header *eth;
     struct llc_header *llc;
     struct ofpbuf payload;
     uint16_t port_no;
-    struct flow flow;
 
-    oh = msg->data;
-    if (oh->type == OFPT_FEATURES_REPLY
+    if (r->msg.type == OFPT_FEATURES_REPLY
         && msg->size >= offsetof(struct ofp_switch_features, ports)) {
         struct ofp_switch_features *osf = msg->data;
         osf->capabilities |= htonl(OFPC_STP);
@@ -86,7 +83,7 @@ stp_local_packet_cb(struct relay *r, void *stp_)
         return false;
     }
 
-    port_no = ntohs(opi->in_port);
+    port_no = r->msg.in_port;
     if (port_no >= STP_MAX_PORTS) {
         /* STP only supports 255 ports. */
         return false;
@@ -96,17 +93,16 @@ stp_local_packet_cb(struct relay *r, void *stp_)
         return false;
     }
 
-    if (opi->reason == OFPR_ACTION) {
+    if (r->msg.reason == OFPR_ACTION) {
         /* The controller set up a flow for this, so we won't intercept it. */
         return false;
     }
 
-    get_ofp_packet_payload(opi, &payload);
-    flow_extract(&payload, port_no, &flow);
-    if (flow.dl_type != htons(OFP_DL_TYPE_NOT_ETH_TYPE)) {
+    if (get_ofp_packet_flow(r)->dl_type != htons(OFP_DL_TYPE_NOT_ETH_TYPE)) {
         VLOG_DBG("non-LLC frame received on STP multicast address");
         return false;
     }
+    payload = r->msg.payload;
     llc = ofpbuf_at_assert(&payload, sizeof *eth, sizeof *llc);
     if (llc->llc_dsap != STP_LLC_DSAP) {
         VLOG_DBG("bad DSAP 0x%02"PRIx8" received on STP multicast address",
@@ -269,6 +265,10 @@ static struct hook_class stp_hook_class = {
     stp_periodic_cb,            /* periodic_cb */
     stp_wait_cb,                /* wait_cb */
     NULL,                       /* closing_cb */
+    (HOOK_TYPE_BIT(OFPT_FEATURES_REPLY)  /* local_types */
+     | HOOK_TYPE_BIT(OFPT_PACKET_IN)),
+    0,                          /* remote_types */
+    "stp",                      /* name */
 };
 
 void
@@ -1,3 +1,8 @@
+TESTS += tests/test-csum
+noinst_PROGRAMS += tests/test-csum
+tests_test_csum_SOURCES = tests/test-csum.c
+tests_test_csum_LDADD = lib/libopenflow.a
+
 TESTS += tests/test-flows.sh
 noinst_PROGRAMS += tests/test-flows
 tests_test_flows_SOURCES = tests/test-flows.c
@@ -22,6 +27,73 @@ noinst_PROGRAMS += tests/test-dhcp-client
 tests_test_dhcp_client_SOURCES = tests/test-dhcp-client.c
 tests_test_dhcp_client_LDADD = lib/libopenflow.a $(FAULT_LIBS)
 
+TESTS += tests/test-dp-buffers
+noinst_PROGRAMS += tests/test-dp-buffers
+tests_test_dp_buffers_SOURCES = \
+	tests/test-dp-buffers.c \
+	udatapath/dp_buffers.c
+tests_test_dp_buffers_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/udatapath
+tests_test_dp_buffers_LDADD = lib/libopenflow.a
+
+TESTS += tests/test-rxring
+noinst_PROGRAMS += tests/test-rxring
+tests_test_rxring_SOURCES = tests/test-rxring.c
+tests_test_rxring_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/udatapath
+tests_test_rxring_LDADD = lib/libopenflow.a
+
+TESTS += tests/test-dp-packet-in
+noinst_PROGRAMS += tests/test-dp-packet-in
+tests_test_dp_packet_in_SOURCES = \
+	tests/test-dp-packet-in.c \
+	udatapath/chain.c \
+	udatapath/crc32.c \
+	udatapath/datapath.c \
+	udatapath/dp_act.c \
+	udatapath/dp_buffers.c \
+	udatapath/dp_limit.c \
+	udatapath/dp_misses.c \
+	udatapath/dp_rxring.c \
+	udatapath/dp_sched.c \
+	udatapath/of_ext_msg.c \
+	udatapath/private-msg.c \
+	udatapath/switch-flow.c \
+	udatapath/table-hash.c \
+	udatapath/table-linear.c
+tests_test_dp_packet_in_CPPFLAGS = \
+	$(AM_CPPFLAGS) -I $(top_srcdir)/udatapath -I $(top_srcdir)/secchan
+tests_test_dp_packet_in_LDADD = lib/libopenflow.a $(SSL_LIBS) $(FAULT_LIBS)
+
+TESTS += tests/test-vconn-stream
+noinst_PROGRAMS += tests/test-vconn-stream
+tests_test_vconn_stream_SOURCES = tests/test-vconn-stream.c
+tests_test_vconn_stream_LDADD = lib/libopenflow.a $(SSL_LIBS)
+
+TESTS += tests/test-rconn-monitor
+noinst_PROGRAMS += tests/test-rconn-monitor
+tests_test_rconn_monitor_SOURCES = tests/test-rconn-monitor.c
+tests_test_rconn_monitor_LDADD = lib/libopenflow.a $(SSL_LIBS)
+
+TESTS += tests/test-failover
+noinst_PROGRAMS += tests/test-failover
+tests_test_failover_SOURCES = tests/test-failover.c
+tests_test_failover_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/secchan
+tests_test_failover_LDADD = \
+	secchan/libsecchan.a lib/libopenflow.a $(SSL_LIBS) $(FAULT_LIBS)
+
+TESTS += tests/test-packet-in-batch
+noinst_PROGRAMS += tests/test-packet-in-batch
+tests_test_packet_in_batch_SOURCES = tests/test-packet-in-batch.c
+tests_test_packet_in_batch_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/secchan
+tests_test_packet_in_batch_LDADD = \
+	secchan/libsecchan.a lib/libopenflow.a $(SSL_LIBS) $(FAULT_LIBS)
+
+if HAVE_SHM_VCONN
+TESTS += tests/test-vconn-shm
+noinst_PROGRAMS += tests/test-vconn-shm
+tests_test_vconn_shm_SOURCES = tests/test-vconn-shm.c
+tests_test_vconn_shm_LDADD = lib/libopenflow.a $(SSL_LIBS)
+endif
+
 TESTS += tests/test-stp.sh
 EXTRA_DIST += tests/test-stp.sh
 noinst_PROGRAMS += tests/test-stp
@@ -18,19 +18,22 @@ print PACKETS pack('NnnNNNN',
 
 output(DL_HEADER => '802.2');
 
-for my $dl_header qw(802.2+SNAP Ethernet) {
+for my $dl_header (qw(802.2+SNAP Ethernet)) {
     my %a = (DL_HEADER => $dl_header);
-    for my $dl_vlan qw(none zero nonzero) {
+    for my $dl_vlan (qw(none zero nonzero)) {
         my %b = (%a, DL_VLAN => $dl_vlan);
 
         # Non-IP case.
         output(%b, DL_TYPE => 'non-ip');
 
-        for my $ip_options qw(no yes) {
+        # ARP case.
+        output(%b, DL_TYPE => 'arp');
+
+        for my $ip_options (qw(no yes)) {
             my %c = (%b, DL_TYPE => 'ip', IP_OPTIONS => $ip_options);
-            for my $ip_fragment qw(no first middle last) {
+            for my $ip_fragment (qw(no first middle last)) {
                 my %d = (%c, IP_FRAGMENT => $ip_fragment);
-                for my $tp_proto qw(TCP TCP+options UDP ICMP other) {
+                for my $tp_proto (qw(TCP TCP+options UDP ICMP other)) {
                     output(%d, TP_PROTO => $tp_proto);
                 }
             }
@@ -85,6 +88,11 @@ sub output {
         if ($attrs{IP_FRAGMENT} ne 'no') {
             $flow{TP_SRC} = $flow{TP_DST} = 0;
         }
+    } elsif ($attrs{DL_TYPE} eq 'arp') {
+        $flow{DL_TYPE} = 0x0806; # ETH_TYPE_ARP
+        $flow{NW_PROTO} = 1;     # ARP_OP_REQUEST
+        $flow{NW_SRC} = '10.0.2.15';
+        $flow{NW_DST} = '10.0.2.2';
     } elsif ($attrs{DL_TYPE} eq 'non-ip') {
         $flow{DL_TYPE} = 0x5678;
     } else {
@@ -175,6 +183,17 @@ sub output {
 
             substr($ip, 2, 2) = pack('n', length($ip));
             $packet .= $ip;
+        } elsif ($attrs{DL_TYPE} eq 'arp') {
+            $packet .= pack('nnCCn',
+                            1,      # hardware type (Ethernet)
+                            0x0800, # protocol type (IP)
+                            6,      # hardware address length
+                            4,      # protocol address length
+                            $flow{NW_PROTO}); # opcode
+            $packet .= pack_ethaddr($flow{DL_SRC});
+            $packet .= pack('N', inet_aton($flow{NW_SRC}));
+            $packet .= pack_ethaddr('00:00:00:00:00:00');
+            $packet .= pack('N', inet_aton($flow{NW_DST}));
         }
     }
     substr($packet, 12, 2) = pack('n', length($packet))
@@ -189,9 +208,11 @@ sub output {
                      0);        # in_port
     print FLOWS pack_ethaddr($flow{DL_SRC});
     print FLOWS pack_ethaddr($flow{DL_DST});
-    print FLOWS pack('nnCxNNnn',
+    print FLOWS pack('nCxnCCxxNNnn',
                      $flow{DL_VLAN},
+                     0,         # dl_vlan_pcp
                      $flow{DL_TYPE},
+                     0,         # nw_tos
                      $flow{NW_PROTO},
                      inet_aton($flow{NW_SRC}),
                      inet_aton($flow{NW_DST}),
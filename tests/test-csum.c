@@ -0,0 +1,202 @@
+/* Tests for the checksum functions declared in csum.h. */
+
+#include <config.h>
+#include "csum.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+#include "packets.h"
+#include "random.h"
+#include "util.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+/* The original byte-at-a-time implementation of csum_continue(), against
+ * which the optimized ones are checked. */
+static uint32_t
+ref_csum_continue(uint32_t partial, const void *data_, size_t n)
+{
+    const uint8_t *data = data_;
+
+    for (; n > 1; n -= 2, data += 2) {
+        uint16_t x;
+
+        memcpy(&x, data, sizeof x);
+        partial = csum_add16(partial, x);
+    }
+    if (n) {
+        partial += *data;
+    }
+    return partial;
+}
+
+static void
+check_csum(const uint8_t *data, size_t n)
+{
+    uint32_t partial = random_uint16();
+    size_t split = random_range(n + 1) & ~1;
+
+    assert(csum(data, n) == csum_finish(ref_csum_continue(0, data, n)));
+    assert(csum_finish(csum_continue(partial, data, n))
+           == csum_finish(ref_csum_continue(partial, data, n)));
+    assert(csum_finish(csum_continue(csum_continue(partial, data, split),
+                                     data + split, n - split))
+           == csum_finish(ref_csum_continue(partial, data, n)));
+}
+
+/* Checks the current implementation against the reference one on buffers of
+ * every length up to a few hundred bytes, plus some longer ones, starting at
+ * every alignment. */
+static void
+test_full(void)
+{
+    static const size_t long_lengths[] = {
+        1023, 1024, 1499, 1500, 1501, 4095, 4096, 9001
+    };
+    static uint8_t buf[65536 + 64];
+    size_t ofs, n, i;
+
+    for (ofs = 0; ofs < 33; ofs++) {
+        for (n = 0; n <= 300; n++) {
+            random_bytes(buf + ofs, n);
+            check_csum(buf + ofs, n);
+        }
+        for (i = 0; i < ARRAY_SIZE(long_lengths); i++) {
+            random_bytes(buf + ofs, long_lengths[i]);
+            check_csum(buf + ofs, long_lengths[i]);
+        }
+    }
+
+    /* Sums that carry as much as possible, and sums of nothing but zeros. */
+    memset(buf, 0xff, sizeof buf);
+    check_csum(buf, 65535);
+    check_csum(buf + 1, 65535);
+    memset(buf, 0, sizeof buf);
+    check_csum(buf, 65535);
+    check_csum(buf + 3, 1501);
+}
+
+struct tcp_packet {
+    struct ip_header ip;
+    struct tcp_header tcp;
+    uint8_t payload[21];
+};
+
+static uint16_t
+tcp_csum(const struct tcp_packet *p)
+{
+    struct tcp_packet tmp = *p;
+    uint32_t partial;
+
+    tmp.tcp.tcp_csum = 0;
+    partial = csum_add32(csum_add32(0, tmp.ip.ip_src), tmp.ip.ip_dst);
+    partial = csum_add16(partial, htons(IP_TYPE_TCP));
+    partial = csum_add16(partial, htons(sizeof tmp - sizeof tmp.ip));
+    return csum_finish(csum_continue(partial, &tmp.tcp,
+                                     sizeof tmp - sizeof tmp.ip));
+}
+
+static uint16_t
+ip_csum(const struct tcp_packet *p)
+{
+    struct ip_header tmp = p->ip;
+
+    tmp.ip_csum = 0;
+    return csum(&tmp, sizeof tmp);
+}
+
+/* Rewrites random header fields of a random TCP packet and checks that
+ * updating the checksums incrementally, one field at a time with
+ * recalc_csum16() and recalc_csum32() or all fields at once with
+ * csum_update16(), csum_update32() and recalc_csum(), gives the same result
+ * as computing them from scratch. */
+static void
+test_incremental(void)
+{
+    int i;
+
+    for (i = 0; i < 100000; i++) {
+        struct tcp_packet p;
+        uint16_t ip_seq, tcp_seq;
+        uint32_t ip_delta = 0, tcp_delta = 0;
+        int n_changes = 1 + random_range(5);
+        int j;
+
+        random_bytes(&p, sizeof p);
+        p.ip.ip_ihl_ver = IP_IHL_VER(5, IP_VERSION);
+        p.ip.ip_proto = IP_TYPE_TCP;
+        p.ip.ip_csum = ip_csum(&p);
+        p.tcp.tcp_csum = tcp_csum(&p);
+        ip_seq = p.ip.ip_csum;
+        tcp_seq = p.tcp.tcp_csum;
+
+        for (j = 0; j < n_changes; j++) {
+            uint32_t *addr;
+            uint16_t *port;
+            uint32_t new32;
+            uint16_t new16;
+            uint8_t new_tos;
+
+            switch (random_range(5)) {
+            case 0:
+            case 1:
+                addr = random_range(2) ? &p.ip.ip_src : &p.ip.ip_dst;
+                new32 = random_uint32();
+                ip_seq = recalc_csum32(ip_seq, *addr, new32);
+                tcp_seq = recalc_csum32(tcp_seq, *addr, new32);
+                ip_delta = csum_update32(ip_delta, *addr, new32);
+                tcp_delta = csum_update32(tcp_delta, *addr, new32);
+                *addr = new32;
+                break;
+
+            case 2:
+                new_tos = random_uint8();
+                ip_seq = recalc_csum16(ip_seq, htons(p.ip.ip_tos),
+                                       htons(new_tos));
+                ip_delta = csum_update16(ip_delta, htons(p.ip.ip_tos),
+                                         htons(new_tos));
+                p.ip.ip_tos = new_tos;
+                break;
+
+            default:
+                port = random_range(2) ? &p.tcp.tcp_src : &p.tcp.tcp_dst;
+                new16 = random_uint16();
+                tcp_seq = recalc_csum16(tcp_seq, *port, new16);
+                tcp_delta = csum_update16(tcp_delta, *port, new16);
+                *port = new16;
+                break;
+            }
+        }
+
+        assert(ip_seq == ip_csum(&p));
+        assert(tcp_seq == tcp_csum(&p));
+        assert(recalc_csum(p.ip.ip_csum, ip_delta) == ip_csum(&p));
+        assert(recalc_csum(p.tcp.tcp_csum, tcp_delta) == tcp_csum(&p));
+    }
+
+    /* Changing a zero word to 1 in data whose sum is all-ones must carry
+     * around twice. */
+    assert(recalc_csum16(0x0000, 0x0000, 0x0001) == 0xfffe);
+}
+
+int
+main(void)
+{
+    static const char *impls[] = { "scalar", "u64", "sse2", "avx2" };
+    const char *best = csum_get_impl();
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(impls); i++) {
+        if (csum_set_impl(impls[i])) {
+            test_full();
+            printf("%s: ok\n", impls[i]);
+        } else {
+            printf("%s: not supported\n", impls[i]);
+        }
+    }
+
+    assert(csum_set_impl(best));
+    test_incremental();
+    return 0;
+}
@@ -0,0 +1,88 @@
+/* Tests the datapath's packet buffer store. */
+
+#include <config.h>
+#include "dp_buffers.h"
+#include <stdlib.h>
+#include "ofpbuf.h"
+#include "switch-flow.h"
+#include "timeval.h"
+#include "util.h"
+#include "vlog.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+/* Returns a new 64-byte packet whose first byte is 'tag'. */
+static struct ofpbuf *
+make_packet(uint8_t tag)
+{
+    struct ofpbuf *buffer = ofpbuf_new(64);
+    uint8_t *data = ofpbuf_put_zeros(buffer, 64);
+    data[0] = tag;
+    return buffer;
+}
+
+/* Retrieves the packet with buffer 'id' from 'b' and checks that it is the
+ * one tagged 'tag'. */
+static void
+check_retrieve(struct dp_buffers *b, uint32_t id, uint8_t tag)
+{
+    struct sw_flow_key key;
+    struct ofpbuf *buffer;
+
+    buffer = dp_buffers_retrieve(b, id, 1, &key);
+    assert(buffer);
+    assert(((uint8_t *) buffer->data)[0] == tag);
+    ofpbuf_delete(buffer);
+}
+
+/* Checks that every packet stored in a store with 'n_slots' slots gets an id
+ * of its own, so that an id whose packet is gone no longer finds anything,
+ * even once a later packet has taken the same slot. */
+static void
+test_ids(unsigned int n_slots)
+{
+    struct dp_buffers *b = dp_buffers_create(n_slots, 1024 * 1024);
+    struct sw_flow_key key;
+    uint32_t ids[8];
+    int i, j;
+
+    assert(dp_buffers_n_slots(b) == n_slots);
+    for (i = 0; i < ARRAY_SIZE(ids); i++) {
+        ids[i] = dp_buffers_save(b, make_packet(i), NULL);
+        assert(ids[i] != UINT32_MAX);
+        for (j = 0; j < i; j++) {
+            assert(ids[i] != ids[j]);
+            assert(!dp_buffers_retrieve(b, ids[j], 1, &key));
+        }
+        check_retrieve(b, ids[i], i);
+        assert(!dp_buffers_retrieve(b, ids[i], 1, &key));
+    }
+}
+
+/* Checks that a store created with no slots never takes a packet. */
+static void
+test_disabled(void)
+{
+    struct dp_buffers *b = dp_buffers_create(0, 1024 * 1024);
+    struct ofpbuf *buffer = make_packet(0);
+
+    assert(dp_buffers_n_slots(b) == 0);
+    assert(dp_buffers_save(b, buffer, NULL) == UINT32_MAX);
+    ofpbuf_delete(buffer);
+}
+
+int
+main(int argc UNUSED, char *argv[])
+{
+    set_program_name(argv[0]);
+    time_init();
+    vlog_init();
+    vlog_set_levels(VLM_ANY_MODULE, VLF_ANY_FACILITY, VLL_EMER);
+
+    test_ids(1);
+    test_ids(2);
+    test_ids(16);
+    test_disabled();
+    return 0;
+}
@@ -0,0 +1,320 @@
+/* Sends packets from the datapath to a fake controller and checks the
+ * packet-ins that arrive:
+ *
+ *   - A TCP super-packet, as received on a device in GSO mode, must reach
+ *     the controller as the packets that it represents on the wire, each
+ *     with a correct length and checksum, whether or not the datapath
+ *     buffers it.
+ *
+ *   - A table miss that the packet-in rate limit drops must not start
+ *     holding back the rest of its flow. */
+
+#include <config.h>
+#include "datapath.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/virtio_net.h>
+#include <stdlib.h>
+#include <string.h>
+#include "csum.h"
+#include "dp_buffers.h"
+#include "dp_limit.h"
+#include "dp_misses.h"
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "packets.h"
+#include "timeval.h"
+#include "util.h"
+#include "vconn.h"
+#include "vlog.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+/* Descriptions that datapath.c reports, normally defined by udatapath.c. */
+char mfr_desc[DESC_STR_LEN] = "";
+char hw_desc[DESC_STR_LEN] = "";
+char sw_desc[DESC_STR_LEN] = "";
+char dp_desc[DESC_STR_LEN] = "test";
+char serial_num[SERIAL_NUM_LEN] = "";
+
+/* The super-packet: 60000 bytes of TCP payload in 1448-byte segments. */
+#define PAYLOAD 60000
+#define MSS 1448
+#define HDR_LEN (ETH_HEADER_LEN + IP_HEADER_LEN + TCP_HEADER_LEN)
+#define N_SEGS DIV_ROUND_UP(PAYLOAD, MSS)
+
+#define MAX_LEN 128
+
+/* Headroom that the datapath leaves in the packets that it receives. */
+#define HEADROOM 130
+
+/* Returns a new TCPv4 super-packet, with room in front of it like a packet
+ * that the datapath receives, whose payload byte at offset 'i' is
+ * (i % 251), with the partial checksum that a device in GSO mode leaves. */
+static struct ofpbuf *
+make_super_packet(void)
+{
+    struct ofpbuf *b = ofpbuf_new(HEADROOM + HDR_LEN + PAYLOAD);
+    struct eth_header *eh;
+    struct ip_header *nh;
+    struct tcp_header *th;
+    uint32_t partial;
+    uint8_t *data;
+    int i;
+
+    ofpbuf_reserve(b, HEADROOM);
+    eh = ofpbuf_put_zeros(b, sizeof *eh);
+    memcpy(eh->eth_dst, "\x00\x00\x00\x00\x00\x02", ETH_ADDR_LEN);
+    memcpy(eh->eth_src, "\x00\x00\x00\x00\x00\x01", ETH_ADDR_LEN);
+    eh->eth_type = htons(ETH_TYPE_IP);
+
+    nh = ofpbuf_put_zeros(b, sizeof *nh);
+    nh->ip_ihl_ver = IP_IHL_VER(5, IP_VERSION);
+    nh->ip_tot_len = htons(0);
+    nh->ip_ttl = 64;
+    nh->ip_proto = IP_TYPE_TCP;
+    nh->ip_src = htonl(0x0a000001);
+    nh->ip_dst = htonl(0x0a000002);
+
+    th = ofpbuf_put_zeros(b, sizeof *th);
+    th->tcp_src = htons(1234);
+    th->tcp_dst = htons(80);
+    th->tcp_seq = htonl(1000);
+    th->tcp_ctl = htons((5 << 12) | TCP_ACK | TCP_PSH);
+    th->tcp_winsz = htons(65535);
+
+    data = ofpbuf_put_uninit(b, PAYLOAD);
+    for (i = 0; i < PAYLOAD; i++) {
+        data[i] = i % 251;
+    }
+
+    partial = csum_add32(csum_add32(0, nh->ip_src), nh->ip_dst);
+    partial = csum_add16(partial, htons(IP_TYPE_TCP));
+    partial = csum_add16(partial, htons(TCP_HEADER_LEN + PAYLOAD));
+    th->tcp_csum = ~csum_finish(partial);
+
+    b->gso_size = MSS;
+    b->gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+    b->csum_partial = true;
+    return b;
+}
+
+/* Checks that 'packet', 'len' bytes long, is a well-formed segment of the
+ * super-packet that carries the payload from 'ofs' onward, and returns the
+ * length of its payload. */
+static size_t
+check_segment(const uint8_t *packet, size_t len, size_t ofs)
+{
+    const struct ip_header *nh = (const void *) (packet + ETH_HEADER_LEN);
+    const struct tcp_header *th = (const void *) (nh + 1);
+    size_t payload = len - HDR_LEN;
+    uint32_t partial;
+    size_t i;
+
+    assert(len > HDR_LEN && payload <= MSS);
+    assert(ntohs(nh->ip_tot_len) == len - ETH_HEADER_LEN);
+    assert(!csum(nh, IP_HEADER_LEN));
+    assert(ntohl(th->tcp_seq) == 1000 + ofs);
+
+    partial = csum_add32(csum_add32(0, nh->ip_src), nh->ip_dst);
+    partial = csum_add16(partial, htons(IP_TYPE_TCP));
+    partial = csum_add16(partial, htons(len - ETH_HEADER_LEN
+                                        - IP_HEADER_LEN));
+    assert(!csum_finish(csum_continue(partial, th,
+                                      len - ETH_HEADER_LEN - IP_HEADER_LEN)));
+
+    for (i = 0; i < payload; i++) {
+        assert(packet[HDR_LEN + i] == (ofs + i) % 251);
+    }
+    return payload;
+}
+
+/* Returns a new minimum-length UDP packet from source port 'src', with room
+ * in front of it like a packet that the datapath receives. */
+static struct ofpbuf *
+make_udp_packet(uint16_t src)
+{
+    struct ofpbuf *b = ofpbuf_new(HEADROOM + ETH_TOTAL_MIN);
+    struct eth_header *eh;
+    struct ip_header *nh;
+    struct udp_header *uh;
+
+    ofpbuf_reserve(b, HEADROOM);
+    eh = ofpbuf_put_zeros(b, sizeof *eh);
+    memcpy(eh->eth_dst, "\x00\x00\x00\x00\x00\x02", ETH_ADDR_LEN);
+    memcpy(eh->eth_src, "\x00\x00\x00\x00\x00\x01", ETH_ADDR_LEN);
+    eh->eth_type = htons(ETH_TYPE_IP);
+
+    nh = ofpbuf_put_zeros(b, sizeof *nh);
+    nh->ip_ihl_ver = IP_IHL_VER(5, IP_VERSION);
+    nh->ip_tot_len = htons(IP_HEADER_LEN + UDP_HEADER_LEN);
+    nh->ip_ttl = 64;
+    nh->ip_proto = IP_TYPE_UDP;
+    nh->ip_src = htonl(0x0a000001);
+    nh->ip_dst = htonl(0x0a000002);
+    nh->ip_csum = csum(nh, IP_HEADER_LEN);
+
+    uh = ofpbuf_put_zeros(b, sizeof *uh);
+    uh->udp_src = htons(src);
+    uh->udp_dst = htons(53);
+    uh->udp_len = htons(UDP_HEADER_LEN);
+
+    ofpbuf_put_zeros(b, ETH_TOTAL_MIN - b->size);
+    return b;
+}
+
+/* Creates a datapath with 'n_buffers' packet buffers, a pending-miss hold
+ * time of 'miss_hold' ms and a packet-in limit of 'rate' per second (0 for
+ * none), and a controller connection to it, in '*dpp' and '*ctlp'. */
+static void
+connect_dp(unsigned int n_buffers, unsigned int miss_hold, int rate,
+           struct datapath **dpp, struct vconn **ctlp)
+{
+    static int n;
+    struct pvconn *pvconn;
+    struct datapath *dp;
+    struct vconn *ctl;
+    char *name;
+    int error;
+
+    assert(!dp_new(&dp, 1));
+    dp->buffers = dp_buffers_create(n_buffers, 1024 * 1024);
+    dp->misses = dp_misses_create(miss_hold, DP_MISSES_DEFAULT_PACKETS);
+    dp->pin_limit = dp_limit_create(rate, 0);
+
+    name = xasprintf("pmem:dp%d", n);
+    assert(!pvconn_open(name, &pvconn));
+    dp_add_pvconn(dp, pvconn);
+    free(name);
+
+    name = xasprintf("mem:dp%d", n++);
+    assert(!vconn_open(name, OFP_VERSION, &ctl));
+    free(name);
+    do {
+        dp_run(dp);
+        error = vconn_connect(ctl);
+        assert(!error || error == EAGAIN);
+    } while (error);
+    dp_run(dp);
+
+    *dpp = dp;
+    *ctlp = ctl;
+}
+
+/* Sends the super-packet to the controller through a datapath with
+ * 'n_buffers' packet buffers and checks the packet-ins that arrive. */
+static void
+test_packet_in(unsigned int n_buffers)
+{
+    size_t ofs = 0;
+    int n_packet_ins = 0;
+    struct datapath *dp;
+    struct vconn *ctl;
+    struct ofpbuf *b;
+    int i;
+
+    connect_dp(n_buffers, 0, 0, &dp, &ctl);
+    dp_output_control(dp, make_super_packet(), 1, MAX_LEN, OFPR_ACTION);
+    for (i = 0; i < 10; i++) {
+        dp_run(dp);
+        while (!vconn_recv(ctl, &b)) {
+            const struct ofp_packet_in *opi = b->data;
+            size_t len = b->size - offsetof(struct ofp_packet_in, data);
+
+            if (opi->header.type == OFPT_PACKET_IN) {
+                assert(ntohs(opi->header.length) == b->size);
+                assert(ntohs(opi->in_port) == 1);
+                if (n_buffers) {
+                    const struct ip_header *nh
+                        = (const void *) (opi->data + ETH_HEADER_LEN);
+
+                    assert(opi->buffer_id != htonl(UINT32_MAX));
+                    assert(ntohs(opi->total_len) == HDR_LEN + MSS);
+                    assert(len == MAX_LEN);
+                    assert(ntohs(nh->ip_tot_len)
+                           == IP_HEADER_LEN + TCP_HEADER_LEN + MSS);
+                } else {
+                    assert(opi->buffer_id == htonl(UINT32_MAX));
+                    assert(ntohs(opi->total_len) == len);
+                    ofs += check_segment(opi->data, len, ofs);
+                }
+                n_packet_ins++;
+            }
+            ofpbuf_delete(b);
+        }
+    }
+
+    if (n_buffers) {
+        assert(n_packet_ins == 1);
+    } else {
+        assert(n_packet_ins == N_SEGS);
+        assert(ofs == PAYLOAD);
+    }
+    vconn_close(ctl);
+}
+
+/* Runs 'dp' and returns the number of packet-ins that arrive on 'ctl'. */
+static int
+count_packet_ins(struct datapath *dp, struct vconn *ctl)
+{
+    int n_packet_ins = 0;
+    struct ofpbuf *b;
+    int i;
+
+    for (i = 0; i < 10; i++) {
+        dp_run(dp);
+        while (!vconn_recv(ctl, &b)) {
+            const struct ofp_header *oh = b->data;
+
+            n_packet_ins += oh->type == OFPT_PACKET_IN;
+            ofpbuf_delete(b);
+        }
+    }
+    return n_packet_ins;
+}
+
+/* Sends table misses for two flows through a datapath that holds back
+ * pending misses and allows one packet-in per second, so that the second
+ * flow's first packet is dropped, and checks that once the limit allows it,
+ * the second flow's next packet reaches the controller instead of being
+ * held back behind a packet-in that was never sent. */
+static void
+test_miss_limit(void)
+{
+    struct sw_port port;
+    struct datapath *dp;
+    struct vconn *ctl;
+
+    connect_dp(0, 60 * 1000, 1, &dp, &ctl);
+    memset(&port, 0, sizeof port);
+    port.port_no = 1;
+
+    fwd_port_input(dp, make_udp_packet(1), &port);
+    fwd_port_input(dp, make_udp_packet(2), &port);
+    assert(count_packet_ins(dp, ctl) == 1);
+
+    /* Lift the limit.  The first flow is held back, the second is not. */
+    dp_limit_destroy(dp->pin_limit);
+    dp->pin_limit = dp_limit_create(0, 0);
+    fwd_port_input(dp, make_udp_packet(1), &port);
+    fwd_port_input(dp, make_udp_packet(2), &port);
+    assert(count_packet_ins(dp, ctl) == 1);
+
+    vconn_close(ctl);
+}
+
+int
+main(int argc UNUSED, char *argv[])
+{
+    set_program_name(argv[0]);
+    time_init();
+    vlog_init();
+    vlog_set_levels(VLM_ANY_MODULE, VLF_ANY_FACILITY, VLL_EMER);
+
+    test_packet_in(0);
+    test_packet_in(256);
+    test_miss_limit();
+
+    return 0;
+}
@@ -0,0 +1,330 @@
+/* Runs a secure channel in-process, between a fake datapath and two fake
+ * controllers.  Checks that the standby controller is refused requests and
+ * kept up to date with port changes, then kills the controller in charge
+ * while packet_ins are flowing and checks that the standby takes over without
+ * losing any of them. */
+
+#include <config.h>
+#include "secchan.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "timeval.h"
+#include "util.h"
+#include "vconn.h"
+#include "vlog.h"
+#include "xtoxll.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+/* Number of packet_ins sent, how many of them go out before the controller
+ * in charge is killed, and how many are sent per round. */
+#define N_PACKET_INS 3000
+#define KILL_AFTER 1000
+#define BURST 7
+
+/* One end of a fake connection to the secure channel. */
+struct peer {
+    const char *name;
+    struct pvconn *pvconn;
+    struct vconn *vconn;
+    bool connected;
+    bool sent_features_request;
+    int n_features_replies;
+    int n_ports;                /* Ports in the last features reply. */
+    int n_eperms;               /* OFPBRC_EPERM errors received. */
+    int n_port_status;          /* Port status messages received. */
+    int n_barriers;             /* Barrier requests received. */
+
+    /* packet_ins received, as their buffer_ids, for the controllers. */
+    uint32_t *packet_ins;
+    int n_packet_ins;
+};
+
+static void
+peer_open(struct peer *peer, const char *name)
+{
+    char *s = xasprintf("pmem:%s", name);
+
+    memset(peer, 0, sizeof *peer);
+    peer->name = name;
+    assert(!pvconn_open(s, &peer->pvconn));
+    peer->packet_ins = xmalloc(N_PACKET_INS * sizeof *peer->packet_ins);
+    free(s);
+}
+
+/* Accepts and completes the connection to 'peer', if it is not done yet, and
+ * returns true once it is connected. */
+static bool
+peer_connect(struct peer *peer)
+{
+    int error;
+
+    if (peer->connected) {
+        return true;
+    }
+    if (!peer->vconn) {
+        error = pvconn_accept(peer->pvconn, OFP_VERSION, &peer->vconn);
+        assert(!error || error == EAGAIN);
+        if (!peer->vconn) {
+            return false;
+        }
+    }
+    error = vconn_connect(peer->vconn);
+    assert(!error || error == EAGAIN);
+    peer->connected = !error;
+    return peer->connected;
+}
+
+/* Sends the reply to features request 'rq', from the fake datapath. */
+static void
+send_features_reply(struct vconn *vconn, const struct ofp_header *rq)
+{
+    struct ofp_switch_features *osf;
+    struct ofpbuf *b;
+
+    osf = make_openflow_xid(sizeof *osf, OFPT_FEATURES_REPLY, rq->xid, &b);
+    osf->datapath_id = htonll(1);
+    osf->n_buffers = htonl(256);
+    osf->n_tables = 1;
+    assert(!vconn_send(vconn, b));
+}
+
+/* Does the work of the fake datapath or controller 'peer': answers echo
+ * requests and, for the datapath, features requests, and records features
+ * replies and packet_ins. */
+static void
+peer_run(struct peer *peer, bool is_datapath)
+{
+    struct ofpbuf *b;
+
+    if (!peer->vconn || !peer_connect(peer)) {
+        return;
+    }
+    if (!is_datapath && !peer->sent_features_request) {
+        make_openflow(sizeof(struct ofp_header), OFPT_FEATURES_REQUEST, &b);
+        assert(!vconn_send(peer->vconn, b));
+        peer->sent_features_request = true;
+    }
+
+    while (!vconn_recv(peer->vconn, &b)) {
+        const struct ofp_header *oh = b->data;
+
+        switch (oh->type) {
+        case OFPT_ECHO_REQUEST:
+            assert(!vconn_send(peer->vconn, make_echo_reply(oh)));
+            break;
+
+        case OFPT_FEATURES_REQUEST:
+            assert(is_datapath);
+            send_features_reply(peer->vconn, oh);
+            break;
+
+        case OFPT_FEATURES_REPLY:
+            peer->n_features_replies++;
+            peer->n_ports = ((b->size - offsetof(struct ofp_switch_features,
+                                                 ports))
+                             / sizeof(struct ofp_phy_port));
+            break;
+
+        case OFPT_ERROR: {
+            const struct ofp_error_msg *oem = b->data;
+            assert(oem->type == htons(OFPET_BAD_REQUEST));
+            assert(oem->code == htons(OFPBRC_EPERM));
+            peer->n_eperms++;
+            break;
+        }
+
+        case OFPT_PORT_STATUS:
+            peer->n_port_status++;
+            break;
+
+        case OFPT_BARRIER_REQUEST:
+            peer->n_barriers++;
+            break;
+
+        case OFPT_PACKET_IN: {
+            const struct ofp_packet_in *opi = b->data;
+            assert(peer->n_packet_ins < N_PACKET_INS);
+            peer->packet_ins[peer->n_packet_ins++] = ntohl(opi->buffer_id);
+            break;
+        }
+        }
+        ofpbuf_delete(b);
+    }
+}
+
+/* Accepts a new connection on 'peer', unless it has one or has been
+ * killed. */
+static void
+peer_accept(struct peer *peer)
+{
+    if (peer->pvconn && !peer->vconn) {
+        peer_connect(peer);
+    }
+}
+
+/* Sends packet_in number 'seq' from the fake datapath 'dp'. */
+static void
+send_packet_in(struct peer *dp, uint32_t seq)
+{
+    struct ofp_packet_in *opi;
+    size_t size = offsetof(struct ofp_packet_in, data) + 60;
+    struct ofpbuf *b;
+
+    opi = make_openflow(size, OFPT_PACKET_IN, &b);
+    opi->buffer_id = htonl(seq);
+    opi->total_len = htons(60);
+    opi->in_port = htons(1);
+    opi->reason = OFPR_NO_MATCH;
+    assert(!vconn_send(dp->vconn, b));
+}
+
+/* Sends a port status message from the fake datapath 'dp' that adds port
+ * 'port_no'. */
+static void
+send_port_add(struct peer *dp, uint16_t port_no)
+{
+    struct ofp_port_status *ops;
+    struct ofpbuf *b;
+
+    ops = make_openflow(sizeof *ops, OFPT_PORT_STATUS, &b);
+    ops->reason = OFPPR_ADD;
+    ops->desc.port_no = htons(port_no);
+    assert(!vconn_send(dp->vconn, b));
+}
+
+/* Runs the secure channel and the fake datapath and controllers once. */
+static void
+run_all(struct secchan *secchan, struct peer *dp, struct peer ctl[2])
+{
+    int i;
+
+    assert(secchan_run(secchan));
+    peer_accept(dp);
+    peer_run(dp, true);
+    for (i = 0; i < 2; i++) {
+        peer_accept(&ctl[i]);
+        peer_run(&ctl[i], false);
+    }
+}
+
+/* Checks that 'peer' received packet_ins 'first' through 'last', in
+ * order. */
+static void
+check_packet_ins(const struct peer *peer, int first, int last)
+{
+    int i;
+
+    assert(peer->n_packet_ins == last - first + 1);
+    for (i = 0; i < peer->n_packet_ins; i++) {
+        assert(peer->packet_ins[i] == first + i);
+    }
+}
+
+int
+main(int argc UNUSED, char *argv[])
+{
+    char controllers[] = "mem:c0,mem:c1";
+    char *args[] = { argv[0], "--out-of-band", "--fail=closed",
+                     "mem:dp", controllers, NULL };
+    struct settings s;
+    struct secchan *secchan;
+    struct peer dp, ctl[2];
+    struct peer *primary, *standby;
+    struct ofpbuf *b;
+    int n_sent, n_before;
+    int i;
+
+    set_program_name(argv[0]);
+    time_init();
+    vlog_init();
+    vlog_set_levels(VLM_ANY_MODULE, VLF_ANY_FACILITY, VLL_EMER);
+
+    peer_open(&dp, "dp");
+    peer_open(&ctl[0], "c0");
+    peer_open(&ctl[1], "c1");
+
+    secchan_parse_options(ARRAY_SIZE(args) - 1, args, &s);
+    secchan = secchan_create(&s);
+    secchan_start(secchan);
+
+    /* Wait for both controllers to be told the datapath's features, one
+     * through the relay and the other by the standby connection. */
+    for (i = 0; i < 1000; i++) {
+        run_all(secchan, &dp, ctl);
+        if (ctl[0].n_features_replies && ctl[1].n_features_replies) {
+            break;
+        }
+    }
+    assert(ctl[0].n_features_replies && ctl[1].n_features_replies);
+
+    /* Find out which controller is in charge. */
+    send_packet_in(&dp, 0);
+    for (i = 0; i < 10; i++) {
+        run_all(secchan, &dp, ctl);
+    }
+    assert(ctl[0].n_packet_ins + ctl[1].n_packet_ins == 1);
+    primary = ctl[0].n_packet_ins ? &ctl[0] : &ctl[1];
+    standby = primary == &ctl[0] ? &ctl[1] : &ctl[0];
+
+    /* The standby may not make requests of the switch. */
+    make_openflow(sizeof(struct ofp_header), OFPT_BARRIER_REQUEST, &b);
+    assert(!vconn_send(standby->vconn, b));
+    for (i = 0; i < 10; i++) {
+        run_all(secchan, &dp, ctl);
+    }
+    assert(standby->n_eperms == 1);
+    assert(dp.n_barriers == 0);
+
+    /* Both controllers hear about a new port, and the standby sees it in
+     * the features reply that it gets from then on. */
+    assert(standby->n_ports == 0);
+    send_port_add(&dp, 5);
+    for (i = 0; i < 10; i++) {
+        run_all(secchan, &dp, ctl);
+    }
+    assert(primary->n_port_status == 1);
+    assert(standby->n_port_status == 1);
+    make_openflow(sizeof(struct ofp_header), OFPT_FEATURES_REQUEST, &b);
+    assert(!vconn_send(standby->vconn, b));
+    for (i = 0; i < 10; i++) {
+        run_all(secchan, &dp, ctl);
+    }
+    assert(standby->n_features_replies == 2);
+    assert(standby->n_ports == 1);
+
+    /* Send packet_ins in bursts and kill the primary partway through, after
+     * it has read everything that reached it. */
+    n_sent = 1;
+    n_before = 0;
+    while (n_sent < N_PACKET_INS) {
+        for (i = 0; i < BURST && n_sent < N_PACKET_INS; i++) {
+            send_packet_in(&dp, n_sent++);
+        }
+        run_all(secchan, &dp, ctl);
+        if (n_sent >= KILL_AFTER && primary->vconn) {
+            n_before = primary->n_packet_ins;
+            vconn_close(primary->vconn);
+            primary->vconn = NULL;
+            primary->connected = false;
+            pvconn_close(primary->pvconn);
+            primary->pvconn = NULL;
+        }
+    }
+    for (i = 0; i < 100; i++) {
+        run_all(secchan, &dp, ctl);
+    }
+
+    /* Every packet_in reached one controller or the other. */
+    assert(n_before > 0);
+    check_packet_ins(primary, 0, n_before - 1);
+    check_packet_ins(standby, n_before, N_PACKET_INS - 1);
+
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include <config.h>
 #include "flow.h"
 #include <errno.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include "openflow/openflow.h"
@@ -14,13 +15,76 @@
 #undef NDEBUG
 #include <assert.h>
 
+/* Layer offsets recorded by flow_extract(), or -1 for a null pointer. */
+struct layers {
+    ptrdiff_t l2, l3, l4, l7;
+};
+
+static ptrdiff_t
+layer_ofs(const struct ofpbuf *packet, const void *layer)
+{
+    return layer ? (const char *) layer - (const char *) packet->data : -1;
+}
+
+static void
+get_layers(const struct ofpbuf *packet, struct layers *layers)
+{
+    layers->l2 = layer_ofs(packet, packet->l2);
+    layers->l3 = layer_ofs(packet, packet->l3);
+    layers->l4 = layer_ofs(packet, packet->l4);
+    layers->l7 = layer_ofs(packet, packet->l7);
+}
+
+/* Runs flow_extract_batch() over the 'n' packets in 'packets', 'chunk'
+ * packets at a time, and checks that it produces the same flows, fragment
+ * flags and layer offsets as flow_extract() did.  Returns the number of
+ * packets that differ. */
+static int
+check_batch(struct ofpbuf *packets[], const struct flow flows[],
+            const int fragments[], const struct layers layers[],
+            size_t n, size_t chunk)
+{
+    struct flow *batch_flows = xmalloc(n * sizeof *batch_flows);
+    int *batch_fragments = xmalloc(n * sizeof *batch_fragments);
+    int errors = 0;
+    size_t i;
+
+    for (i = 0; i < n; i += chunk) {
+        flow_extract_batch(&packets[i], MIN(chunk, n - i), 0,
+                           &batch_flows[i], &batch_fragments[i]);
+    }
+    for (i = 0; i < n; i++) {
+        struct layers batch_layers;
+
+        get_layers(packets[i], &batch_layers);
+        if (memcmp(&flows[i], &batch_flows[i], sizeof flows[i])
+            || fragments[i] != batch_fragments[i]
+            || memcmp(&layers[i], &batch_layers, sizeof layers[i])) {
+            errors++;
+            printf("batch mismatch on packet #%zu (1-based), "
+                   "batches of %zu.\n", i + 1, chunk);
+        }
+    }
+
+    free(batch_flows);
+    free(batch_fragments);
+    return errors;
+}
+
 int
 main(int argc UNUSED, char *argv[])
 {
+    static const size_t chunks[] = { 1, 3, 16 };
     struct ofp_match expected_match;
+    struct ofpbuf **packets = NULL;
+    struct flow *flows_out = NULL;
+    struct layers *layers = NULL;
+    int *fragments = NULL;
+    size_t allocated = 0;
     FILE *flows, *pcap;
     int retval;
     int n = 0, errors = 0;
+    size_t i;
 
     set_program_name(argv[0]);
     time_init();
@@ -43,6 +107,13 @@ main(int argc UNUSED, char *argv[])
         struct flow flow;
 
         n++;
+        if ((size_t) n > allocated) {
+            allocated = allocated ? allocated * 2 : 64;
+            packets = xrealloc(packets, allocated * sizeof *packets);
+            flows_out = xrealloc(flows_out, allocated * sizeof *flows_out);
+            fragments = xrealloc(fragments, allocated * sizeof *fragments);
+            layers = xrealloc(layers, allocated * sizeof *layers);
+        }
 
         retval = pcap_read(pcap, &packet);
         if (retval == EOF) {
@@ -51,7 +122,9 @@ main(int argc UNUSED, char *argv[])
             ofp_fatal(retval, "error reading pcap file");
         }
 
-        flow_extract(packet, 0, &flow);
+        fragments[n - 1] = flow_extract(packet, 0, &flow);
+        flows_out[n - 1] = flow;
+        get_layers(packet, &layers[n - 1]);
         flow_fill_match(&extracted_match, &flow, 0);
 
         if (memcmp(&expected_match, &extracted_match, sizeof expected_match)) {
@@ -68,8 +141,22 @@ main(int argc UNUSED, char *argv[])
             free(got_s);
         }
 
-        ofpbuf_delete(packet);
+        packets[n - 1] = packet;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(chunks); i++) {
+        errors += check_batch(packets, flows_out, fragments, layers,
+                              n, chunks[i]);
     }
+    errors += check_batch(packets, flows_out, fragments, layers, n, MAX(n, 1));
+    for (i = 0; i < (size_t) n; i++) {
+        ofpbuf_delete(packets[i]);
+    }
+    free(packets);
+    free(flows_out);
+    free(fragments);
+    free(layers);
+
     printf("checked %d packets, %d errors\n", n, errors);
     return errors != 0;
 }
@@ -5,5 +5,5 @@ cd tests
 "$srcdir"/tests/flowgen.pl >/dev/null 3>flows$$ 4>pcap$$
 ./test-flows <flows$$ 3<pcap$$ >out$$ || true
 diff -u - out$$ <<EOF
-checked 247 packets, 0 errors
+checked 253 packets, 0 errors
 EOF
@@ -0,0 +1,188 @@
+/* Runs a secure channel in-process, with rate limiting, between a fake
+ * datapath and a fake controller, and checks that the controller cannot turn
+ * on packet-in batching and thereby get its packet-ins past the rate
+ * limiter. */
+
+#include <config.h>
+#include "secchan.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "openflow/openflow-ext.h"
+#include "timeval.h"
+#include "util.h"
+#include "vconn.h"
+#include "vlog.h"
+#include "xtoxll.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+/* Packet-ins sent by the datapath, and the rate and burst limits applied to
+ * them. */
+#define N_PACKET_INS 500
+#define RATE_LIMIT "100"
+#define BURST_LIMIT "10"
+
+/* One end of a fake connection to the secure channel. */
+struct peer {
+    struct pvconn *pvconn;
+    struct vconn *vconn;
+    bool connected;
+
+    int n_packet_ins;           /* OFPT_PACKET_IN messages received. */
+    int n_vendor;               /* OFPT_VENDOR messages received. */
+    int n_eperms;               /* OFPBRC_EPERM errors received. */
+};
+
+static void
+peer_open(struct peer *peer, const char *name)
+{
+    char *s = xasprintf("pmem:%s", name);
+
+    memset(peer, 0, sizeof *peer);
+    assert(!pvconn_open(s, &peer->pvconn));
+    free(s);
+}
+
+/* Accepts and completes the connection to 'peer', receives what has arrived
+ * on it, and answers requests as a datapath would, if 'is_datapath'. */
+static void
+peer_run(struct peer *peer, bool is_datapath)
+{
+    struct ofpbuf *b;
+    int error;
+
+    if (!peer->vconn) {
+        error = pvconn_accept(peer->pvconn, OFP_VERSION, &peer->vconn);
+        assert(!error || error == EAGAIN);
+        if (!peer->vconn) {
+            return;
+        }
+    }
+    if (!peer->connected) {
+        error = vconn_connect(peer->vconn);
+        assert(!error || error == EAGAIN);
+        peer->connected = !error;
+        if (error) {
+            return;
+        }
+    }
+
+    while (!vconn_recv(peer->vconn, &b)) {
+        const struct ofp_header *oh = b->data;
+
+        switch (oh->type) {
+        case OFPT_ECHO_REQUEST:
+            assert(!vconn_send(peer->vconn, make_echo_reply(oh)));
+            break;
+
+        case OFPT_FEATURES_REQUEST:
+            if (is_datapath) {
+                struct ofp_switch_features *osf;
+                struct ofpbuf *reply;
+
+                osf = make_openflow_xid(sizeof *osf, OFPT_FEATURES_REPLY,
+                                        oh->xid, &reply);
+                osf->datapath_id = htonll(1);
+                osf->n_buffers = htonl(256);
+                osf->n_tables = 1;
+                assert(!vconn_send(peer->vconn, reply));
+            }
+            break;
+
+        case OFPT_PACKET_IN:
+            peer->n_packet_ins++;
+            break;
+
+        case OFPT_VENDOR:
+            peer->n_vendor++;
+            break;
+
+        case OFPT_ERROR: {
+            const struct ofp_error_msg *oem = b->data;
+            assert(oem->type == htons(OFPET_BAD_REQUEST));
+            assert(oem->code == htons(OFPBRC_EPERM));
+            peer->n_eperms++;
+            break;
+        }
+        }
+        ofpbuf_delete(b);
+    }
+}
+
+/* Runs the secure channel and the fake datapath and controller 'n' times. */
+static void
+run_all(struct secchan *secchan, struct peer *dp, struct peer *ctl, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        assert(secchan_run(secchan));
+        peer_run(dp, true);
+        peer_run(ctl, false);
+    }
+}
+
+int
+main(int argc UNUSED, char *argv[])
+{
+    char *args[] = { argv[0], "--out-of-band", "--fail=closed",
+                     "--rate-limit=" RATE_LIMIT,
+                     "--burst-limit=" BURST_LIMIT,
+                     "mem:dp", "mem:ctl", NULL };
+    struct openflow_packet_in_batch_config *opibc;
+    struct secchan *secchan;
+    struct peer dp, ctl;
+    struct settings s;
+    struct ofpbuf *b;
+    int i;
+
+    set_program_name(argv[0]);
+    time_init();
+    vlog_init();
+    vlog_set_levels(VLM_ANY_MODULE, VLF_ANY_FACILITY, VLL_EMER);
+
+    peer_open(&dp, "dp");
+    peer_open(&ctl, "ctl");
+    secchan_parse_options(ARRAY_SIZE(args) - 1, args, &s);
+    secchan = secchan_create(&s);
+    secchan_start(secchan);
+    for (i = 0; i < 1000 && !(dp.connected && ctl.connected); i++) {
+        run_all(secchan, &dp, &ctl, 1);
+    }
+    assert(dp.connected && ctl.connected);
+
+    /* The controller asks for batching and is refused, and the datapath
+     * never hears about it. */
+    opibc = make_openflow(sizeof *opibc, OFPT_VENDOR, &b);
+    opibc->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    opibc->header.subtype = htonl(OFP_EXT_PACKET_IN_BATCH_CONFIG);
+    opibc->max_packets = htons(64);
+    assert(!vconn_send(ctl.vconn, b));
+    run_all(secchan, &dp, &ctl, 10);
+    assert(ctl.n_eperms == 1);
+    assert(dp.n_vendor == 0);
+
+    /* A flood of packet-ins from the datapath is still rate limited. */
+    for (i = 0; i < N_PACKET_INS; i++) {
+        struct ofp_packet_in *opi;
+        size_t size = offsetof(struct ofp_packet_in, data) + 60;
+
+        opi = make_openflow(size, OFPT_PACKET_IN, &b);
+        opi->buffer_id = htonl(i);
+        opi->total_len = htons(60);
+        opi->in_port = htons(1);
+        opi->reason = OFPR_NO_MATCH;
+        assert(!vconn_send(dp.vconn, b));
+    }
+    run_all(secchan, &dp, &ctl, 100);
+    assert(ctl.n_vendor == 0);
+    assert(ctl.n_packet_ins > 0);
+    assert(ctl.n_packet_ins < N_PACKET_INS / 2);
+
+    return 0;
+}
@@ -0,0 +1,264 @@
+/* Tests filtering, sampling, truncation and queuing of the copies that an
+ * rconn sends to its monitoring connections. */
+
+#include <config.h>
+#include "rconn.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "openflow/openflow-ext.h"
+#include "poll-loop.h"
+#include "timeval.h"
+#include "util.h"
+#include "vconn.h"
+#include "vlog.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+/* Length of the packet_in messages sent by the tests. */
+#define PACKET_IN_LEN (sizeof(struct ofp_packet_in) + 200)
+
+/* Opens a pmem: listener named 'name' and connects a mem: vconn to it,
+ * returning the active and passive ends, both past the hello exchange. */
+static void
+open_pair(const char *name, struct vconn **activep, struct vconn **passivep)
+{
+    struct pvconn *pvconn;
+    char *s;
+
+    s = xasprintf("pmem:%s", name);
+    assert(!pvconn_open(s, &pvconn));
+    free(s);
+
+    s = xasprintf("mem:%s", name);
+    assert(!vconn_open(s, OFP_VERSION, activep));
+    free(s);
+
+    *passivep = NULL;
+    for (;;) {
+        int a_error = vconn_connect(*activep);
+        int p_error = EAGAIN;
+
+        assert(!a_error || a_error == EAGAIN);
+        if (!*passivep) {
+            int error = pvconn_accept(pvconn, OFP_VERSION, passivep);
+            assert(!error || error == EAGAIN);
+        }
+        if (*passivep) {
+            p_error = vconn_connect(*passivep);
+            assert(!p_error || p_error == EAGAIN);
+        }
+        if (!a_error && !p_error) {
+            break;
+        }
+    }
+    pvconn_close(pvconn);
+}
+
+/* Connects a new rconn to a "pmem:rconn" listener, returning the rconn and
+ * the vconn for its peer. */
+static struct rconn *
+open_rconn(struct vconn **peerp)
+{
+    struct pvconn *pvconn;
+    struct rconn *rc;
+
+    assert(!pvconn_open("pmem:rconn", &pvconn));
+    rc = rconn_create(0, 0);
+    assert(!rconn_connect(rc, "mem:rconn"));
+
+    *peerp = NULL;
+    for (;;) {
+        int error = EAGAIN;
+
+        rconn_run(rc);
+        if (!*peerp) {
+            int retval = pvconn_accept(pvconn, OFP_VERSION, peerp);
+            assert(!retval || retval == EAGAIN);
+        }
+        if (*peerp) {
+            error = vconn_connect(*peerp);
+            assert(!error || error == EAGAIN);
+        }
+        if (!error && rconn_is_connected(rc)) {
+            break;
+        }
+    }
+    pvconn_close(pvconn);
+    return rc;
+}
+
+/* Discards everything that has arrived on 'vconn'. */
+static void
+drain(struct vconn *vconn)
+{
+    struct ofpbuf *b;
+
+    while (!vconn_recv(vconn, &b)) {
+        ofpbuf_delete(b);
+    }
+}
+
+/* Sends an OFP_EXT_MONITOR_CONFIG message on 'monitor' and lets 'rc' apply
+ * it. */
+static void
+configure(struct rconn *rc, struct vconn *monitor, uint32_t types,
+          uint32_t sample, uint16_t max_bytes,
+          const uint16_t *ports, size_t n_ports)
+{
+    struct openflow_monitor_config *omc;
+    struct ofpbuf *b;
+    size_t i;
+
+    omc = make_openflow(sizeof *omc + n_ports * sizeof *omc->ports,
+                        OFPT_VENDOR, &b);
+    omc->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    omc->header.subtype = htonl(OFP_EXT_MONITOR_CONFIG);
+    omc->types = htonl(types);
+    omc->sample = htonl(sample);
+    omc->max_bytes = htons(max_bytes);
+    for (i = 0; i < n_ports; i++) {
+        omc->ports[i] = htons(ports[i]);
+    }
+    assert(!vconn_send(monitor, b));
+    rconn_run(rc);
+}
+
+/* Sends a packet_in for 'port' on 'rc'. */
+static void
+send_packet_in(struct rconn *rc, uint16_t port)
+{
+    struct ofp_packet_in *opi;
+    struct ofpbuf *b;
+
+    opi = make_openflow(PACKET_IN_LEN, OFPT_PACKET_IN, &b);
+    opi->in_port = htons(port);
+    assert(!rconn_send(rc, b, NULL));
+}
+
+/* Sends an echo request on 'rc'. */
+static void
+send_echo(struct rconn *rc)
+{
+    assert(!rconn_send(rc, make_echo_request(), NULL));
+}
+
+/* Receives the copies that have arrived on 'monitor', checking that each one
+ * has type 'type' and is no longer than 'max_len', and returns how many there
+ * were. */
+static int
+count_copies(struct vconn *monitor, uint8_t type, size_t max_len)
+{
+    struct ofpbuf *b;
+    int n = 0;
+
+    while (!vconn_recv(monitor, &b)) {
+        const struct ofp_header *oh = b->data;
+
+        assert(oh->type == type);
+        assert(b->size <= max_len);
+        assert(ntohs(oh->length) == b->size);
+        ofpbuf_delete(b);
+        n++;
+    }
+    return n;
+}
+
+/* Checks that an unconfigured monitor sees everything and that a type, port
+ * and length filter cut that down. */
+static void
+test_filter(struct rconn *rc, struct vconn *peer, struct vconn *monitor)
+{
+    static const uint16_t ports[] = { 2, 5 };
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        send_packet_in(rc, i);
+    }
+    rconn_run(rc);
+    drain(peer);
+    assert(count_copies(monitor, OFPT_PACKET_IN, PACKET_IN_LEN) == 4);
+
+    configure(rc, monitor, UINT32_C(1) << OFPT_PACKET_IN, 1, 64,
+              ports, ARRAY_SIZE(ports));
+    for (i = 0; i < 8; i++) {
+        send_packet_in(rc, i);
+        send_echo(rc);
+    }
+    rconn_run(rc);
+    drain(peer);
+    assert(count_copies(monitor, OFPT_PACKET_IN, 64) == 2);
+}
+
+/* Checks that a monitor that asks for 1 message in 3 gets that many. */
+static void
+test_sample(struct rconn *rc, struct vconn *peer, struct vconn *monitor)
+{
+    int i;
+
+    configure(rc, monitor, UINT32_C(1) << OFPT_ECHO_REQUEST, 3, 0, NULL, 0);
+    for (i = 0; i < 9; i++) {
+        send_echo(rc);
+        send_packet_in(rc, i);
+    }
+    rconn_run(rc);
+    drain(peer);
+    assert(count_copies(monitor, OFPT_ECHO_REQUEST,
+                        sizeof(struct ofp_header)) == 3);
+}
+
+/* Checks that copies for a monitor that is not keeping up are dropped and
+ * counted once its queue fills. */
+static void
+test_overflow(struct rconn *rc, struct vconn *peer, struct vconn *monitor)
+{
+    unsigned long long int copied, dropped;
+    int i;
+
+    configure(rc, monitor, UINT32_MAX, 1, 0, NULL, 0);
+    copied = rconn_monitor_copied(rc, 0);
+    dropped = rconn_monitor_dropped(rc, 0);
+    for (i = 0; i < 200; i++) {
+        send_echo(rc);
+    }
+    assert(rconn_monitor_dropped(rc, 0) - dropped == 200 - 128);
+    assert(rconn_monitor_copied(rc, 0) - copied == 128);
+
+    rconn_run(rc);
+    drain(peer);
+    assert(count_copies(monitor, OFPT_ECHO_REQUEST,
+                        sizeof(struct ofp_header)) == 128);
+}
+
+int
+main(int argc UNUSED, char *argv[])
+{
+    struct vconn *peer, *monitor, *monitor_peer;
+    struct rconn *rc;
+
+    set_program_name(argv[0]);
+    time_init();
+    vlog_init();
+    vlog_set_levels(VLM_ANY_MODULE, VLF_ANY_FACILITY, VLL_EMER);
+
+    rc = open_rconn(&peer);
+    open_pair("monitor", &monitor, &monitor_peer);
+    rconn_add_monitor(rc, monitor_peer);
+    assert(rconn_count_monitors(rc) == 1);
+
+    test_filter(rc, peer, monitor);
+    test_sample(rc, peer, monitor);
+    test_overflow(rc, peer, monitor);
+
+    vconn_close(monitor);
+    rconn_run(rc);
+    assert(rconn_count_monitors(rc) == 0);
+
+    rconn_destroy(rc);
+    vconn_close(peer);
+    return 0;
+}
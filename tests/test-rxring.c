@@ -0,0 +1,184 @@
+/* Tests the receive ring that hands packets from a hardware driver's thread
+ * to the datapath.
+ *
+ * The late-kick case needs to stop the producer between counting a kick and
+ * writing it to the eventfd, so this includes the ring's implementation to
+ * reach its internals. */
+
+#include <config.h>
+#include "dp_rxring.c"
+#include <poll.h>
+#include "dynamic-string.h"
+#include "timeval.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+/* Enqueues on 'r' a packet whose port number is 'seq'. */
+static void
+enqueue(struct dp_rxring *r, uint32_t seq)
+{
+    dp_rxring_enqueue(r, ofpbuf_new(64), seq, 0);
+}
+
+/* Dequeues up to 'max' packets from 'r', checking that they carry sequence
+ * numbers starting at '*seqp', and returns how many there were. */
+static size_t
+dequeue(struct dp_rxring *r, size_t max, uint32_t *seqp)
+{
+    struct dp_rxring_entry entries[16];
+    size_t n, i;
+
+    assert(max <= ARRAY_SIZE(entries));
+    n = dp_rxring_dequeue(r, entries, max);
+    for (i = 0; i < n; i++) {
+        assert(entries[i].port_no == (*seqp)++);
+        ofpbuf_delete(entries[i].buffer);
+    }
+    return n;
+}
+
+/* Returns true if 'r''s eventfd is readable, that is, if a poll loop
+ * waiting on it would wake up at once. */
+static bool
+fd_readable(const struct dp_rxring *r)
+{
+    struct pollfd pfd;
+
+    pfd.fd = r->fd;
+    pfd.events = POLLIN;
+    return poll(&pfd, 1, 0) == 1;
+}
+
+/* Checks that packets come out in order as the indexes wrap around the ring
+ * many times over. */
+static void
+test_wraparound(void)
+{
+    struct dp_rxring *r = dp_rxring_create(3);
+    uint32_t in = 0, out = 0;
+    int i;
+
+    assert(r->mask + 1 == 4);
+    for (i = 0; i < 1000; i++) {
+        enqueue(r, in++);
+        enqueue(r, in++);
+        enqueue(r, in++);
+        assert(dequeue(r, 2, &out) == 2);
+        assert(dequeue(r, 16, &out) == 1);
+    }
+    assert(!dequeue(r, 16, &out));
+    assert(out == in);
+    assert(r->prod.n_dropped == 0);
+    dp_rxring_destroy(r);
+}
+
+/* Checks that a full ring drops and counts the packets that do not fit, and
+ * takes packets again once there is room. */
+static void
+test_full(void)
+{
+    struct dp_rxring *r = dp_rxring_create(4);
+    uint32_t out = 0;
+    struct ds s;
+    uint32_t i;
+
+    for (i = 0; i < 6; i++) {
+        enqueue(r, i);
+    }
+    assert(dequeue(r, 16, &out) == 4);
+    assert(out == 4);
+
+    out = 10;
+    enqueue(r, 10);
+    assert(dequeue(r, 16, &out) == 1);
+
+    ds_init(&s);
+    dp_rxring_format_status(r, &s);
+    assert(strstr(ds_cstr(&s), "hw-rx.enqueued=5\n"));
+    assert(strstr(ds_cstr(&s), "hw-rx.dropped=2\n"));
+    assert(strstr(ds_cstr(&s), "hw-rx.dequeued=5\n"));
+    ds_destroy(&s);
+    dp_rxring_destroy(r);
+}
+
+/* Checks that an enqueue onto a ring whose consumer is about to sleep kicks
+ * the eventfd, and that the consumer drains the kick. */
+static void
+test_wakeup(void)
+{
+    struct dp_rxring *r = dp_rxring_create(4);
+    uint32_t out = 0;
+
+    /* A consumer with packets waiting does not sleep. */
+    enqueue(r, 0);
+    dp_rxring_wait(r);
+    assert(!r->cons.waiting);
+    assert(dequeue(r, 16, &out) == 1);
+
+    /* An empty ring sleeps on the eventfd, and the next packet kicks it. */
+    dp_rxring_wait(r);
+    assert(r->cons.waiting);
+    assert(!fd_readable(r));
+    enqueue(r, 1);
+    assert(r->prod.n_kicks == 1);
+    assert(fd_readable(r));
+
+    /* Only one kick per sleep. */
+    enqueue(r, 2);
+    assert(r->prod.n_kicks == 1);
+
+    assert(dequeue(r, 16, &out) == 2);
+    dp_rxring_wait(r);
+    assert(!fd_readable(r));
+    dp_rxring_destroy(r);
+}
+
+/* Checks that a kick that reaches the eventfd only after the consumer has
+ * already looked for it is still drained later, instead of leaving the
+ * eventfd readable and the poll loop spinning. */
+static void
+test_late_kick(void)
+{
+    static const uint64_t one = 1;
+    struct dp_rxring *r = dp_rxring_create(4);
+    uint32_t out = 0;
+
+    dp_rxring_wait(r);
+    assert(r->cons.waiting);
+
+    /* The producer enqueues, takes over the kick and counts it, but has not
+     * written the eventfd yet when the consumer wakes for another reason,
+     * dequeues the packet and gets ready to sleep again. */
+    r->cons.waiting = 0;
+    r->prod.n_kicks++;
+    enqueue(r, 0);
+    assert(dequeue(r, 16, &out) == 1);
+    dp_rxring_wait(r);
+
+    /* Now the kick arrives. */
+    assert(write(r->fd, &one, sizeof one) == sizeof one);
+    assert(fd_readable(r));
+
+    /* The consumer wakes up, finds nothing, and must drain the kick before
+     * sleeping again. */
+    assert(!dequeue(r, 16, &out));
+    dp_rxring_wait(r);
+    assert(!fd_readable(r));
+    dp_rxring_destroy(r);
+}
+
+int
+main(int argc UNUSED, char *argv[])
+{
+    set_program_name(argv[0]);
+    time_init();
+    vlog_init();
+    vlog_set_levels(VLM_ANY_MODULE, VLF_ANY_FACILITY, VLL_EMER);
+
+    test_wraparound();
+    test_full();
+    test_wakeup();
+    test_late_kick();
+    return 0;
+}
@@ -0,0 +1,222 @@
+/* Tests message transfer over the shared-memory vconn. */
+
+#include <config.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "poll-loop.h"
+#include "random.h"
+#include "timeval.h"
+#include "util.h"
+#include "vconn.h"
+#include "vlog.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+/* Enough traffic to wrap each ring several times. */
+#define N_MSGS 2000
+
+/* Returns the length of test message number 'i', as in test-vconn-stream. */
+static size_t
+msg_length(int i)
+{
+    switch (i % 7) {
+    case 0:
+        return sizeof(struct ofp_header);
+    case 1:
+        return 65535 - i % 100;
+    case 2:
+        return 1500 + i % 97;
+    default:
+        return 72 + i % 61;
+    }
+}
+
+/* Returns a new buffer holding test message number 'i'. */
+static struct ofpbuf *
+make_msg(int i)
+{
+    size_t length = msg_length(i);
+    struct ofpbuf *b = ofpbuf_new(length);
+    struct ofp_header *oh = ofpbuf_put_uninit(b, length);
+    uint8_t *body = (uint8_t *) (oh + 1);
+    size_t j;
+
+    oh->version = OFP_VERSION;
+    oh->type = OFPT_ECHO_REQUEST;
+    oh->length = htons(length);
+    oh->xid = htonl(i);
+    for (j = 0; j < length - sizeof *oh; j++) {
+        body[j] = i + j;
+    }
+    return b;
+}
+
+/* Checks that 'b' is test message number 'i' and frees it. */
+static void
+check_msg(struct ofpbuf *b, int i)
+{
+    struct ofpbuf *expected = make_msg(i);
+
+    assert(b->size == expected->size);
+    assert(!memcmp(b->data, expected->data, b->size));
+    ofpbuf_delete(expected);
+    ofpbuf_delete(b);
+}
+
+/* Opens a pshm: listener and connects a shm: vconn to it, returning the
+ * active and passive ends, both past the hello exchange. */
+static void
+open_pair(const char *path, struct pvconn **pvconnp,
+          struct vconn **activep, struct vconn **passivep)
+{
+    char *name;
+
+    name = xasprintf("pshm:%s", path);
+    assert(!pvconn_open(name, pvconnp));
+    free(name);
+
+    name = xasprintf("shm:%s", path);
+    assert(!vconn_open(name, OFP_VERSION, activep));
+    free(name);
+
+    *passivep = NULL;
+    for (;;) {
+        int a_error = vconn_connect(*activep);
+        int p_error = EAGAIN;
+
+        assert(!a_error || a_error == EAGAIN);
+        if (!*passivep) {
+            int error = pvconn_accept(*pvconnp, OFP_VERSION, passivep);
+            assert(!error || error == EAGAIN);
+        }
+        if (*passivep) {
+            p_error = vconn_connect(*passivep);
+            assert(!p_error || p_error == EAGAIN);
+        }
+        if (!a_error && !p_error) {
+            break;
+        }
+
+        vconn_connect_wait(*activep);
+        if (*passivep) {
+            vconn_connect_wait(*passivep);
+        } else {
+            pvconn_wait(*pvconnp);
+        }
+        poll_block();
+    }
+}
+
+/* Sends test messages from 'tx' to 'rx' in batches of random size while
+ * 'rx' reads a random number at a time, so that the ring is often full, and
+ * checks that they arrive intact and in order. */
+static void
+test_transfer(struct vconn *tx, struct vconn *rx)
+{
+    struct ofpbuf *msgs[N_MSGS];
+    size_t n_sent = 0;
+    int n_received = 0;
+    int i;
+
+    for (i = 0; i < N_MSGS; i++) {
+        msgs[i] = make_msg(i);
+    }
+
+    while (n_received < N_MSGS) {
+        int n_recv = 1 + random_range(50);
+
+        if (n_sent < N_MSGS) {
+            size_t n_msgs = 1 + random_range(100);
+            size_t n;
+            int error;
+
+            n_msgs = MIN(n_msgs, N_MSGS - n_sent);
+            error = vconn_send_batch(tx, &msgs[n_sent], n_msgs, &n);
+            assert(error == (n < n_msgs ? EAGAIN : 0));
+            n_sent += n;
+        }
+
+        while (n_recv-- > 0 && n_received < N_MSGS) {
+            struct ofpbuf *b;
+            int error = vconn_recv(rx, &b);
+
+            if (error == EAGAIN) {
+                break;
+            }
+            assert(!error);
+            check_msg(b, n_received++);
+        }
+
+        if (n_received < N_MSGS) {
+            if (n_sent < N_MSGS) {
+                vconn_send_wait(tx);
+            }
+            vconn_recv_wait(rx);
+            poll_block();
+        }
+    }
+    assert(n_sent == N_MSGS);
+}
+
+/* Checks that after 'tx' sends a few messages and closes, 'rx' still
+ * receives them and then sees end of file. */
+static void
+test_close(struct vconn *tx, struct vconn *rx)
+{
+    int n_received = 0;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        assert(!vconn_send(tx, make_msg(i)));
+    }
+    vconn_close(tx);
+
+    for (;;) {
+        struct ofpbuf *b;
+        int error = vconn_recv(rx, &b);
+
+        if (!error) {
+            check_msg(b, n_received++);
+        } else if (error == EAGAIN) {
+            vconn_recv_wait(rx);
+            poll_block();
+        } else {
+            assert(error == EOF);
+            break;
+        }
+    }
+    assert(n_received == 3);
+}
+
+int
+main(int argc UNUSED, char *argv[])
+{
+    struct vconn *active, *passive;
+    struct pvconn *pvconn;
+    char *path;
+
+    set_program_name(argv[0]);
+    time_init();
+    vlog_init();
+    vlog_set_levels(VLM_ANY_MODULE, VLF_ANY_FACILITY, VLL_EMER);
+
+    path = xasprintf("/tmp/test-vconn-shm.%ld", (long int) getpid());
+    open_pair(path, &pvconn, &active, &passive);
+    pvconn_close(pvconn);
+
+    test_transfer(active, passive);
+    test_transfer(passive, active);
+    test_close(active, passive);
+    vconn_close(passive);
+
+    unlink(path);
+    free(path);
+    return 0;
+}
@@ -0,0 +1,271 @@
+/* Tests message framing in the stream vconn's receive and transmit paths. */
+
+#include <config.h>
+#include "vconn-stream.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "ofpbuf.h"
+#include "openflow/openflow.h"
+#include "poll-loop.h"
+#include "random.h"
+#include "socket-util.h"
+#include "timeval.h"
+#include "util.h"
+#include "vconn.h"
+#include "vconn-provider.h"
+#include "vlog.h"
+
+#undef NDEBUG
+#include <assert.h>
+
+#define N_MSGS 5000
+#define N_BATCH_MSGS 1000
+#define N_KEPT 16
+
+/* Returns the length of test message number 'i': mostly short, like a flow
+ * mod or a packet-in, with some up to the largest possible message. */
+static size_t
+msg_length(int i)
+{
+    switch (i % 7) {
+    case 0:
+        return sizeof(struct ofp_header);
+    case 1:
+        return 65535 - i % 100;
+    case 2:
+        return 1500 + i % 97;
+    default:
+        return 72 + i % 61;
+    }
+}
+
+/* Appends test message number 'i' to 'b'. */
+static void
+put_msg(struct ofpbuf *b, int i)
+{
+    size_t length = msg_length(i);
+    struct ofp_header *oh = ofpbuf_put_uninit(b, length);
+    uint8_t *body = (uint8_t *) (oh + 1);
+    size_t j;
+
+    oh->version = OFP_VERSION;
+    oh->type = OFPT_ECHO_REQUEST;
+    oh->length = htons(length);
+    oh->xid = htonl(i);
+    for (j = 0; j < length - sizeof *oh; j++) {
+        body[j] = i + j;
+    }
+}
+
+/* Checks that 'msg' holds test message number 'i', followed by a zero byte
+ * if 'grown'. */
+static void
+check_msg(const struct ofpbuf *msg, int i, bool grown)
+{
+    struct ofpbuf expected;
+
+    ofpbuf_init(&expected, 0);
+    put_msg(&expected, i);
+    if (grown) {
+        ofpbuf_put_zeros(&expected, 1);
+    }
+    assert(msg->size == expected.size);
+    assert(!memcmp(msg->data, expected.data, msg->size));
+    ofpbuf_uninit(&expected);
+}
+
+/* Opens a stream vconn on one end of a socket pair, returning the vconn in
+ * '*vconnp' and the other end's fd in '*fdp', and completes the OpenFlow
+ * hello exchange over it. */
+static void
+open_pair(struct vconn **vconnp, int *fdp)
+{
+    struct ofp_header hello, reply;
+    struct ofpbuf *msg;
+    int fds[2];
+
+    assert(!socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    assert(!set_nonblocking(fds[0]));
+    assert(!new_stream_vconn("unix:test", fds[0], 0, 0, false, vconnp));
+    (*vconnp)->min_version = OFP_VERSION; /* As vconn_open() would set. */
+
+    hello.version = OFP_VERSION;
+    hello.type = OFPT_HELLO;
+    hello.length = htons(sizeof hello);
+    hello.xid = 0;
+    assert(write(fds[1], &hello, sizeof hello) == sizeof hello);
+    assert(vconn_recv(*vconnp, &msg) == EAGAIN);
+    assert(read(fds[1], &reply, sizeof reply) == sizeof reply);
+    assert(reply.type == OFPT_HELLO);
+
+    *fdp = fds[1];
+}
+
+/* Writes all the test messages to the socket in chunks of random size,
+ * taking in whatever has arrived after each chunk, and checks that every
+ * message comes out of vconn_recv() whole and in order.
+ *
+ * Each message is kept for a while after the next ones arrive, and some are
+ * appended to, to check that messages handed out from the same receive
+ * buffer stay intact. */
+static void
+test_framing(void)
+{
+    struct ofpbuf *stream = ofpbuf_new(0);
+    struct ofpbuf *kept[N_KEPT];
+    struct vconn *vconn;
+    struct ofpbuf *msg;
+    size_t ofs = 0;
+    int next = 0;
+    int fd, i;
+
+    for (i = 0; i < N_MSGS; i++) {
+        put_msg(stream, i);
+    }
+
+    open_pair(&vconn, &fd);
+    assert(!set_nonblocking(fd));
+    while (next < N_MSGS) {
+        int error;
+
+        if (ofs < stream->size) {
+            size_t chunk = 1 + random_range(random_range(2) ? 100 : 70000);
+            ssize_t n;
+
+            chunk = MIN(chunk, stream->size - ofs);
+            n = write(fd, (char *) stream->data + ofs, chunk);
+            assert(n > 0 || errno == EAGAIN);
+            if (n > 0) {
+                ofs += n;
+            }
+        }
+
+        while ((error = vconn_recv(vconn, &msg)) == 0) {
+            int slot = next % N_KEPT;
+
+            check_msg(msg, next, false);
+            if (next % 5 == 0) {
+                ofpbuf_put_zeros(msg, 1);
+            }
+            if (next >= N_KEPT) {
+                int old = next - N_KEPT;
+                check_msg(kept[slot], old, old % 5 == 0);
+                ofpbuf_delete(kept[slot]);
+            }
+            kept[slot] = msg;
+            next++;
+        }
+        assert(error == EAGAIN);
+    }
+    assert(ofs == stream->size);
+    for (i = N_MSGS - N_KEPT; i < N_MSGS; i++) {
+        check_msg(kept[i % N_KEPT], i, i % 5 == 0);
+        ofpbuf_delete(kept[i % N_KEPT]);
+    }
+
+    close(fd);
+    assert(vconn_recv(vconn, &msg) == EOF);
+    vconn_close(vconn);
+    ofpbuf_delete(stream);
+}
+
+/* Checks that a connection closed partway through a message is reported as
+ * a protocol error, after the complete messages before it are received. */
+static void
+test_truncated(void)
+{
+    struct ofpbuf *stream = ofpbuf_new(0);
+    struct vconn *vconn;
+    struct ofpbuf *msg;
+    int fd;
+
+    put_msg(stream, 3);
+    put_msg(stream, 4);
+    open_pair(&vconn, &fd);
+    assert(write(fd, stream->data, stream->size - 1) == stream->size - 1);
+    close(fd);
+
+    assert(!vconn_recv(vconn, &msg));
+    assert(ntohl(((struct ofp_header *) msg->data)->xid) == 3);
+    ofpbuf_delete(msg);
+    assert(vconn_recv(vconn, &msg) == EPROTO);
+    vconn_close(vconn);
+    ofpbuf_delete(stream);
+}
+
+/* Queues test messages with vconn_send_batch() in batches of random size
+ * while the peer reads in chunks of random size, so that the socket often
+ * fills up partway through a message, and checks that the peer receives
+ * exactly the messages' bytes, in order. */
+static void
+test_send_batch(void)
+{
+    struct ofpbuf *msgs[N_BATCH_MSGS];
+    struct ofpbuf *expected = ofpbuf_new(0);
+    struct ofpbuf *received = ofpbuf_new(0);
+    struct vconn *vconn;
+    size_t n_done = 0;
+    int fd, i;
+
+    for (i = 0; i < N_BATCH_MSGS; i++) {
+        msgs[i] = ofpbuf_new(0);
+        put_msg(msgs[i], i);
+        put_msg(expected, i);
+    }
+
+    open_pair(&vconn, &fd);
+    assert(!set_nonblocking(fd));
+    while (received->size < expected->size) {
+        size_t chunk = 1 + random_range(random_range(2) ? 1000 : 100000);
+        ssize_t n;
+
+        if (n_done < N_BATCH_MSGS) {
+            size_t n_msgs = 1 + random_range(300);
+            size_t n_sent;
+            int error;
+
+            n_msgs = MIN(n_msgs, N_BATCH_MSGS - n_done);
+            error = vconn_send_batch(vconn, &msgs[n_done], n_msgs, &n_sent);
+            assert(error == (n_sent < n_msgs ? EAGAIN : 0));
+            n_done += n_sent;
+        }
+
+        /* Let the vconn finish off a partly written message. */
+        poll_immediate_wake();
+        poll_block();
+
+        ofpbuf_prealloc_tailroom(received, chunk);
+        n = read(fd, ofpbuf_tail(received), chunk);
+        assert(n > 0 || errno == EAGAIN);
+        if (n > 0) {
+            received->size += n;
+        }
+    }
+    assert(n_done == N_BATCH_MSGS);
+    assert(received->size == expected->size);
+    assert(!memcmp(received->data, expected->data, expected->size));
+
+    vconn_close(vconn);
+    close(fd);
+    ofpbuf_delete(expected);
+    ofpbuf_delete(received);
+}
+
+int
+main(int argc UNUSED, char *argv[])
+{
+    set_program_name(argv[0]);
+    time_init();
+    vlog_init();
+    vlog_set_levels(VLM_ANY_MODULE, VLF_ANY_FACILITY, VLL_EMER);
+
+    test_framing();
+    test_truncated();
+    test_send_batch();
+    return 0;
+}
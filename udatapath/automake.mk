@@ -14,6 +14,16 @@ udatapath_ofdatapath_SOURCES = \
 	udatapath/datapath.h \
 	udatapath/dp_act.c \
 	udatapath/dp_act.h \
+	udatapath/dp_buffers.c \
+	udatapath/dp_buffers.h \
+	udatapath/dp_limit.c \
+	udatapath/dp_limit.h \
+	udatapath/dp_misses.c \
+	udatapath/dp_misses.h \
+	udatapath/dp_rxring.c \
+	udatapath/dp_rxring.h \
+	udatapath/dp_sched.c \
+	udatapath/dp_sched.h \
 	udatapath/of_ext_msg.c \
 	udatapath/of_ext_msg.h \
 	udatapath/udatapath.c \
@@ -25,8 +35,9 @@ udatapath_ofdatapath_SOURCES = \
 	udatapath/table-hash.c \
 	udatapath/table-linear.c
 
-udatapath_ofdatapath_LDADD = lib/libopenflow.a $(SSL_LIBS) $(FAULT_LIBS)
-udatapath_ofdatapath_CPPFLAGS = $(AM_CPPFLAGS)
+udatapath_ofdatapath_LDADD = \
+	secchan/libsecchan.a lib/libopenflow.a $(SSL_LIBS) $(FAULT_LIBS)
+udatapath_ofdatapath_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/secchan
 
 EXTRA_DIST += udatapath/ofdatapath.8.in
 DISTCLEANFILES += udatapath/ofdatapath.8
@@ -58,6 +69,16 @@ udatapath_libudatapath_a_SOURCES = \
 	udatapath/datapath.h \
 	udatapath/dp_act.c \
 	udatapath/dp_act.h \
+	udatapath/dp_buffers.c \
+	udatapath/dp_buffers.h \
+	udatapath/dp_limit.c \
+	udatapath/dp_limit.h \
+	udatapath/dp_misses.c \
+	udatapath/dp_misses.h \
+	udatapath/dp_rxring.c \
+	udatapath/dp_rxring.h \
+	udatapath/dp_sched.c \
+	udatapath/dp_sched.h \
 	udatapath/of_ext_msg.c \
 	udatapath/of_ext_msg.h \
 	udatapath/udatapath.c \
@@ -69,7 +90,7 @@ udatapath_libudatapath_a_SOURCES = \
 	udatapath/table-hash.c \
 	udatapath/table-linear.c
 
-udatapath_libudatapath_a_CPPFLAGS = $(AM_CPPFLAGS)
+udatapath_libudatapath_a_CPPFLAGS = $(AM_CPPFLAGS) -I $(top_srcdir)/secchan
 udatapath_libudatapath_a_CPPFLAGS += -DOF_HW_PLAT -DUDATAPATH_AS_LIB -g
 
 endif
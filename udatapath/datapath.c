@@ -41,6 +41,7 @@
 #include <unistd.h>
 #include "chain.h"
 #include "csum.h"
+#include "dynamic-string.h"
 #include "flow.h"
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
@@ -49,6 +50,7 @@
 #include "openflow/openflow-ext.h"
 #include "packets.h"
 #include "poll-loop.h"
+#include "queue.h"
 #include "rconn.h"
 #include "stp.h"
 #include "switch-flow.h"
@@ -58,6 +60,10 @@
 #include "private-msg.h"
 #include "of_ext_msg.h"
 #include "dp_act.h"
+#include "dp_buffers.h"
+#include "dp_misses.h"
+#include "dp_rxring.h"
+#include "dp_sched.h"
 
 #define THIS_MODULE VLM_datapath
 #include "vlog.h"
@@ -68,65 +74,9 @@
 #endif
 
 #if defined(OF_HW_PLAT) && !defined(USE_NETDEV)
-/* Queue to decouple receive packet thread from rconn control thread */
-/* Could make mutex per-DP */
-static pthread_mutex_t pkt_q_mutex = PTHREAD_MUTEX_INITIALIZER;
-#define PKT_Q_LOCK pthread_mutex_lock(&pkt_q_mutex)
-#define PKT_Q_UNLOCK pthread_mutex_unlock(&pkt_q_mutex)
-
-static void
-enqueue_pkt(struct datapath *dp, struct ofpbuf *buffer, of_port_t port_no,
-            int reason)
-{
-    struct hw_pkt_q_entry *q_entry;
-
-    if ((q_entry = xmalloc(sizeof(*q_entry))) == NULL) {
-        VLOG_WARN("Could not alloc q entry\n");
-        /* FIXME: Dealloc buffer */
-        return;
-    }
-    q_entry->buffer = buffer;
-    q_entry->next = NULL;
-    q_entry->port_no = port_no;
-    q_entry->reason = reason;
-    pthread_mutex_lock(&pkt_q_mutex);
-    if (dp->hw_pkt_list_head == NULL) {
-        dp->hw_pkt_list_head = q_entry;
-    } else {
-        dp->hw_pkt_list_tail->next = q_entry;
-    }
-    dp->hw_pkt_list_tail = q_entry;
-    pthread_mutex_unlock(&pkt_q_mutex);
-}
-
-/* If queue non-empty, fill out params and return 1; else return 0 */
-static int
-dequeue_pkt(struct datapath *dp, struct ofpbuf **buffer, of_port_t *port_no,
-            int *reason)
-{
-    struct hw_pkt_q_entry *q_entry;
-    int rv = 0;
-
-    pthread_mutex_lock(&pkt_q_mutex);
-    q_entry = dp->hw_pkt_list_head;
-    if (dp->hw_pkt_list_head != NULL) {
-        dp->hw_pkt_list_head = dp->hw_pkt_list_head->next;
-        if (dp->hw_pkt_list_head == NULL) {
-            dp->hw_pkt_list_tail = NULL;
-        }
-    }
-    pthread_mutex_unlock(&pkt_q_mutex);
-
-    if (q_entry != NULL) {
-        rv = 1;
-        *buffer = q_entry->buffer;
-        *port_no = q_entry->port_no;
-        *reason = q_entry->reason;
-        free(q_entry);
-    }
-
-    return rv;
-}
+/* Capacity of the ring that carries packets from the HW driver's receive
+ * thread to dp_run().  Packets that arrive while it is full are dropped. */
+#define HW_RXRING_SIZE 1024
 #endif
 
 extern char mfr_desc;
@@ -159,6 +109,10 @@ extern char serial_num;
 struct sender {
     struct remote *remote;      /* The device that sent the message. */
     uint32_t xid;               /* The OpenFlow transaction ID. */
+
+    /* If nonnull, '*msgp' is the buffer that holds the message.  A handler
+     * may take ownership of it by setting '*msgp' to NULL. */
+    struct ofpbuf **msgp;
 };
 
 /* A connection to a secure channel. */
@@ -176,6 +130,30 @@ struct remote {
     int (*cb_dump)(struct datapath *, void *aux);
     void (*cb_done)(void *aux);
     void *cb_aux;
+
+    /* Packet-in batching, as requested by the remote with an
+     * OFP_EXT_PACKET_IN_BATCH_CONFIG message.  Disabled if 'batch_max_packets'
+     * is 0. */
+    unsigned int batch_max_packets;
+    unsigned int batch_max_bytes;
+    unsigned int batch_max_delay; /* In milliseconds. */
+    struct ofpbuf *batch;       /* OFP_EXT_PACKET_IN_BATCH being filled. */
+    unsigned int batch_n_packets; /* Number of records in 'batch'. */
+    long long int batch_deadline; /* time_msec() at which to send 'batch'. */
+
+    /* Flow removed notifications.  A mass expiry or delete can remove far
+     * more flows at once than fit in the transmit queue, so notifications
+     * wait in 'flow_rem_txq' and at most 'flow_rem_budget' more of them are
+     * handed to 'rconn' in the current run of the datapath.  If the remote
+     * sent OFP_EXT_FLOW_REMOVED_BATCH_CONFIG, they are first collected into
+     * batches of up to 'flow_rem_batch_max' records. */
+#define FLOW_REM_BUDGET 32      /* Messages per remote per run. */
+#define FLOW_REM_BACKLOG 65536  /* Max messages waiting in 'flow_rem_txq'. */
+    struct ofp_queue flow_rem_txq;
+    int flow_rem_budget;
+    unsigned int flow_rem_batch_max; /* 0 if batching is disabled. */
+    struct ofpbuf *flow_rem_batch;   /* OFP_EXT_FLOW_REMOVED_BATCH. */
+    unsigned int flow_rem_batch_n;   /* Number of records in it. */
 };
 
 static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
@@ -184,39 +162,49 @@ static struct remote *remote_create(struct datapath *, struct rconn *);
 static void remote_run(struct datapath *, struct remote *);
 static void remote_wait(struct remote *);
 static void remote_destroy(struct remote *);
+static void remote_flush_batch(struct remote *);
+static void remote_flush_flow_rem_batch(struct datapath *, struct remote *);
+static void remote_send_flow_rems(struct datapath *, struct remote *,
+                                  bool force);
 
 static void update_port_flags(struct datapath *, const struct ofp_port_mod *);
 static void send_port_status(struct sw_port *p, uint8_t status);
 
-/* Buffers are identified by a 31-bit opaque ID.  We divide the ID
- * into a buffer number (low bits) and a cookie (high bits).  The buffer number
- * is an index into an array of buffers.  The cookie distinguishes between
- * different packets that have occupied a single buffer.  Thus, the more
- * buffers we have, the lower-quality the cookie... */
-#define PKT_BUFFER_BITS 8
-#define N_PKT_BUFFERS (1 << PKT_BUFFER_BITS)
-#define PKT_BUFFER_MASK (N_PKT_BUFFERS - 1)
-
-#define PKT_COOKIE_BITS (32 - PKT_BUFFER_BITS)
-
 int run_flow_through_tables(struct datapath *, struct ofpbuf *,
-                            struct sw_port *);
+                            struct sw_port *, struct sw_flow_key *);
 void fwd_port_input(struct datapath *, struct ofpbuf *, struct sw_port *);
+static void fwd_port_input_batch(struct datapath *, struct ofpbuf *[], size_t,
+                                 struct sw_port *);
 int fwd_control_input(struct datapath *, const struct sender *,
                       const void *, size_t);
 
-uint32_t save_buffer(struct ofpbuf *);
-static struct ofpbuf *retrieve_buffer(uint32_t id);
-static void discard_buffer(uint32_t id);
-
 struct sw_port *
 dp_lookup_port(struct datapath *dp, uint16_t port_no)
 {
-    return (port_no < DP_MAX_PORTS ? &dp->ports[port_no]
+    return (port_no < dp->n_port_slots ? dp->ports[port_no]
             : port_no == OFPP_LOCAL ? dp->local_port
             : NULL);
 }
 
+/* Makes room in 'dp''s port table for port number 'port_no', which must be
+ * less than DP_MAX_PORTS. */
+static void
+reserve_port_slot(struct datapath *dp, uint16_t port_no)
+{
+    if (port_no >= dp->n_port_slots) {
+        size_t n = MAX(dp->n_port_slots, 64);
+
+        while (n <= port_no) {
+            n *= 2;
+        }
+        n = MIN(n, DP_MAX_PORTS);
+        dp->ports = xrealloc(dp->ports, n * sizeof *dp->ports);
+        memset(&dp->ports[dp->n_port_slots], 0,
+               (n - dp->n_port_slots) * sizeof *dp->ports);
+        dp->n_port_slots = n;
+    }
+}
+
 struct sw_queue *
 dp_lookup_queue(struct sw_port *p, uint32_t queue_id)
 {
@@ -262,14 +250,14 @@ hw_packet_in(of_port_t port_no, of_packet_t *packet, int reason,
     const int hard_header = VLAN_ETH_HEADER_LEN;
     const int tail_room = sizeof(uint32_t);  /* For crc if needed later */
 
-    VLOG_INFO("dp rcv packet on port %d, size %d\n",
-              port_no, packet->length);
-    if ((port_no < 1) || port_no > DP_MAX_PORTS) {
+    VLOG_DBG("dp rcv packet on port %d, size %d\n",
+             port_no, packet->length);
+    if ((port_no < 1) || port_no >= DP_MAX_PORTS) {
         VLOG_ERR("Bad receive port %d\n", port_no);
         /* TODO increment error counter */
         return -1;
     }
-    port = &dp->ports[port_no];
+    port = dp_lookup_port(dp, port_no);
     if (!PORT_IN_USE(port)) {
         VLOG_WARN("Receive port not active: %d\n", port_no);
         return -1;
@@ -293,8 +281,7 @@ hw_packet_in(of_port_t port_no, of_packet_t *packet, int reason,
         buffer->data = (char*)buffer->data + headroom;
         buffer->size = packet->length;
         memcpy(buffer->data, packet->data, packet->length);
-        enqueue_pkt(dp, buffer, port_no, reason);
-        poll_immediate_wake();
+        dp_rxring_enqueue(dp->hw_rxring, buffer, port_no, reason);
     }
 
     return 0;
@@ -305,8 +292,9 @@ hw_packet_in(of_port_t port_no, of_packet_t *packet, int reason,
 static int
 dp_hw_drv_init(struct datapath *dp)
 {
-    dp->hw_pkt_list_head = NULL;
-    dp->hw_pkt_list_tail = NULL;
+#if !defined(USE_NETDEV)
+    dp->hw_rxring = dp_rxring_create(HW_RXRING_SIZE);
+#endif
 
     dp->hw_drv = new_of_hw_driver(dp);
     if (dp->hw_drv == NULL) {
@@ -314,6 +302,9 @@ dp_hw_drv_init(struct datapath *dp)
         return -1;
     }
 #if !defined(USE_NETDEV)
+    /* hw_packet_in() looks up ports from the driver's own thread, without
+     * any lock, so the port table must never move: make it full size now. */
+    reserve_port_slot(dp, DP_MAX_PORTS - 1);
     if (dp->hw_drv->packet_receive_register(dp->hw_drv,
                                             hw_packet_in, dp) < 0) {
         VLOG_ERR("Could not register with HW driver to receive pkts");
@@ -410,7 +401,7 @@ new_port(struct datapath *dp, struct sw_port *port, uint16_t port_no,
                  netdev_name, in6_name);
     }
 
-    if (num_queues > 0) {
+    if (num_queues > 0 && !dp->user_slicing) {
         error = netdev_setup_slicing(netdev, num_queues);
         if (error) {
             VLOG_ERR("failed to configure slicing on %s device: "\
@@ -430,6 +421,11 @@ new_port(struct datapath *dp, struct sw_port *port, uint16_t port_no,
     port->netdev = netdev;
     port->port_no = port_no;
     port->num_queues = num_queues;
+    if (num_queues > 0 && dp->user_slicing) {
+        port->sched = dp_sched_create(port, (dp->slicing_rate
+                                             ? dp->slicing_rate
+                                             : netdev_get_speed(netdev)));
+    }
     list_push_back(&dp->port_list, &port->node);
 
     /* Notify the ctlpath that this port has been added */
@@ -449,15 +445,21 @@ dp_add_port(struct datapath *dp, const char *port_name, uint16_t num_queues)
     fprintf(stderr, "Adding port %s. hw_drv is %p\n", port_name, dp->hw_drv);
     if (dp->hw_drv && dp->hw_drv->port_add) {
         port_no = dp->hw_drv->port_add(dp->hw_drv, -1, port_name);
-        if (port_no >= 0) {
-            port = &dp->ports[port_no];
-            if (port->flags & SWP_USED) {
+        if (port_no >= DP_MAX_PORTS) {
+            VLOG_ERR("HW port %s has out-of-range number %d\n",
+                     port_name, port_no);
+            rc = -1;
+        } else if (port_no >= 0) {
+            port = dp_lookup_port(dp, port_no);
+            if (port) {
                 VLOG_ERR("HW port %s (%d) already created\n",
                           port_name, port_no);
                 rc = -1;
             } else {
                 fprintf(stderr, "Adding HW port %s as OF port number %d\n",
                        port_name, port_no);
+                reserve_port_slot(dp, port_no);
+                port = dp->ports[port_no] = xcalloc(1, sizeof *port);
                 /* FIXME: Determine and record HW addr, etc */
                 port->flags |= SWP_USED | SWP_HW_DRV_PORT;
                 port->dp = dp;
@@ -483,14 +485,28 @@ dp_add_port(struct datapath *dp, const char *port_name, uint16_t num_queues)
 int
 dp_add_port(struct datapath *dp, const char *netdev, uint16_t num_queues)
 {
+    struct sw_port *port;
     int port_no;
-    for (port_no = 1; port_no < DP_MAX_PORTS; port_no++) {
-        struct sw_port *port = &dp->ports[port_no];
-        if (!port->netdev) {
-            return new_port(dp, port, port_no, netdev, NULL, num_queues);
+    int error;
+
+    for (port_no = 1; port_no < dp->n_port_slots; port_no++) {
+        if (!dp->ports[port_no]) {
+            break;
         }
     }
-    return EXFULL;
+    if (port_no >= DP_MAX_PORTS) {
+        return EXFULL;
+    }
+
+    port = xmalloc(sizeof *port);
+    error = new_port(dp, port, port_no, netdev, NULL, num_queues);
+    if (!error) {
+        reserve_port_slot(dp, port_no);
+        dp->ports[port_no] = port;
+    } else {
+        free(port);
+    }
+    return error;
 }
 #endif /* OF_HW_PLAT */
 
@@ -524,6 +540,17 @@ dp_add_pvconn(struct datapath *dp, struct pvconn *pvconn)
     dp->listeners[dp->n_listeners++] = pvconn;
 }
 
+/* Maximum number of packets that dp_run() receives from one queue of a port
+ * before moving on to the next queue. */
+#define RXQ_BATCH 16
+
+#if defined(OF_HW_PLAT) && !defined(USE_NETDEV)
+/* Maximum number of RXQ_BATCH-sized batches that dp_run() takes from the
+ * HW receive ring per call, so that a flood from the HW driver cannot starve
+ * the software ports and the controller connection. */
+#define HW_RX_MAX_BATCHES 16
+#endif
+
 void
 dp_run(struct datapath *dp)
 {
@@ -533,6 +560,10 @@ dp_run(struct datapath *dp)
     struct ofpbuf *buffer = NULL;
     size_t i;
 
+    LIST_FOR_EACH (r, struct remote, node, &dp->remotes) {
+        r->flow_rem_budget = FLOW_REM_BUDGET;
+    }
+
     if (now != dp->last_timeout) {
         struct list deleted = LIST_INITIALIZER(&deleted);
         struct sw_flow *f, *n;
@@ -546,53 +577,109 @@ dp_run(struct datapath *dp)
         dp->last_timeout = now;
     }
     poll_timer_wait(1000);
+    dp_misses_run(dp->misses);
 
 #if defined(OF_HW_PLAT) && !defined(USE_NETDEV)
     { /* Process packets received from callback thread */
-        struct ofpbuf *buffer;
-        of_port_t port_no;
-        int reason;
-        struct sw_port *p;
+        struct dp_rxring_entry entries[RXQ_BATCH];
+        int n_batches;
+
+        for (n_batches = 0; n_batches < HW_RX_MAX_BATCHES; n_batches++) {
+            size_t n = dp_rxring_dequeue(dp->hw_rxring, entries, RXQ_BATCH);
+            size_t i, j;
+
+            /* Hand each run of packets from the same port to the batch
+             * path together. */
+            for (i = 0; i < n; i = j) {
+                struct ofpbuf *batch[RXQ_BATCH];
+                struct sw_port *p;
+
+                p = dp_lookup_port(dp, entries[i].port_no);
+                for (j = i; j < n && entries[j].port_no == entries[i].port_no;
+                     j++) {
+                    batch[j - i] = entries[j].buffer;
+                }
+                if (!p) {
+                    size_t k;
 
-        while (dequeue_pkt(dp, &buffer, &port_no, &reason)) {
-            p = dp_lookup_port(dp, port_no);
-            /* FIXME:  We're throwing away the reason that came from HW */
-            fwd_port_input(dp, buffer, p);
+                    for (k = 0; k < j - i; k++) {
+                        ofpbuf_delete(batch[k]);
+                    }
+                    continue;
+                }
+                /* FIXME:  We're throwing away the reason that came from HW */
+                fwd_port_input_batch(dp, batch, j - i, p);
+            }
+            if (n < RXQ_BATCH) {
+                break;
+            }
         }
     }
 #endif
 
     LIST_FOR_EACH_SAFE (p, pn, struct sw_port, node, &dp->port_list) {
-        int error;
+        int n_rxq, rxq;
+        size_t room;
 
         if (IS_HW_PORT(p)) {
             continue;
         }
-        if (!buffer) {
-            /* Allocate buffer with some headroom to add headers in forwarding
-             * to the controller or adding a vlan tag, plus an extra 2 bytes to
-             * allow IP headers to be aligned on a 4-byte boundary.  */
-            const int headroom = 128 + 2;
-            const int hard_header = VLAN_ETH_HEADER_LEN;
-            const int mtu = netdev_get_mtu(p->netdev);
-            buffer = ofpbuf_new(headroom + hard_header + mtu);
-            buffer->data = (char*)buffer->data + headroom;
-        }
-        error = netdev_recv(p->netdev, buffer);
-        if (!error) {
-            p->rx_packets++;
-            p->rx_bytes += buffer->size;
-            fwd_port_input(dp, buffer, p);
+
+        /* Service each receive queue separately, taking a batch of packets
+         * from each in turn so that a busy queue cannot starve the others.
+         * In GSO mode, netdev_rxq_recv() grows the buffer for the occasional
+         * super-packet, so an MTU-sized buffer suffices here too. */
+        room = VLAN_ETH_HEADER_LEN + netdev_get_mtu(p->netdev);
+        if (buffer && ofpbuf_tailroom(buffer) < room) {
+            ofpbuf_delete(buffer);
             buffer = NULL;
-        } else if (error != EAGAIN) {
-            VLOG_ERR_RL(&rl, "error receiving data from %s: %s",
-                        netdev_get_name(p->netdev), strerror(error));
+        }
+
+        n_rxq = netdev_get_n_rxq(p->netdev);
+        for (rxq = 0; rxq < n_rxq; rxq++) {
+            struct ofpbuf *batch[RXQ_BATCH];
+            size_t n_batch = 0;
+            int n;
+
+            for (n = 0; n < RXQ_BATCH; n++) {
+                int error;
+
+                if (!buffer) {
+                    /* Allocate buffer with some headroom to add headers in
+                     * forwarding to the controller or adding a vlan tag, plus
+                     * an extra 2 bytes to allow IP headers to be aligned on a
+                     * 4-byte boundary.  */
+                    const int headroom = 128 + 2;
+                    buffer = ofpbuf_new(headroom + room);
+                    buffer->data = (char*)buffer->data + headroom;
+                }
+                error = netdev_rxq_recv(p->netdev, rxq, buffer);
+                if (!error) {
+                    uint64_t n_bytes;
+
+                    p->rx_packets += netdev_packet_segs(buffer, &n_bytes);
+                    p->rx_bytes += n_bytes;
+                    batch[n_batch++] = buffer;
+                    buffer = NULL;
+                } else {
+                    if (error != EAGAIN) {
+                        VLOG_ERR_RL(&rl, "error receiving data from %s: %s",
+                                    netdev_get_name(p->netdev),
+                                    strerror(error));
+                    }
+                    break;
+                }
+            }
+            fwd_port_input_batch(dp, batch, n_batch, p);
         }
     }
     ofpbuf_delete(buffer);
 
     /* Talk to remotes. */
     LIST_FOR_EACH_SAFE (r, rn, struct remote, node, &dp->remotes) {
+        if (r->batch && time_msec() >= r->batch_deadline) {
+            remote_flush_batch(r);
+        }
         remote_run(dp, r);
     }
 
@@ -609,6 +696,13 @@ dp_run(struct datapath *dp)
         }
         i++;
     }
+
+    /* Transmit packets queued by the userspace scheduler. */
+    LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list) {
+        if (p->sched) {
+            dp_sched_run(p->sched);
+        }
+    }
 }
 
 static void
@@ -636,6 +730,7 @@ remote_run(struct datapath *dp, struct remote *r)
                 oh = (struct ofp_header *)buffer->data;
                 sender.remote = r;
                 sender.xid = oh->xid;
+                sender.msgp = &buffer;
                 fwd_control_input(dp, &sender, buffer->data, buffer->size);
             } else {
                 VLOG_WARN_RL(&rl, "received too-short OpenFlow message");
@@ -658,6 +753,11 @@ remote_run(struct datapath *dp, struct remote *r)
         }
     }
 
+    if (r->flow_rem_batch) {
+        remote_flush_flow_rem_batch(dp, r);
+    }
+    remote_send_flow_rems(dp, r, false);
+
     if (!rconn_is_alive(r->rconn)) {
         remote_destroy(r);
     }
@@ -668,6 +768,13 @@ remote_wait(struct remote *r)
 {
     rconn_run_wait(r->rconn);
     rconn_recv_wait(r->rconn);
+    if (r->batch) {
+        poll_timer_wait(MAX(r->batch_deadline - time_msec(), 0));
+    }
+    if (r->flow_rem_batch
+        || (r->flow_rem_txq.n && r->n_txq < TXQ_LIMIT / 2)) {
+        poll_immediate_wake();
+    }
 }
 
 static void
@@ -677,6 +784,9 @@ remote_destroy(struct remote *r)
         if (r->cb_dump && r->cb_done) {
             r->cb_done(r->cb_aux);
         }
+        ofpbuf_delete(r->batch);
+        ofpbuf_delete(r->flow_rem_batch);
+        queue_destroy(&r->flow_rem_txq);
         list_remove(&r->node);
         rconn_destroy(r->rconn);
         free(r);
@@ -691,6 +801,12 @@ remote_create(struct datapath *dp, struct rconn *rconn)
     remote->rconn = rconn;
     remote->cb_dump = NULL;
     remote->n_txq = 0;
+    remote->batch_max_packets = 0;
+    remote->batch = NULL;
+    queue_init(&remote->flow_rem_txq);
+    remote->flow_rem_budget = FLOW_REM_BUDGET;
+    remote->flow_rem_batch_max = 0;
+    remote->flow_rem_batch = NULL;
     return remote;
 }
 
@@ -732,6 +848,9 @@ dp_wait(struct datapath *dp)
             continue;
         }
         netdev_recv_wait(p->netdev);
+        if (p->sched) {
+            dp_sched_wait(p->sched);
+        }
     }
     LIST_FOR_EACH (r, struct remote, node, &dp->remotes) {
         remote_wait(r);
@@ -739,6 +858,10 @@ dp_wait(struct datapath *dp)
     for (i = 0; i < dp->n_listeners; i++) {
         pvconn_wait(dp->listeners[i]);
     }
+    dp_misses_wait(dp->misses);
+#if defined(OF_HW_PLAT) && !defined(USE_NETDEV)
+    dp_rxring_wait(dp->hw_rxring);
+#endif
 }
 
 /* Send packets out all the ports except the originating one.  If the
@@ -825,12 +948,20 @@ output_packet(struct datapath *dp, struct ofpbuf *buffer, uint16_t out_port,
                 }
             }
 
+            if (p->sched) {
+                dp_sched_enqueue(p->sched, buffer, class_id);
+                return;
+            }
+
             if (!netdev_send(p->netdev, buffer, class_id)) {
-                p->tx_packets++;
-                p->tx_bytes += buffer->size;
+                uint64_t n_bytes;
+                unsigned int n_packets = netdev_packet_segs(buffer, &n_bytes);
+
+                p->tx_packets += n_packets;
+                p->tx_bytes += n_bytes;
                 if (q) {
-                    q->tx_packets++;
-                    q->tx_bytes += buffer->size;
+                    q->tx_packets += n_packets;
+                    q->tx_bytes += n_bytes;
                 }
             } else {
                 p->tx_dropped++;
@@ -862,7 +993,8 @@ dp_output_port(struct datapath *dp, struct ofpbuf *buffer,
 
     case OFPP_TABLE: {
         struct sw_port *p = dp_lookup_port(dp, in_port);
-        if (run_flow_through_tables(dp, buffer, p)) {
+        struct sw_flow_key key;
+        if (run_flow_through_tables(dp, buffer, p, &key)) {
             ofpbuf_delete(buffer);
         }
         break;
@@ -877,7 +1009,11 @@ dp_output_port(struct datapath *dp, struct ofpbuf *buffer,
         break;
 
     case OFPP_CONTROLLER:
-        dp_output_control(dp, buffer, in_port, UINT16_MAX, OFPR_ACTION);
+        if (dp_admit_packet_in(dp, in_port)) {
+            dp_output_control(dp, buffer, in_port, UINT16_MAX, OFPR_ACTION);
+        } else {
+            ofpbuf_delete(buffer);
+        }
         break;
 
     case OFPP_LOCAL:
@@ -937,36 +1073,241 @@ send_openflow_buffer(struct datapath *dp, struct ofpbuf *buffer,
     }
 }
 
-/* Takes ownership of 'buffer' and transmits it to 'dp''s controller.  If the
- * packet can be saved in a buffer, then only the first max_len bytes of
- * 'buffer' are sent; otherwise, all of 'buffer' is sent.  'reason' indicates
- * why 'buffer' is being sent. 'max_len' sets the maximum number of bytes that
- * the caller wants to be sent. */
+/* Sends the packet-in batch that 'r' has been collecting. */
+static void
+remote_flush_batch(struct remote *r)
+{
+    struct ofpbuf *batch = r->batch;
+
+    r->batch = NULL;
+    r->batch_n_packets = 0;
+    update_openflow_length(batch);
+    send_openflow_buffer_to_remote(batch, r);
+}
+
+/* Returns true if 'r' takes packet-ins in batches and one with 'len' bytes of
+ * packet data fits in a batch. */
+static bool
+remote_batches_packet_in(const struct remote *r, size_t len)
+{
+    return (r->batch_max_packets
+            && (sizeof(struct ofp_extension_header)
+                + ROUND_UP(sizeof(struct openflow_packet_in_record) + len, 8)
+                <= r->batch_max_bytes));
+}
+
+/* Adds a packet-in record to the batch for 'r', which must satisfy
+ * remote_batches_packet_in() for 'len', and sends the batch if it is full. */
+static void
+remote_batch_packet_in(struct remote *r, uint32_t buffer_id,
+                       size_t total_len, int in_port, int reason,
+                       const void *data, size_t len)
+{
+    size_t rec_len = ROUND_UP(sizeof(struct openflow_packet_in_record) + len,
+                              8);
+    struct openflow_packet_in_record *rec;
+
+    if (r->batch && r->batch->size + rec_len > r->batch_max_bytes) {
+        remote_flush_batch(r);
+    }
+    if (!r->batch) {
+        struct ofp_extension_header *oeh;
+
+        oeh = make_openflow(sizeof *oeh, OFPT_VENDOR, &r->batch);
+        oeh->vendor = htonl(OPENFLOW_VENDOR_ID);
+        oeh->subtype = htonl(OFP_EXT_PACKET_IN_BATCH);
+        ofpbuf_prealloc_tailroom(r->batch, MIN(r->batch_max_bytes,
+                                               16384) - sizeof *oeh);
+        r->batch_deadline = time_msec() + r->batch_max_delay;
+    }
+
+    rec = ofpbuf_put_uninit(r->batch, rec_len);
+    rec->len = htons(rec_len);
+    rec->data_len = htons(len);
+    rec->buffer_id = htonl(buffer_id);
+    rec->total_len = htons(total_len);
+    rec->in_port = htons(in_port);
+    rec->reason = reason;
+    memset(rec->pad, 0, sizeof rec->pad);
+    memcpy(rec->data, data, len);
+    memset(rec->data + len, 0, rec_len - sizeof *rec - len);
+
+    if (++r->batch_n_packets >= r->batch_max_packets
+        || r->batch->size + sizeof *rec > r->batch_max_bytes) {
+        remote_flush_batch(r);
+    }
+}
+
+/* Configures packet-in batching for the remote that sent a request, as
+ * described for struct openflow_packet_in_batch_config. */
 void
-dp_output_control(struct datapath *dp, struct ofpbuf *buffer, int in_port,
-                  size_t max_len, int reason)
+dp_set_packet_in_batching(struct datapath *dp UNUSED,
+                          const struct sender *sender,
+                          unsigned int max_packets, unsigned int max_bytes,
+                          unsigned int max_delay)
+{
+    struct remote *r = sender->remote;
+
+    if (r->batch) {
+        remote_flush_batch(r);
+    }
+    r->batch_max_packets = max_packets;
+    r->batch_max_bytes = (max_bytes && max_bytes < UINT16_MAX
+                          ? max_bytes : UINT16_MAX);
+    r->batch_max_delay = max_delay;
+}
+
+/* Sends 'packet' to 'dp''s remotes as a packet-in with the given
+ * 'buffer_id', 'in_port' and 'reason'.  If 'buffer_id' is UINT32_MAX, takes
+ * ownership of 'packet' and sends all of it; otherwise, copies at most
+ * 'max_len' bytes of it and leaves it with the caller.  Remotes that asked
+ * for packet-in batching get a record added to their batch, the others an
+ * OFPT_PACKET_IN message. */
+static void
+send_packet_in(struct datapath *dp, struct ofpbuf *packet, uint32_t buffer_id,
+               size_t max_len, int in_port, int reason)
 {
     struct ofp_packet_in *opi;
-    size_t total_len;
-    uint32_t buffer_id;
+    struct remote *r, *prev;
+    struct ofpbuf *msg;
+    size_t total_len, len;
+
+    total_len = packet->size;
+    len = buffer_id != UINT32_MAX ? MIN(packet->size, max_len) : packet->size;
+
+    prev = NULL;
+    LIST_FOR_EACH (r, struct remote, node, &dp->remotes) {
+        if (remote_batches_packet_in(r, len)) {
+            remote_batch_packet_in(r, buffer_id, total_len, in_port, reason,
+                                   packet->data, len);
+        } else {
+            prev = r;
+        }
+    }
+    if (!prev) {
+        if (buffer_id == UINT32_MAX) {
+            ofpbuf_delete(packet);
+        }
+        return;
+    }
 
-    buffer_id = save_buffer(buffer);
-    total_len = buffer->size;
-    if (buffer_id != UINT32_MAX && buffer->size > max_len) {
-        buffer->size = max_len;
+    if (buffer_id != UINT32_MAX) {
+        /* The caller keeps 'packet', so copy the part of it that goes to the
+         * controller. */
+        msg = ofpbuf_new(offsetof(struct ofp_packet_in, data) + len);
+        opi = ofpbuf_put_uninit(msg, offsetof(struct ofp_packet_in, data));
+        ofpbuf_put(msg, packet->data, len);
+    } else {
+        msg = packet;
+        opi = ofpbuf_push_uninit(msg, offsetof(struct ofp_packet_in, data));
     }
 
-    opi = ofpbuf_push_uninit(buffer, offsetof(struct ofp_packet_in, data));
     opi->header.version = OFP_VERSION;
     opi->header.type    = OFPT_PACKET_IN;
-    opi->header.length  = htons(buffer->size);
+    opi->header.length  = htons(msg->size);
     opi->header.xid     = htonl(0);
     opi->buffer_id      = htonl(buffer_id);
     opi->total_len      = htons(total_len);
     opi->in_port        = htons(in_port);
     opi->reason         = reason;
     opi->pad            = 0;
-    send_openflow_buffer(dp, buffer, NULL);
+
+    /* Send to the remotes that did not take a record, cloning for all but
+     * the last one, 'prev'. */
+    LIST_FOR_EACH (r, struct remote, node, &dp->remotes) {
+        if (r != prev && !remote_batches_packet_in(r, len)) {
+            send_openflow_buffer_to_remote(ofpbuf_clone(msg), r);
+        }
+    }
+    send_openflow_buffer_to_remote(msg, prev);
+}
+
+/* How output_control() sends the segments of an offloaded packet. */
+struct packet_in_segment_aux {
+    struct datapath *dp;
+    uint32_t buffer_id;
+    size_t max_len;
+    int in_port;
+    int reason;
+};
+
+/* netdev_segment() callback for output_control().  A buffered packet is
+ * represented to the controller by its first segment, an unbuffered one by
+ * a packet-in for each of its segments. */
+static bool
+packet_in_segment(struct ofpbuf *seg, void *aux_)
+{
+    struct packet_in_segment_aux *aux = aux_;
+    struct ofpbuf *copy;
+
+    if (aux->buffer_id != UINT32_MAX) {
+        send_packet_in(aux->dp, seg, aux->buffer_id, aux->max_len,
+                       aux->in_port, aux->reason);
+        return false;
+    }
+
+    /* Leave room for send_packet_in() to push the packet-in header. */
+    copy = ofpbuf_new(offsetof(struct ofp_packet_in, data) + seg->size);
+    ofpbuf_reserve(copy, offsetof(struct ofp_packet_in, data));
+    ofpbuf_put(copy, seg->data, seg->size);
+    send_packet_in(aux->dp, copy, UINT32_MAX, aux->max_len,
+                   aux->in_port, aux->reason);
+    return true;
+}
+
+/* Takes ownership of 'buffer' and transmits it to 'dp''s controller.  If the
+ * packet can be saved in a buffer, then only the first max_len bytes of
+ * 'buffer' are sent; otherwise, all of 'buffer' is sent.  'reason' indicates
+ * why 'buffer' is being sent. 'max_len' sets the maximum number of bytes that
+ * the caller wants to be sent.  If 'key' is nonnull, it is the flow key of
+ * 'buffer', which is kept with the saved packet.
+ *
+ * A packet that carries offload state, such as a super-packet received in GSO
+ * mode, is saved whole, but the controller sees the packets it represents on
+ * the wire, with their checksums completed, so that no packet-in can exceed
+ * the 16-bit OpenFlow length fields. */
+static void
+output_control(struct datapath *dp, struct ofpbuf *buffer, int in_port,
+               size_t max_len, int reason, const struct sw_flow_key *key)
+{
+    uint32_t buffer_id = dp_buffers_save(dp->buffers, buffer, key);
+
+    if (buffer->gso_size || buffer->csum_partial) {
+        struct packet_in_segment_aux aux = { dp, buffer_id, max_len,
+                                             in_port, reason };
+
+        netdev_segment(buffer, packet_in_segment, &aux);
+        if (buffer_id == UINT32_MAX) {
+            ofpbuf_delete(buffer);
+        }
+    } else {
+        send_packet_in(dp, buffer, buffer_id, max_len, in_port, reason);
+    }
+}
+
+/* Returns true if 'dp''s packet-in rate limits allow a packet received on
+ * 'in_port' to be sent to the controller, false if the packet should be
+ * dropped.  Callers check this before dp_output_control(), and before copying
+ * the packet if they can, so that a packet over the limit costs nothing. */
+bool
+dp_admit_packet_in(struct datapath *dp, int in_port)
+{
+    struct sw_port *p = dp_lookup_port(dp, in_port);
+
+    return dp_limit_admit(dp->pin_limit, p ? &p->pin_limit : NULL);
+}
+
+/* Takes ownership of 'buffer' and transmits it to 'dp''s controller.  If the
+ * packet can be saved in a buffer, then only the first max_len bytes of
+ * 'buffer' are sent; otherwise, all of 'buffer' is sent.  'reason' indicates
+ * why 'buffer' is being sent. 'max_len' sets the maximum number of bytes that
+ * the caller wants to be sent.  The caller must already have checked
+ * dp_admit_packet_in(). */
+void
+dp_output_control(struct datapath *dp, struct ofpbuf *buffer, int in_port,
+                  size_t max_len, int reason)
+{
+    output_control(dp, buffer, in_port, max_len, reason, NULL);
 }
 
 static void
@@ -1042,11 +1383,21 @@ dp_send_features_reply(struct datapath *dp, const struct sender *sender)
                                sender, &buffer);
     ofr->datapath_id  = htonll(dp->id);
     ofr->n_tables     = dp->chain->n_tables;
-    ofr->n_buffers    = htonl(N_PKT_BUFFERS);
+    ofr->n_buffers    = htonl(dp_buffers_n_slots(dp->buffers));
     ofr->capabilities = htonl(OFP_SUPPORTED_CAPABILITIES);
     ofr->actions      = htonl(OFP_SUPPORTED_ACTIONS);
     LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list) {
-        struct ofp_phy_port *opp = ofpbuf_put_uninit(buffer, sizeof *opp);
+        struct ofp_phy_port *opp;
+
+        if (buffer->size + sizeof *opp > UINT16_MAX) {
+            /* OpenFlow 1.0 has no way to describe more ports in the features
+             * reply; the controller learns about them from port status
+             * messages and port stats instead. */
+            VLOG_WARN_RL(&rl, "features reply only lists the first %zu ports",
+                         (buffer->size - sizeof *ofr) / sizeof *opp);
+            break;
+        }
+        opp = ofpbuf_put_uninit(buffer, sizeof *opp);
         memset(opp, 0, sizeof *opp);
         fill_port_desc(p, opp);
     }
@@ -1085,14 +1436,124 @@ send_port_status(struct sw_port *p, uint8_t status)
     send_openflow_buffer(p->dp, buffer, NULL);
 }
 
+/* Returns the number of flows reported by 'msg', a flow removed message or
+ * batch. */
+static unsigned int
+flow_rem_n_flows(const struct ofpbuf *msg)
+{
+    const struct ofp_header *oh = msg->data;
+
+    return (oh->type == OFPT_FLOW_REMOVED ? 1
+            : ((msg->size - sizeof(struct ofp_extension_header))
+               / sizeof(struct openflow_flow_removed_record)));
+}
+
+/* Hands flow removed messages waiting for 'r' to its rconn, within the budget
+ * for the current run and leaving room in the transmit queue for other
+ * traffic, or all of them if 'force' is true. */
+static void
+remote_send_flow_rems(struct datapath *dp, struct remote *r, bool force)
+{
+    while (r->flow_rem_txq.n
+           && (force
+               || (r->flow_rem_budget > 0 && r->n_txq < TXQ_LIMIT / 2))) {
+        struct ofpbuf *msg = queue_pop_head(&r->flow_rem_txq);
+        unsigned int n_flows = flow_rem_n_flows(msg);
+        bool batch = ((struct ofp_header *) msg->data)->type == OFPT_VENDOR;
+        int error = rconn_send(r->rconn, msg, &r->n_txq);
+        if (error) {
+            VLOG_WARN_RL(&rl, "send to %s failed: %s",
+                         rconn_get_name(r->rconn), strerror(error));
+            ofpbuf_delete(msg);
+            dp->flow_rem_dropped += n_flows;
+        } else if (batch) {
+            dp->flow_rem_batched += n_flows;
+            dp->flow_rem_batches++;
+        } else {
+            dp->flow_rem_sent++;
+        }
+        r->flow_rem_budget--;
+    }
+}
+
+/* Queues 'msg', a flow removed message or batch, for transmission to 'r'. */
+static void
+remote_queue_flow_rem(struct datapath *dp, struct remote *r,
+                      struct ofpbuf *msg)
+{
+    update_openflow_length(msg);
+    if (r->flow_rem_txq.n >= FLOW_REM_BACKLOG) {
+        VLOG_WARN_RL(&rl, "dropping flow removed message to %s: %d messages "
+                     "already waiting", rconn_get_name(r->rconn),
+                     r->flow_rem_txq.n);
+        dp->flow_rem_dropped += flow_rem_n_flows(msg);
+        ofpbuf_delete(msg);
+        return;
+    }
+    queue_push_tail(&r->flow_rem_txq, msg);
+    remote_send_flow_rems(dp, r, false);
+    if (r->flow_rem_txq.n) {
+        /* FIFO order, so 'msg' itself is still waiting. */
+        dp->flow_rem_paced += flow_rem_n_flows(msg);
+    }
+}
+
+/* Queues the flow removed batch that 'r' has been collecting. */
+static void
+remote_flush_flow_rem_batch(struct datapath *dp, struct remote *r)
+{
+    struct ofpbuf *batch = r->flow_rem_batch;
+
+    r->flow_rem_batch = NULL;
+    r->flow_rem_batch_n = 0;
+    remote_queue_flow_rem(dp, r, batch);
+}
+
+/* Adds 'record' to the flow removed batch for 'r', queuing the batch if it is
+ * full. */
+static void
+remote_batch_flow_rem(struct datapath *dp, struct remote *r,
+                      const struct openflow_flow_removed_record *record)
+{
+    if (!r->flow_rem_batch) {
+        struct ofp_extension_header *oeh;
+
+        oeh = make_openflow(sizeof *oeh, OFPT_VENDOR, &r->flow_rem_batch);
+        oeh->vendor = htonl(OPENFLOW_VENDOR_ID);
+        oeh->subtype = htonl(OFP_EXT_FLOW_REMOVED_BATCH);
+        ofpbuf_prealloc_tailroom(r->flow_rem_batch,
+                                 r->flow_rem_batch_max * sizeof *record);
+    }
+    ofpbuf_put(r->flow_rem_batch, record, sizeof *record);
+    if (++r->flow_rem_batch_n >= r->flow_rem_batch_max) {
+        remote_flush_flow_rem_batch(dp, r);
+    }
+}
+
+/* Configures flow removed batching for the remote that sent a request, as
+ * described for struct openflow_flow_removed_batch_config. */
+void
+dp_set_flow_removed_batching(struct datapath *dp, const struct sender *sender,
+                             unsigned int max_flows)
+{
+    struct remote *r = sender->remote;
+    unsigned int limit = ((UINT16_MAX - sizeof(struct ofp_extension_header))
+                          / sizeof(struct openflow_flow_removed_record));
+
+    if (r->flow_rem_batch) {
+        remote_flush_flow_rem_batch(dp, r);
+    }
+    r->flow_rem_batch_max = MIN(max_flows, limit);
+}
+
 void
 dp_send_flow_end(struct datapath *dp, struct sw_flow *flow,
               enum ofp_flow_removed_reason reason)
 {
-    struct ofpbuf *buffer;
-    struct ofp_flow_removed *ofr;
+    struct openflow_flow_removed_record rec;
     uint64_t tdiff = time_msec() - flow->created;
     uint32_t sec = tdiff / 1000;
+    struct remote *r;
 
     if (!flow->send_flow_rem) {
         return;
@@ -1102,25 +1563,35 @@ dp_send_flow_end(struct datapath *dp, struct sw_flow *flow,
         return;
     }
 
-    ofr = make_openflow_xid(sizeof *ofr, OFPT_FLOW_REMOVED, 0, &buffer);
-    if (!ofr) {
-        return;
-    }
+    flow_fill_match(&rec.match, &flow->key.flow, flow->key.wildcards);
 
-    flow_fill_match(&ofr->match, &flow->key.flow, flow->key.wildcards);
+    rec.cookie = htonll(flow->cookie);
+    rec.priority = htons(flow->priority);
+    rec.reason = reason;
+    rec.pad[0] = 0;
 
-    ofr->cookie = htonll(flow->cookie);
-    ofr->priority = htons(flow->priority);
-    ofr->reason = reason;
+    rec.duration_sec = htonl(sec);
+    rec.duration_nsec = htonl((tdiff - (sec * 1000)) * 1000000);
+    rec.idle_timeout = htons(flow->idle_timeout);
+    memset(rec.pad2, 0, sizeof rec.pad2);
 
-    ofr->duration_sec = htonl(sec);
-    ofr->duration_nsec = htonl((tdiff - (sec * 1000)) * 1000000);
-    ofr->idle_timeout = htons(flow->idle_timeout);
+    rec.packet_count = htonll(flow->packet_count);
+    rec.byte_count   = htonll(flow->byte_count);
 
-    ofr->packet_count = htonll(flow->packet_count);
-    ofr->byte_count   = htonll(flow->byte_count);
+    LIST_FOR_EACH (r, struct remote, node, &dp->remotes) {
+        if (r->flow_rem_batch_max) {
+            remote_batch_flow_rem(dp, r, &rec);
+        } else {
+            struct ofp_flow_removed *ofr;
+            struct ofpbuf *buffer;
 
-    send_openflow_buffer(dp, buffer, NULL);
+            ofr = make_openflow_xid(sizeof *ofr, OFPT_FLOW_REMOVED, 0,
+                                    &buffer);
+            /* The record is the body of the message. */
+            memcpy(&ofr->match, &rec, sizeof rec);
+            remote_queue_flow_rem(dp, r, buffer);
+        }
+    }
 }
 
 void
@@ -1136,6 +1607,15 @@ dp_send_error_msg(struct datapath *dp, const struct sender *sender,
     send_openflow_buffer(dp, buffer, sender);
 }
 
+/* Takes ownership of 'buffer', a complete OpenFlow message, and sends it to
+ * 'sender', or to all of 'dp''s remotes if 'sender' is null. */
+int
+dp_send_openflow(struct datapath *dp, struct ofpbuf *buffer,
+                 const struct sender *sender)
+{
+    return send_openflow_buffer(dp, buffer, sender);
+}
+
 static void
 fill_flow_stats(struct ofpbuf *buffer, struct sw_flow *flow,
                 int table_idx, uint64_t now)
@@ -1174,35 +1654,36 @@ fill_flow_stats(struct ofpbuf *buffer, struct sw_flow *flow,
 }
 
 
-/* 'buffer' was received on 'p', which may be a a physical switch port or a
- * null pointer.  Process it according to 'dp''s flow table.  Returns 0 if
- * successful, in which case 'buffer' is destroyed, or -ESRCH if there is no
- * matching flow, in which case 'buffer' still belongs to the caller. */
-int run_flow_through_tables(struct datapath *dp, struct ofpbuf *buffer,
-                            struct sw_port *p)
+/* Looks up 'key', extracted from 'buffer' by flow_extract() with 'fragment'
+ * as its return value, in 'dp''s flow table and executes the matching flow's
+ * actions.  'buffer' was received on 'p', which may be a physical switch port
+ * or a null pointer.  Returns 0 if successful, in which case 'buffer' is
+ * destroyed, or -ESRCH if there is no matching flow, in which case 'buffer'
+ * still belongs to the caller. */
+static int
+run_key_through_tables(struct datapath *dp, struct ofpbuf *buffer,
+                       struct sw_port *p, struct sw_flow_key *key,
+                       int fragment)
 {
-    struct sw_flow_key key;
     struct sw_flow *flow;
 
-    key.wildcards = 0;
-    if (flow_extract(buffer, p ? p->port_no : OFPP_NONE, &key.flow)
-        && (dp->flags & OFPC_FRAG_MASK) == OFPC_FRAG_DROP) {
+    if (fragment && (dp->flags & OFPC_FRAG_MASK) == OFPC_FRAG_DROP) {
         /* Drop fragment. */
         ofpbuf_delete(buffer);
         return 0;
     }
 
     if (p && p->config & (OFPPC_NO_RECV | OFPPC_NO_RECV_STP)
-        && p->config & (!eth_addr_equals(key.flow.dl_dst, stp_eth_addr)
+        && p->config & (!eth_addr_equals(key->flow.dl_dst, stp_eth_addr)
                        ? OFPPC_NO_RECV : OFPPC_NO_RECV_STP)) {
         ofpbuf_delete(buffer);
         return 0;
     }
 
-    flow = chain_lookup(dp->chain, &key, 0);
+    flow = chain_lookup(dp->chain, key, 0);
     if (flow != NULL) {
         flow_used(flow, buffer);
-        execute_actions(dp, buffer, &key, flow->sf_acts->actions,
+        execute_actions(dp, buffer, key, flow->sf_acts->actions,
                         flow->sf_acts->actions_len, false);
         return 0;
     } else {
@@ -1210,15 +1691,94 @@ int run_flow_through_tables(struct datapath *dp, struct ofpbuf *buffer,
     }
 }
 
+/* 'buffer' was received on 'p', which may be a a physical switch port or a
+ * null pointer.  Process it according to 'dp''s flow table.  Returns 0 if
+ * successful, in which case 'buffer' is destroyed, or -ESRCH if there is no
+ * matching flow, in which case 'buffer' still belongs to the caller and its
+ * flow key is in '*keyp'. */
+int run_flow_through_tables(struct datapath *dp, struct ofpbuf *buffer,
+                            struct sw_port *p, struct sw_flow_key *keyp)
+{
+    struct sw_flow_key key;
+    int fragment;
+    int error;
+
+    key.wildcards = 0;
+    fragment = flow_extract(buffer, p ? p->port_no : OFPP_NONE, &key.flow);
+    error = run_key_through_tables(dp, buffer, p, &key, fragment);
+    if (error) {
+        *keyp = key;
+    }
+    return error;
+}
+
+/* Sends 'buffer', received on 'p' and with flow key 'key', to the controller
+ * as a table miss, unless an earlier packet in the same flow is already
+ * awaiting a response or 'p' is over its packet-in limit.  Takes ownership of
+ * 'buffer'. */
+static void
+fwd_port_miss(struct datapath *dp, struct ofpbuf *buffer, struct sw_port *p,
+              struct sw_flow_key *key)
+{
+    if (!dp_misses_hold(dp->misses, &key->flow, buffer)) {
+        if (dp_admit_packet_in(dp, p->port_no)) {
+            dp_misses_start(dp->misses, &key->flow);
+            output_control(dp, buffer, p->port_no, dp->miss_send_len,
+                           OFPR_NO_MATCH, key);
+        } else {
+            ofpbuf_delete(buffer);
+        }
+    }
+}
+
 /* 'buffer' was received on 'p', which may be a a physical switch port or a
  * null pointer.  Process it according to 'dp''s flow table, sending it up to
  * the controller if no flow matches.  Takes ownership of 'buffer'. */
 void fwd_port_input(struct datapath *dp, struct ofpbuf *buffer,
                     struct sw_port *p)
 {
-    if (run_flow_through_tables(dp, buffer, p)) {
-        dp_output_control(dp, buffer, p->port_no,
-                          dp->miss_send_len, OFPR_NO_MATCH);
+    struct sw_flow_key key;
+
+    if (run_flow_through_tables(dp, buffer, p, &key)) {
+        fwd_port_miss(dp, buffer, p, &key);
+    }
+}
+
+/* Does the same as calling fwd_port_input() on each of the 'n' packets in
+ * 'buffers', all received on 'p', but extracts all of their flow keys in
+ * one pass first.  'n' must not exceed RXQ_BATCH. */
+static void
+fwd_port_input_batch(struct datapath *dp, struct ofpbuf *buffers[], size_t n,
+                     struct sw_port *p)
+{
+    struct flow flows[RXQ_BATCH];
+    int fragments[RXQ_BATCH];
+    size_t i;
+
+    assert(n <= RXQ_BATCH);
+    flow_extract_batch(buffers, n, p->port_no, flows, fragments);
+    for (i = 0; i < n; i++) {
+        struct sw_flow_key key;
+
+        key.wildcards = 0;
+        key.flow = flows[i];
+        if (run_key_through_tables(dp, buffers[i], p, &key, fragments[i])) {
+            fwd_port_miss(dp, buffers[i], p, &key);
+        }
+    }
+}
+
+/* Callback for dp_misses_release() that forwards 'buffer', a packet held
+ * back while its flow's first miss was pending, through the flow table. */
+static void
+release_miss(struct ofpbuf *buffer, const struct flow *flow, void *dp_)
+{
+    struct datapath *dp = dp_;
+    struct sw_port *p = dp_lookup_port(dp, ntohs(flow->in_port));
+    struct sw_flow_key key;
+
+    if (run_flow_through_tables(dp, buffer, p, &key)) {
+        ofpbuf_delete(buffer);
     }
 }
 
@@ -1237,6 +1797,15 @@ static int
 recv_barrier_request(struct datapath *dp, const struct sender *sender,
                      const void *ofph)
 {
+    /* Packet-ins and flow removed messages generated before the barrier go
+     * out before its reply. */
+    if (sender->remote->batch) {
+        remote_flush_batch(sender->remote);
+    }
+    if (sender->remote->flow_rem_batch) {
+        remote_flush_flow_rem_batch(dp, sender->remote);
+    }
+    remote_send_flow_rems(dp, sender->remote, true);
     return send_openflow_buffer(dp, make_barrier_reply(ofph), sender);
 }
 
@@ -1297,19 +1866,35 @@ recv_packet_out(struct datapath *dp, const struct sender *sender,
     }
 
     if (ntohl(opo->buffer_id) == (uint32_t) -1) {
-        /* FIXME: can we avoid copying data here? */
-        int data_len = ntohs(opo->header.length) - sizeof *opo - actions_len;
-        buffer = ofpbuf_new(data_len);
-        ofpbuf_put(buffer, (uint8_t *)opo->actions + actions_len, data_len);
+        size_t data_ofs = sizeof *opo + actions_len;
+        size_t data_len = ntohs(opo->header.length) - data_ofs;
+
+        if (sender->msgp && *sender->msgp
+            && (*sender->msgp)->data == msg
+            && !actions_may_push(opo->actions, actions_len)) {
+            /* Send the packet from the message buffer itself, by trimming
+             * the buffer down to the packet data.  The OpenFlow header and
+             * actions stay intact in the headroom while the actions run. */
+            buffer = *sender->msgp;
+            *sender->msgp = NULL;
+            ofpbuf_pull(buffer, data_ofs);
+            buffer->size = data_len;
+        } else {
+            buffer = ofpbuf_new(VLAN_HEADER_LEN + data_len);
+            ofpbuf_reserve(buffer, VLAN_HEADER_LEN);
+            ofpbuf_put(buffer, (uint8_t *)opo->actions + actions_len,
+                       data_len);
+        }
+        key.wildcards = 0;
+        flow_extract(buffer, ntohs(opo->in_port), &key.flow);
     } else {
-        buffer = retrieve_buffer(ntohl(opo->buffer_id));
+        buffer = dp_buffers_retrieve(dp->buffers, ntohl(opo->buffer_id),
+                                     ntohs(opo->in_port), &key);
         if (!buffer) {
             return -ESRCH;
         }
     }
 
-    flow_extract(buffer, ntohs(opo->in_port), &key.flow);
-
     v_code = validate_actions(dp, &key, opo->actions, actions_len);
     if (v_code != ACT_VALIDATION_OK) {
         dp_send_error_msg(dp, sender, OFPET_BAD_ACTION, v_code,
@@ -1405,11 +1990,12 @@ add_flow(struct datapath *dp, const struct sender *sender,
 
     error = 0;
     if (ntohl(ofm->buffer_id) != UINT32_MAX) {
-        struct ofpbuf *buffer = retrieve_buffer(ntohl(ofm->buffer_id));
+        struct sw_flow_key key;
+        struct ofpbuf *buffer = dp_buffers_retrieve(dp->buffers,
+                                                    ntohl(ofm->buffer_id),
+                                                    ntohs(ofm->match.in_port),
+                                                    &key);
         if (buffer) {
-            struct sw_flow_key key;
-            uint16_t in_port = ntohs(ofm->match.in_port);
-            flow_extract(buffer, in_port, &key.flow);
             flow_used(flow, buffer);
             execute_actions(dp, buffer, &key,
                     ofm->actions, actions_len, false);
@@ -1417,13 +2003,14 @@ add_flow(struct datapath *dp, const struct sender *sender,
             error = -ESRCH;
         }
     }
+    dp_misses_release(dp->misses, &flow->key, release_miss, dp);
     return error;
 
 error_free_flow:
     flow_free(flow);
 error:
     if (ntohl(ofm->buffer_id) != (uint32_t) -1)
-        discard_buffer(ntohl(ofm->buffer_id));
+        dp_buffers_discard(dp->buffers, ntohl(ofm->buffer_id));
     return error;
 }
 
@@ -1480,24 +2067,26 @@ mod_flow(struct datapath *dp, const struct sender *sender,
 
     error = 0;
     if (ntohl(ofm->buffer_id) != UINT32_MAX) {
-      struct ofpbuf *buffer = retrieve_buffer(ntohl(ofm->buffer_id));
-      if (buffer) {
-            struct sw_flow_key skb_key;
-            uint16_t in_port = ntohs(ofm->match.in_port);
-            flow_extract(buffer, in_port, &skb_key.flow);
+        struct sw_flow_key skb_key;
+        struct ofpbuf *buffer = dp_buffers_retrieve(dp->buffers,
+                                                    ntohl(ofm->buffer_id),
+                                                    ntohs(ofm->match.in_port),
+                                                    &skb_key);
+        if (buffer) {
             execute_actions(dp, buffer, &skb_key,
                             ofm->actions, actions_len, false);
         } else {
             error = -ESRCH;
         }
     }
+    dp_misses_release(dp->misses, &flow->key, release_miss, dp);
     return error;
 
 error_free_flow:
     flow_free(flow);
 error:
     if (ntohl(ofm->buffer_id) != (uint32_t) -1)
-        discard_buffer(ntohl(ofm->buffer_id));
+        dp_buffers_discard(dp->buffers, ntohl(ofm->buffer_id));
     return error;
 }
 
@@ -1780,26 +2369,33 @@ dump_port_stats(struct datapath *dp, struct sw_port *port,
     }
 }
 
-/* Although this makes some of the motions of being called
- * multiple times preserving state, it doesn't actually support
- * that process; the for loop can never break early.
- */
+#define MAX_PORT_STATS_BYTES 32768
+
+/* Dumps statistics for all ports in order of port number, followed by the
+ * local port, spreading them over as many replies as it takes. */
 static int port_stats_dump(struct datapath *dp, void *state,
                            struct ofpbuf *buffer)
 {
     struct port_stats_state *s = state;
     struct sw_port *p = NULL;
-    int i = 0;
 
     if (s->port_no == OFPP_NONE) {
         /* Dump statistics for all ports */
-        for (i = s->start_port; i < DP_MAX_PORTS; i++) {
-            p = dp_lookup_port(dp, i);
+        for (; s->start_port < dp->n_port_slots; s->start_port++) {
+            p = dp->ports[s->start_port];
             if (p && PORT_IN_USE(p)) {
+                if (buffer->size + sizeof(struct ofp_port_stats)
+                    > MAX_PORT_STATS_BYTES) {
+                    return 1;
+                }
                 dump_port_stats(dp, p, buffer);
             }
         }
         if (dp->local_port) {
+            if (buffer->size + sizeof(struct ofp_port_stats)
+                > MAX_PORT_STATS_BYTES) {
+                return 1;
+            }
             dump_port_stats(dp, dp->local_port, buffer);
         }
     } else {
@@ -2120,6 +2716,7 @@ recv_stats_request(struct datapath *dp UNUSED, const struct sender *sender,
     cb->done = false;
     cb->rq = xmemdup(rq, rq_len);
     cb->sender = *sender;
+    cb->sender.msgp = NULL;
     cb->s = st;
     cb->state = NULL;
 
@@ -2205,6 +2802,81 @@ recv_queue_get_config_request(struct datapath *dp, const struct sender *sender,
     return 0;
 }
 
+/* Appends "flow-removed.*" status lines for 'dp' to 's'. */
+static void
+format_flow_removed_status(const struct datapath *dp, struct ds *s)
+{
+    const struct remote *r;
+    int backlog = 0;
+
+    LIST_FOR_EACH (r, struct remote, node, &dp->remotes) {
+        backlog += r->flow_rem_txq.n;
+    }
+    ds_put_format(s, "flow-removed.sent=%llu\n", dp->flow_rem_sent);
+    ds_put_format(s, "flow-removed.batched=%llu\n", dp->flow_rem_batched);
+    ds_put_format(s, "flow-removed.batches=%llu\n", dp->flow_rem_batches);
+    ds_put_format(s, "flow-removed.paced=%llu\n", dp->flow_rem_paced);
+    ds_put_format(s, "flow-removed.dropped=%llu\n", dp->flow_rem_dropped);
+    ds_put_format(s, "flow-removed.backlog=%d\n", backlog);
+}
+
+/* Replies to a NXT_STATUS_REQUEST with the lines of datapath status whose
+ * beginning matches the request body, as secchan's status module does. */
+static int
+recv_nx_status_request(struct datapath *dp, const struct sender *sender,
+                       const struct nicira_header *request)
+{
+    size_t request_len = ntohs(request->header.length) - sizeof *request;
+    const char *request_string = (const char *) (request + 1);
+    struct nicira_header *reply;
+    struct ofpbuf *buffer;
+    struct sw_port *p;
+    struct ds status;
+    const char *line;
+
+    ds_init(&status);
+    dp_buffers_format_status(dp->buffers, &status);
+    dp_misses_format_status(dp->misses, &status);
+    dp_limit_format_status(dp->pin_limit, &status);
+    LIST_FOR_EACH (p, struct sw_port, node, &dp->port_list) {
+        dp_limit_format_port_status(&p->pin_limit, p->port_no, &status);
+    }
+    format_flow_removed_status(dp, &status);
+#if defined(OF_HW_PLAT) && !defined(USE_NETDEV)
+    dp_rxring_format_status(dp->hw_rxring, &status);
+#endif
+
+    reply = make_openflow_reply(sizeof *reply, OFPT_VENDOR, sender, &buffer);
+    reply->vendor = htonl(NX_VENDOR_ID);
+    reply->subtype = htonl(NXT_STATUS_REPLY);
+    for (line = ds_cstr(&status); *line; ) {
+        size_t len = strcspn(line, "\n") + 1;
+        if (len >= request_len && !memcmp(line, request_string, request_len)) {
+            ofpbuf_put(buffer, line, len);
+        }
+        line += len;
+    }
+    ds_destroy(&status);
+
+    return send_openflow_buffer(dp, buffer, sender);
+}
+
+static int
+recv_nx_msg(struct datapath *dp, const struct sender *sender, const void *oh)
+{
+    const struct nicira_header *nh = oh;
+
+    if (ntohs(nh->header.length) >= sizeof *nh
+        && ntohl(nh->subtype) == NXT_STATUS_REQUEST) {
+        return recv_nx_status_request(dp, sender, nh);
+    }
+
+    VLOG_WARN_RL(&rl, "unknown Nicira extension message");
+    dp_send_error_msg(dp, sender, OFPET_BAD_REQUEST, OFPBRC_BAD_SUBTYPE,
+                      oh, ntohs(nh->header.length));
+    return -EINVAL;
+}
+
 static int
 recv_vendor(struct datapath *dp, const struct sender *sender,
                   const void *oh)
@@ -2219,6 +2891,9 @@ recv_vendor(struct datapath *dp, const struct sender *sender,
     case OPENFLOW_VENDOR_ID:
         return of_ext_recv_msg(dp, sender, oh);
 
+    case NX_VENDOR_ID:
+        return recv_nx_msg(dp, sender, oh);
+
     default:
         VLOG_WARN_RL(&rl, "unknown vendor: 0x%x\n", ntohl(ovh->vendor));
         dp_send_error_msg(dp, sender, OFPET_BAD_REQUEST,
@@ -2305,71 +2980,3 @@ fwd_control_input(struct datapath *dp, const struct sender *sender,
         return -EFAULT;
     return handler(dp, sender, msg);
 }
-
-/* Packet buffering. */
-
-#define OVERWRITE_SECS  1
-
-struct packet_buffer {
-    struct ofpbuf *buffer;
-    uint32_t cookie;
-    time_t timeout;
-};
-
-static struct packet_buffer buffers[N_PKT_BUFFERS];
-static unsigned int buffer_idx;
-
-uint32_t save_buffer(struct ofpbuf *buffer)
-{
-    struct packet_buffer *p;
-    uint32_t id;
-
-    buffer_idx = (buffer_idx + 1) & PKT_BUFFER_MASK;
-    p = &buffers[buffer_idx];
-    if (p->buffer) {
-        /* Don't buffer packet if existing entry is less than
-         * OVERWRITE_SECS old. */
-        if (time_now() < p->timeout) { /* FIXME */
-                return (uint32_t)-1;
-        } else {
-            ofpbuf_delete(p->buffer);
-        }
-    }
-    /* Don't use maximum cookie value since the all-bits-1 id is
-     * special. */
-    if (++p->cookie >= (1u << PKT_COOKIE_BITS) - 1)
-        p->cookie = 0;
-    p->buffer = ofpbuf_clone(buffer);      /* FIXME */
-    p->timeout = time_now() + OVERWRITE_SECS; /* FIXME */
-    id = buffer_idx | (p->cookie << PKT_BUFFER_BITS);
-
-    return id;
-}
-
-static struct ofpbuf *retrieve_buffer(uint32_t id)
-{
-    struct ofpbuf *buffer = NULL;
-    struct packet_buffer *p;
-
-    p = &buffers[id & PKT_BUFFER_MASK];
-    if (p->cookie == id >> PKT_BUFFER_BITS) {
-        buffer = p->buffer;
-        p->buffer = NULL;
-    } else {
-        printf("cookie mismatch: %x != %x\n",
-               id >> PKT_BUFFER_BITS, p->cookie);
-    }
-
-    return buffer;
-}
-
-static void discard_buffer(uint32_t id)
-{
-    struct packet_buffer *p;
-
-    p = &buffers[id & PKT_BUFFER_MASK];
-    if (p->cookie == id >> PKT_BUFFER_BITS) {
-        ofpbuf_delete(p->buffer);
-        p->buffer = NULL;
-    }
-}
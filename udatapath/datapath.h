@@ -43,12 +43,16 @@
 #include "timeval.h"
 #include "list.h"
 #include "netdev.h"
+#include "dp_limit.h"
 
 /* FIXME:  Can declare struct of_hw_driver instead */
 #if defined(OF_HW_PLAT)
 #include <openflow/of_hw_api.h>
 #endif
 
+struct dp_buffers;
+struct dp_misses;
+struct dp_sched;
 struct rconn;
 struct pvconn;
 struct sw_flow;
@@ -96,18 +100,12 @@ struct sw_port {
     uint16_t num_queues;
     struct sw_queue queues[NETDEV_MAX_QUEUES];
     struct list queue_list; /* list of all queues for this port */
+    struct dp_sched *sched; /* userspace queue scheduler, if any */
+    struct dp_limit_port pin_limit; /* Packet-in rate limiting. */
 };
 
-#if defined(OF_HW_PLAT)
-struct hw_pkt_q_entry {
-    struct ofpbuf *buffer;
-    struct hw_pkt_q_entry *next;
-    of_port_t port_no;
-    int reason;
-};
-#endif
-
-#define DP_MAX_PORTS 255
+/* Switch ports are numbered from 1 up to DP_MAX_PORTS - 1. */
+#define DP_MAX_PORTS OFPP_MAX
 BUILD_ASSERT_DECL(DP_MAX_PORTS <= OFPP_MAX);
 
 struct datapath {
@@ -125,13 +123,37 @@ struct datapath {
     char dp_desc[DESC_STR_LEN];	/* human readible comment to ID this DP */
 
     struct sw_chain *chain;  /* Forwarding rules. */
+    struct dp_buffers *buffers; /* Packets awaiting the controller. */
+    struct dp_misses *misses;   /* Flows awaiting a flow_mod. */
+    struct dp_limit *pin_limit; /* Packet-in rate limiter. */
+
+    /* Flow removed notifications (see dp_send_flow_end()).  Except for
+     * 'flow_rem_batches', these count flows, not messages.  'flow_rem_paced'
+     * counts notifications that the per-run budget held back to a later
+     * run. */
+    unsigned long long int flow_rem_sent;    /* As OFPT_FLOW_REMOVED. */
+    unsigned long long int flow_rem_batched; /* In batches. */
+    unsigned long long int flow_rem_batches; /* Batch messages sent. */
+    unsigned long long int flow_rem_paced;
+    unsigned long long int flow_rem_dropped;
 
     /* Configuration set from controller. */
     uint16_t flags;
     uint16_t miss_send_len;
 
-    /* Switch ports. */
-    struct sw_port ports[DP_MAX_PORTS];
+    /* Slicing queues are scheduled in userspace (see dp_sched.h) rather than
+     * by tc if 'user_slicing' is true.  Ports are then shaped to
+     * 'slicing_rate' Mbps, or to their link speed if it is 0. */
+    bool user_slicing;
+    int slicing_rate;
+
+    /* Switch ports.  'ports' is indexed by port number and has
+     * 'n_port_slots' elements, null where there is no port; it grows as
+     * ports are added, up to DP_MAX_PORTS.  With a hardware driver that
+     * delivers packets from its own thread, it is allocated at full size
+     * when the driver is set up and never reallocated. */
+    struct sw_port **ports;
+    size_t n_port_slots;
     struct sw_port *local_port;  /* OFPP_LOCAL port, if any. */
     struct list port_list; /* All ports, including local_port. */
 
@@ -141,7 +163,7 @@ struct datapath {
      * in the driver structure
      */
     of_hw_driver_t *hw_drv;
-    struct hw_pkt_q_entry *hw_pkt_list_head, *hw_pkt_list_tail;
+    struct dp_rxring *hw_rxring; /* Packets from the driver's RX thread. */
 #endif
 };
 
@@ -153,10 +175,19 @@ void dp_run(struct datapath *);
 void dp_wait(struct datapath *);
 void dp_send_error_msg(struct datapath *, const struct sender *,
                   uint16_t, uint16_t, const void *, size_t);
+int dp_send_openflow(struct datapath *, struct ofpbuf *,
+                     const struct sender *);
+void dp_set_packet_in_batching(struct datapath *, const struct sender *,
+                               unsigned int max_packets,
+                               unsigned int max_bytes, unsigned int max_delay);
+void dp_set_flow_removed_batching(struct datapath *, const struct sender *,
+                                  unsigned int max_flows);
 void dp_send_flow_end(struct datapath *, struct sw_flow *,
                       enum ofp_flow_removed_reason);
 void dp_output_port(struct datapath *, struct ofpbuf *, int in_port, 
                     int out_port, uint32_t queue_id, bool ignore_no_fwd);
+bool dp_admit_packet_in(struct datapath *, int in_port);
+void fwd_port_input(struct datapath *, struct ofpbuf *, struct sw_port *);
 void dp_output_control(struct datapath *, struct ofpbuf *, int in_port,
         size_t max_len, int reason);
 struct sw_port * dp_lookup_port(struct datapath *, uint16_t);
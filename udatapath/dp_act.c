@@ -39,6 +39,16 @@
 #include "dp_act.h"
 #include "openflow/nicira-ext.h"
 
+/* Checksum changes owed by a run of consecutive set-field actions.  The
+ * actions rewrite their fields immediately but only add their effect on the
+ * IP and transport checksums here, and flush_csum() then updates each
+ * checksum once for the whole run. */
+struct csum_fixup {
+    bool pending;               /* Any changes accumulated? */
+    uint32_t ip_delta;          /* Change to the IP header checksum. */
+    uint32_t l4_delta;          /* Change to the TCP or UDP checksum. */
+};
+
 static uint16_t
 validate_output(struct datapath *dp UNUSED, const struct sw_flow_key *key, 
         const struct ofp_action_header *ah) 
@@ -138,7 +148,7 @@ vlan_pull_tag(struct ofpbuf *buffer)
 
 static void
 set_vlan_vid(struct ofpbuf *buffer, struct sw_flow_key *key, 
-        const struct ofp_action_header *ah)
+        const struct ofp_action_header *ah, struct csum_fixup *fixup UNUSED)
 {
     struct ofp_action_vlan_vid *va = (struct ofp_action_vlan_vid *)ah;
     uint16_t tci = ntohs(va->vlan_vid);
@@ -148,7 +158,7 @@ set_vlan_vid(struct ofpbuf *buffer, struct sw_flow_key *key,
 
 static void
 set_vlan_pcp(struct ofpbuf *buffer, struct sw_flow_key *key, 
-        const struct ofp_action_header *ah)
+        const struct ofp_action_header *ah, struct csum_fixup *fixup UNUSED)
 {
     struct ofp_action_vlan_pcp *va = (struct ofp_action_vlan_pcp *)ah;
     uint16_t tci = (uint16_t)va->vlan_pcp << 13;
@@ -158,7 +168,8 @@ set_vlan_pcp(struct ofpbuf *buffer, struct sw_flow_key *key,
 
 static void
 strip_vlan(struct ofpbuf *buffer, struct sw_flow_key *key, 
-        const struct ofp_action_header *ah UNUSED)
+        const struct ofp_action_header *ah UNUSED,
+        struct csum_fixup *fixup UNUSED)
 {
     vlan_pull_tag(buffer);
     key->flow.dl_vlan = htons(OFP_VLAN_NONE);
@@ -166,7 +177,7 @@ strip_vlan(struct ofpbuf *buffer, struct sw_flow_key *key,
 
 static void
 set_dl_addr(struct ofpbuf *buffer, struct sw_flow_key *key UNUSED, 
-        const struct ofp_action_header *ah)
+        const struct ofp_action_header *ah, struct csum_fixup *fixup UNUSED)
 {
     struct ofp_action_dl_addr *da = (struct ofp_action_dl_addr *)ah;
     struct eth_header *eh = buffer->l2;
@@ -180,38 +191,30 @@ set_dl_addr(struct ofpbuf *buffer, struct sw_flow_key *key UNUSED,
 
 static void
 set_nw_addr(struct ofpbuf *buffer, struct sw_flow_key *key, 
-        const struct ofp_action_header *ah)
+        const struct ofp_action_header *ah, struct csum_fixup *fixup)
 {
     struct ofp_action_nw_addr *na = (struct ofp_action_nw_addr *)ah;
     uint16_t eth_proto = ntohs(key->flow.dl_type);
 
     if (eth_proto == ETH_TYPE_IP) {
         struct ip_header *nh = buffer->l3;
-        uint8_t nw_proto = key->flow.nw_proto;
         uint32_t new, *field;
 
         new = na->nw_addr;
         field = na->type == htons(OFPAT_SET_NW_SRC) ? &nh->ip_src : &nh->ip_dst;
-        if (nw_proto == IP_TYPE_TCP) {
-            struct tcp_header *th = buffer->l4;
-            th->tcp_csum = recalc_csum32(th->tcp_csum, *field, new);
-        } else if (nw_proto == IP_TYPE_UDP) {
-            struct udp_header *th = buffer->l4;
-            if (th->udp_csum) {
-                th->udp_csum = recalc_csum32(th->udp_csum, *field, new);
-                if (!th->udp_csum) {
-                    th->udp_csum = 0xffff;
-                }
-            }
-        }
-        nh->ip_csum = recalc_csum32(nh->ip_csum, *field, new);
+
+        /* The address is covered by the IP header checksum and, through the
+         * pseudo-header, by the transport checksum. */
+        fixup->ip_delta = csum_update32(fixup->ip_delta, *field, new);
+        fixup->l4_delta = csum_update32(fixup->l4_delta, *field, new);
+        fixup->pending = true;
         *field = new;
     }
 }
 
 static void
 set_nw_tos(struct ofpbuf *buffer, struct sw_flow_key *key, 
-           const struct ofp_action_header *ah)
+           const struct ofp_action_header *ah, struct csum_fixup *fixup)
 {
     struct ofp_action_nw_tos *nt = (struct ofp_action_nw_tos *)ah;
     uint16_t eth_proto = ntohs(key->flow.dl_type);
@@ -228,8 +231,10 @@ set_nw_tos(struct ofpbuf *buffer, struct sw_flow_key *key,
 
         /* jklee : ip tos field is not included in TCP pseudo header.
          * Need magic as update_csum() don't work with 8 bits. */
-       nh->ip_csum = recalc_csum32(nh->ip_csum, htons((uint16_t)*field),
-                                   htons((uint16_t)new));
+       fixup->ip_delta = csum_update16(fixup->ip_delta,
+                                       htons((uint16_t)*field),
+                                       htons((uint16_t)new));
+       fixup->pending = true;
 
        /* Change the IP ToS bits */
        *field = new;
@@ -238,7 +243,7 @@ set_nw_tos(struct ofpbuf *buffer, struct sw_flow_key *key,
 
 static void
 set_tp_port(struct ofpbuf *buffer, struct sw_flow_key *key, 
-        const struct ofp_action_header *ah)
+        const struct ofp_action_header *ah, struct csum_fixup *fixup)
 {
     struct ofp_action_tp_port *ta = (struct ofp_action_tp_port *)ah;
     uint16_t eth_proto = ntohs(key->flow.dl_type);
@@ -251,17 +256,71 @@ set_tp_port(struct ofpbuf *buffer, struct sw_flow_key *key,
         if (nw_proto == IP_TYPE_TCP) {
             struct tcp_header *th = buffer->l4;
             field = ta->type == htons(OFPAT_SET_TP_SRC) ? &th->tcp_src : &th->tcp_dst;
-            th->tcp_csum = recalc_csum16(th->tcp_csum, *field, new);
-            *field = new;
         } else if (nw_proto == IP_TYPE_UDP) {
             struct udp_header *th = buffer->l4;
             field = ta->type == htons(OFPAT_SET_TP_SRC) ? &th->udp_src : &th->udp_dst;
-            th->udp_csum = recalc_csum16(th->udp_csum, *field, new);
-            *field = new;
+        } else {
+            return;
         }
+
+        /* With a partial checksum the transport checksum field holds only
+         * the pseudo-header checksum, which does not cover the ports. */
+        if (!buffer->csum_partial) {
+            fixup->l4_delta = csum_update16(fixup->l4_delta, *field, new);
+            fixup->pending = true;
+        }
+        *field = new;
     }
 }
 
+/* Applies the checksum changes accumulated in 'fixup' by a run of set-field
+ * actions to 'buffer', and resets 'fixup' for the next run. */
+static void
+flush_csum(struct ofpbuf *buffer, const struct sw_flow_key *key,
+           struct csum_fixup *fixup)
+{
+    struct ip_header *nh;
+    uint8_t nw_proto;
+
+    if (!fixup->pending) {
+        return;
+    }
+
+    nh = buffer->l3;
+    nh->ip_csum = recalc_csum(nh->ip_csum, fixup->ip_delta);
+
+    nw_proto = key->flow.nw_proto;
+    if (buffer->csum_partial) {
+        /* The transport checksum field holds only the uncomplemented
+         * pseudo-header checksum, which the NIC or netdev_send() completes
+         * on output. */
+        if (nw_proto == IP_TYPE_TCP) {
+            struct tcp_header *th = buffer->l4;
+            th->tcp_csum = ~recalc_csum(~th->tcp_csum, fixup->l4_delta);
+        } else if (nw_proto == IP_TYPE_UDP) {
+            struct udp_header *th = buffer->l4;
+            th->udp_csum = ~recalc_csum(~th->udp_csum, fixup->l4_delta);
+        }
+    } else if (nw_proto == IP_TYPE_TCP) {
+        struct tcp_header *th = buffer->l4;
+        th->tcp_csum = recalc_csum(th->tcp_csum, fixup->l4_delta);
+    } else if (nw_proto == IP_TYPE_UDP) {
+        /* A zero UDP checksum means that there is none, and a computed
+         * checksum of zero is sent as all-ones instead. */
+        struct udp_header *th = buffer->l4;
+        if (th->udp_csum) {
+            th->udp_csum = recalc_csum(th->udp_csum, fixup->l4_delta);
+            if (!th->udp_csum) {
+                th->udp_csum = 0xffff;
+            }
+        }
+    }
+
+    fixup->pending = false;
+    fixup->ip_delta = 0;
+    fixup->l4_delta = 0;
+}
+
 struct openflow_action {
     size_t min_size;
     size_t max_size;
@@ -270,7 +329,8 @@ struct openflow_action {
             const struct ofp_action_header *ah);
     void (*execute)(struct ofpbuf *buffer,
             struct sw_flow_key *key, 
-            const struct ofp_action_header *ah);
+            const struct ofp_action_header *ah,
+            struct csum_fixup *fixup);
 };
 
 static const struct openflow_action of_actions[] = {
@@ -440,15 +500,48 @@ validate_actions(struct datapath *dp, const struct sw_flow_key *key,
     return ACT_VALIDATION_OK;
 }
 
+/* Returns true if executing the list of actions may push new header bytes
+ * in front of the packet, that is, into its headroom.  The vlan actions do so
+ * when the packet is not already tagged.  The list need not have been
+ * validated yet; a malformed list yields true. */
+bool
+actions_may_push(const struct ofp_action_header *actions, size_t actions_len)
+{
+    const uint8_t *p = (const uint8_t *)actions;
+
+    while (actions_len > 0) {
+        const struct ofp_action_header *ah;
+        size_t len;
+
+        if (actions_len < sizeof *ah) {
+            return true;
+        }
+        ah = (const struct ofp_action_header *)p;
+        len = ntohs(ah->len);
+        if (len < sizeof *ah || len > actions_len) {
+            return true;
+        }
+        if (ah->type == htons(OFPAT_SET_VLAN_VID)
+            || ah->type == htons(OFPAT_SET_VLAN_PCP)) {
+            return true;
+        }
+
+        p += len;
+        actions_len -= len;
+    }
+    return false;
+}
+
 /* Execute a built-in OpenFlow action against 'buffer'. */
 static void
 execute_ofpat(struct ofpbuf *buffer, struct sw_flow_key *key, 
-        const struct ofp_action_header *ah, uint16_t type)
+        const struct ofp_action_header *ah, uint16_t type,
+        struct csum_fixup *fixup)
 {
     const struct openflow_action *act = &of_actions[type];
 
     if (act->execute) {
-        act->execute(buffer, key, ah);
+        act->execute(buffer, key, ah, fixup);
     }
 }
 
@@ -484,6 +577,7 @@ void execute_actions(struct datapath *dp, struct ofpbuf *buffer,
     size_t max_len = UINT16_MAX;
     uint16_t in_port = ntohs(key->flow.in_port);
     uint8_t *p = (uint8_t *)actions;
+    struct csum_fixup fixup = { false, 0, 0 };
 
     prev_port = -1;
     prev_queue = 0;
@@ -495,8 +589,12 @@ void execute_actions(struct datapath *dp, struct ofpbuf *buffer,
         size_t len = htons(ah->len);
 
         if (prev_port != -1) {
-            do_output(dp, ofpbuf_clone(buffer), in_port, max_len,
-                      prev_port, prev_queue, ignore_no_fwd);
+            flush_csum(buffer, key, &fixup);
+            if (prev_port != OFPP_CONTROLLER
+                || dp_admit_packet_in(dp, in_port)) {
+                do_output(dp, ofpbuf_clone(buffer), in_port, max_len,
+                          prev_port, prev_queue, ignore_no_fwd);
+            }
             prev_port = -1;
         }
 
@@ -514,8 +612,9 @@ void execute_actions(struct datapath *dp, struct ofpbuf *buffer,
             uint16_t type = ntohs(ah->type);
 
             if (type < ARRAY_SIZE(of_actions)) {
-                execute_ofpat(buffer, key, ah, type);
+                execute_ofpat(buffer, key, ah, type, &fixup);
             } else if (type == OFPAT_VENDOR) {
+                flush_csum(buffer, key, &fixup);
                 execute_vendor(buffer, key, ah);
             }
         }
@@ -523,7 +622,9 @@ void execute_actions(struct datapath *dp, struct ofpbuf *buffer,
         p += len;
         actions_len -= len;
     }
-    if (prev_port != -1) {
+    flush_csum(buffer, key, &fixup);
+    if (prev_port != -1
+        && (prev_port != OFPP_CONTROLLER || dp_admit_packet_in(dp, in_port))) {
         do_output(dp, buffer, in_port, max_len, prev_port, prev_queue, ignore_no_fwd);
     } else {
         ofpbuf_delete(buffer);
@@ -0,0 +1,233 @@
+/* Copyright (c) 2010 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "dp_buffers.h"
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include "dynamic-string.h"
+#include "flow.h"
+#include "ofpbuf.h"
+#include "switch-flow.h"
+#include "timeval.h"
+#include "util.h"
+
+#define THIS_MODULE VLM_datapath
+#include "vlog.h"
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
+
+/* A stored packet is kept at least this long before its slot may be reused
+ * for another packet. */
+#define OVERWRITE_SECS  1
+
+struct packet_buffer {
+    struct ofpbuf *buffer;
+    uint32_t cookie;
+    time_t timeout;
+    bool has_key;               /* Is 'key' valid? */
+    struct sw_flow_key key;     /* Key extracted when 'buffer' missed. */
+};
+
+struct dp_buffers {
+    struct packet_buffer *slots;
+    unsigned int slot_bits;     /* log2 of the number of slots. */
+    bool enabled;               /* False if created with no slots. */
+    unsigned int next;          /* Slot to use for the next packet. */
+    size_t max_memory;          /* Maximum sum of buffer allocations. */
+
+    /* Statistics. */
+    unsigned int n_used;        /* Slots holding a packet. */
+    size_t memory;              /* Sum of stored buffers' allocations. */
+    unsigned long long int n_saved;     /* Packets stored. */
+    unsigned long long int n_refused;   /* Packets that could not be stored. */
+    unsigned long long int n_evicted;   /* Stored packets never claimed. */
+    unsigned long long int n_stale;     /* Lookups of unknown ids. */
+};
+
+/* Creates and returns a buffer store with room for 'n_slots' packets,
+ * rounded up to a power of 2 and limited to DP_BUFFERS_MAX_SLOTS, and at most
+ * 'max_memory' bytes of packet data.  If 'n_slots' is 0, the store never
+ * holds any packets. */
+struct dp_buffers *
+dp_buffers_create(unsigned int n_slots, size_t max_memory)
+{
+    struct dp_buffers *b = xcalloc(1, sizeof *b);
+
+    b->enabled = n_slots > 0;
+    n_slots = MIN(MAX(n_slots, 1), DP_BUFFERS_MAX_SLOTS);
+    while ((1u << b->slot_bits) < n_slots) {
+        b->slot_bits++;
+    }
+    b->slots = xcalloc(1u << b->slot_bits, sizeof *b->slots);
+    b->max_memory = max_memory;
+    return b;
+}
+
+/* Returns the number of packets that 'b' can hold. */
+unsigned int
+dp_buffers_n_slots(const struct dp_buffers *b)
+{
+    return b->enabled ? 1u << b->slot_bits : 0;
+}
+
+static void
+free_slot(struct dp_buffers *b, struct packet_buffer *p)
+{
+    b->memory -= p->buffer->allocated;
+    b->n_used--;
+    ofpbuf_delete(p->buffer);
+    p->buffer = NULL;
+}
+
+/* Stores 'buffer' in 'b' and returns its buffer id, taking ownership of
+ * 'buffer'.  If 'key' is nonnull, it is kept as the flow key of 'buffer'.
+ * Returns UINT32_MAX, without taking ownership, if 'b' has no room. */
+uint32_t
+dp_buffers_save(struct dp_buffers *b, struct ofpbuf *buffer,
+                const struct sw_flow_key *key)
+{
+    unsigned int idx = b->next;
+    struct packet_buffer *p = &b->slots[idx];
+    size_t memory = b->memory;
+
+    if (!b->enabled) {
+        return UINT32_MAX;
+    }
+    if (p->buffer) {
+        /* Don't buffer packet if existing entry is less than
+         * OVERWRITE_SECS old. */
+        if (time_now() < p->timeout) {
+            b->n_refused++;
+            return UINT32_MAX;
+        }
+        memory -= p->buffer->allocated;
+    }
+    if (memory + buffer->allocated > b->max_memory) {
+        b->n_refused++;
+        return UINT32_MAX;
+    }
+    if (p->buffer) {
+        free_slot(b, p);
+        b->n_evicted++;
+    }
+
+    /* Don't use maximum cookie value since the all-bits-1 id is
+     * special.  The cookie takes all 32 bits of the id when there is only
+     * one slot, so the limit must be computed in 64 bits. */
+    if (++p->cookie >= (UINT64_C(1) << (32 - b->slot_bits)) - 1) {
+        p->cookie = 0;
+    }
+    p->buffer = buffer;
+    p->timeout = time_now() + OVERWRITE_SECS;
+    p->has_key = key != NULL;
+    if (key) {
+        p->key = *key;
+    }
+    b->memory += buffer->allocated;
+    b->n_used++;
+    b->n_saved++;
+    b->next = (idx + 1) & ((1u << b->slot_bits) - 1);
+
+    return idx | (p->cookie << b->slot_bits);
+}
+
+static struct packet_buffer *
+lookup(struct dp_buffers *b, uint32_t id)
+{
+    struct packet_buffer *p = &b->slots[id & ((1u << b->slot_bits) - 1)];
+
+    if (p->buffer && p->cookie == id >> b->slot_bits) {
+        return p;
+    }
+    VLOG_DBG_RL(&rl, "no packet buffered for id %"PRIx32, id);
+    b->n_stale++;
+    return NULL;
+}
+
+/* Removes the packet with the given buffer 'id' from 'b' and returns it, or
+ * returns a null pointer if there is no such packet.  The caller takes
+ * ownership of the packet.  Its flow key, for a packet received on
+ * 'in_port', is stored in '*key'; it is extracted from the packet only if it
+ * was not saved along with it. */
+struct ofpbuf *
+dp_buffers_retrieve(struct dp_buffers *b, uint32_t id, uint16_t in_port,
+                    struct sw_flow_key *key)
+{
+    struct packet_buffer *p = lookup(b, id);
+    struct ofpbuf *buffer;
+
+    if (!p) {
+        return NULL;
+    }
+
+    buffer = p->buffer;
+    if (p->has_key) {
+        *key = p->key;
+        key->flow.in_port = htons(in_port);
+    } else {
+        key->wildcards = 0;
+        flow_extract(buffer, in_port, &key->flow);
+    }
+
+    b->memory -= buffer->allocated;
+    b->n_used--;
+    p->buffer = NULL;
+    return buffer;
+}
+
+/* Frees the packet with the given buffer 'id' in 'b', if there is one. */
+void
+dp_buffers_discard(struct dp_buffers *b, uint32_t id)
+{
+    struct packet_buffer *p = lookup(b, id);
+
+    if (p) {
+        free_slot(b, p);
+    }
+}
+
+/* Appends status lines for 'b' to 'ds', in the format of NXT_STATUS_REPLY. */
+void
+dp_buffers_format_status(const struct dp_buffers *b, struct ds *ds)
+{
+    ds_put_format(ds, "buffers.slots=%u\n", dp_buffers_n_slots(b));
+    ds_put_format(ds, "buffers.used=%u\n", b->n_used);
+    ds_put_format(ds, "buffers.memory=%zu\n", b->memory);
+    ds_put_format(ds, "buffers.max-memory=%zu\n", b->max_memory);
+    ds_put_format(ds, "buffers.saved=%llu\n", b->n_saved);
+    ds_put_format(ds, "buffers.refused=%llu\n", b->n_refused);
+    ds_put_format(ds, "buffers.evicted=%llu\n", b->n_evicted);
+    ds_put_format(ds, "buffers.stale-ids=%llu\n", b->n_stale);
+}
@@ -0,0 +1,75 @@
+/* Copyright (c) 2010 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#ifndef DP_BUFFERS_H
+#define DP_BUFFERS_H 1
+
+/* Packet buffer store.
+ *
+ * Packets sent to the controller are kept here, so that the controller can
+ * refer to them by buffer id in a later flow_mod or packet_out instead of
+ * sending them back.  Each stored packet also keeps the flow key extracted
+ * from it when it missed in the flow table, if any.
+ *
+ * Buffer ids are 32-bit values, with a slot number in the low bits and a
+ * cookie in the high bits that distinguishes packets that have occupied the
+ * same slot.  UINT32_MAX is never a valid buffer id. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct ds;
+struct dp_buffers;
+struct ofpbuf;
+struct sw_flow_key;
+
+/* Defaults for dp_buffers_create(). */
+#define DP_BUFFERS_DEFAULT_SLOTS 4096
+#define DP_BUFFERS_DEFAULT_MEMORY (64 * 1024 * 1024)
+
+/* Largest number of slots that leaves a useful cookie. */
+#define DP_BUFFERS_MAX_SLOTS (1u << 20)
+
+struct dp_buffers *dp_buffers_create(unsigned int n_slots, size_t max_memory);
+unsigned int dp_buffers_n_slots(const struct dp_buffers *);
+
+uint32_t dp_buffers_save(struct dp_buffers *, struct ofpbuf *,
+                         const struct sw_flow_key *);
+struct ofpbuf *dp_buffers_retrieve(struct dp_buffers *, uint32_t id,
+                                   uint16_t in_port, struct sw_flow_key *);
+void dp_buffers_discard(struct dp_buffers *, uint32_t id);
+
+void dp_buffers_format_status(const struct dp_buffers *, struct ds *);
+
+#endif /* dp_buffers.h */
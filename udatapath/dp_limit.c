@@ -0,0 +1,140 @@
+/* Copyright (c) 2010 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "dp_limit.h"
+#include <limits.h>
+#include <stdlib.h>
+#include "dynamic-string.h"
+#include "timeval.h"
+#include "util.h"
+
+struct dp_limit {
+    int rate;                   /* Total packets per second, 0 for no limit. */
+    int port_rate;              /* Per-port packets per second, or 0. */
+    struct dp_limit_port total; /* Global bucket and totals. */
+    unsigned long long int n_port_dropped; /* Dropped by a port's bucket. */
+};
+
+/* Creates and returns a new packet-in rate limiter that lets through at most
+ * 'rate' packets per second in total and 'port_rate' packets per second from
+ * any one ingress port.  Either limit may be 0 to disable it.  Each bucket
+ * can save up a quarter second's worth of packets for bursts. */
+struct dp_limit *
+dp_limit_create(int rate, int port_rate)
+{
+    struct dp_limit *l = xcalloc(1, sizeof *l);
+
+    l->rate = rate;
+    l->port_rate = port_rate;
+    return l;
+}
+
+void
+dp_limit_destroy(struct dp_limit *l)
+{
+    free(l);
+}
+
+/* Adds tokens to 'b' for the time elapsed since it was last filled, at 'rate'
+ * packets per second. */
+static void
+refill(struct dp_limit_port *b, int rate)
+{
+    long long int now = time_msec();
+    long long int tokens = (now - b->last_fill) * rate + b->tokens;
+
+    if (tokens >= 1000) {
+        int burst = MIN(MAX(rate / 4, 1), INT_MAX / 1000);
+
+        b->last_fill = now;
+        b->tokens = MIN(tokens, burst * 1000);
+    }
+}
+
+/* Returns true if a packet received on the port whose bucket is 'p' may be
+ * sent to the controller, false if it should be dropped.  'p' may be null for
+ * packets that did not arrive on a switch port, which are subject only to
+ * the global limit. */
+bool
+dp_limit_admit(struct dp_limit *l, struct dp_limit_port *p)
+{
+    if (p && l->port_rate) {
+        refill(p, l->port_rate);
+        if (p->tokens < 1000) {
+            p->n_dropped++;
+            l->n_port_dropped++;
+            return false;
+        }
+    }
+    if (l->rate) {
+        refill(&l->total, l->rate);
+        if (l->total.tokens < 1000) {
+            if (p) {
+                p->n_dropped++;
+            }
+            l->total.n_dropped++;
+            return false;
+        }
+        l->total.tokens -= 1000;
+    }
+
+    if (p) {
+        if (l->port_rate) {
+            p->tokens -= 1000;
+        }
+        p->n_sent++;
+    }
+    l->total.n_sent++;
+    return true;
+}
+
+void
+dp_limit_format_status(const struct dp_limit *l, struct ds *ds)
+{
+    ds_put_format(ds, "packet-in.rate-limit=%d\n", l->rate);
+    ds_put_format(ds, "packet-in.port-rate-limit=%d\n", l->port_rate);
+    ds_put_format(ds, "packet-in.sent=%llu\n", l->total.n_sent);
+    ds_put_format(ds, "packet-in.dropped-port=%llu\n", l->n_port_dropped);
+    ds_put_format(ds, "packet-in.dropped-total=%llu\n", l->total.n_dropped);
+}
+
+/* Appends the counters in 'p', the bucket for port 'port_no', to 'ds'. */
+void
+dp_limit_format_port_status(const struct dp_limit_port *p, int port_no,
+                            struct ds *ds)
+{
+    ds_put_format(ds, "packet-in.port%d.sent=%llu\n", port_no, p->n_sent);
+    ds_put_format(ds, "packet-in.port%d.dropped=%llu\n",
+                  port_no, p->n_dropped);
+}
@@ -0,0 +1,69 @@
+/* Copyright (c) 2010 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#ifndef DP_LIMIT_H
+#define DP_LIMIT_H 1
+
+/* Packet-in rate limiter.
+ *
+ * Limits the rate at which the datapath sends packets to the controller,
+ * whether because they missed in the flow table or because a flow's actions
+ * said so.  Each ingress port has its own token bucket, so that a single
+ * host flooding new flows on one port uses up only that port's share, and a
+ * global bucket caps the total.  The check is made before the packet is
+ * buffered or copied into a message, so that a dropped packet costs next to
+ * nothing. */
+
+#include <stdbool.h>
+
+struct ds;
+
+/* Token bucket and counters for one ingress port, embedded in struct
+ * sw_port.  All-zero is a valid initial state. */
+struct dp_limit_port {
+    long long int last_fill;    /* Time at which tokens were last added. */
+    int tokens;                 /* 1000 tokens per packet. */
+    unsigned long long int n_sent;    /* Packets let through. */
+    unsigned long long int n_dropped; /* Packets dropped by either limit. */
+};
+
+struct dp_limit *dp_limit_create(int rate, int port_rate);
+void dp_limit_destroy(struct dp_limit *);
+
+bool dp_limit_admit(struct dp_limit *, struct dp_limit_port *);
+
+void dp_limit_format_status(const struct dp_limit *, struct ds *);
+void dp_limit_format_port_status(const struct dp_limit_port *, int port_no,
+                                 struct ds *);
+
+#endif /* dp_limit.h */
@@ -0,0 +1,293 @@
+/* Copyright (c) 2010 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "dp_misses.h"
+#include <stdlib.h>
+#include "dynamic-string.h"
+#include "flow.h"
+#include "hmap.h"
+#include "list.h"
+#include "ofpbuf.h"
+#include "poll-loop.h"
+#include "switch-flow.h"
+#include "timeval.h"
+#include "util.h"
+
+/* Limits on the table as a whole, so that a burst of new flows cannot tie up
+ * unbounded memory while the controller catches up. */
+#define MAX_PENDING 4096                  /* Flows awaiting a flow_mod. */
+#define MAX_MEMORY (16 * 1024 * 1024)     /* Bytes of queued packets. */
+
+/* A flow that missed in the flow table and was sent to the controller. */
+struct pending_miss {
+    struct hmap_node hmap_node; /* In 'pending', hashed on 'key.flow'. */
+    struct list list_node;      /* In 'by_age'. */
+    struct sw_flow_key key;     /* Exact-match key of the flow. */
+    long long int expires;      /* time_msec() at which to give up. */
+    struct ofpbuf *head;        /* Queued packets, linked through 'next'. */
+    struct ofpbuf *tail;        /* Last queued packet, if any. */
+    unsigned int n_packets;     /* Number of queued packets. */
+};
+
+struct dp_misses {
+    struct hmap pending;        /* Contains "struct pending_miss"es. */
+    struct list by_age;         /* Oldest (and first to expire) first. */
+    unsigned int hold_msec;     /* Hold time, 0 to disable the table. */
+    unsigned int max_packets;   /* Queue limit per pending flow. */
+    size_t memory;              /* Sum of queued packets' allocations. */
+
+    /* Statistics. */
+    unsigned long long int n_misses;    /* Flows sent to the controller. */
+    unsigned long long int n_held;      /* Packets queued. */
+    unsigned long long int n_released;  /* Packets released by a flow_mod. */
+    unsigned long long int n_overflow;  /* Packets dropped, queue full. */
+    unsigned long long int n_expired;   /* Packets dropped on timeout. */
+};
+
+/* Creates and returns a pending-miss table that holds back further packets
+ * of a flow for 'hold_msec' milliseconds after the flow's first miss, queuing
+ * up to 'max_packets' of them.  With a 'hold_msec' of 0, the table holds
+ * nothing, so that every miss goes to the controller. */
+struct dp_misses *
+dp_misses_create(unsigned int hold_msec, unsigned int max_packets)
+{
+    struct dp_misses *m = xcalloc(1, sizeof *m);
+
+    hmap_init(&m->pending);
+    list_init(&m->by_age);
+    m->hold_msec = hold_msec;
+    m->max_packets = max_packets;
+    return m;
+}
+
+static struct pending_miss *
+lookup(const struct dp_misses *m, const struct flow *flow, size_t hash)
+{
+    struct hmap_node *node;
+
+    for (node = hmap_first_with_hash(&m->pending, hash); node;
+         node = hmap_next_with_hash(node)) {
+        struct pending_miss *pm = CONTAINER_OF(node, struct pending_miss,
+                                               hmap_node);
+        if (flow_equal(&pm->key.flow, flow)) {
+            return pm;
+        }
+    }
+    return NULL;
+}
+
+/* Removes 'pm' from 'm' and frees it.  The caller must already have taken
+ * its queued packets. */
+static void
+destroy_pending(struct dp_misses *m, struct pending_miss *pm)
+{
+    hmap_remove(&m->pending, &pm->hmap_node);
+    list_remove(&pm->list_node);
+    free(pm);
+}
+
+/* Drops the packets queued on 'pm' and destroys it. */
+static void
+expire_pending(struct dp_misses *m, struct pending_miss *pm)
+{
+    struct ofpbuf *b, *next;
+
+    for (b = pm->head; b; b = next) {
+        next = b->next;
+        m->memory -= b->allocated;
+        ofpbuf_delete(b);
+    }
+    m->n_expired += pm->n_packets;
+    destroy_pending(m, pm);
+}
+
+/* Called for 'buffer', a packet of 'flow' that missed in the flow table.
+ *
+ * If an earlier packet of 'flow' was sent to the controller less than the
+ * hold time ago, takes ownership of 'buffer', queuing it or dropping it if
+ * the flow's queue is full, and returns true.  Otherwise returns false; the
+ * caller should send 'buffer' to the controller if it can and, if it does,
+ * call dp_misses_start() for 'flow'. */
+bool
+dp_misses_hold(struct dp_misses *m, const struct flow *flow,
+               struct ofpbuf *buffer)
+{
+    size_t hash = flow_hash(flow, 0);
+    struct pending_miss *pm;
+
+    if (!m->hold_msec) {
+        return false;
+    }
+
+    pm = lookup(m, flow, hash);
+    if (pm && time_msec() >= pm->expires) {
+        expire_pending(m, pm);
+        pm = NULL;
+    }
+
+    if (pm) {
+        if (pm->n_packets >= m->max_packets
+            || m->memory + buffer->allocated > MAX_MEMORY) {
+            ofpbuf_delete(buffer);
+            m->n_overflow++;
+            return true;
+        }
+
+        buffer->next = NULL;
+        if (pm->tail) {
+            pm->tail->next = buffer;
+        } else {
+            pm->head = buffer;
+        }
+        pm->tail = buffer;
+        pm->n_packets++;
+        m->memory += buffer->allocated;
+        m->n_held++;
+        return true;
+    }
+    return false;
+}
+
+/* Starts holding back packets of 'flow', a packet of which has just been sent
+ * to the controller after dp_misses_hold() returned false for it.  A packet
+ * that the caller could not send, e.g. because of the packet-in rate limit,
+ * must not start a hold, since then the controller would not see the flow
+ * until the hold time expired. */
+void
+dp_misses_start(struct dp_misses *m, const struct flow *flow)
+{
+    if (m->hold_msec && hmap_count(&m->pending) < MAX_PENDING) {
+        struct pending_miss *pm = xcalloc(1, sizeof *pm);
+
+        pm->key.flow = *flow;
+        pm->expires = time_msec() + m->hold_msec;
+        hmap_insert(&m->pending, &pm->hmap_node, flow_hash(flow, 0));
+        list_push_back(&m->by_age, &pm->list_node);
+        m->n_misses++;
+    }
+}
+
+/* Hands over the packets queued on 'pm' to 'cb', in the order they arrived,
+ * and destroys 'pm'. */
+static void
+release_pending(struct dp_misses *m, struct pending_miss *pm,
+                void (*cb)(struct ofpbuf *, const struct flow *, void *aux),
+                void *aux)
+{
+    struct ofpbuf *b = pm->head;
+    struct flow flow = pm->key.flow;
+
+    m->n_released += pm->n_packets;
+    destroy_pending(m, pm);
+    while (b) {
+        struct ofpbuf *next = b->next;
+
+        b->next = NULL;
+        m->memory -= b->allocated;
+        cb(b, &flow, aux);
+        b = next;
+    }
+}
+
+/* Stops holding back packets of each flow that 'match' matches.  The packets
+ * already queued for those flows are passed to 'cb', along with their flow
+ * and 'aux', which takes ownership of them. */
+void
+dp_misses_release(struct dp_misses *m, const struct sw_flow_key *match,
+                  void (*cb)(struct ofpbuf *, const struct flow *, void *aux),
+                  void *aux)
+{
+    struct pending_miss *pm, *next;
+
+    if (!match->wildcards) {
+        pm = lookup(m, &match->flow, flow_hash(&match->flow, 0));
+        if (pm) {
+            release_pending(m, pm, cb, aux);
+        }
+        return;
+    }
+
+    LIST_FOR_EACH_SAFE (pm, next, struct pending_miss, list_node,
+                        &m->by_age) {
+        if (flow_matches_1wild(&pm->key, match)) {
+            release_pending(m, pm, cb, aux);
+        }
+    }
+}
+
+/* Drops the packets of flows whose hold time has expired. */
+void
+dp_misses_run(struct dp_misses *m)
+{
+    long long int now = time_msec();
+
+    while (!list_is_empty(&m->by_age)) {
+        struct pending_miss *pm = CONTAINER_OF(list_front(&m->by_age),
+                                               struct pending_miss,
+                                               list_node);
+        if (now < pm->expires) {
+            break;
+        }
+        expire_pending(m, pm);
+    }
+}
+
+/* Arranges for the poll loop to wake up when dp_misses_run() has work to
+ * do. */
+void
+dp_misses_wait(struct dp_misses *m)
+{
+    if (!list_is_empty(&m->by_age)) {
+        struct pending_miss *pm = CONTAINER_OF(list_front(&m->by_age),
+                                               struct pending_miss,
+                                               list_node);
+        poll_timer_wait(MAX(pm->expires - time_msec(), 0));
+    }
+}
+
+/* Appends status lines for 'm' to 'ds', in the format of NXT_STATUS_REPLY. */
+void
+dp_misses_format_status(const struct dp_misses *m, struct ds *ds)
+{
+    ds_put_format(ds, "misses.hold-msec=%u\n", m->hold_msec);
+    ds_put_format(ds, "misses.max-packets=%u\n", m->max_packets);
+    ds_put_format(ds, "misses.pending=%zu\n", hmap_count(&m->pending));
+    ds_put_format(ds, "misses.memory=%zu\n", m->memory);
+    ds_put_format(ds, "misses.sent=%llu\n", m->n_misses);
+    ds_put_format(ds, "misses.suppressed=%llu\n",
+                  m->n_held + m->n_overflow);
+    ds_put_format(ds, "misses.released=%llu\n", m->n_released);
+    ds_put_format(ds, "misses.dropped-full=%llu\n", m->n_overflow);
+    ds_put_format(ds, "misses.dropped-expired=%llu\n", m->n_expired);
+}
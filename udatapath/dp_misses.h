@@ -0,0 +1,75 @@
+/* Copyright (c) 2010 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#ifndef DP_MISSES_H
+#define DP_MISSES_H 1
+
+/* Pending-miss table.
+ *
+ * When a packet misses in the flow table, the datapath sends it to the
+ * controller, which usually answers with a flow_mod for the packet's flow.
+ * Until that flow_mod arrives, every further packet of the flow would also
+ * miss and be sent to the controller.  The pending-miss table instead
+ * remembers, for a configurable hold time, each flow that has been sent to
+ * the controller.  Later packets of the flow are queued, up to a per-flow
+ * limit, and are released through the flow table once a flow_mod that
+ * matches the flow arrives.  Packets still queued when the hold time expires
+ * are dropped. */
+
+#include <stdbool.h>
+
+struct ds;
+struct dp_misses;
+struct flow;
+struct ofpbuf;
+struct sw_flow_key;
+
+/* Default for dp_misses_create(). */
+#define DP_MISSES_DEFAULT_PACKETS 64
+
+struct dp_misses *dp_misses_create(unsigned int hold_msec,
+                                   unsigned int max_packets);
+
+bool dp_misses_hold(struct dp_misses *, const struct flow *, struct ofpbuf *);
+void dp_misses_start(struct dp_misses *, const struct flow *);
+void dp_misses_release(struct dp_misses *, const struct sw_flow_key *match,
+                       void (*cb)(struct ofpbuf *, const struct flow *,
+                                  void *aux),
+                       void *aux);
+
+void dp_misses_run(struct dp_misses *);
+void dp_misses_wait(struct dp_misses *);
+
+void dp_misses_format_status(const struct dp_misses *, struct ds *);
+
+#endif /* dp_misses.h */
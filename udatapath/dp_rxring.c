@@ -0,0 +1,242 @@
+/* Copyright (c) 2010 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "dp_rxring.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "dynamic-string.h"
+#include "ofpbuf.h"
+#include "poll-loop.h"
+#include "util.h"
+
+#define THIS_MODULE VLM_datapath
+#include "vlog.h"
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
+
+/* Keeps the fields written by the producer and by the consumer on separate
+ * cache lines, so that each side's writes do not keep stealing the line that
+ * the other side is reading. */
+#define RXRING_CACHE_LINE 64
+
+struct dp_rxring {
+    /* Fixed at creation. */
+    struct dp_rxring_entry *entries;
+    size_t mask;                /* Number of entries minus 1. */
+    int fd;                     /* eventfd for waking the consumer. */
+
+    /* Written only by the consumer. */
+    struct {
+        size_t head;            /* Next entry to dequeue. */
+        size_t tail_cache;      /* Last value read from 'prod.tail'. */
+        int waiting;            /* Consumer may sleep on 'fd'. */
+        unsigned long long int kicks_seen; /* Kicks read back from 'fd'. */
+        unsigned long long int n_dequeued;
+        unsigned long long int n_batches;
+    } cons __attribute__((aligned(RXRING_CACHE_LINE)));
+
+    /* Written only by the producer. */
+    struct {
+        size_t tail;            /* Next entry to fill. */
+        size_t head_cache;      /* Last value read from 'cons.head'. */
+        unsigned long long int n_enqueued;
+        unsigned long long int n_dropped; /* Ring was full. */
+        unsigned long long int n_kicks;   /* Writes to 'fd'. */
+    } prod __attribute__((aligned(RXRING_CACHE_LINE)));
+};
+
+/* Creates and returns a new ring with room for at least 'capacity' packets,
+ * rounded up to a power of 2. */
+struct dp_rxring *
+dp_rxring_create(size_t capacity)
+{
+    struct dp_rxring *r;
+    size_t n;
+
+    for (n = 1; n < capacity; n *= 2) {
+        continue;
+    }
+
+    if (posix_memalign((void **) &r, RXRING_CACHE_LINE, sizeof *r)) {
+        out_of_memory();
+    }
+    memset(r, 0, sizeof *r);
+    r->entries = xmalloc(n * sizeof *r->entries);
+    r->mask = n - 1;
+    r->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (r->fd < 0) {
+        ofp_fatal(errno, "eventfd");
+    }
+    return r;
+}
+
+/* Destroys 'r' and the packets still in it.  The producer must already have
+ * stopped. */
+void
+dp_rxring_destroy(struct dp_rxring *r)
+{
+    if (r) {
+        struct dp_rxring_entry entries[64];
+        size_t n, i;
+
+        while ((n = dp_rxring_dequeue(r, entries, ARRAY_SIZE(entries)))) {
+            for (i = 0; i < n; i++) {
+                ofpbuf_delete(entries[i].buffer);
+            }
+        }
+        close(r->fd);
+        free(r->entries);
+        free(r);
+    }
+}
+
+/* Adds 'buffer', received on 'port_no' for 'reason', to 'r', taking ownership
+ * of it.  If 'r' is full, drops 'buffer' instead.  Must only be called from
+ * one thread at a time. */
+void
+dp_rxring_enqueue(struct dp_rxring *r, struct ofpbuf *buffer,
+                  uint32_t port_no, int reason)
+{
+    size_t tail = r->prod.tail;
+    struct dp_rxring_entry *e;
+
+    if (tail - r->prod.head_cache > r->mask) {
+        r->prod.head_cache = __atomic_load_n(&r->cons.head, __ATOMIC_ACQUIRE);
+        if (tail - r->prod.head_cache > r->mask) {
+            __atomic_store_n(&r->prod.n_dropped, r->prod.n_dropped + 1,
+                             __ATOMIC_RELAXED);
+            ofpbuf_delete(buffer);
+            return;
+        }
+    }
+
+    e = &r->entries[tail & r->mask];
+    e->buffer = buffer;
+    e->port_no = port_no;
+    e->reason = reason;
+    __atomic_store_n(&r->prod.tail, tail + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&r->prod.n_enqueued, r->prod.n_enqueued + 1,
+                     __ATOMIC_RELAXED);
+
+    /* Pairs with the fence in dp_rxring_wait(): either the consumer sees the
+     * new tail before it sleeps or we see that it is about to sleep. */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->cons.waiting, __ATOMIC_RELAXED)
+        && __atomic_exchange_n(&r->cons.waiting, 0, __ATOMIC_RELAXED)) {
+        static const uint64_t one = 1;
+
+        __atomic_store_n(&r->prod.n_kicks, r->prod.n_kicks + 1,
+                         __ATOMIC_RELAXED);
+        if (write(r->fd, &one, sizeof one) < 0) {
+            /* The counter can only be full if the consumer is already bound
+             * to wake up, and this thread must not log. */
+        }
+    }
+}
+
+/* Removes up to 'max' packets from 'r' into 'entries' and returns the number
+ * removed.  The caller takes ownership of their buffers.  Must only be
+ * called by the consumer. */
+size_t
+dp_rxring_dequeue(struct dp_rxring *r, struct dp_rxring_entry entries[],
+                  size_t max)
+{
+    size_t head = r->cons.head;
+    size_t n, i;
+
+    if (r->cons.tail_cache - head < max) {
+        r->cons.tail_cache = __atomic_load_n(&r->prod.tail, __ATOMIC_ACQUIRE);
+    }
+    n = MIN(r->cons.tail_cache - head, max);
+    if (!n) {
+        return 0;
+    }
+
+    for (i = 0; i < n; i++) {
+        entries[i] = r->entries[(head + i) & r->mask];
+    }
+    __atomic_store_n(&r->cons.head, head + n, __ATOMIC_RELEASE);
+    r->cons.n_dequeued += n;
+    r->cons.n_batches++;
+    return n;
+}
+
+/* Arranges for the poll loop to wake up when 'r' has packets to dequeue. */
+void
+dp_rxring_wait(struct dp_rxring *r)
+{
+    unsigned long long int kicks;
+
+    /* The producer counts a kick before writing it, so the count may run
+     * ahead of 'fd' for a moment.  Only what has actually been read is
+     * considered drained; anything else is read on a later pass. */
+    kicks = __atomic_load_n(&r->prod.n_kicks, __ATOMIC_RELAXED);
+    if (kicks != r->cons.kicks_seen) {
+        uint64_t count;
+
+        if (read(r->fd, &count, sizeof count) == sizeof count) {
+            r->cons.kicks_seen += count;
+        } else if (errno != EAGAIN) {
+            VLOG_WARN_RL(&rl, "eventfd read failed: %s", strerror(errno));
+        }
+    }
+
+    __atomic_store_n(&r->cons.waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->prod.tail, __ATOMIC_ACQUIRE) != r->cons.head) {
+        __atomic_store_n(&r->cons.waiting, 0, __ATOMIC_RELAXED);
+        poll_immediate_wake();
+    } else {
+        poll_fd_wait(r->fd, POLLIN);
+    }
+}
+
+void
+dp_rxring_format_status(const struct dp_rxring *r, struct ds *ds)
+{
+    ds_put_format(ds, "hw-rx.capacity=%zu\n", r->mask + 1);
+    ds_put_format(ds, "hw-rx.enqueued=%llu\n",
+                  __atomic_load_n(&r->prod.n_enqueued, __ATOMIC_RELAXED));
+    ds_put_format(ds, "hw-rx.dropped=%llu\n",
+                  __atomic_load_n(&r->prod.n_dropped, __ATOMIC_RELAXED));
+    ds_put_format(ds, "hw-rx.dequeued=%llu\n", r->cons.n_dequeued);
+    ds_put_format(ds, "hw-rx.batches=%llu\n", r->cons.n_batches);
+    ds_put_format(ds, "hw-rx.wakeups=%llu\n",
+                  __atomic_load_n(&r->prod.n_kicks, __ATOMIC_RELAXED));
+}
@@ -0,0 +1,72 @@
+/* Copyright (c) 2010 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#ifndef DP_RXRING_H
+#define DP_RXRING_H 1
+
+/* Receive ring between a hardware driver's packet thread and the datapath.
+ *
+ * A bounded single-producer, single-consumer ring of received packets.  The
+ * driver's receive callback enqueues from its own thread without taking any
+ * lock or allocating anything beyond the packet itself, and drops the packet
+ * if the ring is full.  The datapath dequeues in batches from dp_run().  When
+ * the datapath is about to sleep with the ring empty, the next enqueue wakes
+ * it through an eventfd that dp_rxring_wait() registers with the poll
+ * loop. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct ds;
+struct ofpbuf;
+
+struct dp_rxring_entry {
+    struct ofpbuf *buffer;
+    uint32_t port_no;
+    int reason;
+};
+
+struct dp_rxring *dp_rxring_create(size_t capacity);
+void dp_rxring_destroy(struct dp_rxring *);
+
+/* Producer side. */
+void dp_rxring_enqueue(struct dp_rxring *, struct ofpbuf *,
+                       uint32_t port_no, int reason);
+
+/* Consumer side. */
+size_t dp_rxring_dequeue(struct dp_rxring *, struct dp_rxring_entry[],
+                         size_t max);
+void dp_rxring_wait(struct dp_rxring *);
+void dp_rxring_format_status(const struct dp_rxring *, struct ds *);
+
+#endif /* dp_rxring.h */
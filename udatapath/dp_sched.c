@@ -0,0 +1,392 @@
+/* Copyright (c) 2010 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#include <config.h>
+#include "dp_sched.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include "datapath.h"
+#include "netdev.h"
+#include "ofpbuf.h"
+#include "packets.h"
+#include "poll-loop.h"
+#include "util.h"
+
+#define THIS_MODULE VLM_datapath
+#include "vlog.h"
+
+static struct vlog_rate_limit rl = VLOG_RATE_LIMIT_INIT(60, 60);
+
+/* Each queue holds at most this many packets and, unless it is empty,
+ * at most SCHED_MAX_BYTES bytes.  Further packets are tail-dropped. */
+#define SCHED_MAX_PACKETS 256
+#define SCHED_MAX_BYTES (1024 * 1024)
+
+/* Depth of the token buckets, as an amount of time at the bucket's rate.  The
+ * poll loop only wakes up with millisecond granularity, so this needs to be a
+ * few milliseconds for a port to reach its full rate. */
+#define SCHED_BURST_USEC 5000
+
+/* Token bucket credit is kept in millionths of a byte, so that a bucket
+ * refilled every microsecond at a rate of a few kbps still gains credit. */
+#define SCHED_CREDIT_SCALE 1000000
+
+struct sched_packet {
+    struct ofpbuf *buffer;
+    long long int enqueued;     /* Time of enqueue, in microseconds. */
+};
+
+struct sched_class {
+    /* FIFO of queued packets. */
+    struct sched_packet ring[SCHED_MAX_PACKETS];
+    unsigned int head;          /* Index of oldest packet in 'ring'. */
+    unsigned int n;             /* Number of packets in 'ring'. */
+    size_t n_bytes;             /* Sum of packet sizes in 'ring'. */
+
+    /* Guaranteed rate. */
+    uint16_t min_rate;          /* In 1/10 of a percent of the port rate. */
+    uint64_t rate;              /* 'min_rate' in bytes per second. */
+    int64_t credit;             /* Token bucket, see SCHED_CREDIT_SCALE. */
+
+    /* Share of excess bandwidth: finish tag of the last packet transmitted
+     * from this class in the self-clocked fair queuing schedule. */
+    uint64_t finish;
+
+    struct dp_sched_stats stats;
+};
+
+struct dp_sched {
+    struct sw_port *port;
+    uint64_t rate;              /* Shaping rate in bytes per second. */
+    int64_t credit;             /* Token bucket, see SCHED_CREDIT_SCALE. */
+    long long int last_refill;  /* Time of last refill, in microseconds. */
+    unsigned int n_packets;     /* Packets queued in all classes. */
+    unsigned int next_class;    /* Where to start guaranteed-rate service. */
+    uint64_t vtime;             /* Virtual time for excess bandwidth. */
+    bool blocked;               /* Device refused the last packet? */
+    struct sched_class classes[NETDEV_MAX_QUEUES];
+};
+
+static long long int
+sched_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long int) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Returns the maximum credit of a token bucket filled at 'rate' bytes per
+ * second.  A bucket may always hold at least one full-sized frame. */
+static int64_t
+bucket_depth(uint64_t rate)
+{
+    uint64_t bytes = MAX(rate * SCHED_BURST_USEC / 1000000, ETH_TOTAL_MAX);
+    return bytes * SCHED_CREDIT_SCALE;
+}
+
+/* Creates and returns a scheduler for the queues of 'port', which shapes
+ * the port's output to 'rate_mbps' megabits per second.  The default queue
+ * (class 0) starts out with the same small minimum rate that the tc backend
+ * gives its default class; other queues have no guaranteed rate until
+ * dp_sched_set_rate() is called. */
+struct dp_sched *
+dp_sched_create(struct sw_port *port, int rate_mbps)
+{
+    struct dp_sched *sched = xcalloc(1, sizeof *sched);
+
+    sched->port = port;
+    sched->rate = (uint64_t) MAX(rate_mbps, 1) * 1000000 / 8;
+    sched->credit = bucket_depth(sched->rate);
+    sched->last_refill = sched_now();
+    dp_sched_set_rate(sched, 0, 1);
+    return sched;
+}
+
+/* Sets the guaranteed rate of queue 'class_id' in 'sched' to 'min_rate',
+ * expressed in 1/10 of a percent of the port rate. */
+void
+dp_sched_set_rate(struct dp_sched *sched, uint16_t class_id,
+                  uint16_t min_rate)
+{
+    struct sched_class *c = &sched->classes[class_id];
+
+    c->min_rate = MIN(min_rate, 1000);
+    c->rate = sched->rate * c->min_rate / 1000;
+    c->credit = MIN(c->credit, bucket_depth(c->rate));
+}
+
+/* Drops every packet queued on 'class_id' in 'sched' and resets the queue's
+ * rate and counters, for when its OpenFlow queue is deleted. */
+void
+dp_sched_clear_class(struct dp_sched *sched, uint16_t class_id)
+{
+    struct sched_class *c = &sched->classes[class_id];
+
+    while (c->n) {
+        ofpbuf_delete(c->ring[c->head].buffer);
+        c->head = (c->head + 1) % SCHED_MAX_PACKETS;
+        c->n--;
+        sched->n_packets--;
+    }
+    memset(c, 0, sizeof *c);
+}
+
+/* Queues 'buffer' for transmission on queue 'class_id' of 'sched''s port,
+ * or drops it if that queue is full.  Takes ownership of 'buffer'. */
+void
+dp_sched_enqueue(struct dp_sched *sched, struct ofpbuf *buffer,
+                 uint16_t class_id)
+{
+    struct sched_class *c = &sched->classes[class_id];
+    struct sched_packet *pkt;
+
+    if (c->n >= SCHED_MAX_PACKETS
+        || (c->n && c->n_bytes + buffer->size > SCHED_MAX_BYTES)) {
+        struct sw_port *p = sched->port;
+
+        c->stats.dropped++;
+        p->tx_dropped++;
+        if (class_id) {
+            p->queues[class_id].tx_errors++;
+        }
+        ofpbuf_delete(buffer);
+        return;
+    }
+
+    if (!c->n) {
+        /* A queue that goes idle gives up its place in the excess-bandwidth
+         * schedule rather than saving it up. */
+        c->finish = MAX(c->finish, sched->vtime);
+    }
+    pkt = &c->ring[(c->head + c->n) % SCHED_MAX_PACKETS];
+    pkt->buffer = buffer;
+    pkt->enqueued = sched_now();
+    c->n++;
+    c->n_bytes += buffer->size;
+    sched->n_packets++;
+}
+
+static void
+refill(struct dp_sched *sched, long long int now)
+{
+    long long int elapsed = now - sched->last_refill;
+    int i;
+
+    if (elapsed <= 0) {
+        return;
+    }
+    /* Any longer and every bucket is full anyway; this also bounds the
+     * products below. */
+    elapsed = MIN(elapsed, 1000000);
+    sched->last_refill = now;
+
+    sched->credit = MIN(sched->credit + (int64_t) (sched->rate * elapsed),
+                        bucket_depth(sched->rate));
+    for (i = 0; i < NETDEV_MAX_QUEUES; i++) {
+        struct sched_class *c = &sched->classes[i];
+        if (c->rate) {
+            c->credit = MIN(c->credit + (int64_t) (c->rate * elapsed),
+                            bucket_depth(c->rate));
+        }
+    }
+}
+
+/* Returns the next class with queued packets that is still within its
+ * guaranteed rate, visiting classes round-robin, or NULL if there is none. */
+static struct sched_class *
+pick_guaranteed(struct dp_sched *sched)
+{
+    int i;
+
+    for (i = 0; i < NETDEV_MAX_QUEUES; i++) {
+        int idx = (sched->next_class + i) % NETDEV_MAX_QUEUES;
+        struct sched_class *c = &sched->classes[idx];
+        if (c->n && c->rate && c->credit > 0) {
+            sched->next_class = (idx + 1) % NETDEV_MAX_QUEUES;
+            return c;
+        }
+    }
+    return NULL;
+}
+
+/* Returns the finish tag of the packet at the head of 'c'.  Excess bandwidth
+ * is shared in proportion to the queues' minimum rates, so a queue's tags
+ * advance more slowly the higher its rate. */
+static uint64_t
+head_finish(const struct sched_class *c)
+{
+    const struct ofpbuf *buffer = c->ring[c->head].buffer;
+    return c->finish + (uint64_t) buffer->size * 1000 / MAX(c->min_rate, 1);
+}
+
+/* Returns the class with queued packets whose head packet has the smallest
+ * finish tag.  There must be at least one queued packet. */
+static struct sched_class *
+pick_excess(struct dp_sched *sched)
+{
+    struct sched_class *best = NULL;
+    uint64_t best_finish = 0;
+    int i;
+
+    for (i = 0; i < NETDEV_MAX_QUEUES; i++) {
+        struct sched_class *c = &sched->classes[i];
+        if (c->n) {
+            uint64_t finish = head_finish(c);
+            if (!best || finish < best_finish) {
+                best = c;
+                best_finish = finish;
+            }
+        }
+    }
+    return best;
+}
+
+/* Transmits the packet at the head of 'c'.  Returns the number of bytes put
+ * on the wire, or 0 if the device cannot accept the packet now. */
+static uint64_t
+transmit(struct dp_sched *sched, struct sched_class *c, long long int now)
+{
+    struct sched_packet *pkt = &c->ring[c->head];
+    struct sw_port *p = sched->port;
+    uint16_t class_id = c - sched->classes;
+    uint64_t n_bytes;
+    unsigned int n_packets;
+    int error;
+
+    error = netdev_send(p->netdev, pkt->buffer, 0);
+    if (error == EAGAIN) {
+        sched->blocked = true;
+        return 0;
+    }
+
+    n_packets = netdev_packet_segs(pkt->buffer, &n_bytes);
+    if (!error) {
+        long long int delay = now - pkt->enqueued;
+
+        p->tx_packets += n_packets;
+        p->tx_bytes += n_bytes;
+        if (class_id) {
+            p->queues[class_id].tx_packets += n_packets;
+            p->queues[class_id].tx_bytes += n_bytes;
+        }
+        /* Count a super-packet as the packets it puts on the wire, like the
+         * port and queue counters, each of which waited 'delay'. */
+        c->stats.tx_packets += n_packets;
+        c->stats.delay_total += delay * n_packets;
+        c->stats.delay_max = MAX(c->stats.delay_max, delay);
+    } else {
+        VLOG_WARN_RL(&rl, "error sending on %s: %s",
+                     netdev_get_name(p->netdev), strerror(error));
+        p->tx_dropped++;
+        c->stats.dropped++;
+    }
+
+    c->n_bytes -= pkt->buffer->size;
+    ofpbuf_delete(pkt->buffer);
+    c->head = (c->head + 1) % SCHED_MAX_PACKETS;
+    c->n--;
+    sched->n_packets--;
+
+    return n_bytes;
+}
+
+/* Transmits as many queued packets as the port's rate allows. */
+void
+dp_sched_run(struct dp_sched *sched)
+{
+    long long int now;
+
+    if (!sched->n_packets) {
+        return;
+    }
+
+    now = sched_now();
+    refill(sched, now);
+    sched->blocked = false;
+    while (sched->n_packets && sched->credit > 0) {
+        struct sched_class *c;
+        uint64_t n_bytes;
+
+        /* Queues within their guaranteed rate go first.  Bandwidth that is
+         * left over goes to whichever queues have packets, fairly. */
+        c = pick_guaranteed(sched);
+        if (c) {
+            n_bytes = transmit(sched, c, now);
+            c->credit -= n_bytes * SCHED_CREDIT_SCALE;
+        } else {
+            uint64_t finish;
+
+            c = pick_excess(sched);
+            finish = head_finish(c);
+            n_bytes = transmit(sched, c, now);
+            if (n_bytes) {
+                c->finish = sched->vtime = finish;
+            }
+        }
+        if (!n_bytes) {
+            break;
+        }
+        sched->credit -= n_bytes * SCHED_CREDIT_SCALE;
+    }
+}
+
+/* Arranges for the poll loop to wake up when dp_sched_run() can transmit
+ * more packets. */
+void
+dp_sched_wait(struct dp_sched *sched)
+{
+    if (!sched->n_packets) {
+        return;
+    } else if (sched->blocked) {
+        netdev_send_wait(sched->port->netdev);
+    } else if (sched->credit <= 0) {
+        uint64_t usecs = (-sched->credit / sched->rate) + 1;
+        poll_timer_wait(DIV_ROUND_UP(usecs, 1000));
+    } else {
+        poll_immediate_wake();
+    }
+}
+
+/* Stores the counters for queue 'class_id' of 'sched' into '*stats'. */
+void
+dp_sched_get_stats(const struct dp_sched *sched, uint16_t class_id,
+                   struct dp_sched_stats *stats)
+{
+    const struct sched_class *c = &sched->classes[class_id];
+
+    *stats = c->stats;
+    stats->backlog_packets = c->n;
+    stats->backlog_bytes = c->n_bytes;
+}
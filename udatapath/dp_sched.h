@@ -0,0 +1,81 @@
+/* Copyright (c) 2010 The Board of Trustees of The Leland Stanford
+ * Junior University
+ *
+ * We are making the OpenFlow specification and associated documentation
+ * (Software) available for public use and benefit with the expectation
+ * that others will use, modify and enhance the Software and contribute
+ * those enhancements back to the community. However, since we would
+ * like to make the Software available for broadest use, with as few
+ * restrictions as possible permission is hereby granted, free of
+ * charge, to any person obtaining a copy of this Software to deal in
+ * the Software under the copyrights without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT.  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * The name and trademarks of copyright holder(s) may NOT be used in
+ * advertising or publicity pertaining to the Software or any
+ * derivatives without specific, written prior permission.
+ */
+
+#ifndef DP_SCHED_H
+#define DP_SCHED_H 1
+
+/* Userspace egress scheduler for slicing queues.
+ *
+ * As an alternative to configuring an HTB qdisc with tc, a port may schedule
+ * its queues itself: packets are held in a bounded FIFO per queue and handed
+ * to the device's single transmit socket at no more than the port's link
+ * rate.  Each queue is guaranteed its configured minimum rate, and bandwidth
+ * left over is shared among backlogged queues in proportion to their minimum
+ * rates by self-clocked fair queuing: each head packet gets a virtual finish
+ * tag, its size scaled by the inverse of its queue's minimum rate past the
+ * later of the queue's last tag and the scheduler's virtual time, and the
+ * packet with the smallest tag goes next.
+ *
+ * Queues are identified by class_id, as for netdev_send(); class 0 is the
+ * default, best-effort queue. */
+
+#include <stdint.h>
+
+struct dp_sched;
+struct ofpbuf;
+struct sw_port;
+
+/* Per-queue scheduler counters. */
+struct dp_sched_stats {
+    uint32_t backlog_packets;   /* Packets currently queued. */
+    uint64_t backlog_bytes;     /* Bytes currently queued. */
+    uint64_t tx_packets;        /* Packets transmitted from the queue, with
+                                 * GSO super-packets counted by segment. */
+    uint64_t dropped;           /* Packets dropped because the queue was full
+                                 * or the device rejected them. */
+    uint64_t delay_total;       /* Sum of queuing delays, in microseconds,
+                                 * over the 'tx_packets' packets. */
+    uint64_t delay_max;         /* Largest queuing delay, in microseconds. */
+};
+
+struct dp_sched *dp_sched_create(struct sw_port *, int rate_mbps);
+void dp_sched_set_rate(struct dp_sched *, uint16_t class_id,
+                       uint16_t min_rate);
+void dp_sched_clear_class(struct dp_sched *, uint16_t class_id);
+void dp_sched_enqueue(struct dp_sched *, struct ofpbuf *, uint16_t class_id);
+void dp_sched_run(struct dp_sched *);
+void dp_sched_wait(struct dp_sched *);
+void dp_sched_get_stats(const struct dp_sched *, uint16_t class_id,
+                        struct dp_sched_stats *);
+
+#endif /* dp_sched.h */
@@ -37,6 +37,9 @@
 #include "of_ext_msg.h"
 #include "netdev.h"
 #include "datapath.h"
+#include "dp_sched.h"
+#include "vconn.h"
+#include "xtoxll.h"
 
 #define THIS_MODULE VLM_experimental
 #include "vlog.h"
@@ -104,10 +107,14 @@ recv_of_exp_queue_delete(struct datapath *dp,
     queue_id = ntohl(opq->queue_id);
 
     p = dp_lookup_port(dp,port_no);
-    if (p->netdev) {
+    if (p && p->netdev) {
         q = dp_lookup_queue(p,queue_id);
         if (q) {
-            netdev_delete_class(p->netdev,q->class_id);
+            if (p->sched) {
+                dp_sched_clear_class(p->sched, q->class_id);
+            } else {
+                netdev_delete_class(p->netdev,q->class_id);
+            }
             port_delete_queue(p,q);
         }
         else {
@@ -171,7 +178,12 @@ recv_of_exp_queue_modify(struct datapath *dp,
         q = dp_lookup_queue(p, queue_id);
         if (q) {
             /* queue exists - modify it */
-            error = netdev_change_class(p->netdev,q->class_id, ntohs(mr->rate));
+            if (p->sched) {
+                dp_sched_set_rate(p->sched, q->class_id, ntohs(mr->rate));
+            } else {
+                error = netdev_change_class(p->netdev, q->class_id,
+                                            ntohs(mr->rate));
+            }
             if (error) {
                 VLOG_ERR("Failed to update queue %d", queue_id);
                 dp_send_error_msg(dp, sender, OFPET_QUEUE_OP_FAILED,
@@ -193,7 +205,12 @@ recv_of_exp_queue_modify(struct datapath *dp,
                 return;
             }
             q = dp_lookup_queue(p, queue_id);
-            error = netdev_setup_class(p->netdev,q->class_id, ntohs(mr->rate));
+            if (p->sched) {
+                dp_sched_set_rate(p->sched, q->class_id, ntohs(mr->rate));
+            } else {
+                error = netdev_setup_class(p->netdev, q->class_id,
+                                           ntohs(mr->rate));
+            }
             if (error) {
                 VLOG_ERR("Failed to configure queue %d", queue_id);
                 dp_send_error_msg(dp, sender, OFPET_QUEUE_OP_FAILED,
@@ -221,6 +238,100 @@ recv_of_exp_queue_modify(struct datapath *dp,
         }
     }
 }
+static void
+put_sched_stats(struct ofpbuf *buffer, const struct dp_sched *sched,
+                uint32_t queue_id, uint16_t class_id)
+{
+    struct openflow_queue_sched_stats *oqs;
+    struct dp_sched_stats stats;
+
+    dp_sched_get_stats(sched, class_id, &stats);
+    oqs = ofpbuf_put_zeros(buffer, sizeof *oqs);
+    oqs->queue_id = htonl(queue_id);
+    oqs->backlog_packets = htonl(stats.backlog_packets);
+    oqs->backlog_bytes = htonll(stats.backlog_bytes);
+    oqs->tx_packets = htonll(stats.tx_packets);
+    oqs->dropped = htonll(stats.dropped);
+    oqs->delay_total = htonll(stats.delay_total);
+    oqs->delay_max = htonll(stats.delay_max);
+}
+
+/** Replies with the userspace scheduler counters for each queue of a port.
+ * Fails with OFPQOFC_BAD_PORT if the port's queues are not scheduled in
+ * userspace.
+ */
+static void
+recv_of_exp_queue_sched_stats(struct datapath *dp,
+                              const struct sender *sender,
+                              const void *oh)
+{
+    const struct openflow_queue_command_header *request = oh;
+    struct openflow_queue_command_header *reply;
+    struct ofpbuf *buffer;
+    struct sw_port *p;
+    struct sw_queue *q;
+
+    if (ntohs(request->header.header.length) < sizeof *request) {
+        dp_send_error_msg(dp, sender, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN, oh,
+                          ntohs(request->header.header.length));
+        return;
+    }
+
+    p = dp_lookup_port(dp, ntohs(request->port));
+    if (!PORT_IN_USE(p) || !p->sched) {
+        dp_send_error_msg(dp, sender, OFPET_QUEUE_OP_FAILED,
+                          OFPQOFC_BAD_PORT, oh,
+                          ntohs(request->header.header.length));
+        return;
+    }
+
+    reply = make_openflow_xid(sizeof *reply, OFPT_VENDOR,
+                              request->header.header.xid, &buffer);
+    reply->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    reply->header.subtype = htonl(OFP_EXT_QUEUE_SCHED_STATS);
+    reply->port = request->port;
+
+    put_sched_stats(buffer, p->sched, 0, 0);
+    LIST_FOR_EACH (q, struct sw_queue, node, &p->queue_list) {
+        put_sched_stats(buffer, p->sched, q->queue_id, q->class_id);
+    }
+    dp_send_openflow(dp, buffer, sender);
+}
+
+static void
+recv_of_exp_packet_in_batch_config(struct datapath *dp,
+                                   const struct sender *sender,
+                                   const void *oh)
+{
+    const struct openflow_packet_in_batch_config *request = oh;
+
+    if (ntohs(request->header.header.length) < sizeof *request) {
+        dp_send_error_msg(dp, sender, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN, oh,
+                          ntohs(request->header.header.length));
+        return;
+    }
+
+    dp_set_packet_in_batching(dp, sender, ntohs(request->max_packets),
+                              ntohl(request->max_bytes),
+                              ntohs(request->max_delay));
+}
+
+static void
+recv_of_exp_flow_removed_batch_config(struct datapath *dp,
+                                      const struct sender *sender,
+                                      const void *oh)
+{
+    const struct openflow_flow_removed_batch_config *request = oh;
+
+    if (ntohs(request->header.header.length) < sizeof *request) {
+        dp_send_error_msg(dp, sender, OFPET_BAD_REQUEST, OFPBRC_BAD_LEN, oh,
+                          ntohs(request->header.header.length));
+        return;
+    }
+
+    dp_set_flow_removed_batching(dp, sender, ntohs(request->max_flows));
+}
+
 /**
  * Parses a set dp_desc message and uses it to set
  *  the dp_desc string in dp
@@ -257,6 +368,15 @@ int of_ext_recv_msg(struct datapath *dp, const struct sender *sender,
     case OFP_EXT_SET_DESC:
         recv_of_set_dp_desc(dp,sender,ofexth);
         return 0;
+    case OFP_EXT_QUEUE_SCHED_STATS:
+        recv_of_exp_queue_sched_stats(dp, sender, oh);
+        return 0;
+    case OFP_EXT_PACKET_IN_BATCH_CONFIG:
+        recv_of_exp_packet_in_batch_config(dp, sender, oh);
+        return 0;
+    case OFP_EXT_FLOW_REMOVED_BATCH_CONFIG:
+        recv_of_exp_flow_removed_batch_config(dp, sender, oh);
+        return 0;
     default:
         VLOG_ERR("Received unknown command of type %d",
                  ntohl(ofexth->subtype));
@@ -37,6 +37,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include "netdev.h"
 #include "ofpbuf.h"
 #include "openflow/openflow.h"
 #include "openflow/nicira-ext.h"
@@ -334,8 +335,9 @@ int flow_has_out_port(struct sw_flow *flow, uint16_t out_port)
 
 void flow_used(struct sw_flow *flow, struct ofpbuf *buffer)
 {
-    flow->used = time_msec();
+    uint64_t n_bytes;
 
-    flow->packet_count++;
-    flow->byte_count += buffer->size;
+    flow->used = time_msec();
+    flow->packet_count += netdev_packet_segs(buffer, &n_bytes);
+    flow->byte_count += n_bytes;
 }
@@ -43,12 +43,18 @@
 #include "command-line.h"
 #include "daemon.h"
 #include "datapath.h"
+#include "dp_buffers.h"
+#include "dp_misses.h"
+#include "dp_limit.h"
 #include "fault.h"
+#include "netdev.h"
 #include "openflow/openflow.h"
 #include "poll-loop.h"
 #include "queue.h"
 #include "util.h"
 #include "rconn.h"
+#include "secchan.h"
+#include "svec.h"
 #include "timeval.h"
 #include "vconn.h"
 #include "dirs.h"
@@ -78,8 +84,18 @@ static uint64_t dpid = UINT64_MAX;
 static char *port_list;
 static char *local_port = "tap:";
 static uint16_t num_queues = NETDEV_MAX_QUEUES;
+static bool user_slicing;
+static int slicing_rate;
+static unsigned int n_buffers = DP_BUFFERS_DEFAULT_SLOTS;
+static size_t buffer_memory = DP_BUFFERS_DEFAULT_MEMORY;
+static unsigned int miss_hold;
+static unsigned int miss_queue = DP_MISSES_DEFAULT_PACKETS;
+static int packet_in_limit;
+static int port_packet_in_limit;
+static const char *secchan_args;
 
 static void add_ports(struct datapath *dp, char *port_list);
+static struct secchan *create_secchan(struct datapath *, const char *args);
 
 /* Need to treat this more generically */
 #if defined(UDATAPATH_AS_LIB)
@@ -102,6 +118,7 @@ main(int argc, char *argv[])
 int
 udatapath_cmd(int argc, char *argv[])
 {
+    struct secchan *secchan;
     int n_listeners;
     int error;
     int i;
@@ -113,12 +130,17 @@ udatapath_cmd(int argc, char *argv[])
     parse_options(argc, argv);
     signal(SIGPIPE, SIG_IGN);
 
-    if (argc - optind < 1) {
+    if (argc - optind < 1 && !secchan_args) {
         OFP_FATAL(0, "at least one listener argument is required; "
           "use --help for usage");
     }
 
     error = dp_new(&dp, dpid);
+    dp->user_slicing = user_slicing;
+    dp->slicing_rate = slicing_rate;
+    dp->buffers = dp_buffers_create(n_buffers, buffer_memory);
+    dp->misses = dp_misses_create(miss_hold, miss_queue);
+    dp->pin_limit = dp_limit_create(packet_in_limit, port_packet_in_limit);
 
     n_listeners = 0;
     for (i = optind; i < argc; i++) {
@@ -134,9 +156,10 @@ udatapath_cmd(int argc, char *argv[])
             ofp_error(retval, "opening %s", pvconn_name);
         }
     }
-    if (!n_listeners) {
+    if (!n_listeners && !secchan_args) {
         OFP_FATAL(0, "could not listen for any connections");
     }
+    secchan = secchan_args ? create_secchan(dp, secchan_args) : NULL;
 
     if (port_list) {
         add_ports(dp, port_list);
@@ -156,15 +179,54 @@ udatapath_cmd(int argc, char *argv[])
     die_if_already_running();
     daemonize();
 
+    if (secchan) {
+        secchan_start(secchan);
+    }
     for (;;) {
         dp_run(dp);
+        if (secchan && !secchan_run(secchan)) {
+            break;
+        }
         dp_wait(dp);
+        if (secchan) {
+            secchan_wait(secchan);
+        }
         poll_block();
     }
 
     return 0;
 }
 
+/* Sets up a secure channel, configured by 'args' as if they were the options
+ * and the controller argument of ofprotocol(8), to run inside this process
+ * and exchange messages with 'dp' through an in-process vconn instead of a
+ * socket. */
+static struct secchan *
+create_secchan(struct datapath *dp, const char *args)
+{
+    /* The settings keep pointers into 'argv', so neither is ever freed. */
+    static struct settings settings;
+    static struct svec argv;
+    struct pvconn *pvconn;
+    int error;
+
+    error = pvconn_open("pmem:datapath", &pvconn);
+    if (error) {
+        ofp_fatal(error, "opening in-process secure channel connection");
+    }
+    dp_add_pvconn(dp, pvconn);
+
+    svec_init(&argv);
+    svec_add(&argv, program_name);
+    svec_add(&argv, "mem:datapath");
+    svec_parse_words(&argv, args);
+    svec_terminate(&argv);
+
+    optind = 0;
+    secchan_parse_options(argv.n, argv.names, &settings);
+    return secchan_create(&settings);
+}
+
 static void
 add_ports(struct datapath *dp, char *port_list)
 {
@@ -194,7 +256,17 @@ parse_options(int argc, char *argv[])
         OPT_SERIAL_NUM,
         OPT_BOOTSTRAP_CA_CERT,
         OPT_NO_LOCAL_PORT,
-        OPT_NO_SLICING
+        OPT_NO_SLICING,
+        OPT_XDP_MODE,
+        OPT_GSO,
+        OPT_USER_SLICING,
+        OPT_BUFFERS,
+        OPT_BUFFER_MEMORY,
+        OPT_MISS_HOLD,
+        OPT_MISS_QUEUE,
+        OPT_PACKET_IN_LIMIT,
+        OPT_PORT_PACKET_IN_LIMIT,
+        OPT_SECCHAN
     };
 
     static struct option long_options[] = {
@@ -206,6 +278,17 @@ parse_options(int argc, char *argv[])
         {"help",        no_argument, 0, 'h'},
         {"version",     no_argument, 0, 'V'},
         {"no-slicing",  no_argument, 0, OPT_NO_SLICING},
+        {"xdp-mode",    required_argument, 0, OPT_XDP_MODE},
+        {"gso",         no_argument, 0, OPT_GSO},
+        {"user-slicing", optional_argument, 0, OPT_USER_SLICING},
+        {"buffers",     required_argument, 0, OPT_BUFFERS},
+        {"buffer-memory", required_argument, 0, OPT_BUFFER_MEMORY},
+        {"miss-hold",   required_argument, 0, OPT_MISS_HOLD},
+        {"miss-queue",  required_argument, 0, OPT_MISS_QUEUE},
+        {"packet-in-limit", optional_argument, 0, OPT_PACKET_IN_LIMIT},
+        {"port-packet-in-limit", optional_argument, 0,
+         OPT_PORT_PACKET_IN_LIMIT},
+        {"secchan",     required_argument, 0, OPT_SECCHAN},
         {"mfr-desc",    required_argument, 0, OPT_MFR_DESC},
         {"hw-desc",     required_argument, 0, OPT_HW_DESC},
         {"sw-desc",     required_argument, 0, OPT_SW_DESC},
@@ -295,6 +378,102 @@ parse_options(int argc, char *argv[])
             num_queues = 0;
             break;
 
+        case OPT_XDP_MODE:
+            if (!strcmp(optarg, "auto")) {
+                netdev_set_xdp_mode(NETDEV_XDP_AUTO);
+            } else if (!strcmp(optarg, "native")) {
+                netdev_set_xdp_mode(NETDEV_XDP_NATIVE);
+            } else if (!strcmp(optarg, "generic")) {
+                netdev_set_xdp_mode(NETDEV_XDP_GENERIC);
+            } else {
+                ofp_fatal(0, "argument to --xdp-mode must be "
+                          "\"auto\", \"native\", or \"generic\"");
+            }
+            break;
+
+        case OPT_GSO:
+            netdev_set_gso(true);
+            break;
+
+        case OPT_USER_SLICING:
+            user_slicing = true;
+            if (optarg) {
+                slicing_rate = atoi(optarg);
+                if (slicing_rate <= 0) {
+                    ofp_fatal(0, "argument to --user-slicing must be a "
+                              "positive rate in Mbps");
+                }
+            }
+            break;
+
+        case OPT_BUFFERS: {
+            int value = atoi(optarg);
+            if (value < 0 || value > DP_BUFFERS_MAX_SLOTS) {
+                ofp_fatal(0, "argument to --buffers must be between 0 and %u",
+                          DP_BUFFERS_MAX_SLOTS);
+            }
+            n_buffers = value;
+            break;
+        }
+
+        case OPT_BUFFER_MEMORY: {
+            int value = atoi(optarg);
+            if (value <= 0) {
+                ofp_fatal(0, "argument to --buffer-memory must be a "
+                          "positive size in MB");
+            }
+            buffer_memory = (size_t) value * 1024 * 1024;
+            break;
+        }
+
+        case OPT_MISS_HOLD: {
+            int value = atoi(optarg);
+            if (value < 0) {
+                ofp_fatal(0, "argument to --miss-hold must be a "
+                          "nonnegative time in milliseconds");
+            }
+            miss_hold = value;
+            break;
+        }
+
+        case OPT_MISS_QUEUE: {
+            int value = atoi(optarg);
+            if (value < 0) {
+                ofp_fatal(0, "argument to --miss-queue must be a "
+                          "nonnegative number of packets");
+            }
+            miss_queue = value;
+            break;
+        }
+
+        case OPT_PACKET_IN_LIMIT:
+            if (optarg) {
+                packet_in_limit = atoi(optarg);
+                if (packet_in_limit < 1) {
+                    ofp_fatal(0, "--packet-in-limit argument must be at "
+                              "least 1");
+                }
+            } else {
+                packet_in_limit = 1000;
+            }
+            break;
+
+        case OPT_PORT_PACKET_IN_LIMIT:
+            if (optarg) {
+                port_packet_in_limit = atoi(optarg);
+                if (port_packet_in_limit < 1) {
+                    ofp_fatal(0, "--port-packet-in-limit argument must be at "
+                              "least 1");
+                }
+            } else {
+                port_packet_in_limit = 250;
+            }
+            break;
+
+        case OPT_SECCHAN:
+            secchan_args = optarg;
+            break;
+
         DAEMON_OPTION_HANDLERS
 
 #ifdef HAVE_OPENSSL
@@ -321,7 +500,8 @@ usage(void)
     printf("%s: userspace OpenFlow datapath\n"
            "usage: %s [OPTIONS] LISTEN...\n"
            "where LISTEN is a passive OpenFlow connection method on which\n"
-       "to listen for incoming connections from the secure channel.\n",
+       "to listen for incoming connections from the secure channel.\n"
+           "With --secchan, LISTEN is optional.\n",
            program_name, program_name);
     vconn_usage(false, true, false);
     printf("\nConfiguration options:\n"
@@ -332,6 +512,28 @@ usage(void)
            "  -d, --datapath-id=ID    Use ID as the OpenFlow switch ID\n"
            "                          (ID must consist of 12 hex digits)\n"
            "  --no-slicing            disable slicing\n"
+           "  --xdp-mode=MODE         attach xdp: ports in MODE (auto,\n"
+           "                          native, or generic)\n"
+           "  --gso                   receive and send GSO/GRO super-packets\n"
+           "  --user-slicing[=MBPS]   schedule slicing queues in userspace,\n"
+           "                          shaping ports to MBPS or link speed\n"
+           "  --buffers=N             buffer up to N packets for the\n"
+           "                          controller (default: %u, 0 disables)\n"
+           "  --buffer-memory=MB      limit buffered packets to MB megabytes\n"
+           "                          (default: %zu)\n"
+           "  --miss-hold=MS          after a table miss, hold back packets\n"
+           "                          of the same flow for MS milliseconds\n"
+           "  --miss-queue=N          with --miss-hold, queue up to N packets\n"
+           "                          per flow (default: %u)\n"
+           "  --packet-in-limit[=PACKETS]\n"
+           "                          max packets/s sent to the controller\n"
+           "                          (default: 1000)\n"
+           "  --port-packet-in-limit[=PACKETS]\n"
+           "                          max packets/s sent to the controller\n"
+           "                          from any one port (default: 250)\n"
+           "  --secchan=\"[OPTIONS] CONTROLLER\"\n"
+           "                          run the secure channel in this process,\n"
+           "                          with ofprotocol OPTIONS and CONTROLLER\n"
            "\nOther options:\n"
            "  -D, --detach            run in background as daemon\n"
            "  -P, --pidfile[=FILE]    create pidfile (default: %s/ofdatapath.pid)\n"
@@ -340,6 +542,8 @@ usage(void)
            "  -v, --verbose           set maximum verbosity level\n"
            "  -h, --help              display this help message\n"
            "  -V, --version           display version information\n",
-        ofp_rundir);
+           DP_BUFFERS_DEFAULT_SLOTS,
+           (size_t) DP_BUFFERS_DEFAULT_MEMORY / (1024 * 1024),
+           DP_MISSES_DEFAULT_PACKETS, ofp_rundir);
     exit(EXIT_SUCCESS);
 }
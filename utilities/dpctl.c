@@ -241,13 +241,14 @@ usage(void)
            "  add-flows SWITCH FILE       add flows from FILE\n"
            "  mod-flows SWITCH FLOW       modify actions of matching FLOWs\n"
            "  del-flows SWITCH [FLOW]     delete matching FLOWs\n"
-           "  monitor SWITCH              print packets received from SWITCH\n"
+           "  monitor SWITCH [FILTER...]  print packets received from SWITCH\n"
            "  execute SWITCH CMD [ARG...] execute CMD with ARGS on SWITCH\n"
            "Queue Ops:  Q: queue-id; P: port-id; BW: perthousand bandwidth\n"
            "  add-queue SWITCH P Q [BW]   add queue (with min bandwidth)\n"
            "  mod-queue SWITCH P Q BW     modify queue min bandwidth\n"
            "  del-queue SWITCH P Q        delete queue\n"
            "  dump-queue SWITCH [P [Q]]   show queue info\n"
+           "  queue-sched-stats SWITCH P  show userspace queue scheduler stats\n"
            "\nFor local datapaths, remote switches, and controllers:\n"
            "  probe VCONN                 probe whether VCONN is up\n"
            "  ping VCONN [N]              latency of N-byte echos\n"
@@ -520,6 +521,7 @@ do_status(const struct settings *s UNUSED, int argc, char *argv[])
     request->subtype = htonl(NXT_STATUS_REQUEST);
     if (argc > 2) {
         ofpbuf_put(b, argv[2], strlen(argv[2]));
+        update_openflow_length(b);
     }
     open_vconn(argv[1], &vconn);
     run(vconn_transact(vconn, b, &b), "talking to %s", argv[1]);
@@ -536,7 +538,7 @@ do_status(const struct settings *s UNUSED, int argc, char *argv[])
         ofp_fatal(0, "bad reply");
     }
 
-    fwrite(reply + 1, b->size, 1, stdout);
+    fwrite(reply + 1, b->size - sizeof *reply, 1, stdout);
 }
 
 static void
@@ -1301,8 +1303,81 @@ static void do_del_flows(const struct settings *s, int argc, char *argv[])
     vconn_close(vconn);
 }
 
+/* Returns the OFPT_* message type named 'str', e.g. "packet_in", or given
+ * as a number. */
+static uint8_t
+str_to_msg_type(const char *str)
+{
+    int type;
+
+    for (type = 0; type < 32; type++) {
+        char *name = ofp_message_type_to_string(type);
+        bool match = (!strncmp(name, "OFPT_", 5)
+                      && !strcasecmp(name + 5, str));
+        free(name);
+        if (match) {
+            return type;
+        }
+    }
+    type = str_to_u32(str);
+    if (type >= 32) {
+        ofp_fatal(0, "%s: unknown message type", str);
+    }
+    return type;
+}
+
+/* Returns an OFP_EXT_MONITOR_CONFIG message built from the "types=",
+ * "ports=", "max_bytes=" and "sample=" arguments in 'argv'. */
+static struct ofpbuf *
+make_monitor_config(int argc, char *argv[])
+{
+    struct openflow_monitor_config *omc;
+    struct ofpbuf *b;
+    int i;
+
+    omc = make_openflow(sizeof *omc, OFPT_VENDOR, &b);
+    omc->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    omc->header.subtype = htonl(OFP_EXT_MONITOR_CONFIG);
+    omc->types = htonl(UINT32_MAX);
+    for (i = 0; i < argc; i++) {
+        char *save_ptr = NULL;
+        char *name, *value, *word;
+
+        name = strtok_r(argv[i], "=", &save_ptr);
+        value = strtok_r(NULL, "", &save_ptr);
+        if (!value) {
+            ofp_fatal(0, "%s: monitor argument missing value", name);
+        }
+
+        if (!strcmp(name, "types")) {
+            uint32_t types = 0;
+            for (word = strtok_r(value, ",", &save_ptr); word;
+                 word = strtok_r(NULL, ",", &save_ptr)) {
+                types |= UINT32_C(1) << str_to_msg_type(word);
+            }
+            omc = b->data;
+            omc->types = htonl(types);
+        } else if (!strcmp(name, "ports")) {
+            for (word = strtok_r(value, ",", &save_ptr); word;
+                 word = strtok_r(NULL, ",", &save_ptr)) {
+                uint16_t port = htons(str_to_u32(word));
+                ofpbuf_put(b, &port, sizeof port);
+            }
+        } else if (!strcmp(name, "max_bytes")) {
+            omc = b->data;
+            omc->max_bytes = htons(str_to_u32(value));
+        } else if (!strcmp(name, "sample")) {
+            omc = b->data;
+            omc->sample = htonl(str_to_u32(value));
+        } else {
+            ofp_fatal(0, "%s: unknown monitor argument", name);
+        }
+    }
+    return b;
+}
+
 static void
-do_monitor(const struct settings *s UNUSED, int argc UNUSED, char *argv[])
+do_monitor(const struct settings *s UNUSED, int argc, char *argv[])
 {
     struct vconn *vconn;
     const char *name;
@@ -1316,6 +1391,9 @@ do_monitor(const struct settings *s UNUSED, int argc UNUSED, char *argv[])
         name = argv[1];
     }
     open_vconn(argv[1], &vconn);
+    if (argc > 2) {
+        send_openflow_buffer(vconn, make_monitor_config(argc - 2, argv + 2));
+    }
     for (;;) {
         struct ofpbuf *b;
         run(vconn_recv_block(vconn, &b), "vconn_recv");
@@ -1728,6 +1806,50 @@ do_dump_queue(const struct settings *s UNUSED, int argc, char *argv[])
     }
 }
 
+static void
+do_queue_sched_stats(const struct settings *s UNUSED, int argc UNUSED,
+                     char *argv[])
+{
+    struct openflow_queue_command_header *request, *reply;
+    struct openflow_queue_sched_stats *oqs;
+    struct ofpbuf *buffer, *reply_buf;
+    struct vconn *vconn;
+    uint16_t port;
+    size_t n, i;
+
+    port = str_to_u32(argv[2]);
+    request = make_openflow(sizeof *request, OFPT_VENDOR, &buffer);
+    request->header.vendor = htonl(OPENFLOW_VENDOR_ID);
+    request->header.subtype = htonl(OFP_EXT_QUEUE_SCHED_STATS);
+    request->port = htons(port);
+
+    open_vconn(argv[1], &vconn);
+    run(vconn_transact(vconn, buffer, &reply_buf), "talking to %s", argv[1]);
+    vconn_close(vconn);
+
+    reply = reply_buf->data;
+    if (reply->header.header.type != OFPT_VENDOR
+        || reply_buf->size < sizeof *reply) {
+        ofp_fatal(0, "%s", ofp_to_string(reply_buf->data, reply_buf->size, 1));
+    }
+
+    oqs = (struct openflow_queue_sched_stats *) reply->body;
+    n = (reply_buf->size - sizeof *reply) / sizeof *oqs;
+    for (i = 0; i < n; i++, oqs++) {
+        uint64_t tx_packets = ntohll(oqs->tx_packets);
+        uint64_t delay_total = ntohll(oqs->delay_total);
+
+        printf("port %"PRIu16" queue %"PRIu32": backlog=%"PRIu32" pkts "
+               "%"PRIu64" bytes, tx=%"PRIu64", dropped=%"PRIu64", "
+               "delay avg=%"PRIu64"us max=%"PRIu64"us\n",
+               port, ntohl(oqs->queue_id), ntohl(oqs->backlog_packets),
+               ntohll(oqs->backlog_bytes), tx_packets, ntohll(oqs->dropped),
+               tx_packets ? delay_total / tx_packets : 0,
+               ntohll(oqs->delay_max));
+    }
+    ofpbuf_delete(reply_buf);
+}
+
 static void
 do_help(const struct settings *s UNUSED, int argc UNUSED, char *argv[] UNUSED)
 {
@@ -1749,7 +1871,7 @@ static struct command all_commands[] = {
     { "show-protostat", 1, 1, do_protostat },
 
     { "help", 0, INT_MAX, do_help },
-    { "monitor", 1, 1, do_monitor },
+    { "monitor", 1, INT_MAX, do_monitor },
     { "dump-desc", 1, 1, do_dump_desc },
     { "dump-tables", 1, 1, do_dump_tables },
     { "desc", 2, 2, do_desc },
@@ -1765,6 +1887,7 @@ static struct command all_commands[] = {
     { "mod-queue", 3, 4, do_mod_queue },
     { "del-queue", 3, 3, do_del_queue },
     { "dump-queue", 1, 3, do_dump_queue },
+    { "queue-sched-stats", 2, 2, do_queue_sched_stats },
     { "probe", 1, 1, do_probe },
     { "ping", 1, 2, do_ping },
     { "benchmark", 3, 3, do_benchmark },